@@ -0,0 +1,106 @@
+#include "EmissionQuota.h"
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing can be emitted until Reset(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+EmissionQuota::EmissionQuota() :
+    _numEmitted(0),
+    _maxEmitted(0),
+    _deferEmissions(false)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Starts a new frame.  Must not be called while an update is running.  This also forgets last 
+    frame's waiting particles.
+Parameters:
+    maxEmittedThisFrame     How many this chunk may send out, or if deferred, how many of its 
+                            particles may ask.
+    deferEmissions          See the class description.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void EmissionQuota::Reset(unsigned int maxEmittedThisFrame, bool deferEmissions)
+{
+    _maxEmitted = maxEmittedThisFrame;
+    _numEmitted = 0;
+    _deferEmissions = deferEmissions;
+
+    // the list keeps its memory, so it only grows the first few frames
+    _waitingParticles.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Claims one emission from this frame's quota, if there are any left.  If emissions are 
+    deferred, then the particle is added to the waiting list instead and this says no.
+Parameters:
+    particleIndex   Which particle wants to go out.  Only used if deferred.
+Returns:
+    True if the particle may be emitted now, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool EmissionQuota::TryEmit(unsigned int particleIndex)
+{
+    if (_numEmitted >= _maxEmitted)
+    {
+        return false;
+    }
+
+    _numEmitted++;
+    if (_deferEmissions)
+    {
+        _waitingParticles.push_back(particleIndex);
+        return false;
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lets the SIMD kernels skip the one-particle-at-a-time emission check for a whole register 
+    of particles once nothing more can be emitted (or asked for) this frame.
+Parameters: None
+Returns:
+    True if TryEmit() can't do anything more this frame.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool EmissionQuota::IsUsedUp() const
+{
+    return _numEmitted >= _maxEmitted;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    How many particles asked to go out since the last Reset(...).  Only meaningful between 
+    updates.
+Parameters: None
+Returns:
+    See description.  Always 0 unless deferred.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int EmissionQuota::NumWaiting() const
+{
+    return (unsigned int)_waitingParticles.size();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The particles that asked to go out since the last Reset(...), in the order that they asked,
+    which is particle order.  There are NumWaiting() of them.  Only meaningful between updates.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const unsigned int *EmissionQuota::WaitingParticles() const
+{
+    return _waitingParticles.data();
+}
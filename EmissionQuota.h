@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The CPU version of the compute shader's "particles emitted this frame" count.  Every update 
+    kernel asks it before sending a particle out (or back out), and once the frame's quota is 
+    used up, the particle stays (or becomes) inactive until a later frame.  This keeps all the 
+    particles from launching at once.
+
+    The shader lets whichever threads get to the count first have the quota.  On the CPU that 
+    would make the result depend on the thread timing, and a run couldn't be replayed exactly 
+    (see ReplayLog.h).  So instead, each emitter's quota is split into one of these for every 
+    chunk of its particles (see ParticleSimulatorCpu::UpdateRange(...)).  Only the thread that 
+    has the chunk touches it, so nothing is atomic.  There are two ways to split it:
+
+    If emissions are deferred, then TryEmit(...) only writes down the particle that wants to 
+    go out and says no, so the kernel leaves it off.  Once every chunk is done, the emitter's 
+    quota goes to the particles that asked, in particle order, until it runs out (see 
+    ParticleSimulatorCpu::EmitParticles()).  The same particles get it no matter how many 
+    threads there are.  A chunk never needs more than the whole quota, so that is its limit.
+
+    Otherwise the chunk gets a fixed part of the quota and TryEmit(...) hands it out right 
+    away.  This is for blocked substeps (see ParticleSimulatorCpu::StepBlocked(...)), where 
+    a particle that is sent out in one substep has to move in the next one before the other 
+    chunks have even started.
+-----------------------------------------------------------------------------------------------*/
+class EmissionQuota
+{
+public:
+    EmissionQuota();
+    void Reset(unsigned int maxEmittedThisFrame, bool deferEmissions);
+    bool TryEmit(unsigned int particleIndex);
+    bool IsUsedUp() const;
+    unsigned int NumWaiting() const;
+    const unsigned int *WaitingParticles() const;
+
+private:
+    // if deferred, this counts the particles that asked
+    unsigned int _numEmitted;
+    unsigned int _maxEmitted;
+
+    // empty unless deferred
+    bool _deferEmissions;
+    std::vector<unsigned int> _waitingParticles;
+};
@@ -0,0 +1,206 @@
+#include "ExpiryBuckets.h"
+
+#include <stddef.h>     // size_t
+
+// each level's buckets are 12 bits of the step, and 3 levels cover all 32
+static const unsigned int BITS_PER_LEVEL = 12;
+static const unsigned int BUCKETS_PER_LEVEL = 1 << BITS_PER_LEVEL;
+static const unsigned int NUM_LEVELS = 3;
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  There are no buckets until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ExpiryBuckets::ExpiryBuckets()
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Makes every level's buckets, all empty.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ExpiryBuckets::Init(unsigned int numParticles)
+{
+    _buckets.clear();
+    _buckets.resize(NUM_LEVELS * BUCKETS_PER_LEVEL);
+    _expiryStep.assign(numParticles, 0);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ExpiryBuckets::Cleanup()
+{
+    _buckets.clear();
+    _expiryStep.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ExpiryBuckets::IsInitialized() const
+{
+    return !_buckets.empty();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Starts a new life for the particle.  Whatever bucket it was in before is forgotten.
+Parameters:
+    particleIndex   Self-explanatory.
+    currentStep     The step that the particle was emitted on.  Must be the step that was last
+                    given to TakeExpired(...).
+    stepsToLive     How many steps from now it expires.  At least 1.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ExpiryBuckets::Schedule(unsigned int particleIndex, unsigned int currentStep,
+    unsigned int stepsToLive)
+{
+    if (stepsToLive == 0)
+    {
+        stepsToLive = 1;
+    }
+
+    Entry entry;
+    entry._particleIndex = particleIndex;
+    entry._expiryStep = currentStep + stepsToLive;
+    _expiryStep[particleIndex] = entry._expiryStep;
+    this->Insert(entry, currentStep);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Empties whatever higher level buckets are due into the ones below them, then empties the
+    current step's bucket and hands back the particles whose latest life ends on this step.
+Parameters:
+    currentStep     Self-explanatory.
+    expired         Cleared and then filled with particle indices.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ExpiryBuckets::TakeExpired(unsigned int currentStep, std::vector<unsigned int> *expired)
+{
+    this->Cascade(currentStep);
+
+    expired->clear();
+    std::vector<Entry> &bucket = _buckets[currentStep % BUCKETS_PER_LEVEL];
+    for (size_t entryIndex = 0; entryIndex < bucket.size(); entryIndex++)
+    {
+        const Entry &entry = bucket[entryIndex];
+        if (_expiryStep[entry._particleIndex] == entry._expiryStep)
+        {
+            expired->push_back(entry._particleIndex);
+        }
+    }
+    bucket.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Follows the particles to their new indices after they were moved around.  Every entry in
+    every bucket is changed, stale or not, and the expiry steps move with their particles, so
+    an entry is still only handed back if it was for its particle's latest life.
+Parameters:
+    newIndices      Particle I is now particle newIndices[I].  Must have an entry for every
+                    particle.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ExpiryBuckets::Remap(const unsigned int *newIndices)
+{
+    for (size_t bucketIndex = 0; bucketIndex < _buckets.size(); bucketIndex++)
+    {
+        std::vector<Entry> &bucket = _buckets[bucketIndex];
+        for (size_t entryIndex = 0; entryIndex < bucket.size(); entryIndex++)
+        {
+            bucket[entryIndex]._particleIndex = newIndices[bucket[entryIndex]._particleIndex];
+        }
+    }
+
+    std::vector<unsigned int> oldExpirySteps(_expiryStep);
+    for (size_t particleIndex = 0; particleIndex < oldExpirySteps.size(); particleIndex++)
+    {
+        _expiryStep[newIndices[particleIndex]] = oldExpirySteps[particleIndex];
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Puts an entry into the lowest level that its step fits in.  That is the level of the
+    highest 12 bits where the entry's step and the current step differ, so everything above 
+    it matches, and the entry stays put until the current step catches up with the bits above
+    that level (see Cascade(...)).
+Parameters:
+    entry           Self-explanatory.  Its step must be at or after the current one.
+    currentStep     Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ExpiryBuckets::Insert(const Entry &entry, unsigned int currentStep)
+{
+    unsigned int differentBits = entry._expiryStep ^ currentStep;
+    unsigned int level = 0;
+    while ((level + 1) < NUM_LEVELS && (differentBits >> ((level + 1) * BITS_PER_LEVEL)) != 0)
+    {
+        level++;
+    }
+
+    unsigned int bucketIndex = (entry._expiryStep >> (level * BITS_PER_LEVEL)) %
+        BUCKETS_PER_LEVEL;
+    _buckets[(level * BUCKETS_PER_LEVEL) + bucketIndex].push_back(entry);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Each time the bits below a level all come back around to 0, that level's bucket for the
+    new value of its bits holds everything that ends in the next trip around the levels below
+    it, so it is emptied into them.  The highest level goes first so that what it moves down
+    can be moved down again on the same step if that is due too.  Stale entries are thrown
+    away instead of being moved.
+Parameters:
+    currentStep     Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ExpiryBuckets::Cascade(unsigned int currentStep)
+{
+    for (unsigned int level = NUM_LEVELS - 1; level > 0; level--)
+    {
+        unsigned int lowerBitsMask = (1u << (level * BITS_PER_LEVEL)) - 1;
+        if ((currentStep & lowerBitsMask) != 0)
+        {
+            continue;
+        }
+
+        unsigned int bucketIndex = (currentStep >> (level * BITS_PER_LEVEL)) %
+            BUCKETS_PER_LEVEL;
+        std::vector<Entry> &bucket = _buckets[(level * BUCKETS_PER_LEVEL) + bucketIndex];
+        for (size_t entryIndex = 0; entryIndex < bucket.size(); entryIndex++)
+        {
+            const Entry &entry = bucket[entryIndex];
+            if (_expiryStep[entry._particleIndex] == entry._expiryStep)
+            {
+                this->Insert(entry, currentStep);
+            }
+        }
+        bucket.clear();
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Keeps track of when each particle's life ends without looking at every particle every
+    frame.  When a particle is emitted, its index goes into the bucket for the step that it
+    ends on, and each step only the particles in that step's bucket are looked at.  A life
+    ends when the particle's lifetime runs out or when it would go out of bounds, whichever is
+    first (see ParticleSimulatorCpu::SetExitScheduling(...)).
+
+    The buckets are a hierarchical timing wheel.  The first level has a bucket for each of the
+    next 4096 steps, used as a ring.  The second level has a bucket for each of the next 4096
+    trips around the first, and the third covers the rest of the steps that fit in an 
+    unsigned int.  A particle goes into the lowest level that its step fits in.  Each time the
+    first level comes back around to its first bucket, the second level's bucket for the next
+    4096 steps is emptied into it, and likewise for the third.  No particle is moved more than 
+    twice, and the number of buckets doesn't depend on how long a life can be, so a slow 
+    particle that takes thousands of steps to leave its emitter costs no more than a fast one.
+
+    Note: 4096 steps is over a minute at the default 60 steps a second (see main.cpp), so most 
+    lives go straight into the bucket that they end in and are never moved at all.  With 256 
+    step levels, nearly every particle that took a few seconds to leave was filed twice, and 
+    emptying a second level bucket into the first took a whole frame's worth of time every 256 
+    steps.
+
+    A particle that goes out of bounds before its lifetime is up is usually sent right back
+    out with a new expiry step, but there is no cheap way to take it out of its old bucket.
+    Instead, the expiry step of each particle's latest life is kept here too, and an entry is
+    only handed back by TakeExpired(...) (or moved down a level) if the step matches.  The old
+    entry just gets thrown away.
+
+    Note: TakeExpired(...) must be called for every step, one after the other, so that no
+    level is skipped when it is due to be emptied into the one below it.
+
+    Note: Nothing here knows what a particle looks like.  The simulator that owns this turns
+    the expired particles off (or sends them right back out), and if it moves the particles 
+    around (see ParticleReorder.h), it tells this where they went with Remap(...).
+-----------------------------------------------------------------------------------------------*/
+class ExpiryBuckets
+{
+public:
+    ExpiryBuckets();
+    void Init(unsigned int numParticles);
+    void Cleanup();
+    bool IsInitialized() const;
+
+    void Schedule(unsigned int particleIndex, unsigned int currentStep,
+        unsigned int stepsToLive);
+    void TakeExpired(unsigned int currentStep, std::vector<unsigned int> *expired);
+    void Remap(const unsigned int *newIndices);
+
+private:
+    // the step is kept with the index so that a stale entry can be told apart from the
+    // particle's latest one when a level is emptied into the one below it
+    struct Entry
+    {
+        unsigned int _particleIndex;
+        unsigned int _expiryStep;
+    };
+
+    void Insert(const Entry &entry, unsigned int currentStep);
+    void Cascade(unsigned int currentStep);
+
+    // level L's bucket B is _buckets[(L * BUCKETS_PER_LEVEL) + B]
+    // Note: Taking from a bucket clears it, but it keeps its memory, so after the first few
+    // times around the ring, nothing is allocated.
+    std::vector<std::vector<Entry>> _buckets;
+    std::vector<unsigned int> _expiryStep;
+};
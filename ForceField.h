@@ -0,0 +1,108 @@
+#pragma once
+
+#include "glm/vec2.hpp"
+#include "glm/detail/func_geometric.hpp"    // glm::dot
+
+#include <math.h>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Something that pushes particles around.  Without these, a particle moves in a straight
+    line from the moment that it is emitted until it goes out of bounds.  The simulators keep a
+    table of them (see ParticleSimulator::SetForceFields(...)), and every step, each live
+    particle's acceleration is the sum of every field in the table, all worked out in the same
+    pass, before the particle is moved.
+
+    _type           One of the FORCE_FIELD_* values below.
+    _position       Window coords.  Where an attractor or vortex is.  Not used by the others.
+    _direction      Window coords.  Which way the wind blows.  Not used by the others.
+    _strength       What it means depends on the type (see GetForceFieldAcceleration(...)).
+                    A negative attractor pushes away and a negative vortex turns clockwise.
+    _radius         Window coords.  Attractors and vortices are "softened" by this much so that
+                    a particle that goes right through the middle doesn't get flung out at
+                    infinite speed.  Not used by the others.
+
+    Note: The same table is uploaded to a shader storage buffer, so the structure has to match
+    "struct ForceField" in the update shaders, which use the std430 layout.  The vec2s come
+    first so that they are on 8 byte boundaries, and the size (32 bytes) is a multiple of 8.
+-----------------------------------------------------------------------------------------------*/
+struct ForceField
+{
+    glm::vec2 _position;
+    glm::vec2 _direction;
+    float _strength;
+    float _radius;
+    unsigned int _type;
+    unsigned int _padding;
+};
+
+// Note: Must match the FORCE_FIELD_* values in the update shaders.
+static const unsigned int FORCE_FIELD_ATTRACTOR = 0;
+static const unsigned int FORCE_FIELD_VORTEX = 1;
+static const unsigned int FORCE_FIELD_DRAG = 2;
+static const unsigned int FORCE_FIELD_WIND = 3;
+
+// the shader storage binding of the force field table (see ParticleSimulatorGpu for the
+// others)
+static const unsigned int FORCE_FIELD_BUFFER_BINDING = 7;
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Adds up every field's pull on one particle.
+    - Attractor: Pulls toward the field's position with an inverse square falloff.  _strength
+      is the acceleration at a distance of 1 (window coords per second per second).
+    - Vortex: Pushes sideways (counterclockwise) around the field's position with an inverse
+      falloff, so that particles swirl around it.  _strength is the acceleration at a distance
+      of 1.
+    - Drag: Slows the particle down.  _strength is the fraction of its velocity that it loses
+      per second.
+    - Wind: A constant push (gravity is a wind that blows down).  _strength is the acceleration
+      along _direction, which should be normalized.
+
+    This is in the header so that the CPU kernels can inline it.
+
+    Note: Must match ForceFieldAcceleration(...) in the update shaders.
+Parameters:
+    forceFields     The table.
+    numForceFields  Self-explanatory.
+    position        The particle's position in window coords.
+    velocity        The particle's velocity in window coords.
+Returns:
+    The acceleration in window coords per second per second.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline glm::vec2 GetForceFieldAcceleration(const ForceField *forceFields,
+    unsigned int numForceFields, const glm::vec2 &position, const glm::vec2 &velocity)
+{
+    glm::vec2 acceleration(0.0f, 0.0f);
+    for (unsigned int fieldIndex = 0; fieldIndex < numForceFields; fieldIndex++)
+    {
+        const ForceField &field = forceFields[fieldIndex];
+        if (field._type == FORCE_FIELD_DRAG)
+        {
+            acceleration -= velocity * field._strength;
+        }
+        else if (field._type == FORCE_FIELD_WIND)
+        {
+            acceleration += field._direction * field._strength;
+        }
+        else
+        {
+            // both are around a point, softened by the radius
+            glm::vec2 toField = field._position - position;
+            float distSqr = glm::dot(toField, toField) + (field._radius * field._radius);
+            if (field._type == FORCE_FIELD_ATTRACTOR)
+            {
+                // toField / dist^3 is the direction / dist^2
+                acceleration += toField * (field._strength / (distSqr * sqrtf(distSqr)));
+            }
+            else
+            {
+                // perpendicular (counterclockwise around the field) / dist^2 is the direction
+                // / dist
+                acceleration += glm::vec2(toField.y, -toField.x) * (field._strength / distSqr);
+            }
+        }
+    }
+    return acceleration;
+}
@@ -0,0 +1,110 @@
+#include "FrameClock.h"
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Everything else happens in Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+FrameClock::FrameClock() :
+    _fixedStepSec(0.0),
+    _accumulatedSec(0.0),
+    _droppedSec(0.0),
+    _maxStepsPerTick(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Records the step size and the cap and starts the clock.  The first Tick() measures from
+    here, so call this right before the first frame rather than before a long load.
+Parameters:
+    fixedStepSec        How much simulated time each step covers (ex: 1/60th of a second).
+    maxStepsPerTick     The most steps that Tick() will ever ask for.  Must be at least 1.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void FrameClock::Init(float fixedStepSec, unsigned int maxStepsPerTick)
+{
+    _fixedStepSec = fixedStepSec;
+    _maxStepsPerTick = maxStepsPerTick;
+    _accumulatedSec = 0.0;
+    _droppedSec = 0.0;
+    _lastTickTime = std::chrono::high_resolution_clock::now();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Adds the real time since the last tick to the accumulator and takes out as many whole steps
+    as it can, up to the cap.  Call this once per frame and then advance the simulation by
+    GetFixedStepSec() that many times.
+Parameters: None
+Returns:
+    The number of steps to simulate this frame.  May be 0 if frames are coming faster than
+    steps.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int FrameClock::Tick()
+{
+    std::chrono::high_resolution_clock::time_point now =
+        std::chrono::high_resolution_clock::now();
+    _accumulatedSec += std::chrono::duration<double>(now - _lastTickTime).count();
+    _lastTickTime = now;
+
+    unsigned int numSteps = (unsigned int)(_accumulatedSec / _fixedStepSec);
+    if (numSteps > _maxStepsPerTick)
+    {
+        // keep the part of a step that was left over so that the interpolation doesn't jump,
+        // and throw away the rest (see the class description)
+        double keepSec = (_maxStepsPerTick * _fixedStepSec) +
+            (_accumulatedSec - (numSteps * _fixedStepSec));
+        _droppedSec += _accumulatedSec - keepSec;
+        _accumulatedSec = keepSec;
+        numSteps = _maxStepsPerTick;
+    }
+    _accumulatedSec -= numSteps * _fixedStepSec;
+
+    return numSteps;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+float FrameClock::GetFixedStepSec() const
+{
+    return (float)_fixedStepSec;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    How far the real time is between the last simulated state and the next one.
+Parameters: None
+Returns:
+    On the range [0,1).  0 means that the last simulated state is exactly "now".
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+float FrameClock::GetInterpolation() const
+{
+    return (float)(_accumulatedSec / _fixedStepSec);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The total real time that Tick() has thrown away because a frame owed more steps than the
+    cap.  If this keeps growing, then the simulation can't keep up at this step size.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+double FrameClock::GetDroppedSec() const
+{
+    return _droppedSec;
+}
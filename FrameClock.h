@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Turns real time into a whole number of fixed-size simulation steps.  Every frame, Tick()
+    adds the time since the last tick to an accumulator and takes as many whole steps out of
+    it as fit.  Whatever is left over (less than one step) carries into the next frame, so the
+    simulation advances at the same rate no matter how fast or slow frames are drawn, and the
+    simulation rate can be lower than the display rate.
+
+    GetInterpolation() says how far the leftover time is into the next step, which is what the
+    renderer needs to draw the particles between the last two simulated states instead of
+    snapping from one to the next.
+
+    Note: If a frame takes so long that it owes more than the maximum number of steps (a
+    debugger break, a window drag, or a simulation that just can't keep up), then the extra
+    time is thrown away.  Otherwise a slow frame would owe more steps, which would make the
+    next frame slower, which would owe even more steps, and so on.  The simulation runs in slow
+    motion instead.
+-----------------------------------------------------------------------------------------------*/
+class FrameClock
+{
+public:
+    FrameClock();
+    void Init(float fixedStepSec, unsigned int maxStepsPerTick);
+    unsigned int Tick();
+    float GetFixedStepSec() const;
+    float GetInterpolation() const;
+    double GetDroppedSec() const;
+
+private:
+    std::chrono::high_resolution_clock::time_point _lastTickTime;
+
+    // doubles because the accumulator is added to and subtracted from every frame for as long
+    // as the program runs, and a float's rounding errors would pile up
+    double _fixedStepSec;
+    double _accumulatedSec;
+    double _droppedSec;
+    unsigned int _maxStepsPerTick;
+};
@@ -14,14 +14,16 @@ Description:
     shaders.  It tries to cover all the basics and the error reporting and is as self-contained
     as possible, only returning a program ID when it is finished.
 
-    In particular, this one loads the vertex and fragment parts of the shader program.
-Parameters: None
+    In particular, this one loads the vertex and fragment parts of the shader program.  There
+    is more than one vertex shader (one for each particle format), but only one fragment shader.
+Parameters:
+    vertFileName    The vertex shader's file, relative to the working directory.
 Returns:
     The OpenGL ID of the GPU program.
 Exception:  Safe
 Creator:    John Cox (2-13-2016)
 -----------------------------------------------------------------------------------------------*/
-unsigned int GenerateVertexShaderProgram()
+unsigned int GenerateVertexShaderProgram(const char *vertFileName)
 {
     // hard-coded ignoring possible errors like a boss
 
@@ -33,7 +35,7 @@ unsigned int GenerateVertexShaderProgram()
     // soon as the std::string object disappears.  To deal with it, copy the data into a 
     // temporary string.
     //std::ifstream shaderFile("shaderGeometry.vert");
-    std::ifstream shaderFile("shaderParticle.vert");
+    std::ifstream shaderFile(vertFileName);
     std::stringstream shaderData;
     shaderData << shaderFile.rdbuf();
     shaderFile.close();
@@ -119,21 +121,35 @@ Description:
     as possible, only returning a program ID when it is finished.
 
     In particular, this one loads the compute.
-Parameters: None
+
+    If given any defines, then they are put in just after the first line, which GLSL requires 
+    to be the #version.  A #line directive follows them so that the compile errors still have 
+    the file's own line numbers.
+Parameters:
+    compFileName    The compute shader's file, relative to the working directory.
+    defines         0, or one or more lines of "#define NAME VALUE", each ending in a newline.
 Returns:
     The OpenGL ID of the GPU program.
 Exception:  Safe
 Creator:    John Cox (7-30-2016)
 -----------------------------------------------------------------------------------------------*/
-unsigned int GenerateComputeShaderProgram()
+unsigned int GenerateComputeShaderProgram(const char *compFileName, const char *defines)
 {
     // hard-coded ignoring possible errors like a boss
 
-    std::ifstream shaderFile("shaderParticle.comp");
+    std::ifstream shaderFile(compFileName);
     std::stringstream shaderData;
     shaderData << shaderFile.rdbuf();
     shaderFile.close();
     std::string tempFileContents = shaderData.str();
+    if (defines != 0)
+    {
+        size_t versionEnd = tempFileContents.find('\n');
+        if (versionEnd != std::string::npos)
+        {
+            tempFileContents.insert(versionEnd + 1, std::string(defines) + "#line 2\n");
+        }
+    }
     GLuint compShaderId = glCreateShader(GL_COMPUTE_SHADER);
     const GLchar *bytes[] = { tempFileContents.c_str() };
     const GLint strLengths[] = { (int)tempFileContents.length() };
@@ -1,5 +1,8 @@
 #pragma once
 
-// this is a "barebones" program, so the file names are hard-coded
-unsigned int GenerateVertexShaderProgram();
-unsigned int GenerateComputeShaderProgram();
+// this is a "barebones" program, so the fragment shader's file name is hard-coded
+unsigned int GenerateVertexShaderProgram(const char *vertFileName);
+
+// defines, if not 0, are "#define ..." lines that are compiled in just after the #version 
+// line so that one file can make more than one program
+unsigned int GenerateComputeShaderProgram(const char *compFileName, const char *defines = 0);
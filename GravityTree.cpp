@@ -0,0 +1,676 @@
+#include "GravityTree.h"
+
+#include "glm/detail/func_geometric.hpp"    // glm::dot
+#include "glm/common.hpp"   // glm::min, glm::max
+
+#include <math.h>
+#include <emmintrin.h>  // SSE2
+
+// a cell or node with more particles than this is split into quarters
+static const unsigned int MAX_LEAF_PARTICLES = 32;
+
+// Particles that are on top of each other (every particle that was just emitted is at its
+// emitter's center) can't be split apart, so stop splitting after this many levels below the
+// grid.
+static const unsigned int MAX_SPLIT_DEPTH = 16;
+
+// 4^10 is a million cells, which is as many as the neighbor grid will make
+static const unsigned int MAX_GRID_LEVELS = 10;
+
+// Note: In window coords.  The window is 2 across.
+const float GravityTree::SOFTENING = 0.01f;
+
+// how the work is cut up for the thread pool
+static const unsigned int LEAVES_PER_CHUNK = 1024;
+static const unsigned int NODES_PER_CHUNK = 4096;
+static const unsigned int BODIES_PER_CHUNK = 1024;
+static const unsigned int LEAVES_PER_WALK_CHUNK = 64;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Pulls every other bit (starting with bit 0) of a Morton code together, which is the X of
+    the cell.  Shift the code right by 1 first to get the Y.
+Parameters:
+    mortonCode  Self-explanatory.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline unsigned int CompactBits(unsigned int mortonCode)
+{
+    unsigned int bits = mortonCode & 0x55555555;
+    bits = (bits | (bits >> 1)) & 0x33333333;
+    bits = (bits | (bits >> 2)) & 0x0f0f0f0f;
+    bits = (bits | (bits >> 4)) & 0x00ff00ff;
+    bits = (bits | (bits >> 8)) & 0x0000ffff;
+    return bits;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Where a full level's nodes start in the node list.  Level L has 4^L nodes, and there are
+    (4^L - 1) / 3 nodes above it.
+Parameters:
+    level       0 is the root.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline unsigned int GetLevelStart(unsigned int level)
+{
+    return ((1u << (2 * level)) - 1) / 3;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  There is no tree until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+GravityTree::GravityTree() :
+    _minCorner(0.0f, 0.0f),
+    _size(0.0f),
+    _gridLevels(0),
+    _numBodies(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the grid over the given square and makes room for the particles.  The grid is fine
+    enough that the average cell doesn't need to be split.
+Parameters:
+    minCorner       The bottom left of the square that the particles can be in, in window
+                    coords.
+    size            The width of the square.
+    numParticles    The most particles that Build(...) will be given.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::Init(const glm::vec2 &minCorner, float size, unsigned int numParticles)
+{
+    _minCorner = minCorner;
+    _size = size;
+    _gridLevels = 1;
+    while (_gridLevels < MAX_GRID_LEVELS &&
+        ((1u << (2 * _gridLevels)) * MAX_LEAF_PARTICLES) < numParticles)
+    {
+        _gridLevels++;
+    }
+
+    // Note: The grid's far corner is pulled in a hair so that rounding in (max - min) can't
+    // make the grid one cell wider than 2^_gridLevels.  Anything past it is put in the edge
+    // cells anyway.
+    unsigned int cellsAcross = 1u << _gridLevels;
+    glm::vec2 maxCorner = minCorner + glm::vec2(size, size) * 0.99999f;
+    _grid.Init(minCorner, maxCorner, size / cellsAcross, numParticles);
+
+    unsigned int numLeaves = cellsAcross * cellsAcross;
+    unsigned int numLeafChunks = ((numLeaves - 1) / LEAVES_PER_CHUNK) + 1;
+    _nodes.resize(GetLevelStart(_gridLevels + 1));
+    _chunkNodes.resize(numLeafChunks);
+    _chunkNodeStarts.resize(numLeafChunks);
+    _positions.resize(numParticles);
+    _isActive.resize(numParticles);
+    _accelerations.assign(numParticles, glm::vec2(0.0f, 0.0f));
+    _sortedPositions.resize(numParticles);
+    _sortedParticles.resize(numParticles);
+    _numBodies = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::Cleanup()
+{
+    _gridLevels = 0;
+    _grid.Cleanup();
+    _nodes.clear();
+    _chunkNodes.clear();
+    _chunkNodeStarts.clear();
+    _positions.clear();
+    _isActive.clear();
+    _accelerations.clear();
+    _sortedPositions.clear();
+    _sortedParticles.clear();
+    _numBodies = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool GravityTree::IsInitialized() const
+{
+    return !_nodes.empty();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Builds the tree from where the particles are now.  See the class description for the
+    steps.  Everything from the last build is thrown out.
+Parameters:
+    numParticles    Must not be more than Init(...) was given.
+    getPositions    Called once for each of the grid's blocks.  Must be safe to call from more
+                    than one thread at once.
+    threadPool      May be 0 to build on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::Build(unsigned int numParticles, const PositionFunction &getPositions,
+    ThreadPool *threadPool)
+{
+    if (numParticles == 0 || numParticles > _positions.size())
+    {
+        return;
+    }
+
+    // (1)
+    const NeighborGrid &grid = _grid;
+    glm::vec2 *positions = _positions.data();
+    unsigned char *isActive = _isActive.data();
+    _grid.Build(numParticles,
+        [&grid, &getPositions, positions, isActive](unsigned int beginIndex,
+            unsigned int endIndex, unsigned int *cellIndices)
+    {
+        getPositions(beginIndex, endIndex, positions + beginIndex, isActive + beginIndex);
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            *cellIndices++ = (isActive[particleIndex] != 0) ?
+                grid.GetCellIndex(positions[particleIndex]) : NeighborGrid::NO_CELL;
+        }
+    }, threadPool);
+
+    _numBodies = _grid.NumIndexed();
+    const unsigned int *gridParticles = _grid.GetSortedParticles();
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this, gridParticles](unsigned int beginIndex, unsigned int endIndex)
+    {
+        for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+        {
+            unsigned int particleIndex = gridParticles[sortedIndex];
+            _sortedParticles[sortedIndex] = particleIndex;
+            _sortedPositions[sortedIndex] = _positions[particleIndex];
+        }
+    });
+
+    // (2), then move the new nodes after the full levels
+    unsigned int numLeaves = 1u << (2 * _gridLevels);
+    ThreadPool::ParallelFor(threadPool, numLeaves, LEAVES_PER_CHUNK,
+        [this](unsigned int beginLeaf, unsigned int endLeaf)
+    {
+        this->SplitLeafChunk(beginLeaf / LEAVES_PER_CHUNK, beginLeaf, endLeaf);
+    });
+
+    unsigned int nextNode = GetLevelStart(_gridLevels + 1);
+    for (size_t chunkIndex = 0; chunkIndex < _chunkNodes.size(); chunkIndex++)
+    {
+        _chunkNodeStarts[chunkIndex] = nextNode;
+        nextNode += _chunkNodes[chunkIndex].size();
+    }
+    _nodes.resize(nextNode);
+    ThreadPool::ParallelFor(threadPool, numLeaves, LEAVES_PER_CHUNK,
+        [this](unsigned int beginLeaf, unsigned int endLeaf)
+    {
+        this->MoveChunkNodes(beginLeaf / LEAVES_PER_CHUNK, beginLeaf, endLeaf);
+    });
+
+    // (3)
+    for (int level = (int)_gridLevels - 1; level >= 0; level--)
+    {
+        ThreadPool::ParallelFor(threadPool, 1u << (2 * level), NODES_PER_CHUNK,
+            [this, level](unsigned int beginNode, unsigned int endNode)
+        {
+            this->AddUpNodes((unsigned int)level, beginNode, endNode);
+        });
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out every particle's acceleration from all of the others, using the tree that the
+    last Build(...) made.  The tree is walked once for each leaf instead of once for each
+    particle (see ComputeLeafAccelerations(...)).
+
+    The pull of each particle falls off with the square of the distance, like real gravity,
+    except that it is "softened" at very short distances.
+Parameters:
+    strength        What the acceleration would be at a distance of 1 from all of the
+                    particles together (window coords per second per second).  Splitting it
+                    between the particles keeps the pull the same no matter how many there are.
+    openingAngle    A node that is smaller than this times its distance pulls as if it were
+                    one particle.  0 adds up every particle (slow), and 0.5 - 1.0 is usual.
+    threadPool      May be 0 to work on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::ComputeAccelerations(float strength, float openingAngle,
+    ThreadPool *threadPool)
+{
+    if (_numBodies == 0)
+    {
+        return;
+    }
+
+    // Note: The leaves start at the bottom full level.  Nodes above them aren't leaves.
+    float strengthPerParticle = strength / _numBodies;
+    float openingAngleSqr = openingAngle * openingAngle;
+    unsigned int firstLeaf = GetLevelStart(_gridLevels);
+    unsigned int numLeaves = _nodes.size() - firstLeaf;
+    ThreadPool::ParallelFor(threadPool, numLeaves, LEAVES_PER_WALK_CHUNK,
+        [this, firstLeaf, strengthPerParticle, openingAngleSqr](unsigned int beginIndex,
+            unsigned int endIndex)
+    {
+        InteractionList interactions;
+        for (unsigned int nodeIndex = firstLeaf + beginIndex; nodeIndex < firstLeaf + endIndex;
+            nodeIndex++)
+        {
+            const Node &leaf = _nodes[nodeIndex];
+            if (leaf._firstChild == 0 && leaf._numParticles > 0)
+            {
+                this->ComputeLeafAccelerations(leaf, strengthPerParticle, openingAngleSqr,
+                    &interactions);
+            }
+        }
+    });
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives the accelerations from the last ComputeAccelerations(...).
+Parameters: None
+Returns:
+    One acceleration for each particle, in window coords per second per second.  Inactive
+    particles' accelerations are left over from whenever they were last active.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const glm::vec2 *GravityTree::GetAccelerations() const
+{
+    return _accelerations.data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Simple getters for the size of the last tree, for reporting.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int GravityTree::NumNodes() const
+{
+    return _nodes.size();
+}
+
+unsigned int GravityTree::NumBodies() const
+{
+    return _numBodies;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (2) for a chunk of the grid's cells: fills in each cell's node at the bottom full
+    level and splits it if it has too many particles.  The nodes that are split off go in the
+    chunk's own list.
+Parameters:
+    chunkIndex      Which list to use.
+    beginLeaf       The first cell, in Morton order.
+    endLeaf         One past the last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::SplitLeafChunk(unsigned int chunkIndex, unsigned int beginLeaf,
+    unsigned int endLeaf)
+{
+    std::vector<Node> &chunkNodes = _chunkNodes[chunkIndex];
+    chunkNodes.clear();
+    std::vector<glm::vec2> scratchPositions;
+    std::vector<unsigned int> scratchParticles;
+
+    unsigned int levelStart = GetLevelStart(_gridLevels);
+    float cellSize = _size / (1u << _gridLevels);
+    const unsigned int *gridParticles = _grid.GetSortedParticles();
+    for (unsigned int leafIndex = beginLeaf; leafIndex < endLeaf; leafIndex++)
+    {
+        unsigned int cellX = CompactBits(leafIndex);
+        unsigned int cellY = CompactBits(leafIndex >> 1);
+        const unsigned int *cellBegin = 0;
+        const unsigned int *cellEnd = 0;
+        _grid.GetCellRange(cellX, cellY, &cellBegin, &cellEnd);
+
+        Node leaf = Node();
+        leaf._size = cellSize;
+        leaf._firstParticle = (unsigned int)(cellBegin - gridParticles);
+        leaf._numParticles = (unsigned int)(cellEnd - cellBegin);
+        glm::vec2 sum(0.0f, 0.0f);
+        for (unsigned int sortedIndex = leaf._firstParticle;
+            sortedIndex < leaf._firstParticle + leaf._numParticles; sortedIndex++)
+        {
+            sum += _sortedPositions[sortedIndex];
+        }
+        leaf._mass = (float)leaf._numParticles;
+        if (leaf._numParticles > 0)
+        {
+            leaf._centerOfMass = sum / leaf._mass;
+        }
+
+        glm::vec2 minCorner = _minCorner + (glm::vec2((float)cellX, (float)cellY) * cellSize);
+        leaf._firstChild = this->SplitNode(&chunkNodes, leaf, minCorner, 0, &scratchPositions,
+            &scratchParticles);
+        _nodes[levelStart + leafIndex] = leaf;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Splits a node into quarters if it has too many particles, and then each quarter that has
+    too many, and so on.  The node's particles are rearranged so that each quarter's are
+    together.  They stay in the same order within each quarter.
+
+    Note: Until MoveChunkNodes(...) fixes them, the child indices in the chunk's list are one
+    more than where the child is in the chunk's list, so that 0 can still mean "leaf".
+Parameters:
+    chunkNodes      Where the children go.
+    parent          The node to split.  A copy, because adding children to the list may move
+                    the list.
+    minCorner       The node's bottom left corner.
+    depth           How many times this cell has been split already.
+    scratchPositions    Room to rearrange the particles.  Grows as needed.
+    scratchParticles    Same.
+Returns:
+    The (one more than) index of the first child in the chunk's list, or 0 if the node wasn't
+    split.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int GravityTree::SplitNode(std::vector<Node> *chunkNodes, Node parent,
+    const glm::vec2 &minCorner, unsigned int depth, std::vector<glm::vec2> *scratchPositions,
+    std::vector<unsigned int> *scratchParticles)
+{
+    if (parent._numParticles <= MAX_LEAF_PARTICLES || depth >= MAX_SPLIT_DEPTH)
+    {
+        return 0;
+    }
+
+    // quarter Q is to the right if bit 0 is set and on top if bit 1 is set, which is the same
+    // order as the full levels' Morton order
+    float halfSize = parent._size * 0.5f;
+    glm::vec2 middle = minCorner + glm::vec2(halfSize, halfSize);
+    unsigned int beginIndex = parent._firstParticle;
+    unsigned int endIndex = parent._firstParticle + parent._numParticles;
+    unsigned int quarterCounts[4] = { 0, 0, 0, 0 };
+    scratchPositions->resize(parent._numParticles);
+    scratchParticles->resize(parent._numParticles);
+    for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+    {
+        const glm::vec2 &position = _sortedPositions[sortedIndex];
+        unsigned int quarter = ((position.x >= middle.x) ? 1 : 0) +
+            ((position.y >= middle.y) ? 2 : 0);
+        quarterCounts[quarter]++;
+        (*scratchPositions)[sortedIndex - beginIndex] = position;
+        (*scratchParticles)[sortedIndex - beginIndex] = _sortedParticles[sortedIndex];
+    }
+
+    unsigned int quarterStarts[4] = { beginIndex, 0, 0, 0 };
+    for (unsigned int quarter = 1; quarter < 4; quarter++)
+    {
+        quarterStarts[quarter] = quarterStarts[quarter - 1] + quarterCounts[quarter - 1];
+    }
+    unsigned int nextIndices[4] =
+        { quarterStarts[0], quarterStarts[1], quarterStarts[2], quarterStarts[3] };
+    for (unsigned int scratchIndex = 0; scratchIndex < parent._numParticles; scratchIndex++)
+    {
+        const glm::vec2 &position = (*scratchPositions)[scratchIndex];
+        unsigned int quarter = ((position.x >= middle.x) ? 1 : 0) +
+            ((position.y >= middle.y) ? 2 : 0);
+        unsigned int sortedIndex = nextIndices[quarter]++;
+        _sortedPositions[sortedIndex] = position;
+        _sortedParticles[sortedIndex] = (*scratchParticles)[scratchIndex];
+    }
+
+    unsigned int firstChild = chunkNodes->size();
+    for (unsigned int quarter = 0; quarter < 4; quarter++)
+    {
+        Node child = Node();
+        child._size = halfSize;
+        child._firstParticle = quarterStarts[quarter];
+        child._numParticles = quarterCounts[quarter];
+        glm::vec2 sum(0.0f, 0.0f);
+        for (unsigned int sortedIndex = child._firstParticle;
+            sortedIndex < child._firstParticle + child._numParticles; sortedIndex++)
+        {
+            sum += _sortedPositions[sortedIndex];
+        }
+        child._mass = (float)child._numParticles;
+        if (child._numParticles > 0)
+        {
+            child._centerOfMass = sum / child._mass;
+        }
+        chunkNodes->push_back(child);
+    }
+
+    for (unsigned int quarter = 0; quarter < 4; quarter++)
+    {
+        glm::vec2 childMinCorner = minCorner + glm::vec2(((quarter & 1) != 0) ? halfSize : 0.0f,
+            ((quarter & 2) != 0) ? halfSize : 0.0f);
+        unsigned int grandchild = this->SplitNode(chunkNodes, (*chunkNodes)[firstChild + quarter],
+            childMinCorner, depth + 1, scratchPositions, scratchParticles);
+        (*chunkNodes)[firstChild + quarter]._firstChild = grandchild;
+    }
+
+    return firstChild + 1;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Copies a chunk's split-off nodes to their place in the node list and points their parents
+    (and the chunk's cells) at them.
+Parameters:
+    chunkIndex      Self-explanatory.
+    beginLeaf       The chunk's first cell, in Morton order.
+    endLeaf         One past its last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::MoveChunkNodes(unsigned int chunkIndex, unsigned int beginLeaf,
+    unsigned int endLeaf)
+{
+    // -1 because the chunk's child indices are one too many (see SplitNode(...))
+    const std::vector<Node> &chunkNodes = _chunkNodes[chunkIndex];
+    unsigned int chunkStart = _chunkNodeStarts[chunkIndex];
+    unsigned int indexChange = chunkStart - 1;
+    for (size_t nodeIndex = 0; nodeIndex < chunkNodes.size(); nodeIndex++)
+    {
+        Node node = chunkNodes[nodeIndex];
+        if (node._firstChild != 0)
+        {
+            node._firstChild += indexChange;
+        }
+        _nodes[chunkStart + nodeIndex] = node;
+    }
+
+    unsigned int levelStart = GetLevelStart(_gridLevels);
+    for (unsigned int leafIndex = beginLeaf; leafIndex < endLeaf; leafIndex++)
+    {
+        Node &leaf = _nodes[levelStart + leafIndex];
+        if (leaf._firstChild != 0)
+        {
+            leaf._firstChild += indexChange;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (3) for a range of one full level's nodes: each one's mass and center of mass come
+    from its four children on the level below.
+Parameters:
+    level       Must be above the grid.
+    beginNode   The first node, in Morton order within the level.
+    endNode     One past the last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::AddUpNodes(unsigned int level, unsigned int beginNode, unsigned int endNode)
+{
+    unsigned int levelStart = GetLevelStart(level);
+    unsigned int childLevelStart = GetLevelStart(level + 1);
+    float size = _size / (1u << level);
+    for (unsigned int nodeIndex = beginNode; nodeIndex < endNode; nodeIndex++)
+    {
+        Node node = Node();
+        node._size = size;
+        node._firstChild = childLevelStart + (nodeIndex * 4);
+        glm::vec2 weightedSum(0.0f, 0.0f);
+        for (unsigned int quarter = 0; quarter < 4; quarter++)
+        {
+            const Node &child = _nodes[node._firstChild + quarter];
+            node._mass += child._mass;
+            weightedSum += child._centerOfMass * child._mass;
+        }
+        if (node._mass > 0.0f)
+        {
+            node._centerOfMass = weightedSum / node._mass;
+        }
+        _nodes[levelStart + nodeIndex] = node;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Walks the tree from the root once for all of a leaf's particles and then adds up the pull
+    on each of them.  A node that is small enough for its distance from the leaf's particles
+    (the closest that any of them are) pulls as one particle, a leaf that isn't adds its
+    particles one at a time, and any other node is opened up.  Whatever pulls goes in a list,
+    and then each of the leaf's particles goes through the whole list 4 at a time with SSE.  The
+    walk is done once instead of up to MAX_LEAF_PARTICLES times.
+
+    Each particle's own entry is exactly 0 away from it, so it doesn't pull.
+Parameters:
+    leaf                Self-explanatory.
+    strengthPerParticle See ComputeAccelerations(...).
+    openingAngleSqr     Same.
+    interactions        Room for the list.  Grows as needed.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GravityTree::ComputeLeafAccelerations(const Node &leaf, float strengthPerParticle,
+    float openingAngleSqr, InteractionList *interactions)
+{
+    // the box around the leaf's particles, which may be smaller than the leaf (or bigger, for
+    // particles that have left the grid)
+    unsigned int beginIndex = leaf._firstParticle;
+    unsigned int endIndex = leaf._firstParticle + leaf._numParticles;
+    glm::vec2 boxMin = _sortedPositions[beginIndex];
+    glm::vec2 boxMax = boxMin;
+    for (unsigned int sortedIndex = beginIndex + 1; sortedIndex < endIndex; sortedIndex++)
+    {
+        boxMin = glm::min(boxMin, _sortedPositions[sortedIndex]);
+        boxMax = glm::max(boxMax, _sortedPositions[sortedIndex]);
+    }
+
+    // each level adds at most 3 to the stack (4 children in place of their parent)
+    static const unsigned int MAX_STACK_SIZE =
+        (3 * (MAX_GRID_LEVELS + MAX_SPLIT_DEPTH + 1)) + 1;
+    unsigned int stack[MAX_STACK_SIZE];
+    unsigned int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    float softeningSqr = SOFTENING * SOFTENING;
+    interactions->_x.clear();
+    interactions->_y.clear();
+    interactions->_mass.clear();
+    while (stackSize > 0)
+    {
+        const Node &node = _nodes[stack[--stackSize]];
+        if (node._mass == 0.0f)
+        {
+            continue;
+        }
+
+        // Note: The softened distance is used to decide too.  Well inside the softening, the
+        // pull grows straight with the distance, so a node that is much smaller than the
+        // softening pulls the same as its particles would (each particle's own included),
+        // and a pile of just-emitted particles on top of each other doesn't have to be added
+        // up one by one.
+        glm::vec2 toBox = glm::max(glm::max(boxMin - node._centerOfMass,
+            node._centerOfMass - boxMax), glm::vec2(0.0f, 0.0f));
+        float softDistSqr = glm::dot(toBox, toBox) + softeningSqr;
+        if ((node._size * node._size) < (openingAngleSqr * softDistSqr))
+        {
+            interactions->_x.push_back(node._centerOfMass.x);
+            interactions->_y.push_back(node._centerOfMass.y);
+            interactions->_mass.push_back(node._mass);
+        }
+        else if (node._firstChild == 0)
+        {
+            unsigned int nodeEndIndex = node._firstParticle + node._numParticles;
+            for (unsigned int sortedIndex = node._firstParticle; sortedIndex < nodeEndIndex;
+                sortedIndex++)
+            {
+                interactions->_x.push_back(_sortedPositions[sortedIndex].x);
+                interactions->_y.push_back(_sortedPositions[sortedIndex].y);
+                interactions->_mass.push_back(1.0f);
+            }
+        }
+        else
+        {
+            stack[stackSize++] = node._firstChild;
+            stack[stackSize++] = node._firstChild + 1;
+            stack[stackSize++] = node._firstChild + 2;
+            stack[stackSize++] = node._firstChild + 3;
+        }
+    }
+
+    // fill out the last 4 with nothing so that the list can be gone through 4 at a time
+    // Note: A massless entry at (0,0) doesn't pull.  The softening keeps it from dividing by 0.
+    while ((interactions->_mass.size() % 4) != 0)
+    {
+        interactions->_x.push_back(0.0f);
+        interactions->_y.push_back(0.0f);
+        interactions->_mass.push_back(0.0f);
+    }
+
+    const float *sourceX = interactions->_x.data();
+    const float *sourceY = interactions->_y.data();
+    const float *sourceMass = interactions->_mass.data();
+    unsigned int numInteractions = interactions->_mass.size();
+    __m128 softeningSqrs = _mm_set1_ps(softeningSqr);
+    for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+    {
+        __m128 positionX = _mm_set1_ps(_sortedPositions[sortedIndex].x);
+        __m128 positionY = _mm_set1_ps(_sortedPositions[sortedIndex].y);
+        __m128 pullX = _mm_setzero_ps();
+        __m128 pullY = _mm_setzero_ps();
+        for (unsigned int interactionIndex = 0; interactionIndex < numInteractions;
+            interactionIndex += 4)
+        {
+            __m128 toSourceX = _mm_sub_ps(_mm_loadu_ps(sourceX + interactionIndex), positionX);
+            __m128 toSourceY = _mm_sub_ps(_mm_loadu_ps(sourceY + interactionIndex), positionY);
+            __m128 softDistSqr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toSourceX, toSourceX),
+                _mm_mul_ps(toSourceY, toSourceY)), softeningSqrs);
+            __m128 scale = _mm_div_ps(_mm_loadu_ps(sourceMass + interactionIndex),
+                _mm_mul_ps(softDistSqr, _mm_sqrt_ps(softDistSqr)));
+            pullX = _mm_add_ps(pullX, _mm_mul_ps(toSourceX, scale));
+            pullY = _mm_add_ps(pullY, _mm_mul_ps(toSourceY, scale));
+        }
+
+        float pullsX[4];
+        float pullsY[4];
+        _mm_storeu_ps(pullsX, pullX);
+        _mm_storeu_ps(pullsY, pullY);
+        glm::vec2 pull((pullsX[0] + pullsX[1]) + (pullsX[2] + pullsX[3]),
+            (pullsY[0] + pullsY[1]) + (pullsY[2] + pullsY[3]));
+        _accelerations[_sortedParticles[sortedIndex]] = pull * strengthPerParticle;
+    }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "NeighborGrid.h"
+#include "ThreadPool.h"
+#include "glm/vec2.hpp"
+
+#include <vector>
+#include <functional>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A Barnes-Hut quadtree for letting every particle pull on every other particle without
+    adding up a million pulls for each of a million particles.  Each node of the tree knows how
+    many particles are under it and their center of mass, and a node that is far enough away
+    (its size divided by its distance is less than the "opening angle") pulls like a single
+    particle at its center of mass.  Only nearby nodes are opened up, so each particle's pull is
+    about log(N) work instead of N.  See ParticleSimulatorCpu::SetGravity(...).
+
+    The tree is rebuilt from scratch every step, because the particles move every step:
+    (1) The particles are sorted into a square grid whose cells are the nodes of the tree's
+    bottom full level (see NeighborGrid.h).  The grid's counting sort is split across the
+    thread pool.
+    (2) Each cell that has more than a few particles is split into quarters (and those into
+    quarters...) until none do.  Cells are independent, so they are split across the threads
+    too.
+    (3) The levels above the grid are added up from their children, one level at a time.
+    After that, ComputeAccelerations(...) walks the tree once for each leaf, and the leaf's
+    particles share what the walk found.
+
+    Every particle has the same mass.  Nothing here knows what a particle looks like.  Whoever
+    calls Build(...) hands over the positions.
+
+    Note: The nodes of the full levels are in Morton ("Z") order within their level so that
+    each node's four children are next to each other.
+-----------------------------------------------------------------------------------------------*/
+class GravityTree
+{
+public:
+    // fills in positions[0, endIndex - beginIndex) and isActive[0, endIndex - beginIndex) for
+    // the particles in the range [beginIndex, endIndex)
+    // Note: Positions are in window coords.  Inactive particles are left out of the tree.
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        glm::vec2 *positions, unsigned char *isActive)> PositionFunction;
+
+    // keeps particles that pass right by each other (or right through a node's center of 
+    // mass) from being flung off at nearly infinite speed: every distance D is treated as 
+    // sqrt(D^2 + SOFTENING^2)
+    static const float SOFTENING;
+
+    GravityTree();
+    void Init(const glm::vec2 &minCorner, float size, unsigned int numParticles);
+    void Cleanup();
+    bool IsInitialized() const;
+    void Build(unsigned int numParticles, const PositionFunction &getPositions,
+        ThreadPool *threadPool);
+    void ComputeAccelerations(float strength, float openingAngle, ThreadPool *threadPool);
+    const glm::vec2 *GetAccelerations() const;
+    unsigned int NumNodes() const;
+    unsigned int NumBodies() const;
+
+private:
+    // one square of the tree
+    // Note: A leaf's particles are _sortedPositions[_firstParticle, _firstParticle + 
+    // _numParticles).  Only leaves use those two.
+    struct Node
+    {
+        glm::vec2 _centerOfMass;    // not used if _mass is 0
+        float _mass;                // how many particles are in the square
+        float _size;                // the width of the square
+        unsigned int _firstChild;   // the first of the four children; 0 for a leaf
+        unsigned int _firstParticle;
+        unsigned int _numParticles;
+        unsigned int _padding;
+    };
+
+    // what pulls on a leaf's particles, split up by X, Y, and mass so that it can be gone
+    // through 4 at a time
+    struct InteractionList
+    {
+        std::vector<float> _x;
+        std::vector<float> _y;
+        std::vector<float> _mass;
+    };
+
+    void SplitLeafChunk(unsigned int chunkIndex, unsigned int beginLeaf, unsigned int endLeaf);
+    unsigned int SplitNode(std::vector<Node> *chunkNodes, Node parent,
+        const glm::vec2 &minCorner, unsigned int depth, std::vector<glm::vec2> *scratchPositions,
+        std::vector<unsigned int> *scratchParticles);
+    void MoveChunkNodes(unsigned int chunkIndex, unsigned int beginLeaf, unsigned int endLeaf);
+    void AddUpNodes(unsigned int level, unsigned int beginNode, unsigned int endNode);
+    void ComputeLeafAccelerations(const Node &leaf, float strengthPerParticle,
+        float openingAngleSqr, InteractionList *interactions);
+
+    glm::vec2 _minCorner;
+    float _size;
+
+    // the bottom full level is _gridLevels below the root, so it has 4^_gridLevels nodes
+    unsigned int _gridLevels;
+    NeighborGrid _grid;
+
+    // the full levels, top down, then the nodes that (2) split off
+    std::vector<Node> _nodes;
+
+    // (2) puts each chunk's new nodes in its own list so that no thread has to wait on
+    // another, and then they are moved into _nodes in chunk order
+    std::vector<std::vector<Node>> _chunkNodes;
+    std::vector<unsigned int> _chunkNodeStarts;
+
+    // indexed by particle
+    std::vector<glm::vec2> _positions;
+    std::vector<unsigned char> _isActive;
+    std::vector<glm::vec2> _accelerations;
+
+    // the tree's particles in grid order, which (2) rearranges within each cell
+    std::vector<glm::vec2> _sortedPositions;
+    std::vector<unsigned int> _sortedParticles;
+    unsigned int _numBodies;
+};
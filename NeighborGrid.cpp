@@ -0,0 +1,417 @@
+#include "NeighborGrid.h"
+
+#include <math.h>
+#include <algorithm>    // std::fill(...), std::min(...)
+
+// The block counts are (number of threads) * (number of cells), and step (2) goes through all
+// of them, so a grid that is too fine costs more than the sort.  A finer grid than this gets
+// bigger cells instead.
+static const unsigned int MAX_GRID_CELLS = 1024 * 1024;
+
+// how many cells each of step (2)'s chunks adds up
+static const unsigned int CELLS_PER_CHUNK = 4096;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  There are no cells until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+NeighborGrid::NeighborGrid() :
+    _minCorner(0.0f, 0.0f),
+    _cellSize(0.0f),
+    _inverseCellSize(0.0f),
+    _numCellsX(0),
+    _numCellsY(0),
+    _numBlocks(0),
+    _blockSize(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays out the cells over the given rectangle and makes room for the particles.  The grid is
+    empty until the first Build(...).
+Parameters:
+    minCorner       The bottom left of the area that the particles can be in, in window coords.
+    maxCorner       The top right.
+    cellSize        The width (and height) of a cell in window coords.  If that would make more
+                    than MAX_GRID_CELLS cells, then the cells are made bigger.
+    numParticles    The most particles that Build(...) will be given.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::Init(const glm::vec2 &minCorner, const glm::vec2 &maxCorner, float cellSize,
+    unsigned int numParticles)
+{
+    glm::vec2 size = maxCorner - minCorner;
+    while (true)
+    {
+        _numCellsX = (unsigned int)ceilf(size.x / cellSize);
+        _numCellsY = (unsigned int)ceilf(size.y / cellSize);
+        _numCellsX = (_numCellsX == 0) ? 1 : _numCellsX;
+        _numCellsY = (_numCellsY == 0) ? 1 : _numCellsY;
+        double numCells = (double)_numCellsX * _numCellsY;
+        if (numCells <= MAX_GRID_CELLS)
+        {
+            break;
+        }
+
+        // a little more than needed so that rounding up doesn't go around again
+        cellSize *= (float)sqrt(numCells / MAX_GRID_CELLS) * 1.01f;
+    }
+
+    _minCorner = minCorner;
+    _cellSize = cellSize;
+    _inverseCellSize = 1.0f / cellSize;
+
+    // nothing is in any cell until the first build
+    _cellStart.assign((_numCellsX * _numCellsY) + 1, 0);
+    _sortedParticles.resize(numParticles);
+    _particleCells.resize(numParticles);
+    _blockCounts.clear();
+    _numBlocks = 0;
+    _blockSize = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::Cleanup()
+{
+    _numCellsX = 0;
+    _numCellsY = 0;
+    _cellStart.clear();
+    _sortedParticles.clear();
+    _particleCells.clear();
+    _blockCounts.clear();
+    _cellChunkTotals.clear();
+    _numBlocks = 0;
+    _blockSize = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool NeighborGrid::IsInitialized() const
+{
+    return !_cellStart.empty();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sorts the particles into their cells.  See the class description for the three steps.
+    Everything from the last build is thrown out.
+Parameters:
+    numParticles    Must not be more than Init(...) was given.
+    getCellIndices  Called once for each block with that block's particles.  Must be safe to
+                    call from more than one thread at once.
+    threadPool      May be 0 to sort on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::Build(unsigned int numParticles, const CellIndexFunction &getCellIndices,
+    ThreadPool *threadPool)
+{
+    if (numParticles == 0 || numParticles > _particleCells.size())
+    {
+        return;
+    }
+
+    // one block per thread
+    // Note: More blocks would let idle threads steal work, but every block is another row of
+    // counts for step (2) to go through.
+    unsigned int numThreads = (threadPool != 0) ? threadPool->NumThreads() : 1;
+    numThreads = (numThreads == 0) ? 1 : numThreads;
+    unsigned int numCells = _numCellsX * _numCellsY;
+    _blockSize = ((numParticles - 1) / numThreads) + 1;
+    _numBlocks = ((numParticles - 1) / _blockSize) + 1;
+    if (_blockCounts.size() < (size_t)_numBlocks * numCells)
+    {
+        _blockCounts.resize((size_t)_numBlocks * numCells);
+    }
+    unsigned int numCellChunks = ((numCells - 1) / CELLS_PER_CHUNK) + 1;
+    _cellChunkTotals.resize(numCellChunks);
+
+    // (1)
+    if (threadPool != 0)
+    {
+        threadPool->ParallelFor(numParticles, _blockSize,
+            [this, &getCellIndices](unsigned int beginIndex, unsigned int endIndex)
+        {
+            this->CountBlock(beginIndex / _blockSize, beginIndex, endIndex, getCellIndices);
+        });
+    }
+    else
+    {
+        this->CountBlock(0, 0, numParticles, getCellIndices);
+    }
+
+    // (2), split in two: add up each chunk of cells, then (after adding up the chunks) give
+    // each cell and block its start
+    if (threadPool != 0)
+    {
+        threadPool->ParallelFor(numCells, CELLS_PER_CHUNK,
+            [this](unsigned int beginCell, unsigned int endCell)
+        {
+            this->AddUpCells(beginCell, endCell);
+        });
+    }
+    else
+    {
+        for (unsigned int beginCell = 0; beginCell < numCells; beginCell += CELLS_PER_CHUNK)
+        {
+            this->AddUpCells(beginCell, std::min(beginCell + CELLS_PER_CHUNK, numCells));
+        }
+    }
+
+    unsigned int chunkStart = 0;
+    for (unsigned int chunkIndex = 0; chunkIndex < numCellChunks; chunkIndex++)
+    {
+        unsigned int chunkTotal = _cellChunkTotals[chunkIndex];
+        _cellChunkTotals[chunkIndex] = chunkStart;
+        chunkStart += chunkTotal;
+    }
+    _cellStart[numCells] = chunkStart;
+
+    if (threadPool != 0)
+    {
+        threadPool->ParallelFor(numCells, CELLS_PER_CHUNK,
+            [this](unsigned int beginCell, unsigned int endCell)
+        {
+            this->PlaceCells(beginCell, endCell,
+                _cellChunkTotals[beginCell / CELLS_PER_CHUNK]);
+        });
+    }
+    else
+    {
+        this->PlaceCells(0, numCells, 0);
+    }
+
+    // (3)
+    if (threadPool != 0)
+    {
+        threadPool->ParallelFor(numParticles, _blockSize,
+            [this](unsigned int beginIndex, unsigned int endIndex)
+        {
+            this->PlaceBlock(beginIndex / _blockSize, beginIndex, endIndex);
+        });
+    }
+    else
+    {
+        this->PlaceBlock(0, 0, numParticles);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives the particles in a cell.  They are in index order.
+Parameters:
+    cellX       Must be less than NumCellsX().
+    cellY       Must be less than NumCellsY().
+    begin       Gets a pointer to the first particle index in the cell.
+    end         Gets a pointer to one past the last.  The same as begin if the cell is empty.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::GetCellRange(unsigned int cellX, unsigned int cellY,
+    const unsigned int **begin, const unsigned int **end) const
+{
+    unsigned int cellIndex = (cellY * _numCellsX) + cellX;
+    *begin = _sortedParticles.data() + _cellStart[cellIndex];
+    *end = _sortedParticles.data() + _cellStart[cellIndex + 1];
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives the whole list of particle indices, sorted by cell.  The cells are in row order (all 
+    of the bottom row, then the next row up, and so on), so GetCellRange(...) for cell (X, Y) 
+    is a range of this list.
+Parameters: None
+Returns:
+    A pointer to NumIndexed() particle indices.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const unsigned int *NeighborGrid::GetSortedParticles() const
+{
+    return _sortedParticles.data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives where every cell starts in GetSortedParticles(), so that something that goes 
+    through a lot of cells in order can look up their ranges directly instead of calling 
+    GetCellRange(...) for each one.
+Parameters: None
+Returns:
+    A pointer to (NumCellsX() * NumCellsY()) + 1 starts.  The particles in cell C are 
+    [starts[C], starts[C + 1]).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const unsigned int *NeighborGrid::GetCellStarts() const
+{
+    return _cellStart.data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Simple getters for the layout that Init(...) picked.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int NeighborGrid::NumCellsX() const
+{
+    return _numCellsX;
+}
+
+unsigned int NeighborGrid::NumCellsY() const
+{
+    return _numCellsY;
+}
+
+float NeighborGrid::CellSize() const
+{
+    return _cellSize;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for how many particles the last Build(...) put in the grid.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int NeighborGrid::NumIndexed() const
+{
+    return _cellStart.empty() ? 0 : _cellStart.back();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (1) for one block: works out the cells of the block's particles and counts how many
+    land in each one.
+Parameters:
+    blockIndex      Which row of counts to fill in.
+    beginIndex      The block's first particle.
+    endIndex        One past its last particle.
+    getCellIndices  See Build(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::CountBlock(unsigned int blockIndex, unsigned int beginIndex,
+    unsigned int endIndex, const CellIndexFunction &getCellIndices)
+{
+    unsigned int numCells = _numCellsX * _numCellsY;
+    unsigned int *counts = _blockCounts.data() + ((size_t)blockIndex * numCells);
+    std::fill(counts, counts + numCells, 0);
+
+    unsigned int *cells = _particleCells.data();
+    getCellIndices(beginIndex, endIndex, cells + beginIndex);
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        unsigned int cellIndex = cells[particleIndex];
+        if (cellIndex != NO_CELL)
+        {
+            counts[cellIndex]++;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The first half of step (2): adds up every block's count for every cell in the range, which
+    is the whole range's total.  The range must be one chunk.
+Parameters:
+    beginCell   Self-explanatory.
+    endCell     One past the last cell.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::AddUpCells(unsigned int beginCell, unsigned int endCell)
+{
+    unsigned int numCells = _numCellsX * _numCellsY;
+    unsigned int total = 0;
+    for (unsigned int blockIndex = 0; blockIndex < _numBlocks; blockIndex++)
+    {
+        const unsigned int *counts = _blockCounts.data() + ((size_t)blockIndex * numCells);
+        for (unsigned int cellIndex = beginCell; cellIndex < endCell; cellIndex++)
+        {
+            total += counts[cellIndex];
+        }
+    }
+
+    _cellChunkTotals[beginCell / CELLS_PER_CHUNK] = total;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The second half of step (2): gives each cell in the range its start in the sorted list and
+    turns each block's count for that cell into where the block's first particle in that cell
+    goes.  Within a cell, block 0's particles go first, then block 1's, and so on.
+Parameters:
+    beginCell   Self-explanatory.
+    endCell     One past the last cell.
+    firstIndex  Where the range's first cell starts in the sorted list.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::PlaceCells(unsigned int beginCell, unsigned int endCell,
+    unsigned int firstIndex)
+{
+    unsigned int numCells = _numCellsX * _numCellsY;
+    unsigned int nextIndex = firstIndex;
+    for (unsigned int cellIndex = beginCell; cellIndex < endCell; cellIndex++)
+    {
+        _cellStart[cellIndex] = nextIndex;
+        for (unsigned int blockIndex = 0; blockIndex < _numBlocks; blockIndex++)
+        {
+            unsigned int &count = _blockCounts[((size_t)blockIndex * numCells) + cellIndex];
+            unsigned int blockStart = nextIndex;
+            nextIndex += count;
+            count = blockStart;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (3) for one block: copies each of the block's particle indices to the next spot in its
+    cell.
+Parameters:
+    blockIndex      Which row of starts to use.
+    beginIndex      The block's first particle.
+    endIndex        One past its last particle.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void NeighborGrid::PlaceBlock(unsigned int blockIndex, unsigned int beginIndex,
+    unsigned int endIndex)
+{
+    unsigned int numCells = _numCellsX * _numCellsY;
+    unsigned int *nextIndices = _blockCounts.data() + ((size_t)blockIndex * numCells);
+    const unsigned int *cells = _particleCells.data();
+    unsigned int *sortedParticles = _sortedParticles.data();
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        unsigned int cellIndex = cells[particleIndex];
+        if (cellIndex != NO_CELL)
+        {
+            sortedParticles[nextIndices[cellIndex]++] = particleIndex;
+        }
+    }
+}
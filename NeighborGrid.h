@@ -0,0 +1,117 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include "glm/vec2.hpp"
+
+#include <vector>
+#include <functional>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A uniform grid over the particles so that anything that needs a particle's neighbors only
+    has to look in the cells around it instead of at every other particle.  It is rebuilt from
+    scratch every step (see ParticleSimulatorCpu::SetNeighborGrid(...)) because the particles
+    move every step.
+
+    The grid doesn't move particles around.  It keeps a list of particle indices sorted by
+    cell, and each cell is a range in that list, so a cell's particles can be walked with
+    GetCellRange(...).  Inactive particles are left out.
+
+    Build(...) is a counting sort split across the thread pool:
+    (1) Each thread takes one block of particles, works out each particle's cell, and counts
+    how many of its particles land in each cell.
+    (2) The counts are added up, cell by cell and then block by block within each cell, to get
+    where each block's particles go in each cell.  This is split across the threads by cells.
+    (3) Each thread goes through its block again and copies each particle's index to its spot.
+    Every particle is looked at twice and nothing needs a lock or an atomic.  The blocks are in
+    order, so a cell's particles are always listed in index order no matter how many threads
+    there are.
+
+    Note: Nothing here knows what a particle looks like.  Whoever calls Build(...) works out
+    the cells (see GetCellIndex(...)).
+-----------------------------------------------------------------------------------------------*/
+class NeighborGrid
+{
+public:
+    // fills in cellIndices[0, endIndex - beginIndex) with the cells of the particles in the
+    // range [beginIndex, endIndex), or NO_CELL for a particle that shouldn't be in the grid
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        unsigned int *cellIndices)> CellIndexFunction;
+
+    static const unsigned int NO_CELL = 0xffffffff;
+
+    NeighborGrid();
+    void Init(const glm::vec2 &minCorner, const glm::vec2 &maxCorner, float cellSize,
+        unsigned int numParticles);
+    void Cleanup();
+    bool IsInitialized() const;
+    void Build(unsigned int numParticles, const CellIndexFunction &getCellIndices,
+        ThreadPool *threadPool);
+
+    unsigned int GetCellIndex(const glm::vec2 &position) const;
+    void GetCellRange(unsigned int cellX, unsigned int cellY, const unsigned int **begin,
+        const unsigned int **end) const;
+    const unsigned int *GetSortedParticles() const;
+    const unsigned int *GetCellStarts() const;
+    unsigned int NumCellsX() const;
+    unsigned int NumCellsY() const;
+    float CellSize() const;
+    unsigned int NumIndexed() const;
+
+private:
+    void CountBlock(unsigned int blockIndex, unsigned int beginIndex, unsigned int endIndex,
+        const CellIndexFunction &getCellIndices);
+    void AddUpCells(unsigned int beginCell, unsigned int endCell);
+    void PlaceCells(unsigned int beginCell, unsigned int endCell, unsigned int firstIndex);
+    void PlaceBlock(unsigned int blockIndex, unsigned int beginIndex, unsigned int endIndex);
+
+    glm::vec2 _minCorner;
+    float _cellSize;
+    float _inverseCellSize;
+    unsigned int _numCellsX;
+    unsigned int _numCellsY;
+
+    // the particles in cell C are _sortedParticles[_cellStart[C], _cellStart[C + 1])
+    std::vector<unsigned int> _cellStart;
+    std::vector<unsigned int> _sortedParticles;
+
+    // each particle's cell, from step (1) for step (3)
+    std::vector<unsigned int> _particleCells;
+
+    // one row of counts per block, so block B's count for cell C is
+    // _blockCounts[(B * numCells) + C]
+    // Note: Step (2) turns the counts into where the block's next particle in that cell goes.
+    std::vector<unsigned int> _blockCounts;
+    unsigned int _numBlocks;
+    unsigned int _blockSize;
+
+    // step (2)'s cells are split into chunks, and each chunk's total is added up before the
+    // chunk's cells can be given their starts
+    std::vector<unsigned int> _cellChunkTotals;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out which cell a position is in.  Anything off the edge of the grid is put in the
+    nearest cell on the edge.  This is in the header so that the callers' CellIndexFunctions
+    can inline it.
+Parameters:
+    position    In window coords.
+Returns:
+    The cell's index, which is (Y * NumCellsX()) + X.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline unsigned int NeighborGrid::GetCellIndex(const glm::vec2 &position) const
+{
+    // Note: Clamp as floats before converting so that a position far off the edge doesn't
+    // overflow the int.  The comparisons are written so that NaN ends up in cell 0.
+    float x = (position.x - _minCorner.x) * _inverseCellSize;
+    float y = (position.y - _minCorner.y) * _inverseCellSize;
+    float lastCellX = (float)(_numCellsX - 1);
+    float lastCellY = (float)(_numCellsY - 1);
+    x = (x > 0.0f) ? x : 0.0f;
+    y = (y > 0.0f) ? y : 0.0f;
+    unsigned int cellX = (unsigned int)(int)((x < lastCellX) ? x : lastCellX);
+    unsigned int cellY = (unsigned int)(int)((y < lastCellY) ? y : lastCellY);
+    return (cellY * _numCellsX) + cellX;
+}
@@ -0,0 +1,413 @@
+#include "ObstacleField.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// keeps a tiny cell size from asking for gigabytes of samples (16MB of floats)
+static const unsigned int MAX_OBSTACLE_SAMPLES = 2048 * 2048;
+
+// how the bake is cut up for the thread pool
+static const unsigned int ROWS_PER_CHUNK = 4;
+
+// a file line can be this long, which is enough for a polygon with a couple hundred corners
+static const unsigned int MAX_LINE_LENGTH = 4096;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out the signed distance from a point to one polygon: the distance to the nearest
+    edge, negative if the point is inside.  Inside is found by counting how many edges a ray
+    going right from the point crosses, so the corners may go either way around.
+Parameters:
+    corners     Self-explanatory.
+    numCorners  At least 3.
+    position    In window coords.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static float PolygonDistance(const glm::vec2 *corners, unsigned int numCorners,
+    const glm::vec2 &position)
+{
+    float minDistSqr = 3.402823466e+38f;
+    bool isInside = false;
+    for (unsigned int cornerIndex = 0, prevIndex = numCorners - 1; cornerIndex < numCorners;
+        prevIndex = cornerIndex++)
+    {
+        const glm::vec2 &a = corners[prevIndex];
+        const glm::vec2 &b = corners[cornerIndex];
+
+        // the nearest point on the edge
+        glm::vec2 edge = b - a;
+        glm::vec2 toPosition = position - a;
+        float edgeLengthSqr = glm::dot(edge, edge);
+        float along = (edgeLengthSqr > 0.0f) ? (glm::dot(toPosition, edge) / edgeLengthSqr) : 0.0f;
+        along = (along > 0.0f) ? ((along < 1.0f) ? along : 1.0f) : 0.0f;
+        glm::vec2 fromEdge = toPosition - (edge * along);
+        float distSqr = glm::dot(fromEdge, fromEdge);
+        minDistSqr = (distSqr < minDistSqr) ? distSqr : minDistSqr;
+
+        // Note: An edge counts if one end is above the point and the other isn't, which
+        // takes care of a ray that goes right through a corner.
+        if ((a.y > position.y) != (b.y > position.y))
+        {
+            float crossingX = a.x + ((position.y - a.y) * (edge.x / edge.y));
+            if (position.x < crossingX)
+            {
+                isInside = !isInside;
+            }
+        }
+    }
+
+    float distance = sqrtf(minDistSqr);
+    return isInside ? -distance : distance;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  There are no shapes until Load(...) or Add*(...), and
+    nothing is baked until Bake(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ObstacleField::ObstacleField() :
+    _header()
+{
+    _polygonStarts.push_back(0);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Reads shapes from a file (see the class description for the format) and adds them to the
+    ones that are already here.  The field has to be baked again afterwards.
+Parameters:
+    filePath    Self-explanatory.
+Returns:
+    False if the file couldn't be opened or a line couldn't be read, and then none of the
+    file's shapes are kept.  Otherwise true.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ObstacleField::Load(const char *filePath)
+{
+    FILE *obstacleFile = fopen(filePath, "r");
+    if (obstacleFile == 0)
+    {
+        printf("obstacle file: could not open '%s'\n", filePath);
+        return false;
+    }
+
+    // Note: Copies of the shapes so far, so that a bad line can put them back.
+    std::vector<glm::vec2> circleCenters = _circleCenters;
+    std::vector<float> circleRadii = _circleRadii;
+    std::vector<glm::vec2> polygonCorners = _polygonCorners;
+    std::vector<unsigned int> polygonStarts = _polygonStarts;
+
+    char line[MAX_LINE_LENGTH];
+    unsigned int lineNumber = 0;
+    bool isGood = true;
+    while (isGood && fgets(line, sizeof(line), obstacleFile) != 0)
+    {
+        lineNumber++;
+        char *comment = strchr(line, '#');
+        if (comment != 0)
+        {
+            *comment = 0;
+        }
+
+        // the shape's name and then every number after it
+        char shapeName[16] = { 0 };
+        int numNameChars = 0;
+        if (sscanf(line, " %15s%n", shapeName, &numNameChars) != 1)
+        {
+            // blank
+            continue;
+        }
+        std::vector<float> numbers;
+        const char *numberStart = line + numNameChars;
+        while (true)
+        {
+            char *numberEnd = 0;
+            float number = strtof(numberStart, &numberEnd);
+            if (numberEnd == numberStart)
+            {
+                break;
+            }
+            numbers.push_back(number);
+            numberStart = numberEnd;
+        }
+        while (isspace((unsigned char)*numberStart))
+        {
+            numberStart++;
+        }
+        bool isAllNumbers = (*numberStart == 0);
+
+        if (isAllNumbers && strcmp(shapeName, "circle") == 0 && numbers.size() == 3 &&
+            numbers[2] > 0.0f)
+        {
+            this->AddCircle(glm::vec2(numbers[0], numbers[1]), numbers[2]);
+        }
+        else if (isAllNumbers && strcmp(shapeName, "box") == 0 && numbers.size() == 4 &&
+            numbers[0] < numbers[2] && numbers[1] < numbers[3])
+        {
+            std::vector<glm::vec2> corners;
+            corners.push_back(glm::vec2(numbers[0], numbers[1]));
+            corners.push_back(glm::vec2(numbers[2], numbers[1]));
+            corners.push_back(glm::vec2(numbers[2], numbers[3]));
+            corners.push_back(glm::vec2(numbers[0], numbers[3]));
+            this->AddPolygon(corners);
+        }
+        else if (isAllNumbers && strcmp(shapeName, "polygon") == 0 && numbers.size() >= 6 &&
+            (numbers.size() % 2) == 0)
+        {
+            std::vector<glm::vec2> corners;
+            for (size_t numberIndex = 0; numberIndex < numbers.size(); numberIndex += 2)
+            {
+                corners.push_back(glm::vec2(numbers[numberIndex], numbers[numberIndex + 1]));
+            }
+            this->AddPolygon(corners);
+        }
+        else
+        {
+            printf("obstacle file: '%s' line %u is not a shape\n", filePath, lineNumber);
+            isGood = false;
+        }
+    }
+    fclose(obstacleFile);
+
+    if (!isGood)
+    {
+        _circleCenters.swap(circleCenters);
+        _circleRadii.swap(circleRadii);
+        _polygonCorners.swap(polygonCorners);
+        _polygonStarts.swap(polygonStarts);
+    }
+    return isGood;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.  The field has to be baked again afterwards.
+Parameters:
+    center      In window coords.
+    radius      In window coords.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ObstacleField::AddCircle(const glm::vec2 &center, float radius)
+{
+    _circleCenters.push_back(center);
+    _circleRadii.push_back(radius);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.  The field has to be baked again afterwards.
+Parameters:
+    corners     In window coords.  At least 3, in either order.  The last one is joined back
+                to the first.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ObstacleField::AddPolygon(const std::vector<glm::vec2> &corners)
+{
+    if (corners.size() < 3)
+    {
+        return;
+    }
+    _polygonCorners.insert(_polygonCorners.end(), corners.begin(), corners.end());
+    _polygonStarts.push_back(_polygonCorners.size());
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out the signed distance to the shapes at every sample of a grid over the given
+    rectangle.  Every sample looks at every shape, so this is slow for lots of complicated
+    shapes, but it is only done once.  The rows are split across the thread pool.
+Parameters:
+    minCorner   The bottom left of the area that the particles can be in, in window coords.
+    maxCorner   The top right.
+    cellSize    How far apart the samples are in window coords.  If that would make more than
+                MAX_OBSTACLE_SAMPLES samples, then they are spread out further.
+    threadPool  May be 0 to bake on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ObstacleField::Bake(const glm::vec2 &minCorner, const glm::vec2 &maxCorner, float cellSize,
+    ThreadPool *threadPool)
+{
+    // Note: There is a sample on each edge, so N cells across is N + 1 samples.
+    glm::vec2 size = maxCorner - minCorner;
+    unsigned int numSamplesX = 0;
+    unsigned int numSamplesY = 0;
+    while (true)
+    {
+        numSamplesX = (unsigned int)ceilf(size.x / cellSize) + 1;
+        numSamplesY = (unsigned int)ceilf(size.y / cellSize) + 1;
+        numSamplesX = (numSamplesX < 2) ? 2 : numSamplesX;
+        numSamplesY = (numSamplesY < 2) ? 2 : numSamplesY;
+        double numSamples = (double)numSamplesX * numSamplesY;
+        if (numSamples <= MAX_OBSTACLE_SAMPLES)
+        {
+            break;
+        }
+
+        // a little more than needed so that rounding up doesn't go around again
+        cellSize *= (float)sqrt(numSamples / MAX_OBSTACLE_SAMPLES) * 1.01f;
+    }
+
+    _header = ObstacleFieldHeader();
+    _header._minCorner = minCorner;
+    _header._cellSize = cellSize;
+    _header._inverseCellSize = 1.0f / cellSize;
+    _header._numSamplesX = numSamplesX;
+    _header._numSamplesY = numSamplesY;
+    _samples.resize(numSamplesX * numSamplesY);
+
+    ThreadPool::ParallelFor(threadPool, numSamplesY, ROWS_PER_CHUNK,
+        [this](unsigned int beginRow, unsigned int endRow)
+    {
+        this->BakeRows(beginRow, endRow);
+    });
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Throws out the shapes and the samples.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ObstacleField::Cleanup()
+{
+    _circleCenters.clear();
+    _circleRadii.clear();
+    _polygonCorners.clear();
+    _polygonStarts.assign(1, 0);
+    _header = ObstacleFieldHeader();
+    _samples.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Bake(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ObstacleField::IsBaked() const
+{
+    return !_samples.empty();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    How many circles and polygons (including boxes) there are.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ObstacleField::NumShapes() const
+{
+    return _circleCenters.size() + (_polygonStarts.size() - 1);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out the signed distance to the nearest shape the slow way, by looking at every one.
+    This is what Bake(...) stores at each sample, and it is handy for checking how far off the
+    baked field is between samples.
+Parameters:
+    position    In window coords.
+Returns:
+    The distance in window coords.  Negative if inside a shape.  If there aren't any shapes,
+    then it is the largest float.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+float ObstacleField::GetExactDistance(const glm::vec2 &position) const
+{
+    // Note: The obstacle is all of the shapes together, so the distance to it is the smallest
+    // of the distances to each shape, and it is negative if any of them is.
+    float minDistance = 3.402823466e+38f;
+    for (size_t circleIndex = 0; circleIndex < _circleCenters.size(); circleIndex++)
+    {
+        glm::vec2 fromCenter = position - _circleCenters[circleIndex];
+        float distance = sqrtf(glm::dot(fromCenter, fromCenter)) - _circleRadii[circleIndex];
+        minDistance = (distance < minDistance) ? distance : minDistance;
+    }
+    for (size_t polygonIndex = 0; polygonIndex + 1 < _polygonStarts.size(); polygonIndex++)
+    {
+        unsigned int firstCorner = _polygonStarts[polygonIndex];
+        unsigned int numCorners = _polygonStarts[polygonIndex + 1] - firstCorner;
+        float distance = PolygonDistance(&_polygonCorners[firstCorner], numCorners, position);
+        minDistance = (distance < minDistance) ? distance : minDistance;
+    }
+    return minDistance;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    See ObstacleFieldHeader.  All 0 until Bake(...).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const ObstacleFieldHeader &ObstacleField::GetHeader() const
+{
+    return _header;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    The baked distances, in the order that ObstacleFieldHeader describes.  0 until Bake(...).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const float *ObstacleField::GetSamples() const
+{
+    return _samples.empty() ? 0 : _samples.data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    _numSamplesX * _numSamplesY, or 0 until Bake(...).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ObstacleField::NumSamples() const
+{
+    return _samples.size();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Bakes rows [beginRow, endRow) of samples.  Rows don't share anything, so any number of
+    these can run at once.
+Parameters:
+    beginRow    Self-explanatory.
+    endRow      Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ObstacleField::BakeRows(unsigned int beginRow, unsigned int endRow)
+{
+    for (unsigned int row = beginRow; row < endRow; row++)
+    {
+        float *rowSamples = &_samples[row * _header._numSamplesX];
+        for (unsigned int column = 0; column < _header._numSamplesX; column++)
+        {
+            glm::vec2 position = _header._minCorner +
+                (glm::vec2((float)column, (float)row) * _header._cellSize);
+            rowSamples[column] = this->GetExactDistance(position);
+        }
+    }
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include "glm/vec2.hpp"
+#include "glm/detail/func_geometric.hpp"    // glm::dot
+
+#include <math.h>
+#include <vector>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The part of the baked obstacle field that the update needs to find a sample, followed in
+    memory (and in the shader storage buffer) by the samples themselves.
+
+    _minCorner      Window coords.  Where sample (0, 0) is.
+    _cellSize       Window coords.  How far apart the samples are.
+    _inverseCellSize    Because only the inverse is used during update.
+    _numSamplesX    Samples go left to right and then bottom to top, so sample (X, Y) is
+    _numSamplesY    number (Y * _numSamplesX) + X.  There are always at least 2 each way.
+
+    Note: The header goes into a shader storage buffer just ahead of the samples, so the
+    structure has to match "struct ObstacleFieldHeader" in the update shaders, which use the
+    std430 layout.  The vec2 comes first so that it is on an 8 byte boundary, and the size (32
+    bytes) is a multiple of 8.
+-----------------------------------------------------------------------------------------------*/
+struct ObstacleFieldHeader
+{
+    glm::vec2 _minCorner;
+    float _cellSize;
+    float _inverseCellSize;
+    unsigned int _numSamplesX;
+    unsigned int _numSamplesY;
+    unsigned int _padding[2];
+};
+
+// the shader storage binding of the obstacle field (see ParticleSimulatorGpu for the others)
+static const unsigned int OBSTACLE_FIELD_BUFFER_BINDING = 8;
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Static obstacles for the particles to bounce off of.  The shapes (circles and polygons) are
+    loaded from a text file or added one at a time, and then Bake(...) works out the "signed
+    distance" to the nearest edge of any shape at every point of a grid: positive outside the
+    shapes, negative inside, and 0 right on an edge.  After that, the shapes don't matter.  A
+    particle only looks up the 4 samples around it (see SampleObstacleField(...)), so having
+    more or more complicated obstacles doesn't make the update any slower.  See
+    ParticleSimulator::SetObstacles(...).
+
+    The file has one shape per line, in window coords:
+        circle <center X> <center Y> <radius>
+        box <min X> <min Y> <max X> <max Y>
+        polygon <X 0> <Y 0> <X 1> <Y 1> <X 2> <Y 2> ...
+    A polygon needs at least 3 corners, in either order, and is closed back to the first one.
+    Its edges shouldn't cross.  Blank lines and anything after a '#' are ignored.  Shapes may
+    overlap, and the obstacle is everything that is inside any of them.
+
+    Note: The samples are a straight line between neighbors, so a corner that is sharper than a
+    couple of cells gets rounded off, and anything thinner than a cell may have particles slip
+    through it.
+-----------------------------------------------------------------------------------------------*/
+class ObstacleField
+{
+public:
+    ObstacleField();
+    bool Load(const char *filePath);
+    void AddCircle(const glm::vec2 &center, float radius);
+    void AddPolygon(const std::vector<glm::vec2> &corners);
+    void Bake(const glm::vec2 &minCorner, const glm::vec2 &maxCorner, float cellSize,
+        ThreadPool *threadPool);
+    void Cleanup();
+    bool IsBaked() const;
+    unsigned int NumShapes() const;
+    float GetExactDistance(const glm::vec2 &position) const;
+    const ObstacleFieldHeader &GetHeader() const;
+    const float *GetSamples() const;
+    unsigned int NumSamples() const;
+
+private:
+    void BakeRows(unsigned int beginRow, unsigned int endRow);
+
+    std::vector<glm::vec2> _circleCenters;
+    std::vector<float> _circleRadii;
+
+    // polygon P's corners are _polygonCorners[_polygonStarts[P], _polygonStarts[P + 1])
+    std::vector<glm::vec2> _polygonCorners;
+    std::vector<unsigned int> _polygonStarts;
+
+    // empty until Bake(...)
+    ObstacleFieldHeader _header;
+    std::vector<float> _samples;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Looks up the signed distance to the obstacles at a position by blending the 4 samples
+    around it, along with which way the distance grows the fastest (the way out of an
+    obstacle).  Anything off the edge of the grid uses the nearest point on the edge.  This is
+    in the header so that the CPU kernels can inline it.
+
+    Note: Must match ObstacleDistance(...) in the update shaders.
+Parameters:
+    header      See ObstacleFieldHeader.
+    samples     Self-explanatory.
+    position    In window coords.
+    gradient    Gets how fast the distance changes along X and Y.  Not normalized.  May be 0
+                if only the distance is needed.
+Returns:
+    The distance in window coords.  Negative if inside an obstacle.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline float SampleObstacleField(const ObstacleFieldHeader &header, const float *samples,
+    const glm::vec2 &position, glm::vec2 *gradient)
+{
+    // Note: Like NeighborGrid::GetCellIndex(...), clamp as floats so that a position far off
+    // the edge doesn't overflow the int.  The last cell starts one sample before the edge.
+    float x = (position.x - header._minCorner.x) * header._inverseCellSize;
+    float y = (position.y - header._minCorner.y) * header._inverseCellSize;
+    float lastX = (float)(header._numSamplesX - 1);
+    float lastY = (float)(header._numSamplesY - 1);
+    x = (x > 0.0f) ? ((x < lastX) ? x : lastX) : 0.0f;
+    y = (y > 0.0f) ? ((y < lastY) ? y : lastY) : 0.0f;
+    unsigned int cellX = (unsigned int)(int)x;
+    unsigned int cellY = (unsigned int)(int)y;
+    cellX = (cellX < header._numSamplesX - 2) ? cellX : (header._numSamplesX - 2);
+    cellY = (cellY < header._numSamplesY - 2) ? cellY : (header._numSamplesY - 2);
+    float fractionX = x - (float)cellX;
+    float fractionY = y - (float)cellY;
+
+    const float *bottomRow = samples + (cellY * header._numSamplesX) + cellX;
+    const float *topRow = bottomRow + header._numSamplesX;
+    float bottomSlope = bottomRow[1] - bottomRow[0];
+    float topSlope = topRow[1] - topRow[0];
+    float bottom = bottomRow[0] + (fractionX * bottomSlope);
+    float top = topRow[0] + (fractionX * topSlope);
+    if (gradient != 0)
+    {
+        gradient->x = (bottomSlope + (fractionY * (topSlope - bottomSlope))) *
+            header._inverseCellSize;
+        gradient->y = (top - bottom) * header._inverseCellSize;
+    }
+    return bottom + (fractionY * (top - bottom));
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    If the particle has gone into an obstacle, then this pushes it back out to the edge along
+    the way out and, if it is still moving inwards, bounces it off of the edge (the part of its
+    velocity that points into the obstacle is flipped).  Otherwise the particle is left alone.
+    This is in the header so that the CPU kernels can inline it.
+
+    Note: Must match CollideWithObstacles(...) in the update shaders.
+Parameters:
+    header      See ObstacleFieldHeader.
+    samples     Self-explanatory.
+    position    In window coords.  Changed if the particle was inside.
+    velocity    In window coords.  Changed if the particle bounced.
+Returns:
+    True if the particle was inside an obstacle, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline bool CollideWithObstacles(const ObstacleFieldHeader &header, const float *samples,
+    glm::vec2 *position, glm::vec2 *velocity)
+{
+    // Note: Nearly every particle is outside of every obstacle, so the gradient is only worked
+    // out for the few that aren't.  Going through the 4 samples again for those is cheaper
+    // than working it out for all of them.
+    if (SampleObstacleField(header, samples, *position, 0) >= 0.0f)
+    {
+        return false;
+    }
+
+    // Note: Deep inside an obstacle, the samples around a particle can all be the same
+    // distance (ex: the middle of a circle), and then there is no way out to push it along.
+    glm::vec2 gradient;
+    float distance = SampleObstacleField(header, samples, *position, &gradient);
+    float gradientLengthSqr = glm::dot(gradient, gradient);
+    if (gradientLengthSqr <= 0.0f)
+    {
+        return false;
+    }
+
+    glm::vec2 normal = gradient * (1.0f / sqrtf(gradientLengthSqr));
+    *position -= normal * distance;
+    float normalSpeed = glm::dot(*velocity, normal);
+    if (normalSpeed < 0.0f)
+    {
+        *velocity -= normal * (2.0f * normalSpeed);
+    }
+    return true;
+}
@@ -23,5 +23,9 @@ struct Particle
     // Note: Booleans cannot be uploaded to the shader 
     // (https://www.opengl.org/sdk/docs/man/html/glVertexAttribPointer.xhtml), so send the 
     // "is active" flag as an integer.  It is understood 
-    int _isActive; float iBuffer[3];
+    int _isActive; 
+    
+    // which emitter in the manager's table the particle belongs to (see ParticleEmitter.h)
+    // Note: This used to be padding, so the structure is still 48 bytes.
+    int _emitterIndex; float iBuffer[2];
 };
@@ -0,0 +1,1981 @@
+#include "ParticleBenchmark.h"
+
+#include "GravityTree.h"
+#include "NeighborGrid.h"
+#include "ObstacleField.h"
+#include "ParticleCollider.h"
+#include "ParticleFluid.h"
+#include "ParticleManager.h"
+#include "ParticleMeshGravity.h"
+#include "ParticlePacked.h"
+#include "ParticleReorder.h"
+#include "ParticleSimulatorCpu.h"
+#include "ParticleStorageSoa.h"
+#include "ParticleUpdateKernels.h"
+#include "ThreadPool.h"
+#include "TurbulenceField.h"
+#include "RandomToast.h"
+#include "glm/common.hpp"   // glm::max
+#include "glm/detail/func_geometric.hpp"    // glm::dot
+#include "glm/packing.hpp"  // glm::unpackSnorm2x16
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// same scenario as main.cpp's Init(), except for the emission quota (see TimeStorage(...))
+static const glm::vec2 BENCHMARK_CENTER = glm::vec2(+0.3f, +0.3f);
+static const float BENCHMARK_RADIUS = 1.1f;
+static const float BENCHMARK_MIN_VELOCITY = 0.05f;
+static const float BENCHMARK_MAX_VELOCITY = 0.6f;
+static const float BENCHMARK_DELTA_TIME_SEC = 0.01f;
+
+// main.cpp's emission quota, for when most of the particles should be waiting for it
+static const unsigned int BENCHMARK_MAIN_QUOTA = 200;
+
+// main.cpp's window is 500 pixels across the [-1,+1] window space
+static const float BENCHMARK_PIXELS_PER_UNIT = 250.0f;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sets up a headless particle manager with a CPU simulator using the requested storage, 
+    particle format, and instruction set, runs
+    it for the requested number of frames, and reports the time per particle and the effective
+    memory bandwidth.
+
+    The manager is local so that its particle collection is freed before the next run.  At 50
+    million particles, the collection alone is 2.4GB.
+
+    Note: The emission quota is the whole particle count so that every particle is emitted 
+    during the untimed frame.  With main.cpp's 200 per frame, nearly every particle would still 
+    be waiting to be emitted and the timing would be of skipping them.
+Parameters:
+    storage         See ParticleSimulatorCpu::StorageType.  Ignored if packedFormat is true.
+    packedFormat    See ParticleManager::SetPackedFormat(...).
+    simdLevel       The fastest instruction set that the update kernel may use.
+    name            For the printout.
+    numParticles    Self-explanatory.
+    numFrames       Self-explanatory.
+    bytesStored     How many bytes the simulator keeps for each particle.
+    bytesMoved      How many bytes go between the cache and memory for each particle in each
+                    update.
+    threadPool      May be 0 for a single-threaded update.
+    forceFields     May be empty.
+Returns:
+    The average time to update one particle, in nanoseconds.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static double TimeStorage(ParticleSimulatorCpu::StorageType storage, bool packedFormat,
+    SimdLevel simdLevel, const char *name, unsigned int numParticles, unsigned int numFrames, 
+    unsigned int bytesStored, unsigned int bytesMoved, ThreadPool *threadPool, 
+    const std::vector<ForceField> &forceFields)
+{
+    ParticleSimulatorCpu simulator;
+    simulator.SetStorage(storage);
+    simulator.SetSimdLevel(simdLevel);
+    simulator.SetThreadPool(threadPool);
+    ParticleManager particleManager;
+    particleManager.SetPackedFormat(packedFormat);
+    particleManager.Init(0, &simulator, numParticles, numParticles,
+        BENCHMARK_CENTER, BENCHMARK_RADIUS, BENCHMARK_MIN_VELOCITY, BENCHMARK_MAX_VELOCITY);
+    simulator.SetForceFields(forceFields);
+
+    // one untimed frame to get the pages faulted in and the caches warm
+    particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+    {
+        particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+    }
+    std::chrono::high_resolution_clock::time_point end =
+        std::chrono::high_resolution_clock::now();
+    particleManager.Cleanup();
+
+    double elapsedNs = std::chrono::duration<double, std::nano>(end - start).count();
+    double particleUpdates = (double)numParticles * numFrames;
+    double nsPerParticle = elapsedNs / particleUpdates;
+
+    // bytes per nanosecond is the same thing as gigabytes per second
+    double gigabytesPerSec = (particleUpdates * bytesMoved) / elapsedNs;
+    printf("    %-12s %8.3f ns/particle  %3u bytes/particle stored  %3u bytes/particle moved  %6.2f GB/s\n",
+        name, nsPerParticle, bytesStored, bytesMoved, gigabytesPerSec);
+
+    return nsPerParticle;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Compares the CPU simulator's "array of structures" storage (the Particle collection that
+    gets uploaded to the GPU) against its "structure of arrays" storage and against the 
+    manager's compact ParticlePacked format, each with every instruction set that this CPU 
+    supports.
+
+    "Bytes moved" is what the update has to bring in from memory and write back out.  The
+    Particle structure shares its cache lines with nothing but itself, so the whole 48 bytes
+    is read and, since the position changed, the whole 48 bytes is written back.  The SoA
+    update reads X and Y position and velocity (16 bytes) and writes back the position (8
+    bytes).  It also reads the "is active" flags (4 bytes) to find the particles that are 
+    waiting to be emitted, but only writes them back for a group of particles where one of 
+    them changed, which is rare enough to leave out.  The packed update reads and writes the 
+    whole 12 byte structure.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many updates to time.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunStorageBenchmark(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("storage benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    unsigned int aosBytesStored = sizeof(Particle);
+    unsigned int aosBytesMoved = sizeof(Particle) * 2;
+    unsigned int soaBytesStored = (sizeof(float) * 4) + sizeof(int);
+    unsigned int soaBytesMoved = (sizeof(float) * 4) + sizeof(int) + (sizeof(float) * 2);
+    unsigned int packedBytesStored = sizeof(ParticlePacked);
+    unsigned int packedBytesMoved = sizeof(ParticlePacked) * 2;
+    SimdLevel maxSimdLevel = DetectSimdLevel();
+
+    for (int level = SIMD_LEVEL_SCALAR; level <= maxSimdLevel; level++)
+    {
+        SimdLevel simdLevel = (SimdLevel)level;
+        char name[32];
+        snprintf(name, sizeof(name), "AoS %s", SimdLevelName(simdLevel));
+        TimeStorage(ParticleSimulatorCpu::STORAGE_AOS, false, simdLevel, name, numParticles, 
+            numFrames, aosBytesStored, aosBytesMoved, 0, std::vector<ForceField>());
+    }
+
+    for (int level = SIMD_LEVEL_SCALAR; level <= maxSimdLevel; level++)
+    {
+        SimdLevel simdLevel = (SimdLevel)level;
+        char name[32];
+        snprintf(name, sizeof(name), "SoA %s", SimdLevelName(simdLevel));
+        TimeStorage(ParticleSimulatorCpu::STORAGE_SOA, false, simdLevel, name, numParticles, 
+            numFrames, soaBytesStored, soaBytesMoved, 0, std::vector<ForceField>());
+    }
+
+    // there is no packed kernel past SSE2 (see GetPackedUpdateKernel(...))
+    SimdLevel maxPackedSimdLevel = 
+        (maxSimdLevel > SIMD_LEVEL_SSE2) ? SIMD_LEVEL_SSE2 : maxSimdLevel;
+    for (int level = SIMD_LEVEL_SCALAR; level <= maxPackedSimdLevel; level++)
+    {
+        SimdLevel simdLevel = (SimdLevel)level;
+        char name[32];
+        snprintf(name, sizeof(name), "Packed %s", SimdLevelName(simdLevel));
+        TimeStorage(ParticleSimulatorCpu::STORAGE_AOS, true, simdLevel, name, numParticles, 
+            numFrames, packedBytesStored, packedBytesMoved, 0, std::vector<ForceField>());
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times the "structure of arrays" update on 1 thread, then doubles the thread count until it 
+    reaches the maximum, and reports the speedup over 1 thread for each.  Ideally the speedup 
+    matches the thread count until memory bandwidth runs out.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many updates to time for each thread count.
+    maxThreads      0 means one for each logical processor.
+    pinThreads      See ThreadPool::Init(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunThreadingBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads)
+{
+    if (maxThreads == 0)
+    {
+        maxThreads = std::thread::hardware_concurrency();
+        maxThreads = (maxThreads == 0) ? 1 : maxThreads;
+    }
+
+    printf("threading benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    unsigned int bytesStored = (sizeof(float) * 4) + sizeof(int);
+    unsigned int bytesMoved = (sizeof(float) * 4) + sizeof(int) + (sizeof(float) * 2);
+    double singleThreadNs = 0.0;
+    unsigned int numThreads = 1;
+    while (true)
+    {
+        ThreadPool threadPool;
+        threadPool.Init(numThreads, pinThreads);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%u threads", numThreads);
+        double nsPerParticle = TimeStorage(ParticleSimulatorCpu::STORAGE_SOA, 
+            false, DetectSimdLevel(), name, numParticles, numFrames, bytesStored, bytesMoved, 
+            &threadPool, std::vector<ForceField>());
+        if (numThreads == 1)
+        {
+            singleThreadNs = nsPerParticle;
+        }
+        printf("    %-12s speedup %.2fx\n", "", singleThreadNs / nsPerParticle);
+
+        if (numThreads == maxThreads)
+        {
+            break;
+        }
+        numThreads = (numThreads * 2 > maxThreads) ? maxThreads : (numThreads * 2);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Makes a force field table for the benchmark that goes through the four kinds of fields in 
+    turn, so that a longer table has about as many of each.  The points are spread around the 
+    benchmark's circle so that no two are on top of each other.
+Parameters:
+    numForceFields  Self-explanatory.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static std::vector<ForceField> MakeBenchmarkForceFields(unsigned int numForceFields)
+{
+    std::vector<ForceField> forceFields(numForceFields, ForceField());
+    for (unsigned int fieldIndex = 0; fieldIndex < numForceFields; fieldIndex++)
+    {
+        ForceField &field = forceFields[fieldIndex];
+        float angle = fieldIndex * 2.3999632f;  // the golden angle
+        field._position = BENCHMARK_CENTER + 
+            (glm::vec2(cosf(angle), sinf(angle)) * (BENCHMARK_RADIUS * 0.5f));
+        field._direction = glm::vec2(0.0f, -1.0f);
+        field._radius = 0.1f;
+        field._type = fieldIndex % 4;
+        field._strength = (field._type == FORCE_FIELD_DRAG) ? 0.2f : 0.05f;
+    }
+    return forceFields;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times each storage option with its fastest instruction set, first without any force fields 
+    and then with more and more of them, and reports what each field costs.  The cost is the 
+    extra time over no fields divided by the number of fields, in milliseconds per step for 
+    every million particles (which happens to be the same number as nanoseconds per particle).
+
+    Note: With force fields, the particles that are sent back out get new velocities too (see 
+    ParticleSimulatorCpu), so even the first field costs a little more than the rest.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many updates to time for each table.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunForceFieldBenchmark(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("force field benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    SimdLevel simdLevel = DetectSimdLevel();
+    static const unsigned int FIELD_COUNTS[] = { 0, 1, 2, 4, 8, 16 };
+    static const unsigned int NUM_FIELD_COUNTS = sizeof(FIELD_COUNTS) / sizeof(FIELD_COUNTS[0]);
+    for (int storageIndex = 0; storageIndex < 3; storageIndex++)
+    {
+        // the same 3 as RunStorageBenchmark(...)
+        ParticleSimulatorCpu::StorageType storage = (storageIndex == 1) ? 
+            ParticleSimulatorCpu::STORAGE_SOA : ParticleSimulatorCpu::STORAGE_AOS;
+        bool packedFormat = (storageIndex == 2);
+        const char *storageName = (storageIndex == 0) ? "AoS" : 
+            ((storageIndex == 1) ? "SoA" : "Packed");
+        unsigned int bytesStored = sizeof(Particle);
+        unsigned int bytesMoved = sizeof(Particle) * 2;
+        if (storageIndex == 1)
+        {
+            // with fields, the velocities are written back too
+            bytesStored = (sizeof(float) * 4) + sizeof(int);
+            bytesMoved = (sizeof(float) * 4) + sizeof(int) + (sizeof(float) * 4);
+        }
+        else if (storageIndex == 2)
+        {
+            bytesStored = sizeof(ParticlePacked);
+            bytesMoved = sizeof(ParticlePacked) * 2;
+        }
+
+        double noFieldsNs = 0.0;
+        for (unsigned int countIndex = 0; countIndex < NUM_FIELD_COUNTS; countIndex++)
+        {
+            unsigned int numForceFields = FIELD_COUNTS[countIndex];
+            unsigned int bytesMovedNow = bytesMoved;
+            if (storageIndex == 1 && numForceFields == 0)
+            {
+                bytesMovedNow = (sizeof(float) * 4) + sizeof(int) + (sizeof(float) * 2);
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "%s %u", storageName, numForceFields);
+            double nsPerParticle = TimeStorage(storage, packedFormat, simdLevel, name, 
+                numParticles, numFrames, bytesStored, bytesMovedNow, 0, 
+                MakeBenchmarkForceFields(numForceFields));
+            if (numForceFields == 0)
+            {
+                noFieldsNs = nsPerParticle;
+            }
+            else
+            {
+                printf("    %-12s %8.3f ms/step per field per million particles\n", "", 
+                    (nsPerParticle - noFieldsNs) / numForceFields);
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times rebuilding the neighbor grid (see NeighborGrid.h) on 1 thread, then doubles the 
+    thread count until it reaches the maximum, for a coarse grid (hundreds of particles per 
+    cell) and a fine one (a million cells).  Only the build is timed, not the update.
+
+    The particles are spread evenly over the benchmark's circle, and they are kept in 
+    "structure of arrays" storage like the threading benchmark uses.  Every 10th one is 
+    inactive so that leaving them out is part of the timing.
+
+    "Bytes moved" is reading the positions and flags, writing each particle's cell and reading 
+    it back, and writing each index into the sorted list.  The block counts are left out 
+    because they mostly stay in the cache.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many builds to time for each thread count.
+    maxThreads      0 means one for each logical processor.
+    pinThreads      See ThreadPool::Init(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunNeighborGridBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads)
+{
+    if (maxThreads == 0)
+    {
+        maxThreads = std::thread::hardware_concurrency();
+        maxThreads = (maxThreads == 0) ? 1 : maxThreads;
+    }
+
+    printf("neighbor grid benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    ParticleStorageSoa particles;
+    particles.Resize(numParticles);
+    RandomContext random;
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        // evenly spread over the circle's area (hence the square root)
+        float angle = random.OnRange0to1() * 6.2831853f;
+        float distance = sqrtf(random.OnRange0to1()) * BENCHMARK_RADIUS;
+        particles._positionX[particleIndex] = BENCHMARK_CENTER.x + (cosf(angle) * distance);
+        particles._positionY[particleIndex] = BENCHMARK_CENTER.y + (sinf(angle) * distance);
+        particles._isActive[particleIndex] = ((particleIndex % 10) != 9) ? 1 : 0;
+    }
+
+    NeighborGrid grid;
+    NeighborGrid::CellIndexFunction getCellIndices = [&grid, &particles](
+        unsigned int beginIndex, unsigned int endIndex, unsigned int *cellIndices)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            unsigned int cellIndex = NeighborGrid::NO_CELL;
+            if (particles._isActive[particleIndex] != 0)
+            {
+                cellIndex = grid.GetCellIndex(glm::vec2(particles._positionX[particleIndex], 
+                    particles._positionY[particleIndex]));
+            }
+            *cellIndices++ = cellIndex;
+        }
+    };
+
+    unsigned int bytesMoved = (sizeof(float) * 2) + sizeof(int) + (sizeof(unsigned int) * 3);
+    static const float CELL_SIZES_IN_RADII[] = { 1.0f / 64.0f, 1.0f / 512.0f };
+    for (int sizeIndex = 0; sizeIndex < 2; sizeIndex++)
+    {
+        glm::vec2 corner = glm::vec2(BENCHMARK_RADIUS, BENCHMARK_RADIUS);
+        grid.Init(BENCHMARK_CENTER - corner, BENCHMARK_CENTER + corner, 
+            BENCHMARK_RADIUS * CELL_SIZES_IN_RADII[sizeIndex], numParticles);
+        unsigned int numCells = grid.NumCellsX() * grid.NumCellsY();
+        printf("    %u x %u cells, %.1f particles per cell\n", grid.NumCellsX(), 
+            grid.NumCellsY(), (double)numParticles / numCells);
+
+        double singleThreadMs = 0.0;
+        unsigned int numThreads = 1;
+        while (true)
+        {
+            ThreadPool threadPool;
+            threadPool.Init(numThreads, pinThreads);
+
+            // one untimed build to get the pages faulted in
+            grid.Build(numParticles, getCellIndices, &threadPool);
+
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+            {
+                grid.Build(numParticles, getCellIndices, &threadPool);
+            }
+            std::chrono::high_resolution_clock::time_point end =
+                std::chrono::high_resolution_clock::now();
+
+            double msPerBuild = 
+                std::chrono::duration<double, std::milli>(end - start).count() / numFrames;
+            if (numThreads == 1)
+            {
+                singleThreadMs = msPerBuild;
+            }
+
+            // bytes per nanosecond is the same thing as gigabytes per second
+            double gigabytesPerSec = ((double)numParticles * bytesMoved) / (msPerBuild * 1000000.0);
+            char name[32];
+            snprintf(name, sizeof(name), "%u threads", numThreads);
+            printf("    %-12s %8.3f ms/build  %8.3f ns/particle  %6.2f GB/s  speedup %.2fx  %u indexed\n",
+                name, msPerBuild, (msPerBuild * 1000000.0) / numParticles, gigabytesPerSec, 
+                singleThreadMs / msPerBuild, grid.NumIndexed());
+
+            if (numThreads == maxThreads)
+            {
+                break;
+            }
+            numThreads = (numThreads * 2 > maxThreads) ? maxThreads : (numThreads * 2);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times a whole gravity step, split into sorting the particles (building the tree) and 
+    working out the accelerations, on 1 thread, then doubles the thread count until it 
+    reaches the maximum.  This is done for the tree (see GravityTree.h) at a few opening 
+    angles and then for the particle-mesh (see ParticleMeshGravity.h) at a few sizes.  Only 
+    the gravity is timed, not the update.
+
+    The particles are set up the same way as for the neighbor grid benchmark.  For each 
+    setting, the error is measured against adding up every pull exactly for a sample of 
+    the particles.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many steps to time for each thread count.
+    maxThreads      0 means one for each logical processor.
+    pinThreads      See ThreadPool::Init(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunGravityBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads)
+{
+    if (maxThreads == 0)
+    {
+        maxThreads = std::thread::hardware_concurrency();
+        maxThreads = (maxThreads == 0) ? 1 : maxThreads;
+    }
+
+    printf("gravity benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    ParticleStorageSoa particles;
+    particles.Resize(numParticles);
+    RandomContext random;
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        float angle = random.OnRange0to1() * 6.2831853f;
+        float distance = sqrtf(random.OnRange0to1()) * BENCHMARK_RADIUS;
+        particles._positionX[particleIndex] = BENCHMARK_CENTER.x + (cosf(angle) * distance);
+        particles._positionY[particleIndex] = BENCHMARK_CENTER.y + (sinf(angle) * distance);
+        particles._isActive[particleIndex] = ((particleIndex % 10) != 9) ? 1 : 0;
+    }
+
+    GravityTree::PositionFunction getPositions = [&particles](unsigned int beginIndex, 
+        unsigned int endIndex, glm::vec2 *positions, unsigned char *isActive)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            *positions++ = glm::vec2(particles._positionX[particleIndex], 
+                particles._positionY[particleIndex]);
+            *isActive++ = (particles._isActive[particleIndex] != 0) ? 1 : 0;
+        }
+    };
+
+    // the exact accelerations for about NUM_SAMPLES particles spread through the list
+    // Note: Strength 1 makes the acceleration the average of (direction / distance squared).
+    static const unsigned int NUM_SAMPLES = 100;
+    unsigned int sampleStride = (numParticles / NUM_SAMPLES) + 1;
+    std::vector<unsigned int> sampleParticles;
+    std::vector<glm::dvec2> exactAccelerations;
+    unsigned int numActive = 0;
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        numActive += (particles._isActive[particleIndex] != 0) ? 1 : 0;
+    }
+    for (unsigned int sampleIndex = 0; sampleIndex < numParticles; sampleIndex += sampleStride)
+    {
+        if (particles._isActive[sampleIndex] == 0)
+        {
+            continue;
+        }
+
+        glm::dvec2 position(particles._positionX[sampleIndex], particles._positionY[sampleIndex]);
+        glm::dvec2 sum(0.0, 0.0);
+        double softeningSqr = (double)GravityTree::SOFTENING * GravityTree::SOFTENING;
+        for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+        {
+            if (particles._isActive[particleIndex] != 0)
+            {
+                glm::dvec2 toParticle = glm::dvec2(particles._positionX[particleIndex], 
+                    particles._positionY[particleIndex]) - position;
+                double softDistSqr = glm::dot(toParticle, toParticle) + softeningSqr;
+                sum += toParticle / (softDistSqr * sqrt(softDistSqr));
+            }
+        }
+        sampleParticles.push_back(sampleIndex);
+        exactAccelerations.push_back(sum / (double)numActive);
+    }
+
+    // the tree at a few opening angles, then the particle-mesh at a few sizes
+    GravityTree tree;
+    ParticleMeshGravity mesh;
+    glm::vec2 minCorner = BENCHMARK_CENTER - glm::vec2(BENCHMARK_RADIUS, BENCHMARK_RADIUS);
+    tree.Init(minCorner, BENCHMARK_RADIUS * 2.0f, numParticles);
+    static const float OPENING_ANGLES[] = { 0.3f, 0.5f, 0.7f, 1.0f };
+    static const unsigned int MESH_SIZES[] = { 256, 512, 1024 };
+    for (int solverIndex = 0; solverIndex < 7; solverIndex++)
+    {
+        bool useMesh = (solverIndex >= 4);
+        float openingAngle = useMesh ? 0.0f : OPENING_ANGLES[solverIndex];
+        if (useMesh)
+        {
+            mesh.Init(minCorner, BENCHMARK_RADIUS * 2.0f, MESH_SIZES[solverIndex - 4], 
+                numParticles);
+        }
+
+        // Note: Strength 1 to match the exact accelerations.
+        double buildMs = 0.0;
+        double accelerationMs = 0.0;
+        auto runStep = [&](ThreadPool *threadPool)
+        {
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            if (useMesh)
+            {
+                mesh.Build(numParticles, getPositions, threadPool);
+            }
+            else
+            {
+                tree.Build(numParticles, getPositions, threadPool);
+            }
+            std::chrono::high_resolution_clock::time_point built =
+                std::chrono::high_resolution_clock::now();
+            if (useMesh)
+            {
+                mesh.ComputeAccelerations(1.0f, threadPool);
+            }
+            else
+            {
+                tree.ComputeAccelerations(1.0f, openingAngle, threadPool);
+            }
+            std::chrono::high_resolution_clock::time_point end =
+                std::chrono::high_resolution_clock::now();
+            buildMs += std::chrono::duration<double, std::milli>(built - start).count();
+            accelerationMs += std::chrono::duration<double, std::milli>(end - built).count();
+        };
+
+        runStep(0);
+        const glm::vec2 *accelerations = useMesh ? 
+            mesh.GetAccelerations() : tree.GetAccelerations();
+        double errorSum = 0.0;
+        double exactSum = 0.0;
+        for (size_t sampleIndex = 0; sampleIndex < sampleParticles.size(); sampleIndex++)
+        {
+            glm::dvec2 exact = exactAccelerations[sampleIndex];
+            glm::dvec2 error = glm::dvec2(accelerations[sampleParticles[sampleIndex]]) - exact;
+            errorSum += sqrt(glm::dot(error, error));
+            exactSum += sqrt(glm::dot(exact, exact));
+        }
+        double errorPercent = (exactSum > 0.0) ? (100.0 * errorSum / exactSum) : 0.0;
+        if (useMesh)
+        {
+            printf("    %u x %u mesh: %.3f%% average error\n", mesh.MeshSize(), 
+                mesh.MeshSize(), errorPercent);
+        }
+        else
+        {
+            printf("    tree, opening angle %.1f: %u nodes, %.3f%% average error\n", 
+                openingAngle, tree.NumNodes(), errorPercent);
+        }
+
+        double singleThreadMs = 0.0;
+        unsigned int numThreads = 1;
+        while (true)
+        {
+            ThreadPool threadPool;
+            threadPool.Init(numThreads, pinThreads);
+
+            buildMs = 0.0;
+            accelerationMs = 0.0;
+            for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+            {
+                runStep(&threadPool);
+            }
+            buildMs /= numFrames;
+            accelerationMs /= numFrames;
+
+            double msPerStep = buildMs + accelerationMs;
+            if (numThreads == 1)
+            {
+                singleThreadMs = msPerStep;
+            }
+
+            char name[32];
+            snprintf(name, sizeof(name), "%u threads", numThreads);
+            printf("    %-12s %8.3f ms/step (%.3f sort + %.3f accelerations)  speedup %.2fx\n",
+                name, msPerStep, buildMs, accelerationMs, singleThreadMs / msPerStep);
+
+            if (numThreads == maxThreads)
+            {
+                break;
+            }
+            numThreads = (numThreads * 2 > maxThreads) ? maxThreads : (numThreads * 2);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times a whole collision step (see ParticleCollider.h), split into the broad phase (sorting 
+    the particles and copying them into grid order) and the narrow phase plus handing back the 
+    ones that moved, on 1 thread, then doubles the thread count until it reaches the maximum.  
+    This is done for a small particle radius (a few percent of the particles touching 
+    something) and a bigger one (most of them).  Only the collisions are timed, not the update.
+
+    The particles are set up the same way as for the neighbor grid benchmark, with velocities 
+    in random directions.  Each thread count starts over from the same particles so that they 
+    all have the same amount of work.  The momentum and kinetic energy are checked afterwards, 
+    since elastic collisions shouldn't change either one.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many steps to time for each thread count.
+    maxThreads      0 means one for each logical processor.
+    pinThreads      See ThreadPool::Init(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunCollisionBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads)
+{
+    if (maxThreads == 0)
+    {
+        maxThreads = std::thread::hardware_concurrency();
+        maxThreads = (maxThreads == 0) ? 1 : maxThreads;
+    }
+
+    printf("collision benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    // Note: A new RandomContext starts from the same seed every time, so this always makes the 
+    // same particles.
+    ParticleStorageSoa particles;
+    particles.Resize(numParticles);
+    auto setUpParticles = [&particles, numParticles]()
+    {
+        RandomContext random;
+        for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+        {
+            float angle = random.OnRange0to1() * 6.2831853f;
+            float distance = sqrtf(random.OnRange0to1()) * BENCHMARK_RADIUS;
+            particles._positionX[particleIndex] = BENCHMARK_CENTER.x + (cosf(angle) * distance);
+            particles._positionY[particleIndex] = BENCHMARK_CENTER.y + (sinf(angle) * distance);
+            particles._isActive[particleIndex] = ((particleIndex % 10) != 9) ? 1 : 0;
+
+            angle = random.OnRange0to1() * 6.2831853f;
+            float speed = BENCHMARK_MIN_VELOCITY + 
+                (random.OnRange0to1() * (BENCHMARK_MAX_VELOCITY - BENCHMARK_MIN_VELOCITY));
+            particles._velocityX[particleIndex] = cosf(angle) * speed;
+            particles._velocityY[particleIndex] = sinf(angle) * speed;
+        }
+    };
+
+    ParticleCollider::GetFunction getParticles = [&particles](unsigned int beginIndex, 
+        unsigned int endIndex, glm::vec2 *positions, glm::vec2 *velocities, 
+        unsigned char *isActive)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            *positions++ = glm::vec2(particles._positionX[particleIndex], 
+                particles._positionY[particleIndex]);
+            *velocities++ = glm::vec2(particles._velocityX[particleIndex], 
+                particles._velocityY[particleIndex]);
+            *isActive++ = (particles._isActive[particleIndex] != 0) ? 1 : 0;
+        }
+    };
+    ParticleCollider::SetFunction setParticles = [&particles](unsigned int beginIndex, 
+        unsigned int endIndex, const glm::vec2 *positions, const glm::vec2 *velocities, 
+        const unsigned char *isTouched)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; 
+            particleIndex++, positions++, velocities++, isTouched++)
+        {
+            if (*isTouched != 0)
+            {
+                particles._positionX[particleIndex] = positions->x;
+                particles._positionY[particleIndex] = positions->y;
+                particles._velocityX[particleIndex] = velocities->x;
+                particles._velocityY[particleIndex] = velocities->y;
+            }
+        }
+    };
+
+    // the total momentum and kinetic energy (without the 1/2) of the active particles
+    auto addUpMotion = [&particles, numParticles](glm::dvec2 *momentum, double *energy)
+    {
+        *momentum = glm::dvec2(0.0, 0.0);
+        *energy = 0.0;
+        for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+        {
+            if (particles._isActive[particleIndex] != 0)
+            {
+                glm::dvec2 velocity(particles._velocityX[particleIndex], 
+                    particles._velocityY[particleIndex]);
+                *momentum += velocity;
+                *energy += glm::dot(velocity, velocity);
+            }
+        }
+    };
+
+    ParticleCollider collider;
+    glm::vec2 corner = glm::vec2(BENCHMARK_RADIUS, BENCHMARK_RADIUS);
+    static const float PARTICLE_RADII[] = { 0.0002f, 0.001f };
+    for (int radiusIndex = 0; radiusIndex < 2; radiusIndex++)
+    {
+        collider.Init(BENCHMARK_CENTER - corner, BENCHMARK_CENTER + corner, 
+            PARTICLE_RADII[radiusIndex], numParticles);
+        printf("    particle radius %.4f, %u x %u cells\n", PARTICLE_RADII[radiusIndex], 
+            collider.GetGrid().NumCellsX(), collider.GetGrid().NumCellsY());
+
+        double singleThreadMs = 0.0;
+        unsigned int numThreads = 1;
+        while (true)
+        {
+            ThreadPool threadPool;
+            threadPool.Init(numThreads, pinThreads);
+            setUpParticles();
+
+            glm::dvec2 startMomentum;
+            double startEnergy = 0.0;
+            addUpMotion(&startMomentum, &startEnergy);
+
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            unsigned int numContacts = 0;
+            for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+            {
+                collider.Resolve(numParticles, getParticles, setParticles, &threadPool);
+                numContacts += collider.NumContacts();
+            }
+            std::chrono::high_resolution_clock::time_point end =
+                std::chrono::high_resolution_clock::now();
+
+            glm::dvec2 endMomentum;
+            double endEnergy = 0.0;
+            addUpMotion(&endMomentum, &endEnergy);
+            glm::dvec2 momentumChange = endMomentum - startMomentum;
+
+            double msPerStep = 
+                std::chrono::duration<double, std::milli>(end - start).count() / numFrames;
+            if (numThreads == 1)
+            {
+                singleThreadMs = msPerStep;
+            }
+
+            char name[32];
+            snprintf(name, sizeof(name), "%u threads", numThreads);
+            printf("    %-12s %8.3f ms/step  %8.3f ns/particle  speedup %.2fx  %u contacts/step  momentum change %.2g  energy change %.2g%%\n",
+                name, msPerStep, (msPerStep * 1000000.0) / numParticles, 
+                singleThreadMs / msPerStep, numContacts / numFrames, 
+                sqrt(glm::dot(momentumChange, momentumChange)), 
+                (startEnergy > 0.0) ? (100.0 * (endEnergy - startEnergy) / startEnergy) : 0.0);
+
+            if (numThreads == maxThreads)
+            {
+                break;
+            }
+            numThreads = (numThreads * 2 > maxThreads) ? maxThreads : (numThreads * 2);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Runs the same particles in the full float format and in the compact ParticlePacked format
+    side by side and reports how far apart they drift.
+
+    The particles start spread across the whole circle (instead of near the center like the
+    manager does) so that every distance from the center is measured.  The float particles
+    start at the packed particles' (rounded) positions so that the report is about drift and 
+    not the one-time rounding, which is reported first, but they keep their exact velocities, 
+    so the velocity rounding shows up in the drift.
+
+    Every particle starts active and the emission quota is the whole particle count, so out of
+    bounds particles are always sent right back out, like they were before there was a quota.
+
+    A particle that goes out of bounds in one format but not in the other on the same frame 
+    is counted as "diverged" and left out of the error from then on.  It is a real difference,
+    but it isn't drift, and it would swamp everything else.
+
+    The "drawn" error is for the 16 bit position that the vertex shader uses.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many updates to run.  The error is reported 10 times along the way.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunPackedErrorReport(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("packed format error report: %u particles, %u frames\n", numParticles, numFrames);
+
+    glm::vec2 center = BENCHMARK_CENTER;
+    float radius = BENCHMARK_RADIUS;
+    std::vector<Particle> fullParticles(numParticles);
+    std::vector<ParticlePacked> packedParticles(numParticles);
+    std::vector<bool> diverged(numParticles, false);
+    float maxInitialPositionError = 0.0f;
+    float maxInitialVelocityError = 0.0f;
+
+    // its own generator so that every report is about the same particles
+    RandomContext random;
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        // random spots that are evenly spread over the circle's area (hence the square root)
+        float angle = random.OnRange0to1() * 6.2831853f;
+        float distance = sqrtf(random.OnRange0to1()) * radius * 0.999f;
+        float velocityAngle = random.OnRange0to1() * 6.2831853f;
+        float speed = BENCHMARK_MIN_VELOCITY + 
+            (random.OnRange0to1() * (BENCHMARK_MAX_VELOCITY - BENCHMARK_MIN_VELOCITY));
+        Particle p = Particle();
+        p._position = glm::vec4(center.x + (cosf(angle) * distance), 
+            center.y + (sinf(angle) * distance), 0.0f, 0.0f);
+        p._velocity = glm::vec4(cosf(velocityAngle) * speed, sinf(velocityAngle) * speed, 0.0f, 
+            0.0f);
+        p._isActive = 1;
+
+        packedParticles[particleIndex] = PackParticle(p, center, radius);
+        Particle unpacked = UnpackParticle(packedParticles[particleIndex], center, radius);
+        glm::vec4 positionError = unpacked._position - p._position;
+        glm::vec4 velocityError = unpacked._velocity - p._velocity;
+        maxInitialPositionError = glm::max(maxInitialPositionError, 
+            sqrtf(glm::dot(positionError, positionError)));
+        maxInitialVelocityError = glm::max(maxInitialVelocityError, 
+            sqrtf(glm::dot(velocityError, velocityError)) / speed);
+
+        p._position = unpacked._position;
+        fullParticles[particleIndex] = p;
+    }
+    printf("    packing: max position error %.3e (%.5f px), max velocity error %.3e of speed\n", 
+        maxInitialPositionError, maxInitialPositionError * BENCHMARK_PIXELS_PER_UNIT, 
+        maxInitialVelocityError);
+    printf("    %6s  %10s  %10s  %10s  %10s  %10s\n", "frame", "rms error", "max error", "max px", 
+        "drawn px", "diverged");
+
+    AosUpdateKernel fullKernel = GetAosUpdateKernel(SIMD_LEVEL_SCALAR, true);
+    PackedUpdateKernel packedKernel = GetPackedUpdateKernel(DetectSimdLevel());
+    glm::vec4 emitterCenter(center, 0.0f, 0.0f);
+    unsigned int numDiverged = 0;
+    unsigned int reportInterval = (numFrames >= 10) ? (numFrames / 10) : 1;
+    EmissionQuota fullQuota;
+    EmissionQuota packedQuota;
+    for (unsigned int frameCount = 1; frameCount <= numFrames; frameCount++)
+    {
+        fullQuota.Reset(numParticles, false);
+        packedQuota.Reset(numParticles, false);
+        fullKernel(fullParticles.data(), 0, numParticles, BENCHMARK_DELTA_TIME_SEC, center, 
+            radius * radius, &fullQuota);
+        packedKernel(packedParticles.data(), 0, numParticles, BENCHMARK_DELTA_TIME_SEC, radius,
+            &packedQuota);
+
+        // a reset particle is exactly on the center in both formats
+        bool report = (frameCount % reportInterval) == 0 || frameCount == numFrames;
+        double sumErrorSqr = 0.0;
+        double maxError = 0.0;
+        double maxDrawnError = 0.0;
+        unsigned int numCompared = 0;
+        for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+        {
+            if (diverged[particleIndex])
+            {
+                continue;
+            }
+
+            const Particle &full = fullParticles[particleIndex];
+            const ParticlePacked &packed = packedParticles[particleIndex];
+            bool fullReset = (full._position == emitterCenter);
+            bool packedReset = (packed._position == 0) && 
+                ((packed._lowBitsAndFlags & PACKED_LOW_BITS_MASK) == 0);
+            if (fullReset != packedReset)
+            {
+                diverged[particleIndex] = true;
+                numDiverged++;
+                continue;
+            }
+
+            if (report)
+            {
+                glm::vec4 error = UnpackParticle(packed, center, radius)._position - 
+                    full._position;
+                double errorSqr = glm::dot(error, error);
+                sumErrorSqr += errorSqr;
+                maxError = glm::max(maxError, sqrt(errorSqr));
+
+                glm::vec2 drawn = center + (glm::unpackSnorm2x16(packed._position) * radius);
+                glm::vec2 drawnError = drawn - glm::vec2(full._position.x, full._position.y);
+                maxDrawnError = glm::max(maxDrawnError, 
+                    (double)sqrtf(glm::dot(drawnError, drawnError)));
+                numCompared++;
+            }
+        }
+
+        if (report)
+        {
+            double rmsError = (numCompared > 0) ? sqrt(sumErrorSqr / numCompared) : 0.0;
+            printf("    %6u  %10.3e  %10.3e  %10.5f  %10.5f  %10u\n", frameCount, rmsError, 
+                maxError, maxError * BENCHMARK_PIXELS_PER_UNIT, 
+                maxDrawnError * BENCHMARK_PIXELS_PER_UNIT, numDiverged);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Makes the obstacles for RunObstacleBenchmark(...): octagons spread around the benchmark's 
+    circle, sized so that however many there are, together they cover about the same area (a 
+    circle with a third of the benchmark's radius).
+Parameters:
+    numShapes   Self-explanatory.
+Returns:
+    See description.  Not baked.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static ObstacleField MakeBenchmarkObstacles(unsigned int numShapes)
+{
+    ObstacleField obstacles;
+    float shapeRadius = (BENCHMARK_RADIUS / 3.0f) / sqrtf((float)numShapes);
+    for (unsigned int shapeIndex = 0; shapeIndex < numShapes; shapeIndex++)
+    {
+        // a sunflower spiral, so that they are spread evenly and none are on top of each other
+        float angle = shapeIndex * 2.3999632f;  // the golden angle
+        float distance = sqrtf((shapeIndex + 0.5f) / numShapes) * (BENCHMARK_RADIUS * 0.8f);
+        glm::vec2 shapeCenter = BENCHMARK_CENTER + 
+            (glm::vec2(cosf(angle), sinf(angle)) * distance);
+
+        std::vector<glm::vec2> corners;
+        for (unsigned int cornerIndex = 0; cornerIndex < 8; cornerIndex++)
+        {
+            float cornerAngle = cornerIndex * (6.2831853f / 8.0f);
+            corners.push_back(shapeCenter + 
+                (glm::vec2(cosf(cornerAngle), sinf(cornerAngle)) * shapeRadius));
+        }
+        obstacles.AddPolygon(corners);
+    }
+    return obstacles;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Shows that the obstacle pass costs the same no matter how many obstacles there are.  Each 
+    storage option is timed without obstacles and then with more and more of them (see 
+    MakeBenchmarkObstacles(...)), baked at main.cpp's sample spacing over the benchmark's 
+    circle.  The bake is timed too, since that is where the number of shapes does matter.
+
+    Also reports how far the baked distance is from the exact one, at random points that are 
+    within a few cells of an edge (that is the only place where it matters).  Corners are 
+    where the straight line between samples is the furthest off.
+
+    Note: With obstacles, the particles that are sent back out get new velocities too (see 
+    ParticleSimulatorCpu), just like with force fields.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many updates to time for each obstacle count.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunObstacleBenchmark(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("obstacle benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    // Note: Same as main.cpp's OBSTACLE_CELL_SIZE.
+    static const float CELL_SIZE = 2.0f / 512.0f;
+    static const unsigned int SHAPE_COUNTS[] = { 0, 1, 16, 256 };
+    static const unsigned int NUM_SHAPE_COUNTS = sizeof(SHAPE_COUNTS) / sizeof(SHAPE_COUNTS[0]);
+    static const unsigned int NUM_ERROR_SAMPLES = 100000;
+
+    glm::vec2 minCorner = BENCHMARK_CENTER - glm::vec2(BENCHMARK_RADIUS);
+    glm::vec2 maxCorner = BENCHMARK_CENTER + glm::vec2(BENCHMARK_RADIUS);
+    std::vector<ObstacleField> allObstacles(NUM_SHAPE_COUNTS);
+    for (unsigned int countIndex = 1; countIndex < NUM_SHAPE_COUNTS; countIndex++)
+    {
+        ObstacleField &obstacles = allObstacles[countIndex];
+        obstacles = MakeBenchmarkObstacles(SHAPE_COUNTS[countIndex]);
+        std::chrono::high_resolution_clock::time_point start =
+            std::chrono::high_resolution_clock::now();
+        obstacles.Bake(minCorner, maxCorner, CELL_SIZE, 0);
+        std::chrono::high_resolution_clock::time_point end =
+            std::chrono::high_resolution_clock::now();
+        double bakeMs = std::chrono::duration<double, std::milli>(end - start).count();
+
+        // Note: A new RandomContext starts from the same seed every time.
+        RandomContext random;
+        double errorSum = 0.0;
+        float maxError = 0.0f;
+        unsigned int numErrorSamples = 0;
+        while (numErrorSamples < NUM_ERROR_SAMPLES)
+        {
+            glm::vec2 position = minCorner + 
+                (glm::vec2(random.OnRange0to1(), random.OnRange0to1()) * (maxCorner - minCorner));
+            float exact = obstacles.GetExactDistance(position);
+            if (fabsf(exact) > CELL_SIZE * 4.0f)
+            {
+                continue;
+            }
+            glm::vec2 gradient;
+            float baked = SampleObstacleField(obstacles.GetHeader(), obstacles.GetSamples(), 
+                position, &gradient);
+            float error = fabsf(baked - exact);
+            errorSum += error;
+            maxError = (error > maxError) ? error : maxError;
+            numErrorSamples++;
+        }
+        const ObstacleFieldHeader &header = obstacles.GetHeader();
+        printf("    %4u shapes baked into %u x %u samples in %8.1f ms, error near edges: mean %.4f max %.4f cells\n",
+            SHAPE_COUNTS[countIndex], header._numSamplesX, header._numSamplesY, bakeMs, 
+            (errorSum / numErrorSamples) / CELL_SIZE, maxError / CELL_SIZE);
+    }
+
+    for (int storageIndex = 0; storageIndex < 3; storageIndex++)
+    {
+        // the same 3 as RunStorageBenchmark(...)
+        ParticleSimulatorCpu::StorageType storage = (storageIndex == 1) ? 
+            ParticleSimulatorCpu::STORAGE_SOA : ParticleSimulatorCpu::STORAGE_AOS;
+        bool packedFormat = (storageIndex == 2);
+        const char *storageName = (storageIndex == 0) ? "AoS" : 
+            ((storageIndex == 1) ? "SoA" : "Packed");
+
+        double noObstaclesNs = 0.0;
+        for (unsigned int countIndex = 0; countIndex < NUM_SHAPE_COUNTS; countIndex++)
+        {
+            // Note: Like TimeStorage(...), the quota is the whole particle count, and the 
+            // manager is local so that its particles are freed before the next run.
+            ParticleSimulatorCpu simulator;
+            simulator.SetStorage(storage);
+            ParticleManager particleManager;
+            particleManager.SetPackedFormat(packedFormat);
+            particleManager.Init(0, &simulator, numParticles, numParticles, BENCHMARK_CENTER, 
+                BENCHMARK_RADIUS, BENCHMARK_MIN_VELOCITY, BENCHMARK_MAX_VELOCITY);
+            simulator.SetObstacles(allObstacles[countIndex]);
+            particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+            {
+                particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+            }
+            std::chrono::high_resolution_clock::time_point end =
+                std::chrono::high_resolution_clock::now();
+            particleManager.Cleanup();
+
+            double elapsedNs = std::chrono::duration<double, std::nano>(end - start).count();
+            double nsPerParticle = elapsedNs / ((double)numParticles * numFrames);
+            if (countIndex == 0)
+            {
+                noObstaclesNs = nsPerParticle;
+                printf("    %-8s %4u shapes %8.3f ns/particle\n", storageName, 0, nsPerParticle);
+            }
+            else
+            {
+                printf("    %-8s %4u shapes %8.3f ns/particle  %8.3f ns/particle for the obstacles\n",
+                    storageName, SHAPE_COUNTS[countIndex], nsPerParticle, 
+                    nsPerParticle - noObstaclesNs);
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Compares the integrators (see ParticleIntegrator.h), first for accuracy and then for speed.
+
+    Accuracy: One particle is put in a circular orbit around an attractor with no softening 
+    and run for 10 orbits through each integrator's "array of structures" kernel, at the 
+    benchmark's step size and at 5 times that.  An exact integrator would keep it at the same 
+    distance with the same energy (kinetic plus potential), so the report is how far each of 
+    those ended up from where it started, as a fraction of where it started.  Verlet and RK4 
+    get close enough that float rounding is most of what is left.
+
+    Speed: Each storage option is timed with each integrator and the benchmark's 4 force 
+    fields (one of each kind).  Semi-implicit Euler uses the separate force field pass and 
+    the others use the integrate pass (see ParticleSimulatorCpu), so the lookups per step 
+    (1, 1, 2, and 4) are printed too.  The force field pass is AVX2 for the SoA storage, while 
+    the SoA integrate pass is SSE2 (see GetSoaIntegrateKernel(...)), and both are scalar for 
+    the others, so Euler costs more than semi-implicit Euler even with the same lookups.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many updates to time for each integrator.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunIntegratorBenchmark(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("integrator benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    static const unsigned int NUM_ORBITS = 10;
+    static const float ORBIT_DISTANCE = 0.5f;
+    static const unsigned int LOOKUPS_PER_STEP[INTEGRATOR_COUNT] = { 1, 1, 2, 4 };
+
+    // Note: With no softening, the pull at the orbit is strength / distance^2, and a circular 
+    // orbit needs speed^2 / distance of it.
+    ForceField attractor = ForceField();
+    attractor._type = FORCE_FIELD_ATTRACTOR;
+    attractor._position = glm::vec2(0.0f, 0.0f);
+    attractor._strength = 0.05f;
+    attractor._radius = 0.0f;
+    float orbitSpeed = sqrtf(attractor._strength / ORBIT_DISTANCE);
+    float orbitPeriodSec = (6.2831853f * ORBIT_DISTANCE) / orbitSpeed;
+    double startEnergy = (0.5 * orbitSpeed * orbitSpeed) - (attractor._strength / ORBIT_DISTANCE);
+    for (int stepScale = 1; stepScale <= 5; stepScale += 4)
+    {
+        float deltaTimeSec = BENCHMARK_DELTA_TIME_SEC * stepScale;
+        unsigned int numSteps = (unsigned int)((NUM_ORBITS * orbitPeriodSec) / deltaTimeSec);
+        for (int integratorIndex = 0; integratorIndex < INTEGRATOR_COUNT; integratorIndex++)
+        {
+            IntegratorType integrator = (IntegratorType)integratorIndex;
+            AosIntegrateKernel kernel = GetAosIntegrateKernel(integrator);
+            Particle p;
+            p._position = glm::vec4(ORBIT_DISTANCE, 0.0f, 0.0f, 0.0f);
+            p._velocity = glm::vec4(0.0f, orbitSpeed, 0.0f, 0.0f);
+            p._isActive = 1;
+            for (unsigned int stepCount = 0; stepCount < numSteps; stepCount++)
+            {
+                kernel(&p, 0, 1, deltaTimeSec, 0, &attractor, 1);
+            }
+
+            double distance = sqrt(((double)p._position.x * p._position.x) + 
+                ((double)p._position.y * p._position.y));
+            double speedSqr = ((double)p._velocity.x * p._velocity.x) + 
+                ((double)p._velocity.y * p._velocity.y);
+            double energy = (0.5 * speedSqr) - (attractor._strength / distance);
+            printf("    step %.2f s  %-14s %6u steps  distance error %10.2e  energy error %10.2e\n",
+                deltaTimeSec, IntegratorName(integrator), numSteps, 
+                fabs(distance - ORBIT_DISTANCE) / ORBIT_DISTANCE, 
+                fabs((energy - startEnergy) / startEnergy));
+        }
+    }
+
+    std::vector<ForceField> forceFields = MakeBenchmarkForceFields(4);
+    for (int storageIndex = 0; storageIndex < 3; storageIndex++)
+    {
+        // the same 3 as RunStorageBenchmark(...)
+        ParticleSimulatorCpu::StorageType storage = (storageIndex == 1) ? 
+            ParticleSimulatorCpu::STORAGE_SOA : ParticleSimulatorCpu::STORAGE_AOS;
+        bool packedFormat = (storageIndex == 2);
+        const char *storageName = (storageIndex == 0) ? "AoS" : 
+            ((storageIndex == 1) ? "SoA" : "Packed");
+
+        for (int integratorIndex = 0; integratorIndex < INTEGRATOR_COUNT; integratorIndex++)
+        {
+            // Note: Like TimeStorage(...), the quota is the whole particle count, and the 
+            // manager is local so that its particles are freed before the next run.
+            IntegratorType integrator = (IntegratorType)integratorIndex;
+            ParticleSimulatorCpu simulator;
+            simulator.SetStorage(storage);
+            simulator.SetIntegrator(integrator);
+            ParticleManager particleManager;
+            particleManager.SetPackedFormat(packedFormat);
+            particleManager.Init(0, &simulator, numParticles, numParticles, BENCHMARK_CENTER, 
+                BENCHMARK_RADIUS, BENCHMARK_MIN_VELOCITY, BENCHMARK_MAX_VELOCITY);
+            simulator.SetForceFields(forceFields);
+            particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+            {
+                particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+            }
+            std::chrono::high_resolution_clock::time_point end =
+                std::chrono::high_resolution_clock::now();
+            particleManager.Cleanup();
+
+            double elapsedNs = std::chrono::duration<double, std::nano>(end - start).count();
+            printf("    %-8s %-14s %u lookups/step %8.3f ns/particle\n", storageName, 
+                IntegratorName(integrator), LOOKUPS_PER_STEP[integratorIndex], 
+                elapsedNs / ((double)numParticles * numFrames));
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times the fluid step (see ParticleFluid.h), pass by pass, on 1 thread, then doubles the 
+    thread count until it reaches the maximum.  Only the fluid is timed, not the update, so 
+    the particles stay where they are and only their velocities change.
+
+    The particles are spread evenly over the benchmark circle with velocities in random 
+    directions, and the smoothing radius is picked so that about 20 of them are within it.  
+    The rest density is what the particles' density works out to, so about half of them are 
+    pushing.  Each thread count starts over from the same particles, and the velocities 
+    afterwards are added up and compared against 1 thread's, since the answer isn't supposed 
+    to depend on the thread count.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many steps to time for each thread count.
+    maxThreads      0 means one for each logical processor.
+    pinThreads      See ThreadPool::Init(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunFluidBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads)
+{
+    if (maxThreads == 0)
+    {
+        maxThreads = std::thread::hardware_concurrency();
+        maxThreads = (maxThreads == 0) ? 1 : maxThreads;
+    }
+
+    static const float NEIGHBORS_PER_PARTICLE = 20.0f;
+    float area = 3.14159265f * BENCHMARK_RADIUS * BENCHMARK_RADIUS;
+    FluidSettings settings;
+    settings._restDensity = numParticles / area;
+    settings._smoothingRadius = 
+        sqrtf(NEIGHBORS_PER_PARTICLE / (3.14159265f * settings._restDensity));
+    settings._stiffness = 0.05f;
+    settings._viscosity = 0.0002f;
+    printf("fluid benchmark: %u particles, %u frames, smoothing radius %.5f\n", numParticles, 
+        numFrames, settings._smoothingRadius);
+
+    // Note: A new RandomContext starts from the same seed every time, so this always makes the 
+    // same particles.
+    ParticleStorageSoa particles;
+    particles.Resize(numParticles);
+    auto setUpParticles = [&particles, numParticles]()
+    {
+        RandomContext random;
+        for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+        {
+            float angle = random.OnRange0to1() * 6.2831853f;
+            float distance = sqrtf(random.OnRange0to1()) * BENCHMARK_RADIUS;
+            particles._positionX[particleIndex] = BENCHMARK_CENTER.x + (cosf(angle) * distance);
+            particles._positionY[particleIndex] = BENCHMARK_CENTER.y + (sinf(angle) * distance);
+            particles._isActive[particleIndex] = 1;
+
+            angle = random.OnRange0to1() * 6.2831853f;
+            float speed = BENCHMARK_MIN_VELOCITY + 
+                (random.OnRange0to1() * (BENCHMARK_MAX_VELOCITY - BENCHMARK_MIN_VELOCITY));
+            particles._velocityX[particleIndex] = cosf(angle) * speed;
+            particles._velocityY[particleIndex] = sinf(angle) * speed;
+        }
+    };
+
+    ParticleFluid::GetFunction getParticles = [&particles](unsigned int beginIndex, 
+        unsigned int endIndex, glm::vec2 *positions, glm::vec2 *velocities, 
+        unsigned char *isActive)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            *positions++ = glm::vec2(particles._positionX[particleIndex], 
+                particles._positionY[particleIndex]);
+            *velocities++ = glm::vec2(particles._velocityX[particleIndex], 
+                particles._velocityY[particleIndex]);
+            *isActive++ = (particles._isActive[particleIndex] != 0) ? 1 : 0;
+        }
+    };
+    ParticleFluid::SetFunction setParticles = [&particles](unsigned int beginIndex, 
+        unsigned int endIndex, const glm::vec2 *positions, const glm::vec2 *velocities, 
+        const unsigned char *isTouched)
+    {
+        (void)positions;
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; 
+            particleIndex++, velocities++, isTouched++)
+        {
+            if (*isTouched != 0)
+            {
+                particles._velocityX[particleIndex] = velocities->x;
+                particles._velocityY[particleIndex] = velocities->y;
+            }
+        }
+    };
+
+    // the sum of the speeds, which any difference between thread counts would show up in
+    auto addUpSpeeds = [&particles, numParticles]()
+    {
+        double totalSpeed = 0.0;
+        for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+        {
+            glm::dvec2 velocity(particles._velocityX[particleIndex], 
+                particles._velocityY[particleIndex]);
+            totalSpeed += sqrt(glm::dot(velocity, velocity));
+        }
+        return totalSpeed;
+    };
+
+    ParticleFluid fluid;
+    glm::vec2 corner = glm::vec2(BENCHMARK_RADIUS, BENCHMARK_RADIUS);
+    fluid.Init(BENCHMARK_CENTER - corner, BENCHMARK_CENTER + corner, settings, numParticles);
+    printf("    %u x %u cells\n", fluid.GetGrid().NumCellsX(), fluid.GetGrid().NumCellsY());
+
+    double singleThreadMs = 0.0;
+    double singleThreadSpeeds = 0.0;
+    unsigned int numThreads = 1;
+    while (true)
+    {
+        ThreadPool threadPool;
+        threadPool.Init(numThreads, pinThreads);
+        setUpParticles();
+        fluid.ResetPassTimes();
+
+        for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+        {
+            fluid.Step(numParticles, BENCHMARK_DELTA_TIME_SEC, getParticles, setParticles, 
+                &threadPool);
+        }
+
+        const FluidPassTimes &passTimes = fluid.GetPassTimes();
+        double msPerStep = 0.0;
+        for (int passIndex = 0; passIndex < FLUID_PASS_COUNT; passIndex++)
+        {
+            msPerStep += passTimes._totalMs[passIndex] / numFrames;
+        }
+        double totalSpeed = addUpSpeeds();
+        if (numThreads == 1)
+        {
+            singleThreadMs = msPerStep;
+            singleThreadSpeeds = totalSpeed;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%u threads", numThreads);
+        printf("    %-12s %8.3f ms/step  %8.3f ns/particle  speedup %.2fx  (", name, msPerStep, 
+            (msPerStep * 1000000.0) / numParticles, singleThreadMs / msPerStep);
+        for (int passIndex = 0; passIndex < FLUID_PASS_COUNT; passIndex++)
+        {
+            printf("%s%s %.3f", (passIndex == 0) ? "" : ", ", FluidPassName((FluidPass)passIndex), 
+                passTimes._totalMs[passIndex] / numFrames);
+        }
+        printf(")  density %.3fx rest  %.1f neighbors  %s\n", 
+            fluid.AverageDensity() / settings._restDensity, fluid.AverageNeighbors(), 
+            (totalSpeed == singleThreadSpeeds) ? "same as 1 thread" : "DIFFERENT from 1 thread");
+
+        if (numThreads == maxThreads)
+        {
+            break;
+        }
+        numThreads = (numThreads * 2 > maxThreads) ? maxThreads : (numThreads * 2);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times the turbulence (see TurbulenceField.h) three ways.
+
+    Bake: How long one key takes to bake, next to how long a key lasts at the benchmark's 
+    speed, since the background thread has to keep up.
+
+    Lookups: The push is looked up at random spots in the benchmark circle, once by blending 
+    the baked samples (what the update does) and once straight from the noise (what it would 
+    do without the bake), and both are timed.  The difference between them is reported as a 
+    fraction of the strength.
+
+    Update: Each storage option is timed with no turbulence, with a field that never changes, 
+    and with one that does, and the turbulence's share is printed, along with how many times 
+    the update had to wait for the background thread to finish a key.
+
+    Note: With turbulence, the particles that are sent back out get new velocities too (see 
+    ParticleSimulatorCpu), just like with force fields.
+Parameters:
+    numParticles    Self-explanatory.  Also how many lookups are timed.
+    numFrames       How many updates to time for each storage option and field.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunTurbulenceBenchmark(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("turbulence benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    // about main.cpp's example
+    static const float STRENGTH = 0.5f;
+    static const float FEATURE_SIZE = 0.2f;
+    static const float CHANGES_PER_SEC = 2.0f;
+    static const unsigned int NUM_BAKED_KEYS = 8;
+
+    TurbulenceSettings staticSettings = { STRENGTH, FEATURE_SIZE, 0.0f };
+    TurbulenceSettings animatedSettings = { STRENGTH, FEATURE_SIZE, CHANGES_PER_SEC };
+    TurbulenceField turbulence;
+    turbulence.Init(staticSettings);
+    const TurbulenceFieldHeader &header = turbulence.GetHeader();
+    const glm::vec2 *samples = turbulence.GetSamples();
+
+    std::vector<glm::vec2> keySamples(turbulence.NumSamples());
+    std::vector<float> keyHeights(turbulence.NumSamples());
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    for (unsigned int keyIndex = 0; keyIndex < NUM_BAKED_KEYS; keyIndex++)
+    {
+        turbulence.BakeKey(keyIndex, keySamples.data(), keyHeights.data());
+    }
+    std::chrono::high_resolution_clock::time_point end =
+        std::chrono::high_resolution_clock::now();
+    double bakeMs = std::chrono::duration<double, std::milli>(end - start).count() / 
+        NUM_BAKED_KEYS;
+    printf("    %u x %u samples baked in %8.3f ms/key, a key lasts %.1f ms (%.1f frames)\n", 
+        header._numSamples, header._numSamples, bakeMs, 250.0f / CHANGES_PER_SEC, 
+        0.25f / (CHANGES_PER_SEC * BENCHMARK_DELTA_TIME_SEC));
+
+    // Note: A new RandomContext starts from the same seed every time.
+    RandomContext random;
+    std::vector<glm::vec2> positions(numParticles);
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        float angle = random.OnRange0to1() * 6.2831853f;
+        float distance = sqrtf(random.OnRange0to1()) * BENCHMARK_RADIUS;
+        positions[particleIndex] = BENCHMARK_CENTER + 
+            (glm::vec2(cosf(angle), sinf(angle)) * distance);
+    }
+
+    std::vector<glm::vec2> bakedPushes(numParticles);
+    start = std::chrono::high_resolution_clock::now();
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        bakedPushes[particleIndex] = 
+            SampleTurbulenceField(header, samples, positions[particleIndex]);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double bakedNs = std::chrono::duration<double, std::nano>(end - start).count() / numParticles;
+
+    std::vector<glm::vec2> exactPushes(numParticles);
+    start = std::chrono::high_resolution_clock::now();
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        exactPushes[particleIndex] = turbulence.GetExactAcceleration(positions[particleIndex], 0);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    double exactNs = std::chrono::duration<double, std::nano>(end - start).count() / numParticles;
+
+    double errorSum = 0.0;
+    float maxError = 0.0f;
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        glm::vec2 difference = bakedPushes[particleIndex] - exactPushes[particleIndex];
+        float error = sqrtf(glm::dot(difference, difference));
+        errorSum += error;
+        maxError = (error > maxError) ? error : maxError;
+    }
+    printf("    lookups: baked %8.3f ns, from the noise %8.3f ns (%.1fx), error: mean %.4f max %.4f of the strength\n",
+        bakedNs, exactNs, exactNs / bakedNs, (errorSum / numParticles) / STRENGTH, 
+        maxError / STRENGTH);
+
+    for (int storageIndex = 0; storageIndex < 3; storageIndex++)
+    {
+        // the same 3 as RunStorageBenchmark(...)
+        ParticleSimulatorCpu::StorageType storage = (storageIndex == 1) ? 
+            ParticleSimulatorCpu::STORAGE_SOA : ParticleSimulatorCpu::STORAGE_AOS;
+        bool packedFormat = (storageIndex == 2);
+        const char *storageName = (storageIndex == 0) ? "AoS" : 
+            ((storageIndex == 1) ? "SoA" : "Packed");
+
+        double noTurbulenceNs = 0.0;
+        for (int fieldIndex = 0; fieldIndex < 3; fieldIndex++)
+        {
+            // Note: Like TimeStorage(...), the quota is the whole particle count, and the 
+            // manager is local so that its particles are freed before the next run.
+            ParticleSimulatorCpu simulator;
+            simulator.SetStorage(storage);
+            ParticleManager particleManager;
+            particleManager.SetPackedFormat(packedFormat);
+            particleManager.Init(0, &simulator, numParticles, numParticles, BENCHMARK_CENTER, 
+                BENCHMARK_RADIUS, BENCHMARK_MIN_VELOCITY, BENCHMARK_MAX_VELOCITY);
+            if (fieldIndex > 0)
+            {
+                simulator.SetTurbulence((fieldIndex == 1) ? staticSettings : animatedSettings);
+            }
+            particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+
+            start = std::chrono::high_resolution_clock::now();
+            for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+            {
+                particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+            }
+            end = std::chrono::high_resolution_clock::now();
+            unsigned int numStalls = simulator.GetTurbulence().NumStalls();
+            particleManager.Cleanup();
+
+            double elapsedNs = std::chrono::duration<double, std::nano>(end - start).count();
+            double nsPerParticle = elapsedNs / ((double)numParticles * numFrames);
+            if (fieldIndex == 0)
+            {
+                noTurbulenceNs = nsPerParticle;
+                printf("    %-8s %-8s %8.3f ns/particle\n", storageName, "none", nsPerParticle);
+            }
+            else
+            {
+                printf("    %-8s %-8s %8.3f ns/particle  %8.3f ns/particle for the turbulence", 
+                    storageName, (fieldIndex == 1) ? "static" : "changing", nsPerParticle, 
+                    nsPerParticle - noTurbulenceNs);
+                if (fieldIndex == 2)
+                {
+                    printf("  %u stalls", numStalls);
+                }
+                printf("\n");
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Goes through the particles in the neighbor grid's order and, for each one, counts the 
+    particles in the 3x3 cells around it that are within a cell's width.  It reads the 
+    neighbors' positions by particle index, the same way that the collisions and the fluid 
+    do, so it is as fast as the particles' order in memory lets it be.
+Parameters:
+    grid        Already built.
+    particles   Self-explanatory.
+Returns:
+    How many neighbors were found, added up over every particle, as a checksum.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static unsigned long long CountNeighbors(const NeighborGrid &grid, 
+    const ParticleStorageSoa &particles)
+{
+    unsigned long long numNeighbors = 0;
+    float radiusSqr = grid.CellSize() * grid.CellSize();
+    const unsigned int *sortedParticles = grid.GetSortedParticles();
+    for (unsigned int sortedIndex = 0; sortedIndex < grid.NumIndexed(); sortedIndex++)
+    {
+        unsigned int particleIndex = sortedParticles[sortedIndex];
+        float x = particles._positionX[particleIndex];
+        float y = particles._positionY[particleIndex];
+        unsigned int cellIndex = grid.GetCellIndex(glm::vec2(x, y));
+        unsigned int cellX = cellIndex % grid.NumCellsX();
+        unsigned int cellY = cellIndex / grid.NumCellsX();
+        unsigned int firstX = (cellX > 0) ? (cellX - 1) : 0;
+        unsigned int firstY = (cellY > 0) ? (cellY - 1) : 0;
+        unsigned int lastX = glm::min(cellX + 1, grid.NumCellsX() - 1);
+        unsigned int lastY = glm::min(cellY + 1, grid.NumCellsY() - 1);
+        for (unsigned int neighborY = firstY; neighborY <= lastY; neighborY++)
+        {
+            for (unsigned int neighborX = firstX; neighborX <= lastX; neighborX++)
+            {
+                const unsigned int *begin = 0;
+                const unsigned int *end = 0;
+                grid.GetCellRange(neighborX, neighborY, &begin, &end);
+                for (const unsigned int *other = begin; other != end; other++)
+                {
+                    float offsetX = particles._positionX[*other] - x;
+                    float offsetY = particles._positionY[*other] - y;
+                    numNeighbors += ((offsetX * offsetX) + (offsetY * offsetY) < radiusSqr) ? 1 : 0;
+                }
+            }
+        }
+    }
+    return numNeighbors;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Shows what sorting the particles by where they are (see ParticleReorder.h) buys the 
+    passes that look at each particle's neighbors.  The particles are scattered at random 
+    over the benchmark's circle, which is the order that they end up in after they have been 
+    sent out again and again, and they are kept in "structure of arrays" storage like the 
+    neighbor grid benchmark uses.
+
+    First the neighbor grid build and a neighbor count (see CountNeighbors(...)) are timed in 
+    the scattered order.  Then the sort and moving the particles into their new order are 
+    timed on 1 thread, doubling the thread count until it reaches the maximum.  Last, the 
+    build and the count are timed again in the sorted order.  The neighbor counts must match, 
+    since only the order changed.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many of each to time.
+    maxThreads      0 means one for each logical processor.
+    pinThreads      See ThreadPool::Init(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunReorderBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads)
+{
+    if (maxThreads == 0)
+    {
+        maxThreads = std::thread::hardware_concurrency();
+        maxThreads = (maxThreads == 0) ? 1 : maxThreads;
+    }
+
+    printf("reorder benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    ParticleStorageSoa particles;
+    particles.Resize(numParticles);
+    RandomContext random;
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        float angle = random.OnRange0to1() * 6.2831853f;
+        float distance = sqrtf(random.OnRange0to1()) * BENCHMARK_RADIUS;
+        particles._positionX[particleIndex] = BENCHMARK_CENTER.x + (cosf(angle) * distance);
+        particles._positionY[particleIndex] = BENCHMARK_CENTER.y + (sinf(angle) * distance);
+        particles._velocityX[particleIndex] = 0.0f;
+        particles._velocityY[particleIndex] = 0.0f;
+        particles._isActive[particleIndex] = 1;
+    }
+
+    // about 10 particles per cell
+    float area = 3.14159265f * BENCHMARK_RADIUS * BENCHMARK_RADIUS;
+    glm::vec2 corner = glm::vec2(BENCHMARK_RADIUS, BENCHMARK_RADIUS);
+    NeighborGrid grid;
+    grid.Init(BENCHMARK_CENTER - corner, BENCHMARK_CENTER + corner, 
+        sqrtf((10.0f * area) / numParticles), numParticles);
+    NeighborGrid::CellIndexFunction getCellIndices = [&grid, &particles](
+        unsigned int beginIndex, unsigned int endIndex, unsigned int *cellIndices)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            *cellIndices++ = grid.GetCellIndex(glm::vec2(particles._positionX[particleIndex], 
+                particles._positionY[particleIndex]));
+        }
+    };
+
+    // Note: The builds and counts are on 1 thread so that only the order changes between the 
+    // two runs.
+    unsigned long long numNeighbors[2] = { 0, 0 };
+    double buildMs[2] = { 0.0, 0.0 };
+    double countMs[2] = { 0.0, 0.0 };
+    auto timeNeighbors = [&](int runIndex)
+    {
+        grid.Build(numParticles, getCellIndices, 0);
+        numNeighbors[runIndex] = CountNeighbors(grid, particles);
+        for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+        {
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            grid.Build(numParticles, getCellIndices, 0);
+            std::chrono::high_resolution_clock::time_point built =
+                std::chrono::high_resolution_clock::now();
+            CountNeighbors(grid, particles);
+            std::chrono::high_resolution_clock::time_point end =
+                std::chrono::high_resolution_clock::now();
+            buildMs[runIndex] += std::chrono::duration<double, std::milli>(built - start).count();
+            countMs[runIndex] += std::chrono::duration<double, std::milli>(end - built).count();
+        }
+        buildMs[runIndex] /= numFrames;
+        countMs[runIndex] /= numFrames;
+        printf("    %-12s %8.3f ms/build  %8.3f ms/count  %llu neighbors\n", 
+            (runIndex == 0) ? "scattered" : "sorted", buildMs[runIndex], countMs[runIndex], 
+            numNeighbors[runIndex]);
+    };
+    timeNeighbors(0);
+
+    // Note: The sort only ever reads the scattered particles, so every run gets the same 
+    // order.
+    ReorderKeyLayout layout = GetReorderKeyLayout(1);
+    ParticleReorder reorder;
+    reorder.Init(numParticles, layout._numKeyBits);
+    ParticleReorder::KeyFunction getKeys = [&layout, &particles](unsigned int beginIndex, 
+        unsigned int endIndex, unsigned int *keys)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            glm::vec2 position(particles._positionX[particleIndex], 
+                particles._positionY[particleIndex]);
+            *keys++ = GetReorderKey(layout, 0, particles._isActive[particleIndex] != 0, 
+                (position - BENCHMARK_CENTER) / BENCHMARK_RADIUS);
+        }
+    };
+    ParticleStorageSoa sortedParticles;
+    sortedParticles.Resize(numParticles);
+
+    double singleThreadMs = 0.0;
+    unsigned int numThreads = 1;
+    while (true)
+    {
+        ThreadPool threadPool;
+        threadPool.Init(numThreads, pinThreads);
+        auto sortAndGather = [&]()
+        {
+            reorder.Sort(getKeys, &threadPool);
+            // Note: 256 KB chunks, like the simulator's, at 16 bytes a particle.
+            const unsigned int *oldIndices = reorder.GetOldIndices();
+            threadPool.ParallelFor(numParticles, 16384, 
+                [&sortedParticles, &particles, oldIndices](unsigned int beginIndex, 
+                unsigned int endIndex)
+            {
+                sortedParticles.GatherFrom(particles, oldIndices, beginIndex, endIndex);
+            });
+        };
+
+        // one untimed sort to get the pages faulted in
+        sortAndGather();
+
+        std::chrono::high_resolution_clock::time_point start =
+            std::chrono::high_resolution_clock::now();
+        for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+        {
+            sortAndGather();
+        }
+        std::chrono::high_resolution_clock::time_point end =
+            std::chrono::high_resolution_clock::now();
+
+        double msPerSort = 
+            std::chrono::duration<double, std::milli>(end - start).count() / numFrames;
+        if (numThreads == 1)
+        {
+            singleThreadMs = msPerSort;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%u threads", numThreads);
+        printf("    %-12s %8.3f ms/sort  %8.3f ns/particle  speedup %.2fx\n", name, msPerSort, 
+            (msPerSort * 1000000.0) / numParticles, singleThreadMs / msPerSort);
+
+        if (numThreads == maxThreads)
+        {
+            break;
+        }
+        numThreads = (numThreads * 2 > maxThreads) ? maxThreads : (numThreads * 2);
+    }
+
+    particles.Swap(&sortedParticles);
+    timeNeighbors(1);
+    printf("    sorted order: %.2fx faster build, %.2fx faster count, neighbors %s\n", 
+        buildMs[0] / buildMs[1], countMs[0] / countMs[1], 
+        (numNeighbors[0] == numNeighbors[1]) ? "match" : "DON'T MATCH");
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Shows what taking several steps per update buys when the particles are only moving in 
+    straight lines (see ParticleSimulatorCpu::StepBlocked(...)).  Each storage option takes 
+    the same number of steps, first one per update and then 2, 4, and 8 per update, on the 
+    full thread pool.  A single step is little more than a load and a store per particle, so 
+    with this many particles, how fast it goes is mostly how fast memory is.
+
+    Like TimeStorage(...), the quota is the whole particle count, so every particle that goes 
+    out of bounds is sent right back out and it doesn't matter which thread gets to it first.  
+    The particles after the blocked updates must then be exactly the same as after the 
+    single steps, and their fingerprints (see ParticleFingerprint.h) are compared.
+Parameters:
+    numParticles    Self-explanatory.
+    numSteps        How many steps to time for each option.  Should be a multiple of 8.
+    maxThreads      0 means one for each logical processor.
+    pinThreads      See ThreadPool::Init(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunSubstepBenchmark(unsigned int numParticles, unsigned int numSteps,
+    unsigned int maxThreads, bool pinThreads)
+{
+    if (maxThreads == 0)
+    {
+        maxThreads = std::thread::hardware_concurrency();
+        maxThreads = (maxThreads == 0) ? 1 : maxThreads;
+    }
+
+    printf("substep benchmark: %u particles, %u steps, %u threads\n", numParticles, numSteps, 
+        maxThreads);
+
+    ThreadPool threadPool;
+    threadPool.Init(maxThreads, pinThreads);
+    for (int storageIndex = 0; storageIndex < 3; storageIndex++)
+    {
+        // the same 3 as RunStorageBenchmark(...)
+        ParticleSimulatorCpu::StorageType storage = (storageIndex == 1) ? 
+            ParticleSimulatorCpu::STORAGE_SOA : ParticleSimulatorCpu::STORAGE_AOS;
+        bool packedFormat = (storageIndex == 2);
+        const char *storageName = (storageIndex == 0) ? "AoS" : 
+            ((storageIndex == 1) ? "SoA" : "Packed");
+
+        double singleStepNs = 0.0;
+        ParticleFingerprint singleStepFingerprint = { 0, 0.0, 0.0, 0 };
+        for (unsigned int numSubsteps = 1; numSubsteps <= 8; numSubsteps *= 2)
+        {
+            // Note: The manager is local so that its particles are freed before the next run.
+            ParticleSimulatorCpu simulator;
+            simulator.SetStorage(storage);
+            simulator.SetThreadPool(&threadPool);
+            simulator.SetSubsteps(numSubsteps);
+            ParticleManager particleManager;
+            particleManager.SetPackedFormat(packedFormat);
+            particleManager.Init(0, &simulator, numParticles, numParticles, BENCHMARK_CENTER, 
+                BENCHMARK_RADIUS, BENCHMARK_MIN_VELOCITY, BENCHMARK_MAX_VELOCITY);
+
+            unsigned int numUpdates = numSteps / numSubsteps;
+            std::chrono::high_resolution_clock::time_point start =
+                std::chrono::high_resolution_clock::now();
+            for (unsigned int updateCount = 0; updateCount < numUpdates; updateCount++)
+            {
+                particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+            }
+            std::chrono::high_resolution_clock::time_point end =
+                std::chrono::high_resolution_clock::now();
+            simulator.ReadBackParticles();
+            ParticleFingerprint fingerprint = particleManager.TakeFingerprint();
+            particleManager.Cleanup();
+
+            double nsPerStep = std::chrono::duration<double, std::nano>(end - start).count() / 
+                ((double)numUpdates * numSubsteps * numParticles);
+            if (numSubsteps == 1)
+            {
+                singleStepNs = nsPerStep;
+                singleStepFingerprint = fingerprint;
+            }
+            bool isSame = (fingerprint._hash == singleStepFingerprint._hash) && 
+                (fingerprint._numActive == singleStepFingerprint._numActive);
+            printf("    %-6s %u steps/update: %8.3f ns/particle-step  speedup %.2fx  %s\n", 
+                storageName, numSubsteps, nsPerStep, singleStepNs / nsPerStep, 
+                isSame ? "same particles" : "DIFFERENT PARTICLES");
+        }
+    }
+    threadPool.Cleanup();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Compares simulating the particles against working each one out from the time whenever it 
+    is needed (see ParticleStateless.h).  The simulator updates the full 48 byte particles 
+    every frame on one thread.  The stateless particles have nothing to update, so what is 
+    timed instead is working out every one of them on the CPU, which is what 
+    shaderParticleStateless.vert does for every frame that is drawn.  The memory that each one 
+    keeps is also reported.
+
+    The two don't make the same particles, so only their active counts are shown as a sanity 
+    check.  Like TimeStorage(...), the quota is the whole particle count, so the simulated 
+    particles all come out at once, but the stateless ones come out over their first lives.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many frames to time for each.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunStatelessBenchmark(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("stateless benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    for (int statelessIndex = 0; statelessIndex < 2; statelessIndex++)
+    {
+        bool isStateless = (statelessIndex == 1);
+
+        // Note: The manager is local so that its particles are freed before the next run.
+        ParticleSimulatorCpu simulator;
+        ParticleManager particleManager;
+        particleManager.SetStateless(isStateless);
+        particleManager.Init(0, &simulator, numParticles, numParticles, BENCHMARK_CENTER, 
+            BENCHMARK_RADIUS, BENCHMARK_MIN_VELOCITY, BENCHMARK_MAX_VELOCITY);
+
+        ParticleFingerprint fingerprint = { 0, 0.0, 0.0, 0 };
+        std::chrono::high_resolution_clock::time_point start =
+            std::chrono::high_resolution_clock::now();
+        for (unsigned int frameCount = 0; frameCount < numFrames; frameCount++)
+        {
+            particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+            if (isStateless)
+            {
+                // work out every particle, like drawing them would
+                fingerprint = particleManager.TakeFingerprint();
+            }
+        }
+        std::chrono::high_resolution_clock::time_point end =
+            std::chrono::high_resolution_clock::now();
+        if (!isStateless)
+        {
+            fingerprint = particleManager.TakeFingerprint();
+        }
+        particleManager.Cleanup();
+
+        double nsPerParticle = std::chrono::duration<double, std::nano>(end - start).count() / 
+            ((double)numFrames * numParticles);
+        double particleMb = isStateless ? 0.0 : 
+            ((double)sizeof(Particle) * numParticles / (1024.0 * 1024.0));
+        printf("    %-9s %8.3f ns/particle-frame  %10.1f MB of particles  %u active\n", 
+            isStateless ? "stateless" : "simulated", nsPerParticle, particleMb, 
+            fingerprint._numActive);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Times the CPU simulator with and without scheduled exits (see 
+    ParticleSimulatorCpu::SetExitScheduling(...)) for both unpacked storage options on one 
+    thread, in two scenarios.  Every particle starts off in both.
+
+    In the first, like TimeStorage(...), the quota is the whole particle count, so the first 
+    frame sends out every particle at once.  With scheduled exits, that files every one of 
+    them in the expiry buckets, which is a one-time cost that has nothing to do with how fast 
+    a frame is after that.  It is timed on its own, and the speedup is for the rest of the 
+    frames.  There have to be enough frames for the fastest particles to leave and be sent 
+    back out, or there is nothing to schedule.
+
+    In the second, the quota is main.cpp's, so nearly every particle waits for it the whole 
+    time.  With scheduled exits, the first frame puts them all in the waiting queue, and 
+    after that only the front of the queue is looked at (see 
+    ParticleSimulatorCpu::PickScheduledEmissions(...)).
+
+    A scheduled exit can land a step off from the bounds test for a particle that only just 
+    leaves, so the two don't make exactly the same particles, but the active counts and the 
+    position sums should be very close.
+Parameters:
+    numParticles    Self-explanatory.
+    numFrames       How many frames to time for each option.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunExitScheduleBenchmark(unsigned int numParticles, unsigned int numFrames)
+{
+    printf("exit schedule benchmark: %u particles, %u frames\n", numParticles, numFrames);
+
+    for (int scenarioIndex = 0; scenarioIndex < 2; scenarioIndex++)
+    {
+        unsigned int maxEmittedPerFrame = (scenarioIndex == 1) ? 
+            BENCHMARK_MAIN_QUOTA : numParticles;
+        printf("  quota of %u per frame\n", maxEmittedPerFrame);
+
+        for (int storageIndex = 0; storageIndex < 2; storageIndex++)
+        {
+            ParticleSimulatorCpu::StorageType storage = (storageIndex == 1) ? 
+                ParticleSimulatorCpu::STORAGE_SOA : ParticleSimulatorCpu::STORAGE_AOS;
+            const char *storageName = (storageIndex == 1) ? "SoA" : "AoS";
+
+            double boundsTestNs = 0.0;
+            for (int scheduleIndex = 0; scheduleIndex < 2; scheduleIndex++)
+            {
+                bool scheduleExits = (scheduleIndex == 1);
+
+                // Note: The manager is local so that its particles are freed before the next 
+                // run.
+                ParticleSimulatorCpu simulator;
+                simulator.SetStorage(storage);
+                simulator.SetExitScheduling(scheduleExits);
+                ParticleManager particleManager;
+                particleManager.Init(0, &simulator, numParticles, maxEmittedPerFrame, 
+                    BENCHMARK_CENTER, BENCHMARK_RADIUS, BENCHMARK_MIN_VELOCITY, 
+                    BENCHMARK_MAX_VELOCITY);
+
+                std::chrono::high_resolution_clock::time_point firstStart =
+                    std::chrono::high_resolution_clock::now();
+                particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+                std::chrono::high_resolution_clock::time_point start =
+                    std::chrono::high_resolution_clock::now();
+                for (unsigned int frameCount = 1; frameCount < numFrames; frameCount++)
+                {
+                    particleManager.Update(BENCHMARK_DELTA_TIME_SEC);
+                }
+                std::chrono::high_resolution_clock::time_point end =
+                    std::chrono::high_resolution_clock::now();
+                ParticleFingerprint fingerprint = particleManager.TakeFingerprint();
+                particleManager.Cleanup();
+
+                double firstFrameMs = 
+                    std::chrono::duration<double, std::milli>(start - firstStart).count();
+                double nsPerParticle = 
+                    std::chrono::duration<double, std::nano>(end - start).count() / 
+                    ((double)(numFrames - 1) * numParticles);
+                if (!scheduleExits)
+                {
+                    boundsTestNs = nsPerParticle;
+                }
+                printf("    %s %-11s first frame %7.1f ms  then %6.3f ns/particle-frame  "
+                    "speedup %.2fx  %u active  sum %.3f %.3f\n", 
+                    storageName, scheduleExits ? "scheduled" : "bounds test", firstFrameMs, 
+                    nsPerParticle, boundsTestNs / nsPerParticle, fingerprint._numActive, 
+                    fingerprint._sumX, fingerprint._sumY);
+            }
+        }
+    }
+}
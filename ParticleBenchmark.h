@@ -0,0 +1,31 @@
+#pragma once
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Headless timing runs for the CPU simulator.  These don't need an OpenGL context, so they
+    can be run from the command line on machines without a GPU (see main(...)).  Results are
+    printed to stdout.
+-----------------------------------------------------------------------------------------------*/
+
+void RunStorageBenchmark(unsigned int numParticles, unsigned int numFrames);
+void RunThreadingBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads);
+void RunPackedErrorReport(unsigned int numParticles, unsigned int numFrames);
+void RunForceFieldBenchmark(unsigned int numParticles, unsigned int numFrames);
+void RunNeighborGridBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads);
+void RunGravityBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads);
+void RunCollisionBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads);
+void RunObstacleBenchmark(unsigned int numParticles, unsigned int numFrames);
+void RunIntegratorBenchmark(unsigned int numParticles, unsigned int numFrames);
+void RunFluidBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads);
+void RunTurbulenceBenchmark(unsigned int numParticles, unsigned int numFrames);
+void RunReorderBenchmark(unsigned int numParticles, unsigned int numFrames,
+    unsigned int maxThreads, bool pinThreads);
+void RunSubstepBenchmark(unsigned int numParticles, unsigned int numSteps,
+    unsigned int maxThreads, bool pinThreads);
+void RunStatelessBenchmark(unsigned int numParticles, unsigned int numFrames);
+void RunExitScheduleBenchmark(unsigned int numParticles, unsigned int numFrames);
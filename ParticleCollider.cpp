@@ -0,0 +1,336 @@
+#include "ParticleCollider.h"
+
+#include "glm/detail/func_geometric.hpp"    // glm::dot
+
+#include <math.h>
+
+// how the work is cut up for the thread pool
+static const unsigned int BODIES_PER_CHUNK = 4096;
+static const unsigned int ROWS_PER_CHUNK = 4;
+static const unsigned int PARTICLES_PER_CHUNK = 4096;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The narrow phase for one pair.  If the two overlap, then each is pushed half of the
+    overlap away from the other, and if they are moving towards each other, then they swap
+    the parts of their velocities along the line between them.  With equal masses, that is
+    the whole of an elastic collision.
+Parameters:
+    positions   The sorted positions.
+    velocities  The sorted velocities.
+    isTouched   Set for both if they overlapped.
+    first       The index of one particle in the sorted arrays.
+    second      The other.
+    diameter    Self-explanatory.
+Returns:
+    True if they overlapped, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline bool CollidePair(glm::vec2 *positions, glm::vec2 *velocities,
+    unsigned char *isTouched, unsigned int first, unsigned int second, float diameter)
+{
+    glm::vec2 offset = positions[second] - positions[first];
+    float distanceSqr = glm::dot(offset, offset);
+    if (distanceSqr >= (diameter * diameter) || distanceSqr == 0.0f)
+    {
+        return false;
+    }
+
+    float distance = sqrtf(distanceSqr);
+    glm::vec2 normal = offset / distance;
+    glm::vec2 push = normal * ((diameter - distance) * 0.5f);
+    positions[first] -= push;
+    positions[second] += push;
+
+    // Note: Negative if they are moving towards each other.  If they are already moving apart
+    // (two particles that collided last step and are still overlapping), then leave them be.
+    float approachSpeed = glm::dot(velocities[second] - velocities[first], normal);
+    if (approachSpeed < 0.0f)
+    {
+        glm::vec2 exchange = normal * approachSpeed;
+        velocities[first] += exchange;
+        velocities[second] -= exchange;
+    }
+
+    isTouched[first] = 1;
+    isTouched[second] = 1;
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing collides until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleCollider::ParticleCollider() :
+    _diameter(0.0f),
+    _numBodies(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the grid over the given rectangle and makes room for the particles.  The cells are
+    one particle across, or bigger if that would be too many cells (see NeighborGrid::Init(...)),
+    which only means more pairs to check.
+Parameters:
+    minCorner       The bottom left of the area that the particles can be in, in window
+                    coords.
+    maxCorner       The top right.
+    particleRadius  Every particle's radius, in window coords.
+    numParticles    The most particles that Resolve(...) will be given.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleCollider::Init(const glm::vec2 &minCorner, const glm::vec2 &maxCorner,
+    float particleRadius, unsigned int numParticles)
+{
+    _diameter = particleRadius * 2.0f;
+    _grid.Init(minCorner, maxCorner, _diameter, numParticles);
+    _positions.resize(numParticles);
+    _velocities.resize(numParticles);
+    _isActive.resize(numParticles);
+    _isTouched.assign(numParticles, 0);
+    _sortedPositions.resize(numParticles);
+    _sortedVelocities.resize(numParticles);
+    _sortedIsTouched.resize(numParticles);
+    _numBodies = 0;
+    _rowContacts.assign(_grid.NumCellsY(), 0);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleCollider::Cleanup()
+{
+    _diameter = 0.0f;
+    _grid.Cleanup();
+    _positions.clear();
+    _velocities.clear();
+    _isActive.clear();
+    _isTouched.clear();
+    _sortedPositions.clear();
+    _sortedVelocities.clear();
+    _sortedIsTouched.clear();
+    _numBodies = 0;
+    _rowContacts.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleCollider::IsInitialized() const
+{
+    return _grid.IsInitialized();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sorts the particles, bounces every pair that overlaps, and hands back the ones that
+    changed.  See the class description for the steps.
+Parameters:
+    numParticles    Must not be more than Init(...) was given.
+    getParticles    Called once for each of the grid's blocks.  Must be safe to call from
+                    more than one thread at once.
+    setParticles    Called once for each chunk of particles (in index order) if anything
+                    touched.  Must be safe to call from more than one thread at once.
+    threadPool      May be 0 to work on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleCollider::Resolve(unsigned int numParticles, const GetFunction &getParticles,
+    const SetFunction &setParticles, ThreadPool *threadPool)
+{
+    if (numParticles == 0 || numParticles > _positions.size())
+    {
+        return;
+    }
+
+    // (1)
+    const NeighborGrid &grid = _grid;
+    glm::vec2 *positions = _positions.data();
+    glm::vec2 *velocities = _velocities.data();
+    unsigned char *isActive = _isActive.data();
+    unsigned char *isTouched = _isTouched.data();
+    _grid.Build(numParticles,
+        [&grid, &getParticles, positions, velocities, isActive, isTouched](
+            unsigned int beginIndex, unsigned int endIndex, unsigned int *cellIndices)
+    {
+        getParticles(beginIndex, endIndex, positions + beginIndex, velocities + beginIndex,
+            isActive + beginIndex);
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            isTouched[particleIndex] = 0;
+            *cellIndices++ = (isActive[particleIndex] != 0) ?
+                grid.GetCellIndex(positions[particleIndex]) : NeighborGrid::NO_CELL;
+        }
+    }, threadPool);
+
+    _numBodies = _grid.NumIndexed();
+    const unsigned int *gridParticles = _grid.GetSortedParticles();
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this, gridParticles](unsigned int beginIndex, unsigned int endIndex)
+    {
+        for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+        {
+            unsigned int particleIndex = gridParticles[sortedIndex];
+            _sortedPositions[sortedIndex] = _positions[particleIndex];
+            _sortedVelocities[sortedIndex] = _velocities[particleIndex];
+            _sortedIsTouched[sortedIndex] = 0;
+        }
+    });
+
+    // (2), even rows and then odd rows
+    unsigned int numRows = _grid.NumCellsY();
+    for (unsigned int firstRow = 0; firstRow < 2; firstRow++)
+    {
+        ThreadPool::ParallelFor(threadPool, (numRows + 1 - firstRow) / 2, ROWS_PER_CHUNK,
+            [this, firstRow](unsigned int beginIndex, unsigned int endIndex)
+        {
+            for (unsigned int index = beginIndex; index < endIndex; index++)
+            {
+                this->ResolveRow(firstRow + (index * 2));
+            }
+        });
+    }
+
+    if (this->NumContacts() == 0)
+    {
+        return;
+    }
+
+    // (3)
+    // Note: Each particle is in the sorted list once, so no two chunks write to the same one.
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this, gridParticles](unsigned int beginIndex, unsigned int endIndex)
+    {
+        for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+        {
+            if (_sortedIsTouched[sortedIndex] != 0)
+            {
+                unsigned int particleIndex = gridParticles[sortedIndex];
+                _positions[particleIndex] = _sortedPositions[sortedIndex];
+                _velocities[particleIndex] = _sortedVelocities[sortedIndex];
+                _isTouched[particleIndex] = 1;
+            }
+        }
+    });
+    ThreadPool::ParallelFor(threadPool, numParticles, PARTICLES_PER_CHUNK,
+        [&setParticles, positions, velocities, isTouched](unsigned int beginIndex,
+            unsigned int endIndex)
+    {
+        setParticles(beginIndex, endIndex, positions + beginIndex, velocities + beginIndex,
+            isTouched + beginIndex);
+    });
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the grid that the last Resolve(...) sorted the particles into.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const NeighborGrid &ParticleCollider::GetGrid() const
+{
+    return _grid;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Simple getters for how many particles took part in the last Resolve(...) and how many
+    overlapping pairs it pushed apart, for reporting.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleCollider::NumBodies() const
+{
+    return _numBodies;
+}
+
+unsigned int ParticleCollider::NumContacts() const
+{
+    unsigned int numContacts = 0;
+    for (size_t rowIndex = 0; rowIndex < _rowContacts.size(); rowIndex++)
+    {
+        numContacts += _rowContacts[rowIndex];
+    }
+    return numContacts;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Checks every particle in one row of cells against the ones in its own cell (that come
+    after it), the cell to its right, and the three cells above it.  The cell and the one to
+    its right are next to each other in grid order, and so are the three above, so each is one
+    range of the sorted arrays.
+
+    Only particles in this row and the next one are changed (see the class description).
+Parameters:
+    rowIndex    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleCollider::ResolveRow(unsigned int rowIndex)
+{
+    unsigned int numCellsX = _grid.NumCellsX();
+    bool hasRowAbove = (rowIndex + 1) < _grid.NumCellsY();
+    const unsigned int *rowStarts = _grid.GetCellStarts() + (rowIndex * numCellsX);
+    const unsigned int *aboveStarts = rowStarts + numCellsX;
+    glm::vec2 *positions = _sortedPositions.data();
+    glm::vec2 *velocities = _sortedVelocities.data();
+    unsigned char *isTouched = _sortedIsTouched.data();
+
+    unsigned int numContacts = 0;
+    for (unsigned int cellX = 0; cellX < numCellsX; cellX++)
+    {
+        unsigned int cellBegin = rowStarts[cellX];
+        unsigned int cellEnd = rowStarts[cellX + 1];
+        if (cellBegin == cellEnd)
+        {
+            continue;
+        }
+
+        // Note: The start of the cell after the last one in the row is the start of the next 
+        // row, which is the same as the end of the last one.
+        unsigned int sideEnd = ((cellX + 1) < numCellsX) ? rowStarts[cellX + 2] : cellEnd;
+        unsigned int aboveBegin = 0;
+        unsigned int aboveEnd = 0;
+        if (hasRowAbove)
+        {
+            aboveBegin = aboveStarts[(cellX > 0) ? (cellX - 1) : 0];
+            aboveEnd = aboveStarts[((cellX + 1) < numCellsX) ? (cellX + 2) : (cellX + 1)];
+        }
+
+        for (unsigned int first = cellBegin; first < cellEnd; first++)
+        {
+            for (unsigned int second = first + 1; second < sideEnd; second++)
+            {
+                numContacts += CollidePair(positions, velocities, isTouched, first, second,
+                    _diameter) ? 1 : 0;
+            }
+            for (unsigned int second = aboveBegin; second < aboveEnd; second++)
+            {
+                numContacts += CollidePair(positions, velocities, isTouched, first, second,
+                    _diameter) ? 1 : 0;
+            }
+        }
+    }
+    _rowContacts[rowIndex] = numContacts;
+}
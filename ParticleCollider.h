@@ -0,0 +1,88 @@
+#pragma once
+
+#include "NeighborGrid.h"
+#include "ThreadPool.h"
+#include "glm/vec2.hpp"
+
+#include <vector>
+#include <functional>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Bounces particles off of each other.  Every particle is a circle of the same radius and
+    the same mass, and when two of them overlap, they are pushed apart until they just touch
+    and, if they are moving towards each other, they swap the parts of their velocities that
+    point along the line between them (an elastic collision between equal masses).  See
+    ParticleSimulatorCpu::SetCollisions(...).
+
+    Each step:
+    (1) "Broad phase": The particles are sorted into a grid whose cells are at least one
+    particle across (see NeighborGrid.h), so two particles can only touch if their cells are
+    next to each other.  Their positions and velocities are copied into grid order so that
+    each cell's particles are together in memory.
+    (2) "Narrow phase": Each cell checks its particles against each other and against the
+    cells to its right and in the row above it (the other neighbors check it), so every pair
+    that might touch is checked once.  A cell in row Y only changes particles in rows Y and
+    Y + 1, so all of the even rows can be done at once without touching each other's
+    particles, and then all of the odd rows.  Within a row, the cells go left to right.  This
+    two-color split is what lets the rows be spread across the thread pool with no locks, and
+    the answer doesn't depend on how many threads there are.
+    (3) Only the particles that touched something are handed back.
+
+    Note: Each pair is only pushed apart once per step, so a pile of particles takes a few
+    steps to spread out.  Particles that are exactly on top of each other (every particle that
+    was just emitted is at its emitter's center) have no line between them and are left alone.
+    A pile is still every particle in it checked against every other one, so an emitter that
+    sends out thousands of particles per frame keeps a pile at its center that costs far more
+    than the rest of the particles put together.
+
+    Note: Nothing here knows what a particle looks like.  Whoever calls Resolve(...) hands over
+    the positions and velocities and takes back the ones that changed.
+-----------------------------------------------------------------------------------------------*/
+class ParticleCollider
+{
+public:
+    // fills in positions[0, endIndex - beginIndex), velocities[...], and isActive[...] for the
+    // particles in the range [beginIndex, endIndex)
+    // Note: In window coords.  Inactive particles don't collide.
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        glm::vec2 *positions, glm::vec2 *velocities, unsigned char *isActive)> GetFunction;
+
+    // stores positions[0, endIndex - beginIndex) and velocities[...] for the particles in the
+    // range [beginIndex, endIndex) that have isTouched[...] set and leaves the rest alone
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        const glm::vec2 *positions, const glm::vec2 *velocities,
+        const unsigned char *isTouched)> SetFunction;
+
+    ParticleCollider();
+    void Init(const glm::vec2 &minCorner, const glm::vec2 &maxCorner, float particleRadius,
+        unsigned int numParticles);
+    void Cleanup();
+    bool IsInitialized() const;
+    void Resolve(unsigned int numParticles, const GetFunction &getParticles,
+        const SetFunction &setParticles, ThreadPool *threadPool);
+    const NeighborGrid &GetGrid() const;
+    unsigned int NumBodies() const;
+    unsigned int NumContacts() const;
+
+private:
+    void ResolveRow(unsigned int rowIndex);
+
+    float _diameter;
+    NeighborGrid _grid;
+
+    // indexed by particle
+    std::vector<glm::vec2> _positions;
+    std::vector<glm::vec2> _velocities;
+    std::vector<unsigned char> _isActive;
+    std::vector<unsigned char> _isTouched;
+
+    // the active particles in grid order
+    std::vector<glm::vec2> _sortedPositions;
+    std::vector<glm::vec2> _sortedVelocities;
+    std::vector<unsigned char> _sortedIsTouched;
+    unsigned int _numBodies;
+
+    // how many pairs each row of cells pushed apart on the last step
+    std::vector<unsigned int> _rowContacts;
+};
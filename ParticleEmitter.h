@@ -0,0 +1,167 @@
+#pragma once
+
+#include "glm/vec2.hpp"
+
+#include <math.h>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    One emitter's circle, velocity range, and share of the particles.  The particle manager 
+    can run many of these at once out of the same particle collection and the same buffer.  
+    Each emitter owns a contiguous range of the particles, so the CPU simulator can hand each 
+    range to the update kernels as-is, and the compute shaders look up each particle's emitter 
+    by the index that is stored in the particle.
+
+    The user fills in these:
+    _center         A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    _radius         In window coords.
+    _minVelocity    In window coords.
+    _maxVelocity    In window coords.
+    _minLifetimeSec How long a particle lives after it is emitted, unless it goes out of bounds 
+    _maxLifetimeSec first.  Each particle gets its own lifetime on this range (see 
+                    GetParticleLifetimeSec(...)).  0 for both means that particles live until 
+                    they go out of bounds.
+    _numParticles   How many particles this emitter owns.
+    _maxParticlesEmittedPerFrame    Self-explanatory.
+
+    ParticleManager::Init(...) fills in these:
+    _radiusSqr      Because only the square is used during update.
+    _firstParticle  Where this emitter's range starts in the particle collection.
+
+    Note: The same table is uploaded to a shader storage buffer, so the structure has to match 
+    "struct Emitter" in the shaders, which use the std430 layout.  The vec2 comes first so that 
+    it is on an 8 byte boundary, and the size (48 bytes) is a multiple of 8.
+-----------------------------------------------------------------------------------------------*/
+struct ParticleEmitter
+{
+    glm::vec2 _center;
+    float _radius;
+    float _radiusSqr;
+    float _minVelocity;
+    float _maxVelocity;
+    float _minLifetimeSec;
+    float _maxLifetimeSec;
+    unsigned int _firstParticle;
+    unsigned int _numParticles;
+    unsigned int _maxParticlesEmittedPerFrame;
+    unsigned int _padding;
+};
+
+// the packed format keeps the emitter index in 15 bits (see ParticlePacked.h), and the emit 
+// shaders run one work group per emitter, which can't go past 65535
+static const unsigned int MAX_EMITTERS = 32768;
+
+// the shader storage binding of the emitter table (see ParticleSimulatorGpu for the others)
+static const unsigned int EMITTER_BUFFER_BINDING = 4;
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The "lowbias32" integer hash, which mixes consecutive indices well.  Rather than store more 
+    values in every particle (the compact format doesn't have room), the things that are 
+    picked at random when a particle is emitted come from a hash of its index, so the compute 
+    shaders can work them out the same way.
+
+    Note: Must match Hash(...) in the compute shaders.
+Parameters:
+    value       Self-explanatory.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline unsigned int HashParticleIndex(unsigned int value)
+{
+    unsigned int hash = value;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352d;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68b;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks a particle's lifetime from its emitter's range.  It comes from a hash of the 
+    particle's index, so it is the same every time the particle is emitted.
+
+    Note: Must match StartLifetime(...) in the compute shaders.
+Parameters:
+    emitter         The particle's emitter.
+    particleIndex   Self-explanatory.
+Returns:
+    See description.  0 if the emitter's particles don't expire.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline float GetParticleLifetimeSec(const ParticleEmitter &emitter, unsigned int particleIndex)
+{
+    // the top 24 bits fit in a float exactly
+    unsigned int hash = HashParticleIndex(particleIndex);
+    float fraction = (float)(hash >> 8) * (1.0f / 16777216.0f);
+    return emitter._minLifetimeSec + 
+        (fraction * (emitter._maxLifetimeSec - emitter._minLifetimeSec));
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out how long a particle moving in a straight line takes to leave its emitter's 
+    circle.  This is where the ray from the particle along its velocity meets the circle, 
+    which is the larger root of |p + vt|^2 = r^2, where p is the particle relative to the 
+    center.  Emitted particles start at the center, where this is just the radius over the 
+    speed, but it works from anywhere inside the circle.
+Parameters:
+    emitter         The particle's emitter.
+    position        In window coords.
+    velocity        In window coords.
+Returns:
+    The time in seconds.  0 if it is already outside, and a negative number if it isn't 
+    moving and so never leaves.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline float GetParticleExitTimeSec(const ParticleEmitter &emitter, const glm::vec2 &position, 
+    const glm::vec2 &velocity)
+{
+    glm::vec2 fromCenter = position - emitter._center;
+    float a = (velocity.x * velocity.x) + (velocity.y * velocity.y);
+    float halfB = (fromCenter.x * velocity.x) + (fromCenter.y * velocity.y);
+    float c = (fromCenter.x * fromCenter.x) + (fromCenter.y * fromCenter.y) - emitter._radiusSqr;
+    if (a <= 0.0f)
+    {
+        return -1.0f;
+    }
+    if (c >= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    // c < 0, so the discriminant is positive and the larger root is ahead of the particle
+    return (-halfB + sqrtf((halfB * halfB) - (a * c))) / a;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks a new velocity for a particle that is being sent back out.  Normally a particle 
+    keeps the velocity that the manager gave it forever, but force fields change it, so with 
+    force fields, every emission needs a new one.  The step is mixed into the hash so that a 
+    particle doesn't go out the same way every time.
+
+    Note: Must match EmitVelocity(...) in the compute shaders.
+Parameters:
+    emitter         The particle's emitter.
+    particleIndex   Self-explanatory.
+    stepIndex       How many updates came before the one that is emitting the particle.
+Returns:
+    A 2D vector whose magnitude is between the emitter's "min" and "max" velocities and whose 
+    direction is random.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline glm::vec2 GetParticleEmitVelocity(const ParticleEmitter &emitter, 
+    unsigned int particleIndex, unsigned int stepIndex)
+{
+    // 0x9e3779b9 is 2^32 divided by the golden ratio, which spreads the steps out
+    unsigned int angleHash = HashParticleIndex(particleIndex ^ (stepIndex * 0x9e3779b9));
+    unsigned int speedHash = HashParticleIndex(angleHash);
+    float angle = (float)(angleHash >> 8) * (6.2831853f / 16777216.0f);
+    float speed = emitter._minVelocity + ((float)(speedHash >> 8) * (1.0f / 16777216.0f) * 
+        (emitter._maxVelocity - emitter._minVelocity));
+    return glm::vec2(cosf(angle) * speed, sinf(angle) * speed);
+}
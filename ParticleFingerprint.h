@@ -0,0 +1,23 @@
+#pragma once
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A small summary of every particle's state after a frame, for telling whether two runs of 
+    the same scenario did the same thing (see ReplayLog.h) without keeping all the particles 
+    around.
+
+    _numActive      Self-explanatory.
+    _sumX, _sumY    The sum of the active particles' positions in window coords.  Two runs 
+                    that differ only by float rounding (ex: CPU vs GPU) have nearly the same 
+                    sums, so these say how far apart they are.
+    _hash           A 64 bit FNV-1a hash of every particle's position and "is active" flag, 
+                    exactly as stored.  If this matches, then the runs are bit-for-bit the 
+                    same.  Only comparable between runs that use the same particle format.
+-----------------------------------------------------------------------------------------------*/
+struct ParticleFingerprint
+{
+    unsigned int _numActive;
+    double _sumX;
+    double _sumY;
+    unsigned long long _hash;
+};
@@ -0,0 +1,509 @@
+#include "ParticleFluid.h"
+
+#include "glm/detail/func_geometric.hpp"    // glm::dot
+
+#include <math.h>
+#include <chrono>
+
+// how the work is cut up for the thread pool
+static const unsigned int BODIES_PER_CHUNK = 2048;
+static const unsigned int PARTICLES_PER_CHUNK = 4096;
+
+static const float PI = 3.14159265f;
+
+// indexed by FluidPass
+static const char *FLUID_PASS_NAMES[FLUID_PASS_COUNT] =
+{
+    "grid",
+    "density",
+    "forces",
+    "store",
+};
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    For printouts.
+Parameters:
+    pass    Self-explanatory.
+Returns:
+    A string literal.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const char *FluidPassName(FluidPass pass)
+{
+    if (pass < 0 || pass >= FLUID_PASS_COUNT)
+    {
+        return "unknown";
+    }
+    return FLUID_PASS_NAMES[pass];
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out the constants in front of the smoothing kernels.  For a distance r within the 
+    smoothing radius h, the 2D kernels are:
+        density:    (4 / (pi * h^8)) * (h^2 - r^2)^3
+        pressure:   (30 / (pi * h^5)) * (h - r)^2, along the line between the particles
+        viscosity:  (40 / (pi * h^5)) * (h - r)
+    The compute shader is handed the same constants.
+Parameters:
+    smoothingRadius Self-explanatory.  Must not be 0.
+    densityScale    Gets the constant for the density kernel.
+    pressureScale   Same, for the pressure.
+    viscosityScale  Same, for the viscosity.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void GetFluidKernelScales(float smoothingRadius, float *densityScale, float *pressureScale,
+    float *viscosityScale)
+{
+    *densityScale = 4.0f / (PI * powf(smoothingRadius, 8.0f));
+    *pressureScale = 30.0f / (PI * powf(smoothingRadius, 5.0f));
+    *viscosityScale = 40.0f / (PI * powf(smoothingRadius, 5.0f));
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing is a fluid until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleFluid::ParticleFluid() :
+    _densityScale(0.0f),
+    _pressureScale(0.0f),
+    _viscosityScale(0.0f),
+    _numBodies(0)
+{
+    _settings._smoothingRadius = 0.0f;
+    _settings._restDensity = 0.0f;
+    _settings._stiffness = 0.0f;
+    _settings._viscosity = 0.0f;
+    this->ResetPassTimes();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the grid over the given rectangle, works out the smoothing kernels' constants, and
+    makes room for the particles.  The cells are a smoothing radius across, or bigger if that
+    would be too many cells (see NeighborGrid::Init(...)), which only means more neighbors to
+    look at.
+Parameters:
+    minCorner       The bottom left of the area that the particles can be in, in window
+                    coords.
+    maxCorner       The top right.
+    settings        See FluidSettings.  The smoothing radius must not be 0.
+    numParticles    The most particles that Step(...) will be given.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleFluid::Init(const glm::vec2 &minCorner, const glm::vec2 &maxCorner,
+    const FluidSettings &settings, unsigned int numParticles)
+{
+    _settings = settings;
+    GetFluidKernelScales(settings._smoothingRadius, &_densityScale, &_pressureScale, 
+        &_viscosityScale);
+    _grid.Init(minCorner, maxCorner, settings._smoothingRadius, numParticles);
+    _positions.resize(numParticles);
+    _velocities.resize(numParticles);
+    _isActive.resize(numParticles);
+    _sortedPositions.resize(numParticles);
+    _sortedVelocities.resize(numParticles);
+    _sortedDensities.resize(numParticles);
+    _sortedPressures.resize(numParticles);
+    _sortedNewVelocities.resize(numParticles);
+    _numBodies = 0;
+    _chunkNeighbors.assign((numParticles / BODIES_PER_CHUNK) + 1, 0);
+    this->ResetPassTimes();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleFluid::Cleanup()
+{
+    _settings._smoothingRadius = 0.0f;
+    _grid.Cleanup();
+    _positions.clear();
+    _velocities.clear();
+    _isActive.clear();
+    _sortedPositions.clear();
+    _sortedVelocities.clear();
+    _sortedDensities.clear();
+    _sortedPressures.clear();
+    _sortedNewVelocities.clear();
+    _numBodies = 0;
+    _chunkNeighbors.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleFluid::IsInitialized() const
+{
+    return _grid.IsInitialized();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sorts the particles, works out their densities and then their new velocities, and hands
+    those back.  See the class description for the steps.  Each step's time is added to the
+    pass times.
+Parameters:
+    numParticles    Must not be more than Init(...) was given.
+    deltaTimeSec    Self-explanatory.
+    getParticles    Called once for each of the grid's blocks.  Must be safe to call from
+                    more than one thread at once.
+    setParticles    Called once for each chunk of particles (in index order), with every
+                    active particle touched.  Must be safe to call from more than one thread
+                    at once.
+    threadPool      May be 0 to work on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleFluid::Step(unsigned int numParticles, float deltaTimeSec,
+    const GetFunction &getParticles, const SetFunction &setParticles, ThreadPool *threadPool)
+{
+    if (numParticles == 0 || numParticles > _positions.size())
+    {
+        return;
+    }
+
+    // (1)
+    std::chrono::high_resolution_clock::time_point gridStart =
+        std::chrono::high_resolution_clock::now();
+    const NeighborGrid &grid = _grid;
+    glm::vec2 *positions = _positions.data();
+    glm::vec2 *velocities = _velocities.data();
+    unsigned char *isActive = _isActive.data();
+    _grid.Build(numParticles,
+        [&grid, &getParticles, positions, velocities, isActive](
+            unsigned int beginIndex, unsigned int endIndex, unsigned int *cellIndices)
+    {
+        getParticles(beginIndex, endIndex, positions + beginIndex, velocities + beginIndex,
+            isActive + beginIndex);
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            *cellIndices++ = (isActive[particleIndex] != 0) ?
+                grid.GetCellIndex(positions[particleIndex]) : NeighborGrid::NO_CELL;
+        }
+    }, threadPool);
+
+    _numBodies = _grid.NumIndexed();
+    const unsigned int *gridParticles = _grid.GetSortedParticles();
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this, gridParticles](unsigned int beginIndex, unsigned int endIndex)
+    {
+        for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+        {
+            unsigned int particleIndex = gridParticles[sortedIndex];
+            _sortedPositions[sortedIndex] = _positions[particleIndex];
+            _sortedVelocities[sortedIndex] = _velocities[particleIndex];
+        }
+    });
+
+    // (2)
+    std::chrono::high_resolution_clock::time_point densityStart =
+        std::chrono::high_resolution_clock::now();
+    _chunkNeighbors.assign(_chunkNeighbors.size(), 0);
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this](unsigned int beginIndex, unsigned int endIndex)
+    {
+        this->ComputeDensities(beginIndex, endIndex);
+    });
+
+    // (3)
+    std::chrono::high_resolution_clock::time_point forcesStart =
+        std::chrono::high_resolution_clock::now();
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this, deltaTimeSec](unsigned int beginIndex, unsigned int endIndex)
+    {
+        this->ComputeVelocities(beginIndex, endIndex, deltaTimeSec);
+    });
+
+    // (4)
+    // Note: Each particle is in the sorted list once, so no two chunks write to the same one.
+    // Every active particle is in it, so the "is active" flags are also the "is touched" ones.
+    std::chrono::high_resolution_clock::time_point storeStart =
+        std::chrono::high_resolution_clock::now();
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this, gridParticles](unsigned int beginIndex, unsigned int endIndex)
+    {
+        for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+        {
+            _velocities[gridParticles[sortedIndex]] = _sortedNewVelocities[sortedIndex];
+        }
+    });
+    ThreadPool::ParallelFor(threadPool, numParticles, PARTICLES_PER_CHUNK,
+        [&setParticles, positions, velocities, isActive](unsigned int beginIndex,
+            unsigned int endIndex)
+    {
+        setParticles(beginIndex, endIndex, positions + beginIndex, velocities + beginIndex,
+            isActive + beginIndex);
+    });
+    std::chrono::high_resolution_clock::time_point storeEnd =
+        std::chrono::high_resolution_clock::now();
+
+    _passTimes._numSteps++;
+    _passTimes._totalMs[FLUID_PASS_GRID] +=
+        std::chrono::duration<double, std::milli>(densityStart - gridStart).count();
+    _passTimes._totalMs[FLUID_PASS_DENSITY] +=
+        std::chrono::duration<double, std::milli>(forcesStart - densityStart).count();
+    _passTimes._totalMs[FLUID_PASS_FORCES] +=
+        std::chrono::duration<double, std::milli>(storeStart - forcesStart).count();
+    _passTimes._totalMs[FLUID_PASS_STORE] +=
+        std::chrono::duration<double, std::milli>(storeEnd - storeStart).count();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the grid that the last Step(...) sorted the particles into.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const NeighborGrid &ParticleFluid::GetGrid() const
+{
+    return _grid;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    For reporting: how many particles took part in the last Step(...), their average density,
+    and how many neighbors (within the smoothing radius, counting themselves) each one had on
+    average.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleFluid::NumBodies() const
+{
+    return _numBodies;
+}
+
+double ParticleFluid::AverageDensity() const
+{
+    if (_numBodies == 0)
+    {
+        return 0.0;
+    }
+
+    double totalDensity = 0.0;
+    for (unsigned int sortedIndex = 0; sortedIndex < _numBodies; sortedIndex++)
+    {
+        totalDensity += _sortedDensities[sortedIndex];
+    }
+    return totalDensity / _numBodies;
+}
+
+double ParticleFluid::AverageNeighbors() const
+{
+    if (_numBodies == 0)
+    {
+        return 0.0;
+    }
+
+    double totalNeighbors = 0.0;
+    for (size_t chunkIndex = 0; chunkIndex < _chunkNeighbors.size(); chunkIndex++)
+    {
+        totalNeighbors += _chunkNeighbors[chunkIndex];
+    }
+    return totalNeighbors / _numBodies;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    How long each pass took, added up over every Step(...) since Init(...) or the last
+    ResetPassTimes().
+Parameters: None
+Returns:
+    See FluidPassTimes.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const FluidPassTimes &ParticleFluid::GetPassTimes() const
+{
+    return _passTimes;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleFluid::ResetPassTimes()
+{
+    _passTimes._numSteps = 0;
+    for (int passIndex = 0; passIndex < FLUID_PASS_COUNT; passIndex++)
+    {
+        _passTimes._totalMs[passIndex] = 0.0;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Finds the three rows of 3 cells around the cell that a position is in.  The cells in a row
+    are next to each other in grid order, so each row is one range of the sorted arrays.  A
+    row that is off the edge of the grid is empty, and so is the part of a row that is.
+Parameters:
+    position    In window coords.
+    rowBegins   Gets where each row starts in the sorted arrays.
+    rowEnds     Gets where each row ends.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleFluid::GetNeighborRows(const glm::vec2 &position, unsigned int rowBegins[3],
+    unsigned int rowEnds[3]) const
+{
+    unsigned int numCellsX = _grid.NumCellsX();
+    unsigned int numCellsY = _grid.NumCellsY();
+    unsigned int cellIndex = _grid.GetCellIndex(position);
+    unsigned int cellX = cellIndex % numCellsX;
+    unsigned int cellY = cellIndex / numCellsX;
+    unsigned int firstX = (cellX > 0) ? (cellX - 1) : 0;
+    unsigned int lastX = ((cellX + 1) < numCellsX) ? (cellX + 1) : cellX;
+    const unsigned int *cellStarts = _grid.GetCellStarts();
+    for (unsigned int rowIndex = 0; rowIndex < 3; rowIndex++)
+    {
+        // Note: Unsigned, so the row below row 0 wraps around to something too big.
+        unsigned int row = cellY + rowIndex - 1;
+        if (row >= numCellsY)
+        {
+            rowBegins[rowIndex] = 0;
+            rowEnds[rowIndex] = 0;
+            continue;
+        }
+
+        rowBegins[rowIndex] = cellStarts[(row * numCellsX) + firstX];
+        rowEnds[rowIndex] = cellStarts[(row * numCellsX) + lastX + 1];
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (2) for one range of the sorted particles.  A particle counts itself, so the density
+    is never 0.
+Parameters:
+    beginIndex  In the sorted arrays.
+    endIndex    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleFluid::ComputeDensities(unsigned int beginIndex, unsigned int endIndex)
+{
+    float radiusSqr = _settings._smoothingRadius * _settings._smoothingRadius;
+    const glm::vec2 *positions = _sortedPositions.data();
+    unsigned int numNeighbors = 0;
+    for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+    {
+        glm::vec2 position = positions[sortedIndex];
+        unsigned int rowBegins[3];
+        unsigned int rowEnds[3];
+        this->GetNeighborRows(position, rowBegins, rowEnds);
+
+        float density = 0.0f;
+        for (unsigned int rowIndex = 0; rowIndex < 3; rowIndex++)
+        {
+            for (unsigned int other = rowBegins[rowIndex]; other < rowEnds[rowIndex]; other++)
+            {
+                glm::vec2 offset = positions[other] - position;
+                float distanceSqr = glm::dot(offset, offset);
+                if (distanceSqr < radiusSqr)
+                {
+                    float falloff = radiusSqr - distanceSqr;
+                    density += falloff * falloff * falloff;
+                    numNeighbors++;
+                }
+            }
+        }
+        density *= _densityScale;
+
+        float pressure = _settings._stiffness * (density - _settings._restDensity);
+        _sortedDensities[sortedIndex] = density;
+        _sortedPressures[sortedIndex] = (pressure > 0.0f) ? pressure : 0.0f;
+    }
+    _chunkNeighbors[beginIndex / BODIES_PER_CHUNK] = numNeighbors;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (3) for one range of the sorted particles.  The accelerations on particle i from each
+    neighbor j at distance r are:
+        pressure:   (P_i + P_j) / (2 * D_i * D_j) * (pressure kernel) away from j
+        viscosity:  viscosity * (V_j - V_i) / (D_i * D_j) * (viscosity kernel)
+    Both are symmetric, so each pair pushes on each other equally (momentum is kept).  The
+    change in velocity is capped (see the class description).
+Parameters:
+    beginIndex      In the sorted arrays.
+    endIndex        Self-explanatory.
+    deltaTimeSec    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleFluid::ComputeVelocities(unsigned int beginIndex, unsigned int endIndex,
+    float deltaTimeSec)
+{
+    float radius = _settings._smoothingRadius;
+    float radiusSqr = radius * radius;
+    float maxSpeedChange = (deltaTimeSec > 0.0f) ? ((0.5f * radius) / deltaTimeSec) : 0.0f;
+    const glm::vec2 *positions = _sortedPositions.data();
+    const glm::vec2 *velocities = _sortedVelocities.data();
+    const float *densities = _sortedDensities.data();
+    const float *pressures = _sortedPressures.data();
+    for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+    {
+        glm::vec2 position = positions[sortedIndex];
+        glm::vec2 velocity = velocities[sortedIndex];
+        float pressure = pressures[sortedIndex];
+        unsigned int rowBegins[3];
+        unsigned int rowEnds[3];
+        this->GetNeighborRows(position, rowBegins, rowEnds);
+
+        // Note: 1 / D_i is the same for every neighbor, so it is left until the end.
+        glm::vec2 pressureSum(0.0f, 0.0f);
+        glm::vec2 viscositySum(0.0f, 0.0f);
+        for (unsigned int rowIndex = 0; rowIndex < 3; rowIndex++)
+        {
+            for (unsigned int other = rowBegins[rowIndex]; other < rowEnds[rowIndex]; other++)
+            {
+                glm::vec2 offset = position - positions[other];
+                float distanceSqr = glm::dot(offset, offset);
+                if (distanceSqr >= radiusSqr || distanceSqr == 0.0f)
+                {
+                    continue;
+                }
+
+                float distance = sqrtf(distanceSqr);
+                float falloff = radius - distance;
+                float inverseDensity = 1.0f / densities[other];
+                pressureSum += offset * (((pressure + pressures[other]) * 0.5f * inverseDensity *
+                    falloff * falloff) / distance);
+                viscositySum += (velocities[other] - velocity) * (inverseDensity * falloff);
+            }
+        }
+
+        float inverseDensity = 1.0f / densities[sortedIndex];
+        glm::vec2 acceleration = ((pressureSum * _pressureScale) +
+            (viscositySum * (_settings._viscosity * _viscosityScale))) * inverseDensity;
+        glm::vec2 speedChange = acceleration * deltaTimeSec;
+        float speedChangeSqr = glm::dot(speedChange, speedChange);
+        if (speedChangeSqr > (maxSpeedChange * maxSpeedChange))
+        {
+            speedChange *= maxSpeedChange / sqrtf(speedChangeSqr);
+        }
+        _sortedNewVelocities[sortedIndex] = velocity + speedChange;
+    }
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "NeighborGrid.h"
+#include "ThreadPool.h"
+#include "glm/vec2.hpp"
+
+#include <vector>
+#include <functional>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    How the particles behave as a fluid (see ParticleFluid).
+
+    _smoothingRadius    Window coords.  How far away a particle can feel another one.  0 means
+                        no fluid.  Around 20 particles should fit in a circle this big when
+                        the fluid is at rest.
+    _restDensity        Particles per window coords squared.  The fluid pushes outwards where
+                        the particles are closer together than this.
+    _stiffness          How hard it pushes.  This is the square of how fast a push travels
+                        through the fluid, so a step shouldn't let it travel much more than
+                        half of a smoothing radius (ex: 0.01 across, 60 steps per second, and
+                        0.05 or less).
+    _viscosity          How quickly neighbors' velocities even out (window coords squared per
+                        second).  0 is none.  Above (smoothing radius squared) / (4 * step),
+                        neighbors overshoot each other's velocities.
+
+    Note: Each particle has a mass of 1 and the smoothing kernels add up to 1 over their
+    circles, so a particle's density is just how many particles per unit area are around it.
+-----------------------------------------------------------------------------------------------*/
+struct FluidSettings
+{
+    float _smoothingRadius;
+    float _restDensity;
+    float _stiffness;
+    float _viscosity;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The fluid step in the pieces that it is timed in.  Both simulators add up how long each
+    one took (see ParticleSimulator::GetFluidPassTimes()).
+    - Grid: Sorting the particles into the neighbor grid and copying them into grid order.
+    - Density: Adding up each particle's density and pressure from its neighbors.
+    - Forces: Adding up each particle's pressure and viscosity accelerations and changing its
+      velocity.
+    - Store: Handing the new velocities back to wherever the particles are kept.  The compute
+      shader writes them straight into the particle buffer in the forces pass, so it is always
+      0 there.
+
+    _numSteps   How many steps the totals are for.
+    _totalMs    Indexed by FluidPass.
+-----------------------------------------------------------------------------------------------*/
+enum FluidPass
+{
+    FLUID_PASS_GRID = 0,
+    FLUID_PASS_DENSITY,
+    FLUID_PASS_FORCES,
+    FLUID_PASS_STORE,
+    FLUID_PASS_COUNT,
+};
+
+struct FluidPassTimes
+{
+    unsigned int _numSteps;
+    double _totalMs[FLUID_PASS_COUNT];
+};
+
+const char *FluidPassName(FluidPass pass);
+void GetFluidKernelScales(float smoothingRadius, float *densityScale, float *pressureScale,
+    float *viscosityScale);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Makes the particles behave like a fluid with "smoothed particle hydrodynamics": every
+    particle stands for a little blob of fluid that is smeared out over a circle (the smoothing
+    radius), and the fluid's density, pressure, and viscosity anywhere are the sums of the
+    blobs that overlap there.  See ParticleSimulatorCpu::SetFluid(...).
+
+    Each step:
+    (1) The particles are sorted into a grid whose cells are a smoothing radius across (see
+    NeighborGrid.h), so all of a particle's neighbors are in the 3 x 3 cells around it, and
+    their positions and velocities are copied into grid order.
+    (2) Each particle's density is the sum of its neighbors' smoothing kernels, and its
+    pressure is how far that is above the rest density times the stiffness.
+    (3) Each particle is pushed away from its neighbors by their pressures and pulled towards
+    their velocities by the viscosity, and its velocity is changed by both.
+    (4) The new velocities are handed back.
+    Steps (2) and (3) only read what the step before them wrote, so the particles can be split
+    across the thread pool any which way, and the answer doesn't depend on how many threads
+    there are.  The positions are left alone; the update moves the particles along their new
+    velocities.
+
+    The kernels are the usual ones from Muller, Charypar, and Gross (2003), scaled for 2D:
+    "poly6" for the density, the gradient of "spiky" for the pressure (it doesn't go to 0 in
+    the middle, so particles that get close still push apart), and the Laplacian of
+    "viscosity" for the viscosity.
+
+    Note: Pressure below the rest density is clamped to 0.  Otherwise particles out on the
+    edges of a spray pull each other into clumps and strings.
+
+    Note: Every particle that was just emitted is at its emitter's center, so a pile there has
+    an enormous density.  Particles that are exactly on top of each other have no line between
+    them and don't push on each other, and no particle's velocity may change by more than it
+    takes to go half of a smoothing radius in one step, so the pile spreads out over a few
+    steps instead of flinging its neighbors across the window.
+
+    Note: Nothing here knows what a particle looks like.  Whoever calls Step(...) hands over
+    the positions and velocities the same way as for ParticleCollider::Resolve(...).
+-----------------------------------------------------------------------------------------------*/
+class ParticleFluid
+{
+public:
+    // Note: The same as ParticleCollider's, so the simulator can hand both of them the same
+    // functions.  Only the velocities of the particles with isTouched[...] set are changed.
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        glm::vec2 *positions, glm::vec2 *velocities, unsigned char *isActive)> GetFunction;
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        const glm::vec2 *positions, const glm::vec2 *velocities,
+        const unsigned char *isTouched)> SetFunction;
+
+    ParticleFluid();
+    void Init(const glm::vec2 &minCorner, const glm::vec2 &maxCorner,
+        const FluidSettings &settings, unsigned int numParticles);
+    void Cleanup();
+    bool IsInitialized() const;
+    void Step(unsigned int numParticles, float deltaTimeSec, const GetFunction &getParticles,
+        const SetFunction &setParticles, ThreadPool *threadPool);
+    const NeighborGrid &GetGrid() const;
+    unsigned int NumBodies() const;
+    double AverageDensity() const;
+    double AverageNeighbors() const;
+    const FluidPassTimes &GetPassTimes() const;
+    void ResetPassTimes();
+
+private:
+    void GetNeighborRows(const glm::vec2 &position, unsigned int rowBegins[3],
+        unsigned int rowEnds[3]) const;
+    void ComputeDensities(unsigned int beginIndex, unsigned int endIndex);
+    void ComputeVelocities(unsigned int beginIndex, unsigned int endIndex,
+        float deltaTimeSec);
+
+    FluidSettings _settings;
+    NeighborGrid _grid;
+
+    // see GetFluidKernelScales(...)
+    float _densityScale;
+    float _pressureScale;
+    float _viscosityScale;
+
+    // indexed by particle
+    std::vector<glm::vec2> _positions;
+    std::vector<glm::vec2> _velocities;
+    std::vector<unsigned char> _isActive;
+
+    // the active particles in grid order
+    std::vector<glm::vec2> _sortedPositions;
+    std::vector<glm::vec2> _sortedVelocities;
+    std::vector<float> _sortedDensities;
+    std::vector<float> _sortedPressures;
+    std::vector<glm::vec2> _sortedNewVelocities;
+    unsigned int _numBodies;
+
+    // for reporting; how many neighbors each chunk of the density pass found
+    std::vector<unsigned int> _chunkNeighbors;
+    FluidPassTimes _passTimes;
+};
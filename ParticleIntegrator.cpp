@@ -0,0 +1,54 @@
+#include "ParticleIntegrator.h"
+
+#include <string.h>
+
+// indexed by IntegratorType
+// Note: These go in the replay log and on the command line, so they can't have spaces.
+static const char *INTEGRATOR_NAMES[INTEGRATOR_COUNT] =
+{
+    "euler",
+    "semi-implicit",
+    "verlet",
+    "rk4",
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    For printouts, the command line, and the replay log.
+Parameters:
+    integrator  Self-explanatory.
+Returns:
+    A string literal.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const char *IntegratorName(IntegratorType integrator)
+{
+    if (integrator < 0 || integrator >= INTEGRATOR_COUNT)
+    {
+        return "unknown";
+    }
+    return INTEGRATOR_NAMES[integrator];
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The reverse of IntegratorName(...).
+Parameters:
+    name        Self-explanatory.
+    integrator  Gets the matching type.  Left alone if the name doesn't match any of them.
+Returns:
+    True if the name matched, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool GetIntegratorByName(const char *name, IntegratorType *integrator)
+{
+    for (int integratorIndex = 0; integratorIndex < INTEGRATOR_COUNT; integratorIndex++)
+    {
+        if (strcmp(name, INTEGRATOR_NAMES[integratorIndex]) == 0)
+        {
+            *integrator = (IntegratorType)integratorIndex;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "glm/vec2.hpp"
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    How a particle's position and velocity are carried forward by one step once something is
+    accelerating it (force fields or gravity).  Without any acceleration, they all come down to
+    moving the particle along its velocity, and the simulators don't run them at all.
+
+    - Euler: Moves along the velocity that the step starts with, then changes the velocity.
+      The simplest and the least stable.  An orbit spirals outwards.
+    - Semi-implicit Euler: Changes the velocity first and moves along the new one.  Same cost
+      as Euler, but orbits stay closed, so this is the default.  It is what the simulators
+      always did before there was a choice.
+    - Verlet: "Velocity Verlet".  Moves along the average of the velocity and the acceleration
+      over the step, then averages the acceleration at the start and the end into the
+      velocity.  Looks up the accelerations twice.
+    - RK4: The classic 4th order Runge-Kutta.  The most accurate per step, and looks up the
+      accelerations 4 times.
+
+    The choice is made once, before the simulator's Init(...) (see
+    ParticleSimulator::SetIntegrator(...)), so no particle ever has to ask which one to use.
+    The CPU kernels are templates on one of the policy structures below (see
+    GetAosIntegrateKernel(...)), and the update shaders are compiled with the matching
+    INTEGRATOR #define.  The "structure of arrays" storage also has SSE2 kernels that run the 
+    same policies on 4 particles at once (see GetSoaIntegrateKernel(...)).  The other storages 
+    carry their particles forward one at a time.
+
+    Note: The values must match the INTEGRATOR_* #defines in the update shaders.
+-----------------------------------------------------------------------------------------------*/
+enum IntegratorType
+{
+    INTEGRATOR_EULER = 0,
+    INTEGRATOR_SEMI_IMPLICIT_EULER,
+    INTEGRATOR_VERLET,
+    INTEGRATOR_RK4,
+    INTEGRATOR_COUNT,
+};
+
+const char *IntegratorName(IntegratorType integrator);
+bool GetIntegratorByName(const char *name, IntegratorType *integrator);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The integrator policies.  Each one's Step(...) carries one particle forward by one step.
+    The acceleration is whatever the caller hands over as a function of position and velocity
+    (drag depends on the velocity), so these don't know anything about force fields or
+    gravity, and they are in the header so that the kernels can inline both them and the
+    acceleration.
+
+    The vector type is a template parameter too so that a SIMD kernel can hand over a group 
+    of particles, one in each lane, and get the same results as it would one at a time.  It 
+    only needs +, +=, and * by a float.
+
+    Note: Each must match Integrate(...) in the update shaders.
+Parameters:
+    position        In window coords.  Changed.  A glm::vec2 or a SIMD kernel's lanes.
+    velocity        In window coords.  Changed.  Same type as the position.
+    deltaTimeSec    Self-explanatory.
+    getAcceleration Called as getAcceleration(position, velocity) and returns the acceleration
+                    in window coords per second per second.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+struct IntegratorEuler
+{
+    template <typename Vec2, typename GetAcceleration>
+    static void Step(Vec2 *position, Vec2 *velocity, float deltaTimeSec,
+        const GetAcceleration &getAcceleration)
+    {
+        Vec2 acceleration = getAcceleration(*position, *velocity);
+        *position += *velocity * deltaTimeSec;
+        *velocity += acceleration * deltaTimeSec;
+    }
+};
+
+struct IntegratorSemiImplicitEuler
+{
+    template <typename Vec2, typename GetAcceleration>
+    static void Step(Vec2 *position, Vec2 *velocity, float deltaTimeSec,
+        const GetAcceleration &getAcceleration)
+    {
+        *velocity += getAcceleration(*position, *velocity) * deltaTimeSec;
+        *position += *velocity * deltaTimeSec;
+    }
+};
+
+struct IntegratorVerlet
+{
+    template <typename Vec2, typename GetAcceleration>
+    static void Step(Vec2 *position, Vec2 *velocity, float deltaTimeSec,
+        const GetAcceleration &getAcceleration)
+    {
+        // Note: The acceleration at the end can depend on the velocity at the end (drag),
+        // which isn't known yet, so it is looked up with Euler's guess at it.
+        Vec2 startAcceleration = getAcceleration(*position, *velocity);
+        *position += (*velocity + (startAcceleration * (0.5f * deltaTimeSec))) * deltaTimeSec;
+        Vec2 endAcceleration = getAcceleration(*position,
+            *velocity + (startAcceleration * deltaTimeSec));
+        *velocity += (startAcceleration + endAcceleration) * (0.5f * deltaTimeSec);
+    }
+};
+
+struct IntegratorRk4
+{
+    template <typename Vec2, typename GetAcceleration>
+    static void Step(Vec2 *position, Vec2 *velocity, float deltaTimeSec,
+        const GetAcceleration &getAcceleration)
+    {
+        // each stage's slope is (velocity, acceleration) at the position and velocity that
+        // the stage before it points to
+        float halfStep = 0.5f * deltaTimeSec;
+        Vec2 velocity1 = *velocity;
+        Vec2 acceleration1 = getAcceleration(*position, velocity1);
+        Vec2 velocity2 = *velocity + (acceleration1 * halfStep);
+        Vec2 acceleration2 = getAcceleration(*position + (velocity1 * halfStep), velocity2);
+        Vec2 velocity3 = *velocity + (acceleration2 * halfStep);
+        Vec2 acceleration3 = getAcceleration(*position + (velocity2 * halfStep), velocity3);
+        Vec2 velocity4 = *velocity + (acceleration3 * deltaTimeSec);
+        Vec2 acceleration4 = getAcceleration(*position + (velocity3 * deltaTimeSec),
+            velocity4);
+
+        float sixthStep = deltaTimeSec / 6.0f;
+        *position += (velocity1 + ((velocity2 + velocity3) * 2.0f) + velocity4) * sixthStep;
+        *velocity += (acceleration1 + ((acceleration2 + acceleration3) * 2.0f) + acceleration4) *
+            sixthStep;
+    }
+};
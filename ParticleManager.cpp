@@ -1,20 +1,47 @@
 #include "ParticleManager.h"
+#include "ParticleStateless.h"
 
 #include "glm/detail/func_geometric.hpp"    // glm::dot
-#include "RandomToast.h"
 #include "glload/include/glload/gl_4_4.h"
 
+#include <algorithm>    // std::upper_bound
+#include <string.h>     // memcpy(...)
+#include <stdio.h>
+
+// how many particles share a random context when they are made (see Init(...))
+// Note: This must not change with the thread count, or the same seed would make different 
+// particles on different machines.
+static const unsigned int RANDOM_BLOCK_PARTICLES = 16 * 1024;
+
 
 /*-----------------------------------------------------------------------------------------------
 Description:
-    An empty constructor.  It exists because I didn't know if anything had to go in it, and then
-    I kept it around even when everything was moved to the Init(...) method.
+    Gives members default values so that Cleanup() can tell what was never created.  Everything 
+    else happens in the Init(...) method.
 Parameters: None
 Returns:    None
 Exception:  Safe
 Creator:    John Cox (7-26-2016)
 -----------------------------------------------------------------------------------------------*/
-ParticleManager::ParticleManager()
+ParticleManager::ParticleManager() :
+    _lastDeltaTimeSec(0.0f),
+    _programId(0),
+    _vaoId(0),
+    _drawStyle(0),
+    _sizeBytes(0),
+    _unifLocRenderOffsetSec(0),
+    _usePackedFormat(false),
+    _isStateless(false),
+    _statelessTimeSec(0.0),
+    _unifLocPeriodIndex(0),
+    _unifLocPeriodTimeSec(0),
+    _unifLocEmitterIndex(0),
+    _randomSeed(0),
+    _threadPool(0),
+    _shaderBufferId(0),
+    _emitterBufferId(0),
+    _bufferIsStale(false),
+    _simulator(0)
 {
 
 }
@@ -38,6 +65,9 @@ Description:
     with this object.  Is called in the constructor in the event that someone forgot to call it 
     explicitly.  This method exists so that the user can reset it without deleting the actual 
     object (??why would you want to do this??) .
+
+    The simulator is also told to clean up since this object initialized it.  Nothing is 
+    deleted that wasn't created, so this is safe without an OpenGL context (headless runs).
 Parameters: None
 Returns:    None
 Exception:  Safe
@@ -45,10 +75,35 @@ Creator:    John Cox (7-26-2016)
 -----------------------------------------------------------------------------------------------*/
 void ParticleManager::Cleanup()
 {
-    glDeleteProgram(_programId);
-    glDeleteProgram(_computeProgramId);
-    glDeleteBuffers(1, &_shaderBufferId);
-    glDeleteVertexArrays(1, &_vaoId);
+    if (_simulator != 0)
+    {
+        _simulator->Cleanup();
+        _simulator = 0;
+    }
+
+    if (_programId != 0)
+    {
+        glDeleteProgram(_programId);
+        _programId = 0;
+    }
+
+    if (_shaderBufferId != 0)
+    {
+        glDeleteBuffers(1, &_shaderBufferId);
+        _shaderBufferId = 0;
+    }
+
+    if (_emitterBufferId != 0)
+    {
+        glDeleteBuffers(1, &_emitterBufferId);
+        _emitterBufferId = 0;
+    }
+
+    if (_vaoId != 0)
+    {
+        glDeleteVertexArrays(1, &_vaoId);
+        _vaoId = 0;
+    }
 }
 
 /*-----------------------------------------------------------------------------------------------
@@ -56,10 +111,13 @@ Description:
     Records the program ID, the maximum number of particles to be emitted per frame, and the 
     emitter center.  Re-sizes the internal collection of particles to accomodate the specified 
     number.  Calculates the boundary at which particles become invalid based on the provided 
-    radius.  Calculates the velocity delta from the provided min and max velocities.
+    radius.  Calculates the velocity delta from the provided min and max velocities.  Lastly, 
+    hands all of that to the simulator.
+
+    This is the single emitter version of the Init(...) below.
 Parameters: 
-    programId       The shader program must be constructed prior to this.
-    computeProgramId    Same issue.
+    programId       See the other Init(...).
+    simulator       See the other Init(...).
     numParticles    The maximum number of particles that the manager has to work with.
     maxParticlesEmittedPerFrame     Self-explanatory.
     center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
@@ -71,7 +129,7 @@ Exception:  Safe
 Creator:    John Cox (7-26-2016)
 -----------------------------------------------------------------------------------------------*/
 void ParticleManager::Init(unsigned int programId,
-    unsigned int computeProgramId,
+    ParticleSimulator *simulator,
     unsigned int numParticles, 
     unsigned int maxParticlesEmittedPerFrame,
     const glm::vec2 center,
@@ -79,116 +137,216 @@ void ParticleManager::Init(unsigned int programId,
     float minVelocity,
     float maxVelocity)
 {
-    _programId = programId;
-    _computeProgramId = computeProgramId;
-    _allParticles.resize(numParticles);
-    _sizeBytes = sizeof(Particle) * numParticles;
-    _drawStyle = GL_POINTS;
-    _maxParticlesEmittedPerFrame = maxParticlesEmittedPerFrame;
-    _center = center;
-    _radiusSqr = radius * radius;   // because only radius squared is used during update
-    _velocityMin = minVelocity;
-    _velocityDelta = maxVelocity - minVelocity;
+    ParticleEmitter emitter = ParticleEmitter();
+    emitter._center = center;
+    emitter._radius = radius;
+    emitter._minVelocity = minVelocity;
+    emitter._maxVelocity = maxVelocity;
+    emitter._numParticles = numParticles;
+    emitter._maxParticlesEmittedPerFrame = maxParticlesEmittedPerFrame;
+
+    this->Init(programId, simulator, std::vector<ParticleEmitter>(1, emitter));
+}
 
-    // start all particles at the emission orign
-    for (size_t particleCount = 0; particleCount < _allParticles.size(); particleCount++)
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Copies the emitter table and gives each emitter its range of the particles, one after 
+    another in the order given.  Re-sizes the internal collection of particles to hold all of 
+    them and starts each one at its emitter.  Lastly, hands all of that to the simulator.
+
+    All of the emitters' particles share one collection and one buffer, so the simulator 
+    updates them all at once and Render(...) draws them all at once, no matter how many 
+    emitters there are.
+
+    If the program ID is 0, then no OpenGL buffers are created and Render() does nothing.  This 
+    is for running a CPU simulator on a machine without an OpenGL context.
+
+    If SetPackedFormat(...) was called, then each particle is packed as soon as it is reset so 
+    that the full 48 byte collection never exists.
+
+    The particles are made in blocks of RANDOM_BLOCK_PARTICLES, each with its own random 
+    context.  The first block's context is seeded with the seed, and each one after that is 
+    the one before it jumped ahead (see RandomContext::Jump()), so the blocks can be made on 
+    any thread in any order and still make the same particles.  If SetThreadPool(...) was 
+    called, then they are spread across its threads.
+
+    If SetStateless(...) was called, then only the emitter table is kept.  The simulator is 
+    neither initialized nor used.
+Parameters: 
+    programId       The shader program must be constructed prior to this.  May be 0.  If using 
+                    the packed format, then it must be made from shaderParticlePacked.vert.  If 
+                    stateless, then it must be made from shaderParticleStateless.vert.
+    simulator       Advances the particles during Update(...).  Must outlive this object or be 
+                    detached with Cleanup().  Ignored if stateless.
+    emitters        The user's part of each emitter must be filled in (see ParticleEmitter.h).
+                    There must be at least 1 and no more than MAX_EMITTERS.
+Returns:    None
+Exception:  Safe
+Creator:    John Cox (7-26-2016)
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::Init(unsigned int programId,
+    ParticleSimulator *simulator,
+    const std::vector<ParticleEmitter> &emitters)
+{
+    if (emitters.empty() || emitters.size() > MAX_EMITTERS)
     {
-        // pointer arithmetic will do
-        this->ResetParticle(_allParticles.data() + particleCount);
+        printf("ParticleManager::Init(...): %u emitters is not on the range [1,%u]\n",
+            (unsigned int)emitters.size(), MAX_EMITTERS);
+        return;
     }
 
-    _unifLocDeltaTimeSec = glGetUniformLocation(_computeProgramId, "uDeltaTimeSec");
-    _unifLocRadiusSqr = glGetUniformLocation(_computeProgramId, "uRadiusSqr");
-    _unifLocEmitterCenter = glGetUniformLocation(_computeProgramId, "uEmitterCenter");
-    _unifLocMaxParticlesEmittedPerFrame = glGetUniformLocation(_computeProgramId, "uMmaxParticlesEmittedPerFrame");
-    _unifLocMaxParticleCount = glGetUniformLocation(_computeProgramId, "uMaxParticleCount");
+    _programId = programId;
+    _simulator = simulator;
+    _drawStyle = GL_POINTS;
 
-    glUseProgram(_computeProgramId);
-    
-    glUniform1f(_unifLocRadiusSqr, _radiusSqr);
-    glUniform1ui(_unifLocMaxParticlesEmittedPerFrame, maxParticlesEmittedPerFrame);
-    glUniform1ui(_unifLocMaxParticleCount, numParticles);
-
-    // feeding vectors into uniforms requires an array, or at least they need to be contiguous 
-    // in memory, and I would rather explicitly spell out an array than assume the value order 
-    // in a 3rd party struct
-    float centerArr[4] = { center.x, center.y, 0.0f, 0.0f };
-    glUniform2fv(_unifLocEmitterCenter, 1, centerArr);
-    
-    //??why are these work group counts all undefined??
-    int workGroupCount[3];
-    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &workGroupCount[0]);
-    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &workGroupCount[1]);
-    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 2, &workGroupCount[2]);
-    printf("max global (total) work group counts: x = %d, y = %d, z = %d\n", workGroupCount[0], 
-        workGroupCount[1], workGroupCount[2]);
-
-    int workGroupSize[3];
-    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &workGroupCount[0]);
-    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 1, &workGroupCount[1]);
-    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 2, &workGroupCount[2]);
-    printf("max global (total) work group sizes: x = %d, y = %d, z = %d\n", workGroupSize[0],
-        workGroupSize[1], workGroupSize[2]);
-
-    int workGroupInvocations = 0;
-    // ??why is GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, which is in the lists at https://www.opengl.org/wiki/GLAPI/glGet, bute  undefined, but GL_MAX_COMPUTE_LOCAL_INVOCATIONS, which is not in the lists on that website, is defined? are they the same thing??
-    glGetIntegerv(GL_MAX_COMPUTE_LOCAL_INVOCATIONS, &workGroupInvocations);
-    printf("max local invocations = %d\n", workGroupInvocations);
+    // lay the emitters' particles end to end
+    _emitters = emitters;
+    unsigned int numParticles = 0;
+    for (size_t emitterIndex = 0; emitterIndex < _emitters.size(); emitterIndex++)
+    {
+        ParticleEmitter &emitter = _emitters[emitterIndex];
+        emitter._radiusSqr = emitter._radius * emitter._radius;
+        emitter._firstParticle = numParticles;
+        emitter._padding = 0;
+        numParticles += emitter._numParticles;
+    }
 
-    glUseProgram(0);
+    if (_isStateless)
+    {
+        this->InitStateless();
+        return;
+    }
 
-    // no program binding needed 
-    // Note: Using a "shader storage buffer" because, unlike the vertex array buffer, this same buffer can be used for both the compute shader and the vertex shader.
-    _shaderBufferId = 0;
-    glGenBuffers(1, &_shaderBufferId);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _shaderBufferId);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, _allParticles.size() * sizeof(Particle), _allParticles.data(), GL_STATIC_DRAW);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _shaderBufferId);  // ??the hey does this do??
-
-    // now set up the vertex array indices for the drawing shader
-    // Note: MUST bind the program beforehand or else the VAO binding will blow up.  It won't 
-    // spit out an error but will rather silently bind to whatever program is currently bound, 
-    // even if it is the undefined program 0.
-    glUseProgram(programId);
-    glGenVertexArrays(1, &_vaoId);
-    glBindVertexArray(_vaoId);
-    glBindBuffer(GL_ARRAY_BUFFER, _shaderBufferId);
-    // do NOT call glBufferData(...) because info was already loaded
+    // start all particles at the emission orign
+    // Note: They also start inactive, so the simulator lets them out a few at a time 
+    // (maxParticlesEmittedPerFrame) instead of all at once.
+    const void *particleData = 0;
+    if (_usePackedFormat)
+    {
+        _allPackedParticles.resize(numParticles);
+        _sizeBytes = sizeof(ParticlePacked) * numParticles;
+        particleData = _allPackedParticles.data();
+    }
+    else
+    {
+        _allParticles.resize(numParticles);
+        _sizeBytes = sizeof(Particle) * numParticles;
+        particleData = _allParticles.data();
+    }
 
-    // position appears first in structure and so is attribute 0 
-    // velocity appears second and is attribute 1
-    // "is active" flag is third and is attribute 2
-    unsigned int vertexArrayIndex = 0;
-    unsigned int bufferStartOffset = 0;
+    // one random context for each block, each jumped ahead from the one before it
+    unsigned int numBlocks = (numParticles + RANDOM_BLOCK_PARTICLES - 1) / RANDOM_BLOCK_PARTICLES;
+    std::vector<RandomContext> blockRandoms(numBlocks);
+    RandomContext random;
+    random.Seed(_randomSeed);
+    for (unsigned int blockIndex = 0; blockIndex < numBlocks; blockIndex++)
+    {
+        blockRandoms[blockIndex] = random;
+        random.Jump();
+    }
 
-    unsigned int bytesPerStep = sizeof(Particle);
+    if (_threadPool != 0 && numParticles > 0)
+    {
+        _threadPool->ParallelFor(numParticles, RANDOM_BLOCK_PARTICLES,
+            [this, &blockRandoms](unsigned int beginIndex, unsigned int endIndex)
+        {
+            this->ResetParticleRange(beginIndex, endIndex, 
+                &blockRandoms[beginIndex / RANDOM_BLOCK_PARTICLES]);
+        });
+    }
+    else
+    {
+        for (unsigned int blockIndex = 0; blockIndex < numBlocks; blockIndex++)
+        {
+            unsigned int beginIndex = blockIndex * RANDOM_BLOCK_PARTICLES;
+            unsigned int endIndex = (numParticles - beginIndex > RANDOM_BLOCK_PARTICLES) ? 
+                (beginIndex + RANDOM_BLOCK_PARTICLES) : numParticles;
+            this->ResetParticleRange(beginIndex, endIndex, &blockRandoms[blockIndex]);
+        }
+    }
 
-    // position
-    GLenum itemType = GL_FLOAT;
-    unsigned int numItems = sizeof(Particle::_position) / sizeof(float);
-    glEnableVertexAttribArray(vertexArrayIndex);
-    glVertexAttribPointer(vertexArrayIndex, numItems, itemType, GL_FALSE, bytesPerStep, (void *)bufferStartOffset);
+    if (_programId != 0)
+    {
+        // no program binding needed 
+        // Note: Using a "shader storage buffer" because, unlike the vertex array buffer, this same buffer can be used for both the compute shader and the vertex shader.
+        _shaderBufferId = 0;
+        glGenBuffers(1, &_shaderBufferId);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _shaderBufferId);
+        // Also Note: A CPU simulator re-uploads everything every frame, so hint accordingly.
+        GLenum usage = _simulator->UpdatesOnCpu() ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _sizeBytes, particleData, usage);
+
+        // the emitter table never changes after this
+        glGenBuffers(1, &_emitterBufferId);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _emitterBufferId);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ParticleEmitter) * _emitters.size(), 
+            _emitters.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        // now set up the vertex array indices for the drawing shader
+        // Note: MUST bind the program beforehand or else the VAO binding will blow up.  It won't 
+        // spit out an error but will rather silently bind to whatever program is currently bound, 
+        // even if it is the undefined program 0.
+        glUseProgram(programId);
+        glGenVertexArrays(1, &_vaoId);
+        glBindVertexArray(_vaoId);
+        glBindBuffer(GL_ARRAY_BUFFER, _shaderBufferId);
+        // do NOT call glBufferData(...) because info was already loaded
+
+        // both drawing programs have this
+        _unifLocRenderOffsetSec = glGetUniformLocation(programId, "uRenderOffsetSec");
+
+        if (_usePackedFormat)
+        {
+            this->InitPackedVertexAttributes();
+        }
+        else
+        {
+            // position appears first in structure and so is attribute 0 
+            // velocity appears second and is attribute 1
+            // "is active" flag is third and is attribute 2
+            unsigned int vertexArrayIndex = 0;
+            unsigned int bufferStartOffset = 0;
+
+            unsigned int bytesPerStep = sizeof(Particle);
+
+            // position
+            GLenum itemType = GL_FLOAT;
+            unsigned int numItems = sizeof(Particle::_position) / sizeof(float);
+            glEnableVertexAttribArray(vertexArrayIndex);
+            glVertexAttribPointer(vertexArrayIndex, numItems, itemType, GL_FALSE, bytesPerStep, (void *)bufferStartOffset);
+
+            // velocity
+            itemType = GL_FLOAT;
+            numItems = sizeof(Particle::_velocity) / sizeof(float);
+            bufferStartOffset += sizeof(Particle::_position);
+            vertexArrayIndex++;
+            glEnableVertexAttribArray(vertexArrayIndex);
+            glVertexAttribPointer(vertexArrayIndex, numItems, itemType, GL_FALSE, bytesPerStep, (void *)bufferStartOffset);
+
+            // "is active" flag
+            itemType = GL_INT;
+            numItems = sizeof(Particle::_isActive) / sizeof(int);
+            bufferStartOffset += sizeof(Particle::_velocity);
+            vertexArrayIndex++;
+            glEnableVertexAttribArray(vertexArrayIndex);
+            glVertexAttribPointer(vertexArrayIndex, numItems, itemType, GL_FALSE, bytesPerStep, (void *)bufferStartOffset);
+        }
+
+        // cleanup
+        glBindVertexArray(0);   // unbind this BEFORE the array
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);    // always last
+    }
 
-    // velocity
-    itemType = GL_FLOAT;
-    numItems = sizeof(Particle::_velocity) / sizeof(float);
-    bufferStartOffset += sizeof(Particle::_position);
-    vertexArrayIndex++;
-    glEnableVertexAttribArray(vertexArrayIndex);
-    glVertexAttribPointer(vertexArrayIndex, numItems, itemType, GL_FALSE, bytesPerStep, (void *)bufferStartOffset);
-
-    // "is active" flag
-    itemType = GL_INT;
-    numItems = sizeof(Particle::_isActive) / sizeof(int);
-    bufferStartOffset += sizeof(Particle::_velocity);
-    vertexArrayIndex++;
-    glEnableVertexAttribArray(vertexArrayIndex);
-    glVertexAttribPointer(vertexArrayIndex, numItems, itemType, GL_FALSE, bytesPerStep, (void *)bufferStartOffset);
-
-    // cleanup
-    glBindVertexArray(0);   // unbind this BEFORE the array
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glUseProgram(0);    // always last
+    if (_usePackedFormat)
+    {
+        _simulator->Init(0, &_allPackedParticles, _shaderBufferId, &_emitters, _emitterBufferId);
+    }
+    else
+    {
+        _simulator->Init(&_allParticles, 0, _shaderBufferId, &_emitters, _emitterBufferId);
+    }
 }
 
 /*-----------------------------------------------------------------------------------------------
@@ -197,6 +355,12 @@ Description:
     particles hasn't been reached yet, then the particle is sent back out again.  Lastly, if the 
     particle is active, then its position is updated with its velocity and the provided delta 
     time.
+
+    The work itself is done by the simulator.  If it did the work on the CPU, then the results 
+    are uploaded to the particle buffer by the next Render(...) so that they can be drawn.  
+    Note: The upload waits for Render(...) because there may be several updates per frame.
+
+    If stateless, then this only moves the clock forward.
 Parameters:
     deltatimeSec        Self-explanatory
 Returns:    None
@@ -205,52 +369,418 @@ Creator:    John Cox (7-4-2016)
 -----------------------------------------------------------------------------------------------*/
 void ParticleManager::Update(float deltaTimeSec)
 {
-    // bind before attempting to send any uniforms or starting to compute stuff
-    glUseProgram(_computeProgramId);
-    glUniform1f(_unifLocDeltaTimeSec, deltaTimeSec);
-
-    // the work groups specified here MUST (??you sure??) match the values specified by 
-    // "local_size_x", "local_size_y", and "local_size_z" in the compute shader's input layout
-    GLuint numWorkGroupsX = (_allParticles.size() / 256) + 1;
-    GLuint numWorkGroupsY = 1;
-    GLuint numWorkGroupsZ = 1;
-    glDispatchCompute(numWorkGroupsX, numWorkGroupsY, numWorkGroupsZ);
-
-    // tell the GPU:
-    // (1) Accesses to the shader buffer after this call will reflect writes prior to the 
-    // barrier.  This is only available in OpenGL 4.3 or higher.
-    // (2) Vertex data sourced from buffer objects after the barrier will reflect data written 
-    // by shaders prior to the barrier.  The affected buffer(s) is determined by the buffers 
-    // that were bound for the vertex attributes.  In this case, that means GL_ARRAY_BUFFER.
-    //glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
-    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    if (_isStateless)
+    {
+        // nothing to update; the particles are wherever the time says they are
+        _statelessTimeSec += deltaTimeSec;
+        _lastDeltaTimeSec = deltaTimeSec;
+        return;
+    }
+
+    _simulator->Update(deltaTimeSec);
+    _lastDeltaTimeSec = deltaTimeSec;
+
+    // the simulator changed the particle collection and not the buffer
+    if (_simulator->UpdatesOnCpu())
+    {
+        _bufferIsStale = true;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Draws every particle as a point.  Does nothing if there is no render program (headless).
+    If a CPU simulator has changed the particles since the last draw, they are uploaded first.
+
+    If the simulator keeps a list of live particles, then only those are drawn.  The list 
+    buffer holds its own draw command, so the count never comes back to the CPU.
+
+    The particles are drawn partway between the state before the last Update(...) and the 
+    state after it.  The vertex shader does this by backing each particle up along its 
+    velocity, so nothing extra is kept around.  A particle that was reset during the last 
+    update is drawn a little way behind the emitter for that one frame.
+
+    If stateless, then each emitter's particles are drawn with their own glDrawArrays(...) and 
+    the vertex shader works each one out from its index and the time in between the updates, 
+    so there is nothing to back up.
+Parameters:
+    interpolation   On the range [0,1].  0 draws the particles where they were before the last
+                    update and 1 draws them where it left them (see FrameClock).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::Render(float interpolation)
+{
+    if (_programId == 0)
+    {
+        return;
+    }
+
+    if (_isStateless)
+    {
+        this->RenderStateless(interpolation);
+        return;
+    }
 
+    if (_bufferIsStale)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, _shaderBufferId);
+        const void *particleData = _usePackedFormat ? 
+            (const void *)_allPackedParticles.data() : (const void *)_allParticles.data();
+        glBufferSubData(GL_ARRAY_BUFFER, 0, _sizeBytes, particleData);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        _bufferIsStale = false;
+    }
+
+    glUseProgram(_programId);
+    glUniform1f(_unifLocRenderOffsetSec, (interpolation - 1.0f) * _lastDeltaTimeSec);
+    glBindVertexArray(_vaoId);
+    unsigned int liveListBufferId = _simulator->GetLiveListBufferId();
+    if (liveListBufferId != 0)
+    {
+        // the live particles' indices are the element array, so the vertex attributes are 
+        // pulled from the particle buffer just like with glDrawArrays(...)
+        // Note: The element array binding is part of the VAO, and the simulator swaps between 
+        // two lists, so it has to be bound every time.
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, liveListBufferId);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, liveListBufferId);
+        glDrawElementsIndirect(_drawStyle, GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else
+    {
+        glDrawArrays(_drawStyle, 0, this->NumParticles());
+    }
+    glBindVertexArray(0);
     glUseProgram(0);
 }
 
-void ParticleManager::Render()
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the size of the particle collection.  Useful for reporting timings.  If 
+    stateless, then there is no collection, but this is still how many particles there are.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleManager::NumParticles() const
 {
+    if (_isStateless)
+    {
+        // the particles are laid out end to end, so the last emitter's end is the total
+        if (_emitters.empty())
+        {
+            return 0;
+        }
+        const ParticleEmitter &lastEmitter = _emitters.back();
+        return lastEmitter._firstParticle + lastEmitter._numParticles;
+    }
+    if (_usePackedFormat)
+    {
+        return _allPackedParticles.size();
+    }
+    return _allParticles.size();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Chooses between the full 48 byte Particle structure and the compact 12 byte ParticlePacked
+    structure for the particle collection, the buffer, and the drawing program's inputs.  Must 
+    be called before Init(...).
+Parameters:
+    usePackedFormat     Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::SetPackedFormat(bool usePackedFormat)
+{
+    _usePackedFormat = usePackedFormat;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Chooses "stateless" particles (see ParticleStateless.h).  No particles are stored, nothing 
+    is simulated, and Update(...) only moves the clock forward.  Each particle's position is 
+    worked out from its index and the time whenever it is drawn or fingerprinted, so memory 
+    stays the same no matter how many particles there are.  Must be called before Init(...).
+
+    This only works because the particles move in straight lines and are sent out again when 
+    they leave.  Anything that pushes them around, like force fields, obstacles, turbulence, 
+    collisions, or the fluid, needs the simulator and is not available.  The random seed and 
+    the packed format don't apply either.
+Parameters:
+    isStateless     Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::SetStateless(bool isStateless)
+{
+    _isStateless = isStateless;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives Init(...) threads to make the particles on.  Must be called before Init(...).  The 
+    particles are the same with or without it, and with any number of threads.
+Parameters:
+    threadPool  Must outlive Init(...).  0 means make them on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::SetThreadPool(ThreadPool *threadPool)
+{
+    _threadPool = threadPool;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sets the seed for the random starting positions and velocities.  Must be called before 
+    Init(...).  Two runs with the same seed and the same Init(...) arguments start with exactly 
+    the same particles, no matter what else used randomness in between.
+Parameters:
+    seed    Any value.  The default is 0.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::SetRandomSeed(unsigned int seed)
+{
+    _randomSeed = seed;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Summarizes the particles' current state (see ParticleFingerprint.h).  The simulator is 
+    asked to bring the particle collection up to date first, which for the compute shader 
+    means waiting on the GPU and reading the whole buffer back, so this is for checking runs 
+    against each other, not for every frame of a normal run.
+
+    If stateless, then every particle is worked out on the CPU at the current time instead.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleFingerprint ParticleManager::TakeFingerprint()
+{
+    if (_simulator != 0)
+    {
+        _simulator->ReadBackParticles();
+    }
+
+    // FNV-1a, 64 bit
+    static const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ULL;
+    static const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+    ParticleFingerprint fingerprint;
+    fingerprint._numActive = 0;
+    fingerprint._sumX = 0.0;
+    fingerprint._sumY = 0.0;
+    fingerprint._hash = FNV_OFFSET_BASIS;
+    unsigned int words[3] = { 0, 0, 0 };
+    for (unsigned int particleIndex = 0; particleIndex < this->NumParticles(); particleIndex++)
+    {
+        Particle p;
+        if (_isStateless)
+        {
+            // the same words as the full format so that a stateless run can be compared with 
+            // itself on another machine
+            p = this->GetStatelessParticleAt(particleIndex);
+            memcpy(&words[0], &p._position.x, sizeof(float));
+            memcpy(&words[1], &p._position.y, sizeof(float));
+            words[2] = (unsigned int)p._isActive;
+        }
+        else if (_usePackedFormat)
+        {
+            const ParticlePacked &packed = _allPackedParticles[particleIndex];
+            words[0] = packed._position;
+            words[1] = packed._lowBitsAndFlags;
+            words[2] = 0;
+            const ParticleEmitter &emitter = _emitters[GetPackedEmitterIndex(packed)];
+            p = UnpackParticle(packed, emitter._center, emitter._radius);
+        }
+        else
+        {
+            p = _allParticles[particleIndex];
+            memcpy(&words[0], &p._position.x, sizeof(float));
+            memcpy(&words[1], &p._position.y, sizeof(float));
+            words[2] = (unsigned int)p._isActive;
+        }
+
+        const unsigned char *bytes = (const unsigned char *)words;
+        for (unsigned int byteIndex = 0; byteIndex < sizeof(words); byteIndex++)
+        {
+            fingerprint._hash = (fingerprint._hash ^ bytes[byteIndex]) * FNV_PRIME;
+        }
+
+        if (p._isActive != 0)
+        {
+            fingerprint._numActive++;
+            fingerprint._sumX += p._position.x;
+            fingerprint._sumY += p._position.y;
+        }
+    }
+
+    return fingerprint;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The packed format's version of the vertex attribute setup in Init(...).  Each field of 
+    ParticlePacked is a single unsigned int, so they are integer attributes, and 
+    shaderParticlePacked.vert unpacks them itself.  That shader also needs each particle's 
+    emitter center and radius to turn the packed position back into window coordinates, so it 
+    gets the emitter table too.
+
+    The drawing program, the VAO, and the buffer must already be bound.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::InitPackedVertexAttributes()
+{
+    // Note: glVertexAttribIPointer(...), with the "I", keeps the values as integers instead of 
+    // converting them to floats.
+    unsigned int bytesPerStep = sizeof(ParticlePacked);
+    unsigned int bufferStartOffset = 0;
+
+    // position
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, bytesPerStep, (void *)bufferStartOffset);
+
+    // velocity
+    bufferStartOffset += sizeof(ParticlePacked::_position);
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, bytesPerStep, (void *)bufferStartOffset);
+
+    // low position bits, the "is active" flag, and the emitter index
+    bufferStartOffset += sizeof(ParticlePacked::_velocity);
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, bytesPerStep, (void *)bufferStartOffset);
+
+    // Note: The compute shaders use the same binding, so this is the same as what the GPU 
+    // simulator does, but a CPU simulator doesn't bind anything.
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_BUFFER_BINDING, _emitterBufferId);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The stateless version of the buffer setup in Init(...).  There are no particles to upload, 
+    so only the emitter table goes to the GPU, and the VAO has no attributes at all because 
+    shaderParticleStateless.vert works everything out from gl_VertexID.  Does nothing if there 
+    is no program (headless).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::InitStateless()
+{
+    _simulator = 0;
+    _sizeBytes = 0;
+    _statelessTimeSec = 0.0;
+    if (_programId == 0)
+    {
+        return;
+    }
+
+    // the emitter table never changes after this
+    glGenBuffers(1, &_emitterBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _emitterBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ParticleEmitter) * _emitters.size(), 
+        _emitters.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // Note: A core profile won't draw without a VAO bound, even if it has nothing in it.
+    glUseProgram(_programId);
+    glGenVertexArrays(1, &_vaoId);
+    _unifLocPeriodIndex = glGetUniformLocation(_programId, "uPeriodIndex");
+    _unifLocPeriodTimeSec = glGetUniformLocation(_programId, "uPeriodTimeSec");
+    _unifLocEmitterIndex = glGetUniformLocation(_programId, "uEmitterIndex");
+    glUseProgram(0);
+
+    // Also Note: Nothing else uses this binding when there is no simulator, so it only needs 
+    // to be bound once.
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_BUFFER_BINDING, _emitterBufferId);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The stateless version of Render(...).  Each emitter's particles are one glDrawArrays(...) 
+    so that the vertex shader gets the emitter from a uniform and adds gl_VertexID to the 
+    emitter's first particle to get the particle's index.  That is one draw call per emitter, 
+    but there aren't usually very many, and it saves looking up the emitter for every vertex.
+Parameters:
+    interpolation   See Render(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::RenderStateless(float interpolation)
+{
+    // Note: Only the time within the period goes down to a float, not the clock itself (see 
+    // _statelessTimeSec).
+    double timeSec = _statelessTimeSec + ((interpolation - 1.0f) * _lastDeltaTimeSec);
+    unsigned int periodIndex = 0;
+    float periodTimeSec = 0.0f;
+    SplitStatelessTime(timeSec, &periodIndex, &periodTimeSec);
+
     glUseProgram(_programId);
+    glUniform1ui(_unifLocPeriodIndex, periodIndex);
+    glUniform1f(_unifLocPeriodTimeSec, periodTimeSec);
     glBindVertexArray(_vaoId);
-    glDrawArrays(_drawStyle, 0, _allParticles.size());
+    for (size_t emitterIndex = 0; emitterIndex < _emitters.size(); emitterIndex++)
+    {
+        glUniform1ui(_unifLocEmitterIndex, (GLuint)emitterIndex);
+        glDrawArrays(_drawStyle, 0, _emitters[emitterIndex]._numParticles);
+    }
+    glBindVertexArray(0);
     glUseProgram(0);
 }
 
 /*-----------------------------------------------------------------------------------------------
 Description:
-    Checks if the provided particle has gone outside the circle.
+    Works out one stateless particle at the current time (see ParticleStateless.h).  The 
+    emitters' ranges are in order, so the particle's emitter is found with a binary search.
 Parameters:
-    p   A const reference to a Particle object.
+    particleIndex   Across all emitters, like the particle collection would be.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+Particle ParticleManager::GetStatelessParticleAt(unsigned int particleIndex) const
+{
+    // the first emitter that starts after this particle, then back one
+    std::vector<ParticleEmitter>::const_iterator after = std::upper_bound(_emitters.begin(), 
+        _emitters.end(), particleIndex, 
+        [](unsigned int index, const ParticleEmitter &emitter)
+    {
+        return index < emitter._firstParticle;
+    });
+    unsigned int emitterIndex = (unsigned int)(after - _emitters.begin()) - 1;
+    const ParticleEmitter &emitter = _emitters[emitterIndex];
+
+    unsigned int periodIndex = 0;
+    float periodTimeSec = 0.0f;
+    SplitStatelessTime(_statelessTimeSec, &periodIndex, &periodTimeSec);
+    return GetStatelessParticle(emitter, emitterIndex, particleIndex, periodIndex, 
+        periodTimeSec);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Checks if the provided particle has gone outside its emitter's circle.
+Parameters:
+    p           A const reference to a Particle object.
+    emitter     The particle's emitter.
 Returns:
     True if the particle's position is outside the circle's boundaries, otherwise false.
     Exception:  Safe
 Creator:    John Cox (7-2-2016)
 -----------------------------------------------------------------------------------------------*/
-bool ParticleManager::OutOfBounds(const Particle &p) const
+bool ParticleManager::OutOfBounds(const Particle &p, const ParticleEmitter &emitter) const
 {
-    glm::vec4 centerToParticle = p._position - glm::vec4(_center, 0.0f, 0.0f);
+    glm::vec4 centerToParticle = p._position - glm::vec4(emitter._center, 0.0f, 0.0f);
     float distSqr = glm::dot(centerToParticle, centerToParticle);
-    if (distSqr > _radiusSqr)
+    if (distSqr > emitter._radiusSqr)
     {
         return true;
     }
@@ -263,52 +793,125 @@ bool ParticleManager::OutOfBounds(const Particle &p) const
 
 /*-----------------------------------------------------------------------------------------------
 Description:
-    Sets the given particle's starting position and velocity.  Does NOT alter the "is active"
-    flag.  That flag is altered during Update(...).
+    Resets one block of particles, in order, with that block's random context (see 
+    Init(...)).  A block may hold particles from more than one emitter.  If using the packed 
+    format, then each particle is packed as soon as it is reset.
+Parameters:
+    beginIndex      The first particle to reset.
+    endIndex        One past the last particle to reset.
+    random          The block's own random context.  No other thread may be using it.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleManager::ResetParticleRange(unsigned int beginIndex, unsigned int endIndex, 
+    RandomContext *random)
+{
+    // the emitters are in order of their first particle, so the one that owns beginIndex is 
+    // the last one that starts at or before it
+    std::vector<ParticleEmitter>::const_iterator emitterItr = std::upper_bound(
+        _emitters.begin(), _emitters.end(), beginIndex,
+        [](unsigned int particleIndex, const ParticleEmitter &emitter)
+    {
+        return particleIndex < emitter._firstParticle;
+    });
+    unsigned int emitterIndex = (unsigned int)(emitterItr - _emitters.begin()) - 1;
+
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        // skip past the emitters that end before this particle (and the empty ones)
+        while (particleIndex >= 
+            _emitters[emitterIndex]._firstParticle + _emitters[emitterIndex]._numParticles)
+        {
+            emitterIndex++;
+        }
+
+        if (_usePackedFormat)
+        {
+            const ParticleEmitter &emitter = _emitters[emitterIndex];
+            Particle p = Particle();
+            this->ResetParticle(&p, emitterIndex, random);
+            _allPackedParticles[particleIndex] = PackParticle(p, emitter._center, 
+                emitter._radius);
+        }
+        else
+        {
+            // pointer arithmetic will do
+            this->ResetParticle(_allParticles.data() + particleIndex, emitterIndex, random);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sets the given particle's starting position and velocity and records which emitter it 
+    belongs to.  Does NOT alter the "is active" flag.  That flag is altered during Update(...).
 Parameters:
-    resetThis   Self-explanatory.
+    resetThis       Self-explanatory.
+    emitterIndex    Self-explanatory.
+    random          Where the random numbers come from.
 Returns:    None
 Exception:  Safe
 Creator:    John Cox (7-2-2016)
 -----------------------------------------------------------------------------------------------*/
-void ParticleManager::ResetParticle(Particle *resetThis) const
+void ParticleManager::ResetParticle(Particle *resetThis, unsigned int emitterIndex, 
+    RandomContext *random)
 {
+    const ParticleEmitter &emitter = _emitters[emitterIndex];
+
     // Note: The hard-coded mod100 is just to prevent the random axis magnitudes from 
     // getting too crazy different from each other.
-    float newX = (float)(RandomPosAndNeg() % 100);
-    float newY = (float)(RandomPosAndNeg() % 100);
+    // Also Note: Both can come up 0 (about 1 in 10000), and normalizing that makes a NaN 
+    // particle that is never out of bounds, so roll again.
+    float newX = 0.0f;
+    float newY = 0.0f;
+    while (newX == 0.0f && newY == 0.0f)
+    {
+        newX = (float)(random->PosAndNeg() % 100);
+        newY = (float)(random->PosAndNeg() % 100);
+    }
     glm::vec2 randomVector = glm::normalize(glm::vec2(newX, newY));
     
     // hard-coded region of radius 0.1f in window space
-    float radiusVariation = RandomOnRange0to1() * 0.1f; 
+    float radiusVariation = random->OnRange0to1() * 0.1f; 
 
-    resetThis->_position = glm::vec4(_center + (randomVector * radiusVariation), 0.0f, 0.0f);
-    resetThis->_velocity = glm::vec4(this->GetNewVelocityVector(), 0.0f, 0.0f);
+    resetThis->_position = glm::vec4(emitter._center + (randomVector * radiusVariation), 0.0f, 0.0f);
+    resetThis->_velocity = glm::vec4(this->GetNewVelocityVector(emitter, random), 0.0f, 0.0f);
+    resetThis->_emitterIndex = (int)emitterIndex;
 }
 
 /*-----------------------------------------------------------------------------------------------
 Description:
-    Generates a new velocity vector between the previously provided minimum and maximum values 
-    and in the provided direction.
-Parameters: None
+    Generates a new velocity vector between the emitter's minimum and maximum values and in a 
+    random direction.
+Parameters:
+    emitter     Self-explanatory.
+    random      Where the random numbers come from.
 Returns:    
-    A 2D vector whose magnitude is between the initialized "min" and "max" values and whose
+    A 2D vector whose magnitude is between the emitter's "min" and "max" values and whose
     direction is random.
 Exception:  Safe
 Creator:    John Cox (7-2-2016)
 -----------------------------------------------------------------------------------------------*/
-glm::vec2 ParticleManager::GetNewVelocityVector() const
+glm::vec2 ParticleManager::GetNewVelocityVector(const ParticleEmitter &emitter, 
+    RandomContext *random)
 {
     // this demo particle "manager" emits in a circle, so get a random 2D direction
     // Note: The hard-coded mod100 is just to prevent the random axis magnitudes from 
     // getting too crazy different from each other.
-    float newX = (float)(RandomPosAndNeg() % 100);
-    float newY = (float)(RandomPosAndNeg() % 100);
+    // Also Note: Both can come up 0 (about 1 in 10000), and normalizing that makes a NaN 
+    // particle that is never out of bounds, so roll again.
+    float newX = 0.0f;
+    float newY = 0.0f;
+    while (newX == 0.0f && newY == 0.0f)
+    {
+        newX = (float)(random->PosAndNeg() % 100);
+        newY = (float)(random->PosAndNeg() % 100);
+    }
     glm::vec2 randomVelocityVector = glm::normalize(glm::vec2(newX, newY));
     
     // randomize between the min and max velocities to get a little variation
-    float velocityVariation = RandomOnRange0to1() * _velocityDelta;
-    float velocityMagnitude = _velocityMin + velocityVariation;
+    float velocityVariation = random->OnRange0to1() * (emitter._maxVelocity - emitter._minVelocity);
+    float velocityMagnitude = emitter._minVelocity + velocityVariation;
 
     return randomVelocityVector * velocityMagnitude;
 }
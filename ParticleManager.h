@@ -1,6 +1,12 @@
 #pragma once
 
 #include "Particle.h"
+#include "ParticlePacked.h"
+#include "ParticleSimulator.h"
+#include "ParticleFingerprint.h"
+#include "ParticleEmitter.h"
+#include "RandomToast.h"
+#include "ThreadPool.h"
 #include "glm/vec2.hpp"
 
 #include <vector>
@@ -19,54 +25,85 @@ public:
     ParticleManager();
     ~ParticleManager();
     void Init(unsigned int programId,
-        unsigned int computeProgramId,
+        ParticleSimulator *simulator,
         unsigned int numParticles, 
         unsigned int maxParticlesEmittedPerFrame,
         const glm::vec2 center,
         float radius,
         float minVelocity,
         float maxVelocity);
+    void Init(unsigned int programId,
+        ParticleSimulator *simulator,
+        const std::vector<ParticleEmitter> &emitters);
     void Cleanup();
     void Update(float deltaTimeSec);
 
-    void Render();
+    void Render(float interpolation);
+
+    unsigned int NumParticles() const;
+
+    void SetPackedFormat(bool usePackedFormat);
+    void SetStateless(bool isStateless);
+    void SetRandomSeed(unsigned int seed);
+    void SetThreadPool(ThreadPool *threadPool);
+    ParticleFingerprint TakeFingerprint();
 
 private:
-    bool OutOfBounds(const Particle &p) const;
-    void ResetParticle(Particle *resetThis) const;
-    glm::vec2 GetNewVelocityVector() const;
+    void InitPackedVertexAttributes();
+    void InitStateless();
+    void RenderStateless(float interpolation);
+    Particle GetStatelessParticleAt(unsigned int particleIndex) const;
+    bool OutOfBounds(const Particle &p, const ParticleEmitter &emitter) const;
+    void ResetParticleRange(unsigned int beginIndex, unsigned int endIndex, 
+        RandomContext *random);
+    void ResetParticle(Particle *resetThis, unsigned int emitterIndex, RandomContext *random);
+    glm::vec2 GetNewVelocityVector(const ParticleEmitter &emitter, RandomContext *random);
 
-    glm::vec2 _center;
-    float _radiusSqr;   // because radius is never used
-    float _velocityMin;
-    float _velocityDelta;
+    // each one owns a contiguous range of the particles (see ParticleEmitter.h)
+    std::vector<ParticleEmitter> _emitters;
+    float _lastDeltaTimeSec;    // for drawing between the last two updates
 
     // save on the large header inclusion of OpenGL and write out these primitive types instead 
     // of using the OpenGL typedefs
     // Note: IDs are GLuint (unsigned int), draw style is GLenum (unsigned int), GLushort is 
     // unsigned short.
     unsigned int _programId;
-    unsigned int _computeProgramId;
     unsigned int _vaoId;
     //unsigned int _arrayBufferId;
     unsigned int _drawStyle;    // GL_TRIANGLES, GL_LINES, etc.
     unsigned int _sizeBytes;    // useful for glBufferSubData(...)
+    unsigned int _unifLocRenderOffsetSec;
     std::vector<Particle> _allParticles;
-    unsigned int _maxParticlesEmittedPerFrame;
+
+    // if true, then the particles are kept in _allPackedParticles instead of _allParticles, 
+    // and the buffer and drawing program use the same format
+    bool _usePackedFormat;
+    std::vector<ParticlePacked> _allPackedParticles;
+
+    // if true, then there is no particle collection or simulator, and every particle is worked 
+    // out from the time when it is needed (see ParticleStateless.h)
+    // Note: The time is a double so that adding up many small steps doesn't drift.  Only the 
+    // time within the current period is turned into a float (see SplitStatelessTime(...)).
+    bool _isStateless;
+    double _statelessTimeSec;
+    unsigned int _unifLocPeriodIndex;
+    unsigned int _unifLocPeriodTimeSec;
+    unsigned int _unifLocEmitterIndex;
+
+    // each block of particles gets its own random context in Init(...), all made from this 
+    // seed, so that the same seed always makes the same particles
+    unsigned int _randomSeed;
+
+    // not owned; if not 0, then Init(...) makes the particles' blocks on it
+    ThreadPool *_threadPool;
 
 
     unsigned int _shaderBufferId;
+    unsigned int _emitterBufferId;  // a copy of _emitters for the shaders
 
+    // true if a CPU simulator has changed the particles since they were last uploaded
+    bool _bufferIsStale;
 
-    // these are associated with the compute shader
-    // Note: To be honest, the only one that needs to be kept around in this demo is the one for 
-    // delta time.  That needs to be updated potentially every frame (this demo hard codes it, 
-    // but eh?).  Nevertheless, if the user wants to expand and shrink the circle or move the 
-    // emitter or flucuate how many particles can be emitted per frame, then these uniforms 
-    // could be useful.
-    unsigned int _unifLocDeltaTimeSec;
-    unsigned int _unifLocRadiusSqr;
-    unsigned int _unifLocEmitterCenter;
-    unsigned int _unifLocMaxParticlesEmittedPerFrame;
-    unsigned int _unifLocMaxParticleCount;
+    // not owned; the compute shader or a CPU stand-in
+    ParticleSimulator *_simulator;
 };
@@ -0,0 +1,581 @@
+#include "ParticleMeshGravity.h"
+
+#include "GravityTree.h"    // GravityTree::SOFTENING
+
+#include <math.h>
+#include <utility>  // std::swap
+
+// how the work is cut up for the thread pool
+static const unsigned int ROWS_PER_CHUNK = 4;
+static const unsigned int COLUMNS_PER_CHUNK = 8;
+static const unsigned int BODIES_PER_CHUNK = 4096;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    An in-place radix-2 FFT.  The data is put in bit-reversed order and then combined in
+    pairs, then fours, and so on.
+
+    Note: The complex multiply is written out because std::complex's operator* checks for
+    infinities and NaNs, which is several times slower.
+Parameters:
+    data        Self-explanatory.
+    size        A power of 2.
+    twiddles    e^(-2 pi i k / size) for k in [0, size / 2).
+    bitReversed Where each element goes.
+    inverse     If true, then transform back (without dividing by the size).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static void Fft(std::complex<float> *data, unsigned int size,
+    const std::complex<float> *twiddles, const unsigned int *bitReversed, bool inverse)
+{
+    for (unsigned int index = 0; index < size; index++)
+    {
+        unsigned int otherIndex = bitReversed[index];
+        if (otherIndex > index)
+        {
+            std::swap(data[index], data[otherIndex]);
+        }
+    }
+
+    float sign = inverse ? -1.0f : 1.0f;
+    for (unsigned int length = 2; length <= size; length *= 2)
+    {
+        unsigned int halfLength = length / 2;
+        unsigned int twiddleStep = size / length;
+        for (unsigned int start = 0; start < size; start += length)
+        {
+            std::complex<float> *even = data + start;
+            std::complex<float> *odd = data + start + halfLength;
+            for (unsigned int pairIndex = 0; pairIndex < halfLength; pairIndex++)
+            {
+                const std::complex<float> &twiddle = twiddles[pairIndex * twiddleStep];
+                float twiddleRe = twiddle.real();
+                float twiddleIm = twiddle.imag() * sign;
+                float oddRe = odd[pairIndex].real();
+                float oddIm = odd[pairIndex].imag();
+                std::complex<float> turned((oddRe * twiddleRe) - (oddIm * twiddleIm),
+                    (oddRe * twiddleIm) + (oddIm * twiddleRe));
+                odd[pairIndex] = even[pairIndex] - turned;
+                even[pairIndex] += turned;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  There is no mesh until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleMeshGravity::ParticleMeshGravity() :
+    _minCorner(0.0f, 0.0f),
+    _meshSize(0),
+    _meshSpacing(0.0f),
+    _inverseMeshSpacing(0.0f),
+    _fftSize(0),
+    _numBodies(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the mesh over the given square, makes room for the particles, and works out the
+    transform of a single particle's potential, which is the same every step.
+
+    The potential is softened by GravityTree::SOFTENING or one mesh cell, whichever is bigger.
+    Softening any less than a cell would only make a spike that the mesh can't follow.
+Parameters:
+    minCorner       The bottom left of the square that the particles can be in, in window
+                    coords.  The mesh has points on all four edges.
+    size            The width of the square.
+    meshSize        How many mesh points across.  Rounded down to a power of 2 and clamped to
+                    [MIN_MESH_SIZE, MAX_MESH_SIZE].
+    numParticles    The most particles that Build(...) will be given.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::Init(const glm::vec2 &minCorner, float size, unsigned int meshSize,
+    unsigned int numParticles)
+{
+    _meshSize = MIN_MESH_SIZE;
+    while (_meshSize < MAX_MESH_SIZE && (_meshSize * 2) <= meshSize)
+    {
+        _meshSize *= 2;
+    }
+    _minCorner = minCorner;
+    _meshSpacing = size / (_meshSize - 1);
+    _inverseMeshSpacing = 1.0f / _meshSpacing;
+    _fftSize = _meshSize * 2;
+
+    // Note: The grid's far corner is pulled in a hair so that rounding in (max - min) can't
+    // make the grid one cell wider than the mesh.  See GetMeshPoint(...) for the cells.
+    glm::vec2 maxCorner = minCorner + (glm::vec2(size, size) * 0.99999f);
+    _grid.Init(minCorner, maxCorner, _meshSpacing, numParticles);
+
+    _twiddles.resize(_fftSize / 2);
+    for (unsigned int index = 0; index < _fftSize / 2; index++)
+    {
+        double angle = -6.283185307179586 * index / _fftSize;
+        _twiddles[index] = Complex((float)cos(angle), (float)sin(angle));
+    }
+    _bitReversed.resize(_fftSize);
+    unsigned int numBits = 0;
+    while ((1u << numBits) < _fftSize)
+    {
+        numBits++;
+    }
+    for (unsigned int index = 0; index < _fftSize; index++)
+    {
+        unsigned int reversed = 0;
+        for (unsigned int bit = 0; bit < numBits; bit++)
+        {
+            reversed |= ((index >> bit) & 1) << (numBits - 1 - bit);
+        }
+        _bitReversed[index] = reversed;
+    }
+
+    // the padded mesh wraps around, so an offset of -D is at _fftSize - D
+    float softening = (GravityTree::SOFTENING > _meshSpacing) ?
+        GravityTree::SOFTENING : _meshSpacing;
+    _work.assign(_fftSize * _fftSize, Complex(0.0f, 0.0f));
+    for (unsigned int y = 0; y < _fftSize; y++)
+    {
+        float offsetY = (float)((y <= _meshSize) ? y : (_fftSize - y)) * _meshSpacing;
+        for (unsigned int x = 0; x < _fftSize; x++)
+        {
+            float offsetX = (float)((x <= _meshSize) ? x : (_fftSize - x)) * _meshSpacing;
+            float distSqr = (offsetX * offsetX) + (offsetY * offsetY) + (softening * softening);
+            _work[(y * _fftSize) + x] = Complex(1.0f / sqrtf(distSqr), 0.0f);
+        }
+    }
+
+    std::vector<Complex> column(_fftSize);
+    for (unsigned int y = 0; y < _fftSize; y++)
+    {
+        Fft(&_work[y * _fftSize], _fftSize, _twiddles.data(), _bitReversed.data(), false);
+    }
+    _potentialTransform.resize(_fftSize * _fftSize);
+    for (unsigned int x = 0; x < _fftSize; x++)
+    {
+        for (unsigned int y = 0; y < _fftSize; y++)
+        {
+            column[y] = _work[(y * _fftSize) + x];
+        }
+        Fft(column.data(), _fftSize, _twiddles.data(), _bitReversed.data(), false);
+
+        // Note: The 1 / (size * size) that the inverse transform leaves out goes in here.
+        for (unsigned int y = 0; y < _fftSize; y++)
+        {
+            _potentialTransform[(x * _fftSize) + y] =
+                column[y].real() / ((float)_fftSize * _fftSize);
+        }
+    }
+
+    _potential.resize(_meshSize * _meshSize);
+    _meshAccelerations.resize(_meshSize * _meshSize);
+    _positions.resize(numParticles);
+    _isActive.resize(numParticles);
+    _accelerations.assign(numParticles, glm::vec2(0.0f, 0.0f));
+    _sortedPositions.resize(numParticles);
+    _sortedParticles.resize(numParticles);
+    _numBodies = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::Cleanup()
+{
+    _meshSize = 0;
+    _fftSize = 0;
+    _twiddles.clear();
+    _bitReversed.clear();
+    _potentialTransform.clear();
+    _work.clear();
+    _potential.clear();
+    _meshAccelerations.clear();
+    _grid.Cleanup();
+    _positions.clear();
+    _isActive.clear();
+    _accelerations.clear();
+    _sortedPositions.clear();
+    _sortedParticles.clear();
+    _numBodies = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleMeshGravity::IsInitialized() const
+{
+    return _meshSize != 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (1): sorts the particles by mesh cell.  Everything from the last build is thrown out.
+Parameters:
+    numParticles    Must not be more than Init(...) was given.
+    getPositions    Called once for each of the grid's blocks.  Must be safe to call from more
+                    than one thread at once.
+    threadPool      May be 0 to build on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::Build(unsigned int numParticles, const PositionFunction &getPositions,
+    ThreadPool *threadPool)
+{
+    if (numParticles == 0 || numParticles > _positions.size())
+    {
+        return;
+    }
+
+    glm::vec2 *positions = _positions.data();
+    unsigned char *isActive = _isActive.data();
+    unsigned int numCellsX = _meshSize - 1;
+    _grid.Build(numParticles,
+        [this, &getPositions, positions, isActive, numCellsX](unsigned int beginIndex,
+            unsigned int endIndex, unsigned int *cellIndices)
+    {
+        getPositions(beginIndex, endIndex, positions + beginIndex, isActive + beginIndex);
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            unsigned int cellIndex = NeighborGrid::NO_CELL;
+            if (isActive[particleIndex] != 0)
+            {
+                unsigned int baseX = 0;
+                unsigned int baseY = 0;
+                glm::vec2 fraction;
+                this->GetMeshPoint(positions[particleIndex], &baseX, &baseY, &fraction);
+                cellIndex = (baseY * numCellsX) + baseX;
+            }
+            *cellIndices++ = cellIndex;
+        }
+    }, threadPool);
+
+    _numBodies = _grid.NumIndexed();
+    const unsigned int *gridParticles = _grid.GetSortedParticles();
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this, gridParticles](unsigned int beginIndex, unsigned int endIndex)
+    {
+        for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+        {
+            unsigned int particleIndex = gridParticles[sortedIndex];
+            _sortedParticles[sortedIndex] = particleIndex;
+            _sortedPositions[sortedIndex] = _positions[particleIndex];
+        }
+    });
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Steps (2) through (4).  Works out every particle's acceleration from the particles that
+    the last Build(...) sorted.
+Parameters:
+    strength        What the acceleration would be at a distance of 1 from all of the
+                    particles together.  See GravityTree::ComputeAccelerations(...).
+    threadPool      May be 0 to work on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::ComputeAccelerations(float strength, ThreadPool *threadPool)
+{
+    if (_numBodies == 0)
+    {
+        return;
+    }
+
+    // (2), and the forward transform of each row
+    ThreadPool::ParallelFor(threadPool, _meshSize, ROWS_PER_CHUNK,
+        [this](unsigned int beginRow, unsigned int endRow)
+    {
+        for (unsigned int rowIndex = beginRow; rowIndex < endRow; rowIndex++)
+        {
+            this->DepositRow(rowIndex);
+        }
+    });
+
+    // (3)
+    ThreadPool::ParallelFor(threadPool, _fftSize, COLUMNS_PER_CHUNK,
+        [this](unsigned int beginColumn, unsigned int endColumn)
+    {
+        this->ConvolveColumns(beginColumn, endColumn);
+    });
+    ThreadPool::ParallelFor(threadPool, _meshSize, ROWS_PER_CHUNK,
+        [this](unsigned int beginRow, unsigned int endRow)
+    {
+        for (unsigned int rowIndex = beginRow; rowIndex < endRow; rowIndex++)
+        {
+            this->FinishRow(rowIndex);
+        }
+    });
+
+    // (4)
+    float strengthPerParticle = strength / _numBodies;
+    ThreadPool::ParallelFor(threadPool, _meshSize, ROWS_PER_CHUNK,
+        [this, strengthPerParticle](unsigned int beginRow, unsigned int endRow)
+    {
+        for (unsigned int rowIndex = beginRow; rowIndex < endRow; rowIndex++)
+        {
+            this->ComputeSlopeRow(rowIndex, strengthPerParticle);
+        }
+    });
+    ThreadPool::ParallelFor(threadPool, _numBodies, BODIES_PER_CHUNK,
+        [this](unsigned int beginIndex, unsigned int endIndex)
+    {
+        this->InterpolateRange(beginIndex, endIndex);
+    });
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives the accelerations from the last ComputeAccelerations(...).
+Parameters: None
+Returns:
+    One acceleration for each particle, in window coords per second per second.  Inactive
+    particles' accelerations are left over from whenever they were last active.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const glm::vec2 *ParticleMeshGravity::GetAccelerations() const
+{
+    return _accelerations.data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Simple getters for the mesh that Init(...) made and the last build, for reporting.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleMeshGravity::MeshSize() const
+{
+    return _meshSize;
+}
+
+unsigned int ParticleMeshGravity::NumBodies() const
+{
+    return _numBodies;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out which mesh cell a position is in and how far across the cell it is.  Anything
+    off the edge of the mesh is put on the nearest edge.  The grid sort and the deposit and
+    interpolation all use this so that they can't disagree about a particle's cell.
+Parameters:
+    position    In window coords.
+    baseX       Gets the mesh point to the left, which is also the cell's X.
+    baseY       Gets the mesh point below, which is also the cell's Y.
+    fraction    Gets how far toward the next mesh point on each axis, [0, 1].
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::GetMeshPoint(const glm::vec2 &position, unsigned int *baseX,
+    unsigned int *baseY, glm::vec2 *fraction) const
+{
+    // Note: The comparisons are written so that NaN ends up at 0 (see
+    // NeighborGrid::GetCellIndex(...)).
+    float lastPoint = (float)(_meshSize - 1);
+    float x = (position.x - _minCorner.x) * _inverseMeshSpacing;
+    float y = (position.y - _minCorner.y) * _inverseMeshSpacing;
+    x = (x > 0.0f) ? x : 0.0f;
+    y = (y > 0.0f) ? y : 0.0f;
+    x = (x < lastPoint) ? x : lastPoint;
+    y = (y < lastPoint) ? y : lastPoint;
+    unsigned int cellX = (unsigned int)(int)x;
+    unsigned int cellY = (unsigned int)(int)y;
+    cellX = (cellX < _meshSize - 2) ? cellX : (_meshSize - 2);
+    cellY = (cellY < _meshSize - 2) ? cellY : (_meshSize - 2);
+    *baseX = cellX;
+    *baseY = cellY;
+    *fraction = glm::vec2(x - (float)cellX, y - (float)cellY);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (2) for one row of the mesh.  The mass comes from the particles in the row of cells
+    just below the row (which is the top edge of their cells) and the row of cells just above
+    it (the bottom edge).  Each of those particles' mass is split between the two mesh points
+    on that edge.  Then the row is padded with zeros and transformed.
+Parameters:
+    rowIndex    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::DepositRow(unsigned int rowIndex)
+{
+    Complex *row = &_work[rowIndex * _fftSize];
+    for (unsigned int x = 0; x < _fftSize; x++)
+    {
+        row[x] = Complex(0.0f, 0.0f);
+    }
+
+    // the cell row below this mesh row has it as its top edge
+    const unsigned int *gridParticles = _grid.GetSortedParticles();
+    unsigned int numCells = _meshSize - 1;
+    for (int cellRow = (int)rowIndex - 1; cellRow <= (int)rowIndex; cellRow++)
+    {
+        if (cellRow < 0 || cellRow >= (int)numCells)
+        {
+            continue;
+        }
+
+        const unsigned int *rowBegin = 0;
+        const unsigned int *rowEnd = 0;
+        const unsigned int *cellEnd = 0;
+        _grid.GetCellRange(0, (unsigned int)cellRow, &rowBegin, &cellEnd);
+        _grid.GetCellRange(numCells - 1, (unsigned int)cellRow, &cellEnd, &rowEnd);
+        unsigned int beginIndex = (unsigned int)(rowBegin - gridParticles);
+        unsigned int endIndex = (unsigned int)(rowEnd - gridParticles);
+        bool isTopEdge = (cellRow != (int)rowIndex);
+        for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+        {
+            unsigned int baseX = 0;
+            unsigned int baseY = 0;
+            glm::vec2 fraction;
+            this->GetMeshPoint(_sortedPositions[sortedIndex], &baseX, &baseY, &fraction);
+            float weightY = isTopEdge ? fraction.y : (1.0f - fraction.y);
+            float rightMass = weightY * fraction.x;
+            row[baseX] += Complex(weightY - rightMass, 0.0f);
+            row[baseX + 1] += Complex(rightMass, 0.0f);
+        }
+    }
+
+    Fft(row, _fftSize, _twiddles.data(), _bitReversed.data(), false);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (3) for some of the padded mesh's columns: transform, multiply by the potential's
+    transform, and transform back.  The padding rows are all 0 going in, and they don't need
+    to be kept coming out, so only the mesh's rows are read and written.
+Parameters:
+    beginColumn     Self-explanatory.
+    endColumn       One past the last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::ConvolveColumns(unsigned int beginColumn, unsigned int endColumn)
+{
+    std::vector<Complex> column(_fftSize);
+    for (unsigned int x = beginColumn; x < endColumn; x++)
+    {
+        for (unsigned int y = 0; y < _meshSize; y++)
+        {
+            column[y] = _work[(y * _fftSize) + x];
+        }
+        for (unsigned int y = _meshSize; y < _fftSize; y++)
+        {
+            column[y] = Complex(0.0f, 0.0f);
+        }
+
+        Fft(column.data(), _fftSize, _twiddles.data(), _bitReversed.data(), false);
+        const float *potentialTransform = &_potentialTransform[x * _fftSize];
+        for (unsigned int y = 0; y < _fftSize; y++)
+        {
+            column[y] *= potentialTransform[y];
+        }
+        Fft(column.data(), _fftSize, _twiddles.data(), _bitReversed.data(), true);
+
+        for (unsigned int y = 0; y < _meshSize; y++)
+        {
+            _work[(y * _fftSize) + x] = column[y];
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The last of step (3) for one row of the mesh: transforms it back and keeps the mesh's part
+    of it as the potential.  The potential's transform already has the FFT's scale in it.
+Parameters:
+    rowIndex    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::FinishRow(unsigned int rowIndex)
+{
+    Complex *row = &_work[rowIndex * _fftSize];
+    Fft(row, _fftSize, _twiddles.data(), _bitReversed.data(), true);
+    float *potential = &_potential[rowIndex * _meshSize];
+    for (unsigned int x = 0; x < _meshSize; x++)
+    {
+        potential[x] = row[x].real();
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The first of step (4) for one row of the mesh: the acceleration at each point is the slope
+    of the potential there (the potential is highest where the mass is, so particles are
+    pulled uphill).  The slope is the difference between the points on either side, or
+    between the point and the one next to it on the mesh's edges.
+Parameters:
+    rowIndex            Self-explanatory.
+    strengthPerParticle See GravityTree::ComputeAccelerations(...).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::ComputeSlopeRow(unsigned int rowIndex, float strengthPerParticle)
+{
+    unsigned int lastPoint = _meshSize - 1;
+    unsigned int belowRow = (rowIndex > 0) ? (rowIndex - 1) : 0;
+    unsigned int aboveRow = (rowIndex < lastPoint) ? (rowIndex + 1) : lastPoint;
+    float scaleY = strengthPerParticle * _inverseMeshSpacing / (float)(aboveRow - belowRow);
+    const float *row = &_potential[rowIndex * _meshSize];
+    const float *below = &_potential[belowRow * _meshSize];
+    const float *above = &_potential[aboveRow * _meshSize];
+    glm::vec2 *accelerations = &_meshAccelerations[rowIndex * _meshSize];
+    for (unsigned int x = 0; x < _meshSize; x++)
+    {
+        unsigned int leftX = (x > 0) ? (x - 1) : 0;
+        unsigned int rightX = (x < lastPoint) ? (x + 1) : lastPoint;
+        float scaleX = strengthPerParticle * _inverseMeshSpacing / (float)(rightX - leftX);
+        accelerations[x] = glm::vec2((row[rightX] - row[leftX]) * scaleX,
+            (above[x] - below[x]) * scaleY);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The last of step (4) for a range of the sorted particles: each one's acceleration is
+    blended from the 4 mesh points around it with the same weights that its mass was spread
+    with, which keeps a particle's pull on itself small.
+Parameters:
+    beginIndex      Self-explanatory.
+    endIndex        One past the last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleMeshGravity::InterpolateRange(unsigned int beginIndex, unsigned int endIndex)
+{
+    for (unsigned int sortedIndex = beginIndex; sortedIndex < endIndex; sortedIndex++)
+    {
+        unsigned int baseX = 0;
+        unsigned int baseY = 0;
+        glm::vec2 fraction;
+        this->GetMeshPoint(_sortedPositions[sortedIndex], &baseX, &baseY, &fraction);
+        const glm::vec2 *bottom = &_meshAccelerations[(baseY * _meshSize) + baseX];
+        const glm::vec2 *top = bottom + _meshSize;
+        glm::vec2 bottomBlend = bottom[0] + ((bottom[1] - bottom[0]) * fraction.x);
+        glm::vec2 topBlend = top[0] + ((top[1] - top[0]) * fraction.x);
+        _accelerations[_sortedParticles[sortedIndex]] =
+            bottomBlend + ((topBlend - bottomBlend) * fraction.y);
+    }
+}
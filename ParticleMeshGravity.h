@@ -0,0 +1,117 @@
+#pragma once
+
+#include "NeighborGrid.h"
+#include "ThreadPool.h"
+#include "glm/vec2.hpp"
+
+#include <complex>
+#include <vector>
+#include <functional>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A particle-mesh (PM) solver for the same pull as GravityTree: every particle pulls on
+    every other one with a softened 1/distance^2 acceleration.  Instead of a tree, the
+    particles' mass is spread onto a square mesh, the mesh's potential is worked out all at once
+    with FFTs, and each particle's acceleration is read back off the mesh.  The cost is
+    O(N + G^2 log G) for a G x G mesh no matter how the particles are spread out, so it beats
+    the tree when there are a lot of particles spread fairly evenly.  Anything smaller than a
+    mesh cell is blurred, so up close it is rougher than the tree.
+
+    Each step:
+    (1) The particles are sorted by mesh cell with a NeighborGrid so that each mesh row's
+    particles are together in one list.
+    (2) "Cloud in cell" deposit: each particle's mass is split between the 4 mesh points
+    around it, weighted by how close it is to each.  Each row of the mesh adds up the particles
+    from the cells just above and below it, so each thread writes only its own rows and
+    nothing needs a lock.  Each row is FFT'd as soon as it is filled in.
+    (3) The potential is the mass convolved with the softened 1/distance potential, which the
+    FFT turns into a multiply.  The mesh is padded with zeros to twice its size so that mass
+    on one side doesn't wrap around and pull on the other side.  The columns are FFT'd,
+    multiplied by the pre-transformed potential, and transformed back one at a time, and then
+    the rows are transformed back.
+    (4) The acceleration at each mesh point is the slope of the potential there, and each
+    particle's acceleration is read off the 4 mesh points around it with the same weights as
+    (2).
+    Each stage is split across the thread pool by rows, columns, or particles.
+
+    The FFT is a plain radix-2 one, so the mesh size must be a power of 2.
+
+    Note: Nothing here knows what a particle looks like.  Whoever calls Build(...) hands over
+    the positions.  See GravityTree.h.
+-----------------------------------------------------------------------------------------------*/
+class ParticleMeshGravity
+{
+public:
+    // fills in positions[0, endIndex - beginIndex) and isActive[0, endIndex - beginIndex) for
+    // the particles in the range [beginIndex, endIndex)
+    // Note: The same as GravityTree::PositionFunction.
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        glm::vec2 *positions, unsigned char *isActive)> PositionFunction;
+
+    static const unsigned int MIN_MESH_SIZE = 16;
+    static const unsigned int MAX_MESH_SIZE = 1024;
+
+    ParticleMeshGravity();
+    void Init(const glm::vec2 &minCorner, float size, unsigned int meshSize,
+        unsigned int numParticles);
+    void Cleanup();
+    bool IsInitialized() const;
+    void Build(unsigned int numParticles, const PositionFunction &getPositions,
+        ThreadPool *threadPool);
+    void ComputeAccelerations(float strength, ThreadPool *threadPool);
+    const glm::vec2 *GetAccelerations() const;
+    unsigned int MeshSize() const;
+    unsigned int NumBodies() const;
+
+private:
+    typedef std::complex<float> Complex;
+
+    void GetMeshPoint(const glm::vec2 &position, unsigned int *baseX, unsigned int *baseY,
+        glm::vec2 *fraction) const;
+    void DepositRow(unsigned int rowIndex);
+    void ConvolveColumns(unsigned int beginColumn, unsigned int endColumn);
+    void FinishRow(unsigned int rowIndex);
+    void ComputeSlopeRow(unsigned int rowIndex, float strengthPerParticle);
+    void InterpolateRange(unsigned int beginIndex, unsigned int endIndex);
+
+    glm::vec2 _minCorner;
+    unsigned int _meshSize;
+    float _meshSpacing;
+    float _inverseMeshSpacing;
+
+    // the padded size, which is twice the mesh size
+    unsigned int _fftSize;
+
+    // the FFT's twiddle factors (e^(-2 pi i k / _fftSize) for the first half) and
+    // bit-reversed order
+    std::vector<Complex> _twiddles;
+    std::vector<unsigned int> _bitReversed;
+
+    // The transform of the softened potential of a particle.  It is real because the potential
+    // is the same in every direction.  It is stored by column (X * _fftSize + Y) because it
+    // is used one column at a time.
+    std::vector<float> _potentialTransform;
+
+    // _fftSize rows of _fftSize; only the first _meshSize rows are ever anything but 0 outside
+    // of (3)
+    std::vector<Complex> _work;
+
+    // _meshSize x _meshSize, row by row
+    std::vector<float> _potential;
+    std::vector<glm::vec2> _meshAccelerations;
+
+    // the grid's cells are the mesh's cells, so cell (X, Y) is between mesh points X and X + 1
+    // and Y and Y + 1
+    NeighborGrid _grid;
+
+    // indexed by particle
+    std::vector<glm::vec2> _positions;
+    std::vector<unsigned char> _isActive;
+    std::vector<glm::vec2> _accelerations;
+
+    // the active particles in grid order
+    std::vector<glm::vec2> _sortedPositions;
+    std::vector<unsigned int> _sortedParticles;
+    unsigned int _numBodies;
+};
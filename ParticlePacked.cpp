@@ -0,0 +1,59 @@
+#include "ParticlePacked.h"
+
+#include "glm/common.hpp"   // glm::clamp, glm::round
+#include "glm/packing.hpp"  // glm::packHalf2x16, glm::unpackHalf2x16
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Squeezes a particle into the compact structure.  The Z and W components are always 0 in
+    this 2D demo, so they are dropped.
+Parameters:
+    p           Self-explanatory.
+    center      The emitter center in window coords.
+    radius      The emitter radius in window coords.
+Returns:
+    A copy of the particle in the compact format.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticlePacked PackParticle(const Particle &p, const glm::vec2 &center, float radius)
+{
+    glm::vec2 fromCenter = (glm::vec2(p._position.x, p._position.y) - center) / radius;
+
+    // the particle should always be inside the circle, but make sure that it fits
+    glm::vec2 fixedPosition = glm::round(glm::clamp(fromCenter, -1.0f, +1.0f) *
+        (float)PACKED_POSITION_MAX);
+
+    ParticlePacked packed;
+    packed._lowBitsAndFlags = (p._isActive != 0) ? PACKED_IS_ACTIVE_FLAG : 0;
+    SetPackedPosition(&packed, (int)fixedPosition.x, (int)fixedPosition.y);
+    SetPackedEmitterIndex(&packed, (unsigned int)p._emitterIndex);
+    packed._velocity = glm::packHalf2x16(glm::vec2(p._velocity.x, p._velocity.y));
+    return packed;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The reverse of PackParticle(...).  The padding and the Z and W components come back as 0.
+Parameters:
+    p           Self-explanatory.
+    center      The emitter center in window coords.
+    radius      The emitter radius in window coords.
+Returns:
+    A copy of the particle in the full format.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+Particle UnpackParticle(const ParticlePacked &p, const glm::vec2 &center, float radius)
+{
+    int fixedX = 0;
+    int fixedY = 0;
+    GetPackedPosition(p, &fixedX, &fixedY);
+    glm::vec2 fromCenter = glm::vec2((float)fixedX, (float)fixedY) / (float)PACKED_POSITION_MAX;
+
+    Particle unpacked = Particle();
+    unpacked._position = glm::vec4(center + (fromCenter * radius), 0.0f, 0.0f);
+    unpacked._velocity = glm::vec4(glm::unpackHalf2x16(p._velocity), 0.0f, 0.0f);
+    unpacked._isActive = ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) != 0) ? 1 : 0;
+    unpacked._emitterIndex = (int)GetPackedEmitterIndex(p);
+    return unpacked;
+}
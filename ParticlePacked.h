@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Particle.h"
+#include "glm/vec2.hpp"
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A compact, 12 byte version of the Particle structure for when there are so many particles
+    that the 48 byte version doesn't fit in memory (100 million of them is 4.8GB) or the update
+    is limited by memory bandwidth.  It only works because every particle is confined to the
+    emitter's circle, so the position can be stored relative to the emitter center in units of
+    the radius.
+
+    _position       The X and Y position relative to the emitter center, divided by the radius,
+                    as 16 bit signed normalized values (the same thing that packSnorm2x16(...)
+                    makes).  This is all that the vertex shader needs.
+    _velocity       The X and Y velocity in window coords as 16 bit floats (packHalf2x16(...)).
+    _lowBitsAndFlags    Bits 0-7 and 8-15 are X and Y signed corrections to _position in 1/256ths
+                        of a step.  Bit 16 is the "is active" flag.  Bits 17-31 are the index 
+                        of the particle's emitter (see ParticleEmitter.h).
+
+    Note: Why the extra 8 bits of position?  With only 16 bits, every update rounds the new
+    position to the nearest step, and because a particle moves the same distance every frame, it
+    rounds the same way every frame.  The error doesn't average out.  It piles up by as much as
+    half a step per frame, which is a pixel every few seconds.  With 24 bits, the pile-up is 256
+    times smaller.
+
+    Note: Together, _position and the low bits make a 24 bit fixed point number that goes from
+    -PACKED_POSITION_MAX at the left/bottom of the circle to +PACKED_POSITION_MAX at the
+    right/top.  24 bits is exactly what a float can hold without rounding, so the update can do
+    its math in floats in those units.
+
+    Note: The position is relative to the particle's own emitter, so the emitter's center and 
+    radius are needed to make sense of it.
+
+    Note: The structure has to match the one in shaderParticlePacked.comp, which must use the
+    std430 layout or else the GPU may pad it out to 16 bytes.
+-----------------------------------------------------------------------------------------------*/
+struct ParticlePacked
+{
+    unsigned int _position;
+    unsigned int _velocity;
+    unsigned int _lowBitsAndFlags;
+};
+
+// the largest 16 bit signed normalized value, with 8 more bits below it
+static const int PACKED_POSITION_MAX = 32767 * 256;
+static const unsigned int PACKED_LOW_BITS_MASK = 0x0000ffff;
+static const unsigned int PACKED_IS_ACTIVE_FLAG = 0x00010000;
+static const unsigned int PACKED_EMITTER_INDEX_SHIFT = 17;
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Conversions between the full and compact particle structures.  The emitter center and radius
+    must be the same ones that the particle manager was given.  Packing is lossy: the position
+    is off by as much as 1/2 of a 24 bit step and the velocity by about 1 part in 2048.
+-----------------------------------------------------------------------------------------------*/
+
+ParticlePacked PackParticle(const Particle &p, const glm::vec2 &center, float radius);
+Particle UnpackParticle(const ParticlePacked &p, const glm::vec2 &center, float radius);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gets and sets the emitter index in the top 15 bits of _lowBitsAndFlags.  The update never 
+    changes these bits.
+Parameters:
+    p               Self-explanatory.
+    emitterIndex    Must be less than MAX_EMITTERS.
+Returns:
+    GetPackedEmitterIndex(...) returns the index.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline unsigned int GetPackedEmitterIndex(const ParticlePacked &p)
+{
+    return p._lowBitsAndFlags >> PACKED_EMITTER_INDEX_SHIFT;
+}
+
+inline void SetPackedEmitterIndex(ParticlePacked *p, unsigned int emitterIndex)
+{
+    p->_lowBitsAndFlags = (p->_lowBitsAndFlags & ((1u << PACKED_EMITTER_INDEX_SHIFT) - 1)) |
+        (emitterIndex << PACKED_EMITTER_INDEX_SHIFT);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Pulls the 24 bit fixed point position out of _position and the low bits.  These are in the
+    header so that the update kernels can inline them.
+Parameters:
+    p           Self-explanatory.
+    fixedX      The X position on the range [-PACKED_POSITION_MAX, +PACKED_POSITION_MAX].
+    fixedY      Same, but Y.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline void GetPackedPosition(const ParticlePacked &p, int *fixedX, int *fixedY)
+{
+    int highX = (short)(p._position & 0xffff);
+    int highY = (short)(p._position >> 16);
+    int lowX = (signed char)(p._lowBitsAndFlags & 0xff);
+    int lowY = (signed char)((p._lowBitsAndFlags >> 8) & 0xff);
+    *fixedX = (highX * 256) + lowX;
+    *fixedY = (highY * 256) + lowY;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The reverse of GetPackedPosition(...).  The 16 bit part is rounded to the nearest step
+    (rather than truncated) so that the vertex shader, which only looks at the 16 bit part,
+    draws the particle as close as it can to where it really is.  The low bits are whatever is
+    left over, which is always within [-128, +127].  The flags are left alone.
+Parameters:
+    p           Self-explanatory.
+    fixedX      The X position on the range [-PACKED_POSITION_MAX, +PACKED_POSITION_MAX].
+    fixedY      Same, but Y.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline void SetPackedPosition(ParticlePacked *p, int fixedX, int fixedY)
+{
+    // Note: >> on a negative int is an arithmetic shift on every compiler that this builds on,
+    // so this is floor((fixed + 128) / 256).
+    int highX = (fixedX + 128) >> 8;
+    int highY = (fixedY + 128) >> 8;
+    int lowX = fixedX - (highX * 256);
+    int lowY = fixedY - (highY * 256);
+    p->_position = ((unsigned int)highX & 0xffff) | ((unsigned int)highY << 16);
+    p->_lowBitsAndFlags = (p->_lowBitsAndFlags & ~PACKED_LOW_BITS_MASK) |
+        ((unsigned int)lowX & 0xff) | (((unsigned int)lowY & 0xff) << 8);
+}
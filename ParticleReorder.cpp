@@ -0,0 +1,446 @@
+#include "ParticleReorder.h"
+
+#include <algorithm>    // std::fill(...)
+
+// each pass sorts by this many bits of the key
+static const unsigned int RADIX_BITS = 8;
+static const unsigned int RADIX_SIZE = 1 << RADIX_BITS;
+
+// the finest Morton code that the keys use; 1024 cells across an emitter is already finer
+// than the neighbor grid or the fluid would use, and it keeps a single emitter's keys to 3
+// passes
+static const unsigned int MAX_REORDER_BITS_PER_AXIS = 10;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out how to fit the emitter index, the inactive bit, and the Morton code into 32 bits
+    (see ReorderKeyLayout).  The emitter index gets as many bits as the last emitter's index
+    needs, and the Morton code gets what is left, up to MAX_REORDER_BITS_PER_AXIS each way.
+Parameters:
+    numEmitters     Must not be more than MAX_EMITTERS.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ReorderKeyLayout GetReorderKeyLayout(unsigned int numEmitters)
+{
+    unsigned int numEmitterBits = 0;
+    while (numEmitters > 1 && ((numEmitters - 1) >> numEmitterBits) != 0)
+    {
+        numEmitterBits++;
+    }
+
+    ReorderKeyLayout layout;
+    layout._bitsPerAxis = (32 - 1 - numEmitterBits) / 2;
+    if (layout._bitsPerAxis > MAX_REORDER_BITS_PER_AXIS)
+    {
+        layout._bitsPerAxis = MAX_REORDER_BITS_PER_AXIS;
+    }
+    layout._inactiveShift = layout._bitsPerAxis * 2;
+    layout._emitterShift = layout._inactiveShift + 1;
+    layout._numKeyBits = layout._emitterShift + numEmitterBits;
+    return layout;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing can be sorted until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleReorder::ParticleReorder() :
+    _numKeyBits(0),
+    _numSorts(0),
+    _current(0),
+    _numBlocks(0),
+    _blockSize(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Makes room for the particles and starts the handle tables over, with every particle's
+    handle the same as its index.
+Parameters:
+    numParticles    Every Sort(...) sorts this many.
+    numKeyBits      How many of the keys' bits are used (see ReorderKeyLayout).  The sort
+                    only takes as many passes as it needs for these.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleReorder::Init(unsigned int numParticles, unsigned int numKeyBits)
+{
+    _numKeyBits = (numKeyBits > 32) ? 32 : numKeyBits;
+    _numSorts = 0;
+    _current = 0;
+    for (unsigned int bufferIndex = 0; bufferIndex < 2; bufferIndex++)
+    {
+        _keys[bufferIndex].resize(numParticles);
+        _values[bufferIndex].resize(numParticles);
+    }
+    _blockCounts.clear();
+    _numBlocks = 0;
+    _blockSize = 0;
+
+    _newIndices.resize(numParticles);
+    _handleToIndex.resize(numParticles);
+    _indexToHandle.resize(numParticles);
+    for (unsigned int particleIndex = 0; particleIndex < numParticles; particleIndex++)
+    {
+        _newIndices[particleIndex] = particleIndex;
+        _values[0][particleIndex] = particleIndex;
+        _handleToIndex[particleIndex] = particleIndex;
+        _indexToHandle[particleIndex] = particleIndex;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleReorder::Cleanup()
+{
+    _numKeyBits = 0;
+    _numSorts = 0;
+    _current = 0;
+    for (unsigned int bufferIndex = 0; bufferIndex < 2; bufferIndex++)
+    {
+        _keys[bufferIndex].clear();
+        _values[bufferIndex].clear();
+    }
+    _blockCounts.clear();
+    _numBlocks = 0;
+    _blockSize = 0;
+    _newIndices.clear();
+    _handleToIndex.clear();
+    _indexToHandle.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) was called since the last Cleanup(), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleReorder::IsInitialized() const
+{
+    return !_handleToIndex.empty();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sorts the particles by their keys.  See the class description for the steps of each
+    pass.  Afterwards, GetOldIndices() and GetNewIndices() say where each particle goes, and
+    the handle tables say where each handle's particle is once it gets there.
+Parameters:
+    getKeys     Called once for each block with that block's particles.  Must be safe to call
+                from more than one thread at once.
+    threadPool  May be 0 to sort on the calling thread.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleReorder::Sort(const KeyFunction &getKeys, ThreadPool *threadPool)
+{
+    unsigned int numParticles = _newIndices.size();
+    if (numParticles == 0)
+    {
+        return;
+    }
+
+    // one block per thread, the same as the neighbor grid
+    unsigned int numThreads = (threadPool != 0) ? threadPool->NumThreads() : 1;
+    numThreads = (numThreads == 0) ? 1 : numThreads;
+    _blockSize = ((numParticles - 1) / numThreads) + 1;
+    _numBlocks = ((numParticles - 1) / _blockSize) + 1;
+    _blockCounts.resize((size_t)_numBlocks * RADIX_SIZE);
+
+    // the first pass reads the keys straight from the caller, so it starts from the particles'
+    // own order
+    _current = 0;
+    unsigned int numPasses = (_numKeyBits + RADIX_BITS - 1) / RADIX_BITS;
+    for (unsigned int passIndex = 0; passIndex < numPasses; passIndex++)
+    {
+        unsigned int digitShift = passIndex * RADIX_BITS;
+        const KeyFunction *passGetKeys = (passIndex == 0) ? &getKeys : 0;
+
+        // (1)
+        if (threadPool != 0)
+        {
+            threadPool->ParallelFor(numParticles, _blockSize,
+                [this, digitShift, passGetKeys](unsigned int beginIndex, unsigned int endIndex)
+            {
+                this->CountBlock(beginIndex / _blockSize, beginIndex, endIndex, digitShift,
+                    passGetKeys);
+            });
+        }
+        else
+        {
+            this->CountBlock(0, 0, numParticles, digitShift, passGetKeys);
+        }
+
+        // (2)
+        if (!this->AddUpDigits(numParticles))
+        {
+            // every key has the same digit, so this pass wouldn't move anything
+            continue;
+        }
+
+        // (3)
+        if (threadPool != 0)
+        {
+            threadPool->ParallelFor(numParticles, _blockSize,
+                [this, digitShift](unsigned int beginIndex, unsigned int endIndex)
+            {
+                this->PlaceBlock(beginIndex / _blockSize, beginIndex, endIndex, digitShift);
+            });
+        }
+        else
+        {
+            this->PlaceBlock(0, 0, numParticles, digitShift);
+        }
+        _current = 1 - _current;
+    }
+
+    // where each particle went, and where each handle's particle is now
+    if (threadPool != 0)
+    {
+        threadPool->ParallelFor(numParticles, _blockSize,
+            [this](unsigned int beginIndex, unsigned int endIndex)
+        {
+            this->RemapBlock(beginIndex, endIndex);
+        });
+    }
+    else
+    {
+        this->RemapBlock(0, numParticles);
+    }
+
+    // Note: RemapBlock(...) wrote the new handles into the spare key buffer, which isn't
+    // needed again until the next sort asks for new keys.
+    _indexToHandle.swap(_keys[1 - _current]);
+    _numSorts++;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives where each particle in the new order came from.
+Parameters: None
+Returns:
+    A pointer to NumParticles() indices.  Particle I in the new order was particle
+    oldIndices[I] in the old one.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const unsigned int *ParticleReorder::GetOldIndices() const
+{
+    return _values[_current].data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives where each particle in the old order went.  This is the other way around from
+    GetOldIndices(), for anything that kept particle indices from before the sort (ex: the
+    expiry buckets).
+Parameters: None
+Returns:
+    A pointer to NumParticles() indices.  Particle I in the old order is particle
+    newIndices[I] in the new one.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const unsigned int *ParticleReorder::GetNewIndices() const
+{
+    return _newIndices.data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Looks up where a handle's particle is now.  If the sort isn't initialized, then the
+    particles never move and the handle is the index.
+Parameters:
+    handle      The particle's index before the first sort.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleReorder::GetParticleIndex(unsigned int handle) const
+{
+    return (handle < _handleToIndex.size()) ? _handleToIndex[handle] : handle;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The other way around from GetParticleIndex(...).
+Parameters:
+    particleIndex   Where the particle is now.
+Returns:
+    The particle's handle.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleReorder::GetHandle(unsigned int particleIndex) const
+{
+    return (particleIndex < _indexToHandle.size()) ? _indexToHandle[particleIndex] : particleIndex;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Simple getters for how many particles are sorted and how many times they have been.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleReorder::NumParticles() const
+{
+    return _newIndices.size();
+}
+
+unsigned int ParticleReorder::NumSorts() const
+{
+    return _numSorts;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (1) for one block: counts how many of the block's keys have each digit.  On the first
+    pass, the keys are asked for first, and each one starts out with its own particle's index.
+Parameters:
+    blockIndex      Which row of counts to fill in.
+    beginIndex      The block's first key.
+    endIndex        One past its last key.
+    digitShift      Where this pass's digit is in the key.
+    getKeys         See Sort(...).  0 unless this is the first pass.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleReorder::CountBlock(unsigned int blockIndex, unsigned int beginIndex,
+    unsigned int endIndex, unsigned int digitShift, const KeyFunction *getKeys)
+{
+    unsigned int *counts = _blockCounts.data() + ((size_t)blockIndex * RADIX_SIZE);
+    std::fill(counts, counts + RADIX_SIZE, 0);
+
+    unsigned int *keys = _keys[_current].data();
+    if (getKeys != 0)
+    {
+        (*getKeys)(beginIndex, endIndex, keys + beginIndex);
+        unsigned int *values = _values[_current].data();
+        for (unsigned int index = beginIndex; index < endIndex; index++)
+        {
+            values[index] = index;
+        }
+    }
+
+    for (unsigned int index = beginIndex; index < endIndex; index++)
+    {
+        counts[(keys[index] >> digitShift) & (RADIX_SIZE - 1)]++;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (2): gives each digit its start and turns each block's count for that digit into
+    where the block's first key with that digit goes.  Within a digit, block 0's keys go
+    first, then block 1's, and so on.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:
+    False if every key had the same digit, in which case the counts are left alone, otherwise
+    true.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleReorder::AddUpDigits(unsigned int numParticles)
+{
+    // if the first digit that has any keys doesn't have all of them, then no digit does
+    for (unsigned int digit = 0; digit < RADIX_SIZE; digit++)
+    {
+        unsigned int digitTotal = 0;
+        for (unsigned int blockIndex = 0; blockIndex < _numBlocks; blockIndex++)
+        {
+            digitTotal += _blockCounts[(blockIndex * RADIX_SIZE) + digit];
+        }
+        if (digitTotal == numParticles)
+        {
+            return false;
+        }
+        if (digitTotal != 0)
+        {
+            break;
+        }
+    }
+
+    unsigned int nextIndex = 0;
+    for (unsigned int digit = 0; digit < RADIX_SIZE; digit++)
+    {
+        for (unsigned int blockIndex = 0; blockIndex < _numBlocks; blockIndex++)
+        {
+            unsigned int &count = _blockCounts[(blockIndex * RADIX_SIZE) + digit];
+            unsigned int blockStart = nextIndex;
+            nextIndex += count;
+            count = blockStart;
+        }
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Step (3) for one block: copies each of the block's keys, along with the particle index
+    that goes with it, to the next spot for its digit in the other buffer.
+Parameters:
+    blockIndex      Which row of starts to use.
+    beginIndex      The block's first key.
+    endIndex        One past its last key.
+    digitShift      Where this pass's digit is in the key.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleReorder::PlaceBlock(unsigned int blockIndex, unsigned int beginIndex,
+    unsigned int endIndex, unsigned int digitShift)
+{
+    unsigned int *nextIndices = _blockCounts.data() + ((size_t)blockIndex * RADIX_SIZE);
+    const unsigned int *keys = _keys[_current].data();
+    const unsigned int *values = _values[_current].data();
+    unsigned int *sortedKeys = _keys[1 - _current].data();
+    unsigned int *sortedValues = _values[1 - _current].data();
+    for (unsigned int index = beginIndex; index < endIndex; index++)
+    {
+        unsigned int key = keys[index];
+        unsigned int sortedIndex = nextIndices[(key >> digitShift) & (RADIX_SIZE - 1)]++;
+        sortedKeys[sortedIndex] = key;
+        sortedValues[sortedIndex] = values[index];
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    After the last pass, works out where each particle in the range of the new order came
+    from in the old one, and moves the handles along with the particles.  The new handles go
+    in the spare key buffer (see Sort(...)).
+
+    Note: Each particle is only in one range and each handle belongs to one particle, so
+    nothing written here is written by more than one thread.
+Parameters:
+    beginIndex      The first particle in the new order.
+    endIndex        One past the last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleReorder::RemapBlock(unsigned int beginIndex, unsigned int endIndex)
+{
+    const unsigned int *oldIndices = _values[_current].data();
+    unsigned int *newHandles = _keys[1 - _current].data();
+    for (unsigned int newIndex = beginIndex; newIndex < endIndex; newIndex++)
+    {
+        unsigned int oldIndex = oldIndices[newIndex];
+        unsigned int handle = _indexToHandle[oldIndex];
+        _newIndices[oldIndex] = newIndex;
+        newHandles[newIndex] = handle;
+        _handleToIndex[handle] = newIndex;
+    }
+}
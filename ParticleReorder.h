@@ -0,0 +1,184 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include "glm/vec2.hpp"
+
+#include <vector>
+#include <functional>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    How a particle's sort key is put together (see GetReorderKey(...)).  From the top bit
+    down, the key is the particle's emitter index, then a bit that is set if the particle is
+    inactive, and then the Morton code of where the particle is in its emitter's square.
+    Sorting by the key therefore keeps every emitter's particles in the emitter's range, puts
+    the active ones first and the inactive ones after them, and lays out the active ones along
+    a "Z" curve so that particles that are close together in the window are close together in
+    memory.
+
+    _bitsPerAxis    How many bits of X and of Y go into the Morton code, so the emitter's
+                    square is split into (1 << _bitsPerAxis) cells each way.
+    _inactiveShift  Where the inactive bit is (2 * _bitsPerAxis).
+    _emitterShift   Where the emitter index starts (_inactiveShift + 1).
+    _numKeyBits     How many bits of the key are used.  Never more than 32.
+
+    Note: More emitters take more of the key's 32 bits, so the Morton code gets coarser.  Even
+    with the most emitters (see MAX_EMITTERS), it still has 8 bits for each axis.
+
+    Note: The compute shader version (shaderParticleReorder.comp) is given these same values,
+    so both simulators sort the same way.
+-----------------------------------------------------------------------------------------------*/
+struct ReorderKeyLayout
+{
+    unsigned int _bitsPerAxis;
+    unsigned int _inactiveShift;
+    unsigned int _emitterShift;
+    unsigned int _numKeyBits;
+};
+
+ReorderKeyLayout GetReorderKeyLayout(unsigned int numEmitters);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Puts a particle in the order that the periodic reorder sorts the particles into (see
+    ParticleSimulatorCpu::SetReorder(...)).  A radix sort over 32 bit keys, split across the
+    thread pool, with 8 bits per pass.  The key layout only decides how many passes there are
+    (see ReorderKeyLayout), so the sort itself doesn't care what the keys mean.
+
+    Each pass is a counting sort by one 8 bit digit, done the same way as the neighbor grid's
+    sort (see NeighborGrid.h):
+    (1) Each thread takes one block of keys and counts how many of them have each digit.  The
+    first pass also asks for the keys then.
+    (2) The counts are added up, digit by digit and then block by block within each digit, to
+    get where each block's keys with each digit go.  There are only 256 digits, so this is
+    done on the calling thread.
+    (3) Each thread goes through its block again and copies each key, and the index of the
+    particle that it came from, to its spot.
+    The blocks are in order, so each pass keeps keys that have the same digit in the order
+    that they were in, which is what lets the next pass sort by the next digit without
+    undoing this one.  The result is the same no matter how many threads there are.  A pass
+    where every key has the same digit (ex: the emitter bits when there is only one emitter)
+    is skipped.
+
+    The result is where each particle came from (see GetOldIndices()) and where each one went
+    (see GetNewIndices()).  Whoever owns the particles moves them.
+
+    Anything outside the simulator that needs to keep track of a particle from step to step
+    can hold on to a "handle" instead of an index.  A particle's handle is its index before the
+    first sort, and it never changes.  The handle tables are brought up to date after every
+    sort (see GetParticleIndex(...) and GetHandle(...)).
+
+    Note: Nothing here knows what a particle looks like.  Whoever calls Sort(...) works out
+    the keys (see GetReorderKey(...)).
+-----------------------------------------------------------------------------------------------*/
+class ParticleReorder
+{
+public:
+    // fills in keys[0, endIndex - beginIndex) with the sort keys of the particles in the range
+    // [beginIndex, endIndex)
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex,
+        unsigned int *keys)> KeyFunction;
+
+    ParticleReorder();
+    void Init(unsigned int numParticles, unsigned int numKeyBits);
+    void Cleanup();
+    bool IsInitialized() const;
+    void Sort(const KeyFunction &getKeys, ThreadPool *threadPool);
+
+    const unsigned int *GetOldIndices() const;
+    const unsigned int *GetNewIndices() const;
+    unsigned int GetParticleIndex(unsigned int handle) const;
+    unsigned int GetHandle(unsigned int particleIndex) const;
+    unsigned int NumParticles() const;
+    unsigned int NumSorts() const;
+
+private:
+    void CountBlock(unsigned int blockIndex, unsigned int beginIndex, unsigned int endIndex,
+        unsigned int digitShift, const KeyFunction *getKeys);
+    bool AddUpDigits(unsigned int numParticles);
+    void PlaceBlock(unsigned int blockIndex, unsigned int beginIndex, unsigned int endIndex,
+        unsigned int digitShift);
+    void RemapBlock(unsigned int beginIndex, unsigned int endIndex);
+
+    unsigned int _numKeyBits;
+    unsigned int _numSorts;
+
+    // each pass copies from one of these to the other, and the particle indices go along with
+    // the keys; the last pass's results are in _keys[_current] and _values[_current]
+    std::vector<unsigned int> _keys[2];
+    std::vector<unsigned int> _values[2];
+    unsigned int _current;
+
+    // one row of counts per block, so block B's count for digit D is
+    // _blockCounts[(B * 256) + D]
+    // Note: Step (2) turns the counts into where the block's next key with that digit goes.
+    std::vector<unsigned int> _blockCounts;
+    unsigned int _numBlocks;
+    unsigned int _blockSize;
+
+    // where each particle went in the last sort
+    std::vector<unsigned int> _newIndices;
+
+    // empty until Init(...), and then they start out with every handle the same as its index
+    std::vector<unsigned int> _handleToIndex;
+    std::vector<unsigned int> _indexToHandle;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Spreads the bottom 16 bits of a value out to the even bits so that two of them can be
+    woven together into a Morton code.
+Parameters:
+    value   Self-explanatory.
+Returns:
+    Bit N of the value is now bit 2N.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline unsigned int SpreadMortonBits(unsigned int value)
+{
+    value &= 0x0000ffff;
+    value = (value | (value << 8)) & 0x00ff00ff;
+    value = (value | (value << 4)) & 0x0f0f0f0f;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out a particle's sort key (see ReorderKeyLayout).  This is in the header so that
+    the callers' KeyFunctions can inline it.
+
+    Note: Must match GetReorderKey(...) in shaderParticleReorder.comp.
+Parameters:
+    layout          See GetReorderKeyLayout(...).
+    emitterIndex    Self-explanatory.
+    isActive        If false, then the position doesn't matter.
+    fromCenter      The position relative to the emitter center, in units of its radius, so
+                    that the emitter's square is [-1, +1] each way.  Anything outside of that
+                    is put in the nearest cell on the edge.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline unsigned int GetReorderKey(const ReorderKeyLayout &layout, unsigned int emitterIndex,
+    bool isActive, const glm::vec2 &fromCenter)
+{
+    unsigned int key = emitterIndex << layout._emitterShift;
+    if (!isActive)
+    {
+        return key | (1u << layout._inactiveShift);
+    }
+
+    // Note: Clamp as floats before converting, the same way as NeighborGrid::GetCellIndex(...),
+    // so that NaN ends up in cell 0.
+    float numCells = (float)(1u << layout._bitsPerAxis);
+    float lastCell = numCells - 1.0f;
+    float x = (fromCenter.x + 1.0f) * 0.5f * numCells;
+    float y = (fromCenter.y + 1.0f) * 0.5f * numCells;
+    x = (x > 0.0f) ? x : 0.0f;
+    y = (y > 0.0f) ? y : 0.0f;
+    unsigned int cellX = (unsigned int)(int)((x < lastCell) ? x : lastCell);
+    unsigned int cellY = (unsigned int)(int)((y < lastCell) ? y : lastCell);
+    return key | SpreadMortonBits(cellX) | (SpreadMortonBits(cellY) << 1);
+}
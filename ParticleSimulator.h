@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Particle.h"
+#include "ParticlePacked.h"
+#include "ParticleEmitter.h"
+#include "ForceField.h"
+#include "ObstacleField.h"
+#include "ParticleIntegrator.h"
+#include "ParticleFluid.h"
+#include "TurbulenceField.h"
+#include "glm/vec2.hpp"
+
+#include <vector>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The particle manager takes care of particle storage, emission, and drawing, but the actual
+    "move the particles along and restart the ones that went out of bounds" step can be done
+    either by the compute shader or on the CPU.  This is the common interface for both so that
+    the manager doesn't have to care which one it was given.
+
+    The manager owns the particle collection and the shader storage buffer.  A simulator that
+    runs on the CPU updates the collection and the manager uploads it before rendering.  A
+    simulator that runs on the GPU works on the buffer directly and never touches the collection
+    after Init(...) unless asked to with ReadBackParticles().
+
+    The manager keeps its particles either as full Particle structures or as compact
+    ParticlePacked structures (see ParticleManager::SetPackedFormat(...)), so Init(...) is
+    given a pointer for each kind of collection, and exactly one of them is non-null.  The
+    buffer uses the same format.
+
+    The particles are split up between one or more emitters (see ParticleEmitter.h).  The 
+    manager owns the emitter table and a shader storage buffer with a copy of it.
+
+    The force fields (see ForceField.h), on the other hand, only matter to the update, so the 
+    simulator keeps its own copy of them and they can be changed between updates.  The same 
+    goes for the baked obstacles (see ObstacleField.h).
+
+    How the particles are moved once something accelerates them (see ParticleIntegrator.h) is 
+    chosen before Init(...) so that the simulator can set itself up for just that one.  So is 
+    whether the particles behave as a fluid (see ParticleFluid.h), since that needs its own 
+    grid and buffers, and whether they are sorted every so often (see ParticleReorder.h).
+
+    Note: If the particles are sorted, then a particle's index changes, so anything that 
+    needs to follow one particle from step to step has to ask the simulator where it went.
+-----------------------------------------------------------------------------------------------*/
+class ParticleSimulator
+{
+public:
+    virtual ~ParticleSimulator() {}
+    virtual void Init(std::vector<Particle> *allParticles,
+        std::vector<ParticlePacked> *allPackedParticles,
+        unsigned int particleBufferId,
+        const std::vector<ParticleEmitter> *emitters,
+        unsigned int emitterBufferId) = 0;
+    virtual void Cleanup() = 0;
+    virtual void Update(float deltaTimeSec) = 0;
+
+    // picks the integrator; must be called before Init(...) to have any effect, and the 
+    // default is INTEGRATOR_SEMI_IMPLICIT_EULER
+    virtual void SetIntegrator(IntegratorType integrator) = 0;
+
+    // makes the particles a fluid; must be called before Init(...) to have any effect, and a 
+    // smoothing radius of 0 (the default) turns the fluid passes off
+    virtual void SetFluid(const FluidSettings &settings) = 0;
+
+    // how long the fluid passes have taken so far, for reporting; all 0 if there is no fluid
+    virtual FluidPassTimes GetFluidPassTimes() = 0;
+
+    // replaces the force field table; may be called any time after Init(...), and an empty 
+    // table turns the force field pass off
+    virtual void SetForceFields(const std::vector<ForceField> &forceFields) = 0;
+
+    // replaces the obstacles with a copy of the baked field; may be called any time after 
+    // Init(...), and a field that isn't baked turns the obstacle pass off
+    virtual void SetObstacles(const ObstacleField &obstacles) = 0;
+
+    // bakes a turbulence field to push the particles around (see TurbulenceField.h); may be 
+    // called any time after Init(...), and a strength of 0 turns the turbulence pass off
+    virtual void SetTurbulence(const TurbulenceSettings &settings) = 0;
+
+    // sorts the particles by where they are every so many steps so that particles that are 
+    // close together are close together in memory (see ParticleReorder.h); must be called 
+    // before Init(...) to have any effect, and 0 (the default) never sorts them
+    virtual void SetReorder(unsigned int numStepsBetweenSorts) = 0;
+
+    // makes every Update(...) take this many steps of the time that it is given, for running a 
+    // scenario forward quickly; must be called before Init(...) to have any effect, and 1 (the 
+    // default) takes one step per update
+    virtual void SetSubsteps(unsigned int numSubsteps) = 0;
+
+    // if true, then the particle collection is the one that changed during Update(...) and the
+    // manager needs to upload it before drawing
+    virtual bool UpdatesOnCpu() const = 0;
+
+    // if not 0, then this buffer starts with a DrawElementsIndirectCommand followed by the 
+    // indices of the live particles, and the manager draws only those (see 
+    // ParticleSimulatorGpu)
+    virtual unsigned int GetLiveListBufferId() const = 0;
+
+    // brings the manager's particle collection up to date with the simulation so that it can be 
+    // inspected (see ParticleManager::TakeFingerprint()); may be slow
+    virtual void ReadBackParticles() = 0;
+};
@@ -0,0 +1,2471 @@
+#include "ParticleSimulatorCpu.h"
+
+#include "glm/common.hpp"   // glm::min, glm::max, glm::clamp
+#include "glm/packing.hpp"  // glm::packHalf2x16, glm::unpackHalf2x16
+
+#include <algorithm>    // std::upper_bound(...), std::sort(...), std::push_heap(...), etc.
+
+// aim for each chunk of particles to fit in half of a typical 512KB L2 cache
+static const unsigned int CHUNK_BYTES = 256 * 1024;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing is simulated until Init(...) is called.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleSimulatorCpu::ParticleSimulatorCpu() :
+    _storage(STORAGE_AOS),
+    _maxSimdLevel(SIMD_LEVEL_AVX2),
+    _simdLevel(SIMD_LEVEL_SCALAR),
+    _aosKernel(0),
+    _soaKernel(0),
+    _packedKernel(0),
+    _soaForceFieldKernel(0),
+    _integrator(INTEGRATOR_SEMI_IMPLICIT_EULER),
+    _aosIntegrateKernel(0),
+    _soaIntegrateKernel(0),
+    _packedIntegrateKernel(0),
+    _threadPool(0),
+    _chunkSize(0),
+    _allParticles(0),
+    _allPackedParticles(0),
+    _particleBufferId(0),
+    _emitters(0),
+    _numQuotasPerSubstep(0),
+    _useLifetimes(false),
+    _stepIndex(0),
+    _knowsWaitingParticles(false),
+    _gridCellSizeInRadii(0.0f),
+    _gravityStrength(0.0f),
+    _gravityOpeningAngle(0.0f),
+    _gravityMeshSize(0),
+    _collisionRadius(0.0f),
+    _reorderStepsBetween(0),
+    _numSubsteps(1),
+    _scheduleExits(false)
+{
+    _fluidSettings._smoothingRadius = 0.0f;
+    _fluidSettings._restDensity = 0.0f;
+    _fluidSettings._stiffness = 0.0f;
+    _fluidSettings._viscosity = 0.0f;
+    _reorderKeyLayout = GetReorderKeyLayout(1);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Calls Cleanup() in the event that the user forgot to call it themselves.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleSimulatorCpu::~ParticleSimulatorCpu()
+{
+    this->Cleanup();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Records where the particles are and the emitters' regions in which they are valid.  If 
+    using the "structure of arrays" storage, then the particles are copied into it.  Picks the 
+    update kernel for the storage and the CPU.
+Parameters:
+    allParticles    The manager's particle collection.  This simulator updates it in place (or 
+                    its own copy of it).  0 if the manager uses the packed format.
+    allPackedParticles  The manager's compact particle collection.  Always updated in place.
+                        0 unless the manager uses the packed format.
+    particleBufferId    Not used directly because the manager uploads the collection after the 
+                        update.  If 0, then nothing is being drawn.
+    emitters        The manager's emitter table.  Must stay put until Cleanup().
+    emitterBufferId     Not used.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::Init(std::vector<Particle> *allParticles,
+    std::vector<ParticlePacked> *allPackedParticles,
+    unsigned int particleBufferId,
+    const std::vector<ParticleEmitter> *emitters,
+    unsigned int emitterBufferId)
+{
+    // the emitters are read straight from the table instead
+    (void)emitterBufferId;
+
+    _allParticles = allParticles;
+    _allPackedParticles = allPackedParticles;
+    _particleBufferId = particleBufferId;
+    _emitters = emitters;
+    _emittedParticles.clear();
+    _emittedParticles.resize(emitters->size());
+    _waitingParticles.clear();
+    _waitingParticles.resize(emitters->size());
+
+    // the expiry buckets are made in the first update that needs them
+    _useLifetimes = false;
+    for (size_t emitterIndex = 0; emitterIndex < emitters->size(); emitterIndex++)
+    {
+        _useLifetimes = _useLifetimes || ((*emitters)[emitterIndex]._maxLifetimeSec > 0.0f);
+    }
+    _forceFields.clear();
+    _obstacles.Cleanup();
+    _turbulence.Cleanup();
+    _stepIndex = 0;
+    _expiryBuckets.Cleanup();
+
+    _simdLevel = DetectSimdLevel();
+    if (_simdLevel > _maxSimdLevel)
+    {
+        _simdLevel = _maxSimdLevel;
+    }
+    this->PickUpdateKernels();
+    _packedKernel = GetPackedUpdateKernel(_simdLevel);
+    _soaForceFieldKernel = GetSoaForceFieldKernel(_simdLevel);
+    _aosIntegrateKernel = GetAosIntegrateKernel(_integrator);
+    _soaIntegrateKernel = GetSoaIntegrateKernel(_integrator, _simdLevel);
+    _packedIntegrateKernel = GetPackedIntegrateKernel(_integrator);
+
+    unsigned int bytesPerParticle = sizeof(Particle);
+    if (_allPackedParticles != 0)
+    {
+        bytesPerParticle = sizeof(ParticlePacked);
+    }
+    else if (_storage == STORAGE_SOA)
+    {
+        _particlesSoa.CopyFrom(*_allParticles);
+        bytesPerParticle = (sizeof(float) * 4) + sizeof(int);
+    }
+
+    // keep chunks on 8-particle boundaries so that the SIMD kernels don't have to do any of 
+    // them one at a time (except at the very end)
+    _chunkSize = ((CHUNK_BYTES / bytesPerParticle) / 8) * 8;
+
+    // one quota for each piece of an emitter's particles that is in a different chunk (see 
+    // GetEmissionQuota(...)), and one set of those for each substep that an update can take 
+    // in one pass (see StepBlocked(...)); everything else only uses the first set
+    unsigned int numAllParticles = (_allPackedParticles != 0) ? 
+        _allPackedParticles->size() : _allParticles->size();
+    unsigned int numChunks = (numAllParticles + _chunkSize - 1) / _chunkSize;
+    _numQuotasPerSubstep = numChunks + emitters->size();
+    _emissionQuotas.clear();
+    _emissionQuotas.resize(_numQuotasPerSubstep * _numSubsteps);
+
+    _neighborGrid.Cleanup();
+    if (_gridCellSizeInRadii > 0.0f)
+    {
+        unsigned int numParticles = (_allPackedParticles != 0) ? 
+            _allPackedParticles->size() : _allParticles->size();
+        this->InitNeighborGrid(numParticles);
+    }
+
+    _gravityTree.Cleanup();
+    _gravityMesh.Cleanup();
+    if (_gravityStrength != 0.0f)
+    {
+        unsigned int numParticles = (_allPackedParticles != 0) ? 
+            _allPackedParticles->size() : _allParticles->size();
+        this->InitGravity(numParticles);
+    }
+
+    _collider.Cleanup();
+    if (_collisionRadius > 0.0f)
+    {
+        unsigned int numParticles = (_allPackedParticles != 0) ? 
+            _allPackedParticles->size() : _allParticles->size();
+        this->InitCollider(numParticles);
+    }
+
+    _fluid.Cleanup();
+    if (_fluidSettings._smoothingRadius > 0.0f)
+    {
+        unsigned int numParticles = (_allPackedParticles != 0) ? 
+            _allPackedParticles->size() : _allParticles->size();
+        this->InitFluid(numParticles);
+    }
+
+    _reorder.Cleanup();
+    if (_reorderStepsBetween > 0)
+    {
+        unsigned int numParticles = (_allPackedParticles != 0) ? 
+            _allPackedParticles->size() : _allParticles->size();
+        this->InitReorder(numParticles);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Forgets the particle collection and frees the "structure of arrays" copy, if there is one.
+    The collection belongs to the manager, so it is not deleted.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::Cleanup()
+{
+    _allParticles = 0;
+    _allPackedParticles = 0;
+    _particleBufferId = 0;
+    _emitters = 0;
+    _emissionQuotas.clear();
+    _numQuotasPerSubstep = 0;
+    _emittedParticles.clear();
+    _useLifetimes = false;
+    _expiryBuckets.Cleanup();
+    _expiredParticles.clear();
+    _knowsWaitingParticles = false;
+    _waitingParticles.clear();
+    _forceFields.clear();
+    _obstacles.Cleanup();
+    _turbulence.Cleanup();
+    _neighborGrid.Cleanup();
+    _gravityTree.Cleanup();
+    _gravityMesh.Cleanup();
+    _collider.Cleanup();
+    _fluid.Cleanup();
+    _reorder.Cleanup();
+    _reorderParticles.clear();
+    _reorderPackedParticles.clear();
+    _reorderParticlesSoa.Clear();
+    _particlesSoa.Clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Takes as many steps of deltaTimeSec as it was asked to with SetSubsteps(...), which is 
+    one unless asked otherwise.  If nothing but the update kernel touches the particles (see 
+    CanBlockSubsteps()), then they are all taken in one pass over the particles (see 
+    StepBlocked(...)).  Otherwise they are taken one after the other (see Step(...)).
+Parameters:
+    deltaTimeSec    The length of each step.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::Update(float deltaTimeSec)
+{
+    unsigned int numParticles = 0;
+    if (_allPackedParticles != 0)
+    {
+        numParticles = _allPackedParticles->size();
+    }
+    else if (_allParticles != 0)
+    {
+        numParticles = _allParticles->size();
+    }
+    else
+    {
+        return;
+    }
+
+    if (_numSubsteps > 1 && this->CanBlockSubsteps())
+    {
+        this->StepBlocked(numParticles, deltaTimeSec);
+        return;
+    }
+
+    for (unsigned int substepIndex = 0; substepIndex < _numSubsteps; substepIndex++)
+    {
+        this->Step(numParticles, deltaTimeSec);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The CPU version of shaderParticle.comp's main().  Moves every active particle along its 
+    velocity and, if that took it outside the circle, puts it back at the emitter center.  The 
+    velocity is left alone, just like in the shader.  Inactive and out of bounds particles are 
+    only sent out while this frame's emission quota lasts, and that is worked out after the 
+    update so that the same ones go out no matter how many threads there are (see 
+    EmissionQuota.h).
+
+    If the particles have lifetimes, then the ones whose lifetimes run out on this step are 
+    turned off first, which lets the update send them right back out, and the ones that the 
+    update sent out are filed by when they expire afterwards.  Scheduled exits (see 
+    SetExitScheduling(...)) go through the same expiry buckets.
+
+    If there are force fields, then they change the velocities before the particles are moved, 
+    and the particles that were sent out get new velocities afterwards.  Gravity does the same, 
+    and its tree is built (from where the particles are at the start of the step) before any 
+    particle is moved.  Obstacles bounce the particles right after they are moved.  If the 
+    turbulence changes over time, then it is moved along to this step before any particle is 
+    pushed by it.
+
+    The particles are split into cache-sized chunks, and if there is a thread pool, then each 
+    chunk is updated by whichever thread gets to it.
+
+    If the particles are a fluid, then the fluid step changes their velocities after the 
+    update, from where they ended up.  Collisions are worked out after that.  If the 
+    particles are due to be sorted (see SetReorder(...)), then that is next.  If there is a 
+    neighbor grid, then it is rebuilt last.
+Parameters:
+    numParticles    Self-explanatory
+    deltaTimeSec    Self-explanatory
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::Step(unsigned int numParticles, float deltaTimeSec)
+{
+    bool schedulesExits = this->SchedulesExits();
+    bool useExpiry = _useLifetimes || schedulesExits;
+    if (useExpiry)
+    {
+        this->ExpireParticles(numParticles);
+    }
+    if (schedulesExits)
+    {
+        this->PickScheduledEmissions(numParticles);
+        this->ScheduleExpiry(deltaTimeSec);
+    }
+    if (_gravityTree.IsInitialized() || _gravityMesh.IsInitialized())
+    {
+        this->BuildGravity(numParticles);
+    }
+    _turbulence.Advance(deltaTimeSec);
+
+    this->ResetEmissionQuotas(1);
+    this->UpdateChunks(numParticles, deltaTimeSec, 1);
+    if (schedulesExits)
+    {
+        this->EmitScheduledParticles();
+    }
+    else
+    {
+        this->EmitParticles();
+    }
+
+    if (useExpiry && !schedulesExits)
+    {
+        this->ScheduleExpiry(deltaTimeSec);
+    }
+    if (this->ChangesVelocities())
+    {
+        this->ResetEmittedVelocities();
+    }
+    if (_fluid.IsInitialized())
+    {
+        this->StepFluid(numParticles, deltaTimeSec);
+    }
+    if (_collider.IsInitialized())
+    {
+        this->ResolveCollisions(numParticles);
+    }
+    if (_reorder.IsInitialized() && ((_stepIndex + 1) % _reorderStepsBetween) == 0)
+    {
+        this->ReorderParticles(numParticles);
+    }
+    if (_neighborGrid.IsInitialized())
+    {
+        this->BuildNeighborGrid(numParticles);
+    }
+    _stepIndex++;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Takes every substep of an update in one pass over the particles.  Each chunk is moved 
+    along all of the substeps, one after the other, while it is still in the cache, and only 
+    then does the pass move on to the next chunk.  A plain step loads and stores every 
+    particle once, and when there are a lot of them, that is all that it has time for, so 
+    this cuts the trips to memory by about as many times as there are substeps.
+
+    Each substep has its own set of emission quotas, which are all reset first.  A particle 
+    that goes out of bounds during a substep asks that substep's quota, just as it would have 
+    if the steps had been taken one at a time.  But the chunk can't wait for the others to 
+    find out whether it may go (see EmitParticles()), so each chunk gets its own fixed part of 
+    each quota instead (see ResetEmissionQuotas(...)).  That still doesn't depend on the 
+    threads, but a chunk that has more particles to send out than its part has to keep some 
+    waiting even if another chunk didn't use all of its part, so the result isn't exactly 
+    the same as that of the separate steps.  The chunk size depends on the storage, so the 
+    storages don't come out exactly the same either.
+
+    The SoA particles are only copied back once per chunk, after its last substep, and the 
+    neighbor grid (if there is one) is only rebuilt at the end, since nothing in between 
+    looks at it.
+
+    Note: Only called if CanBlockSubsteps().
+Parameters:
+    numParticles    Self-explanatory
+    deltaTimeSec    The length of each substep.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::StepBlocked(unsigned int numParticles, float deltaTimeSec)
+{
+    this->ResetEmissionQuotas(_numSubsteps);
+    this->UpdateChunks(numParticles, deltaTimeSec, _numSubsteps);
+
+    if (_neighborGrid.IsInitialized())
+    {
+        this->BuildNeighborGrid(numParticles);
+    }
+    _stepIndex += _numSubsteps;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Updates every chunk of the particles (see UpdateRange(...)), on the thread pool if there is 
+    one.  Without one, it is still a chunk at a time, because each chunk has its own emission 
+    quotas (see GetEmissionQuota(...)), and because blocked substeps would otherwise go over 
+    all of the particles and nothing would still be in the cache.
+Parameters:
+    numParticles    Self-explanatory
+    deltaTimeSec    The length of each substep.
+    numSubsteps     Self-explanatory.  1 unless the steps are blocked.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::UpdateChunks(unsigned int numParticles, float deltaTimeSec, 
+    unsigned int numSubsteps)
+{
+    if (_threadPool != 0)
+    {
+        _threadPool->ParallelFor(numParticles, _chunkSize,
+            [this, deltaTimeSec, numSubsteps](unsigned int beginIndex, unsigned int endIndex)
+        {
+            this->UpdateRange(beginIndex, endIndex, deltaTimeSec, numSubsteps);
+        });
+        return;
+    }
+
+    for (unsigned int beginIndex = 0; beginIndex < numParticles; beginIndex += _chunkSize)
+    {
+        unsigned int endIndex = beginIndex + _chunkSize;
+        if (endIndex > numParticles)
+        {
+            endIndex = numParticles;
+        }
+        this->UpdateRange(beginIndex, endIndex, deltaTimeSec, numSubsteps);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Starts this frame's emission quotas for every piece of every emitter's particles.
+
+    In a plain step, the emissions are deferred (see EmissionQuota.h), and each piece may have 
+    as many particles ask as it has particles, up to the whole quota.  EmitParticles() then 
+    hands out the quota afterwards.
+
+    Blocked substeps can't wait for that, so each piece gets a fixed part of each substep's 
+    quota, by how many of the emitter's particles it has.  The parts are rounded so that they 
+    add up to exactly the quota.
+Parameters:
+    numSubsteps     How many sets of quotas to reset.  1 unless the steps are blocked.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ResetEmissionQuotas(unsigned int numSubsteps)
+{
+    bool deferEmissions = (numSubsteps == 1);
+    for (unsigned int substepIndex = 0; substepIndex < numSubsteps; substepIndex++)
+    {
+        for (unsigned int emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+        {
+            const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+            unsigned long long maxEmitted = emitter._maxParticlesEmittedPerFrame;
+            unsigned int endIndex = emitter._firstParticle + emitter._numParticles;
+            unsigned int pieceBeginIndex = emitter._firstParticle;
+            while (pieceBeginIndex < endIndex)
+            {
+                unsigned int pieceEndIndex = ((pieceBeginIndex / _chunkSize) + 1) * _chunkSize;
+                if (pieceEndIndex > endIndex)
+                {
+                    pieceEndIndex = endIndex;
+                }
+
+                unsigned int pieceMaxEmitted = 0;
+                if (deferEmissions)
+                {
+                    unsigned int numPieceParticles = pieceEndIndex - pieceBeginIndex;
+                    pieceMaxEmitted = (maxEmitted < numPieceParticles) ? 
+                        (unsigned int)maxEmitted : numPieceParticles;
+                }
+                else
+                {
+                    // this piece's part is what the quota would be up to its end minus what 
+                    // it would be up to its beginning, so the parts add up
+                    unsigned long long numBefore = pieceBeginIndex - emitter._firstParticle;
+                    unsigned long long numThrough = pieceEndIndex - emitter._firstParticle;
+                    pieceMaxEmitted = (unsigned int)(
+                        ((maxEmitted * numThrough) / emitter._numParticles) - 
+                        ((maxEmitted * numBefore) / emitter._numParticles));
+                }
+
+                this->GetEmissionQuota(substepIndex, emitterIndex, pieceBeginIndex)->Reset(
+                    pieceMaxEmitted, deferEmissions);
+                pieceBeginIndex = pieceEndIndex;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Finds the emission quota for the piece of an emitter's particles that is in the same chunk 
+    as the given particle.
+
+    Note: The emitters and the chunks both go in particle order, so going from one piece to the 
+    next always moves on to the next chunk, the next emitter, or both.  That makes the chunk 
+    index plus the emitter index different for every piece, and it is never more than the 
+    number of chunks plus the number of emitters.
+Parameters:
+    substepIndex    Which substep's quotas (see StepBlocked(...)).  0 unless the steps are 
+                    blocked.
+    emitterIndex    Self-explanatory.
+    particleIndex   Any of the emitter's particles in the chunk.
+Returns:
+    A pointer to the quota.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+EmissionQuota *ParticleSimulatorCpu::GetEmissionQuota(unsigned int substepIndex, 
+    unsigned int emitterIndex, unsigned int particleIndex)
+{
+    unsigned int quotaIndex = (particleIndex / _chunkSize) + emitterIndex;
+    return &_emissionQuotas[(substepIndex * _numQuotasPerSubstep) + quotaIndex];
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Tells whether the substeps of an update can be taken in one pass over the particles (see 
+    StepBlocked(...)).  That is only the case when each particle's step depends on nothing but 
+    the particle itself, so the particles are only moving in straight lines and being sent 
+    back out.  Anything that changes the velocities needs the emitted particles' new 
+    velocities (or the gravity, fluid, or collisions) between the steps, the lifetimes and the 
+    scheduled exits need their expiry buckets between them, and the sort moves the particles 
+    around between them.
+Parameters: None
+Returns:
+    True if there are no lifetimes, no scheduled exits, no sort, and nothing that changes the 
+    velocities (see ChangesVelocities()), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleSimulatorCpu::CanBlockSubsteps() const
+{
+    return !_useLifetimes && !this->SchedulesExits() && !_reorder.IsInitialized() && 
+        !this->ChangesVelocities();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Chooses how the particles are moved when something is accelerating them (see 
+    ParticleIntegrator.h).  Must be called before Init(...), which picks the kernels.
+
+    Note: Semi-implicit Euler is the fastest by far.  It uses the separate force field pass, 
+    which has an AVX2 version.  The others look up the fields at every stage inside the 
+    integrate kernel.  For the "structure of arrays" storage, that kernel is SSE2, 4 particles 
+    at a time.  For the others, it is scalar, one particle at a time.
+Parameters:
+    integrator  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetIntegrator(IntegratorType integrator)
+{
+    _integrator = integrator;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for the particles to behave as a fluid (see ParticleFluid.h).  Must be called before 
+    Init(...).
+Parameters:
+    settings    See FluidSettings.  A smoothing radius of 0 means no fluid.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetFluid(const FluidSettings &settings)
+{
+    _fluidSettings = settings;
+    if (_fluidSettings._smoothingRadius < 0.0f)
+    {
+        _fluidSettings._smoothingRadius = 0.0f;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    See ParticleFluid::GetPassTimes().
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+FluidPassTimes ParticleSimulatorCpu::GetFluidPassTimes()
+{
+    return _fluid.GetPassTimes();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Copies the force field table.  The particles that are emitted from then on are listed so 
+    that they can be given new velocities (see EmitParticles()).  The fields bend the 
+    particles' paths, so if the exits were scheduled, then the kernels go back to the bounds 
+    test (see PickUpdateKernels()).
+Parameters:
+    forceFields     See ForceField.h.  May be empty.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetForceFields(const std::vector<ForceField> &forceFields)
+{
+    _forceFields = forceFields;
+    this->PickUpdateKernels();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Copies the baked obstacle field.  Like SetForceFields(...), this has the emitted particles 
+    listed and may bring back the bounds test, because bounces change the velocities.
+Parameters:
+    obstacles   See ObstacleField.h.  If it isn't baked, then there are no obstacles.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetObstacles(const ObstacleField &obstacles)
+{
+    _obstacles = obstacles;
+    this->PickUpdateKernels();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Bakes the turbulence field (see TurbulenceField::Init(...)).  Like SetForceFields(...), 
+    this has the emitted particles listed and may bring back the bounds test, because the 
+    turbulence changes the velocities.
+Parameters:
+    settings    See TurbulenceSettings.  A strength of 0 means no turbulence.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetTurbulence(const TurbulenceSettings &settings)
+{
+    _turbulence.Init(settings);
+    this->PickUpdateKernels();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for the particles to be sorted by where they are every so many steps (see 
+    ParticleReorder.h).  Must be called before Init(...).
+Parameters:
+    numStepsBetweenSorts    The particles are sorted during every step whose count 
+                            (starting from 1) is a multiple of this.  0 means never.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetReorder(unsigned int numStepsBetweenSorts)
+{
+    _reorderStepsBetween = numStepsBetweenSorts;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for every update to take this many steps (see Update(...)).  Must be called before 
+    Init(...), which makes a set of emission quotas for each of them.
+Parameters:
+    numSubsteps     0 is the same as 1.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetSubsteps(unsigned int numSubsteps)
+{
+    _numSubsteps = (numSubsteps > 0) ? numSubsteps : 1;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Tells the manager that the particle collection changed and that it needs to be uploaded
+    before drawing.
+Parameters: None
+Returns:
+    True.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleSimulatorCpu::UpdatesOnCpu() const
+{
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The CPU update doesn't keep a list of live particles, so the manager draws all of them and 
+    the vertex shader hides the inactive ones.
+Parameters: None
+Returns:
+    0.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleSimulatorCpu::GetLiveListBufferId() const
+{
+    return 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The AoS and packed updates work on the manager's collection directly, and the SoA update 
+    copies its results back every frame if they are going to be drawn.  The only time that the 
+    collection is stale is an SoA update without a buffer (headless), so copy it back then.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ReadBackParticles()
+{
+    if (_storage == STORAGE_SOA && _allParticles != 0 && _particleBufferId == 0)
+    {
+        _particlesSoa.CopyBackTo(_allParticles, 0, _particlesSoa.Size(), 
+            this->ChangesVelocities());
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Chooses how the particles are stored during the update.  Must be called before Init(...).
+Parameters:
+    storage     See the StorageType enum.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetStorage(StorageType storage)
+{
+    _storage = storage;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for how the particles are stored during the update.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleSimulatorCpu::StorageType ParticleSimulatorCpu::GetStorage() const
+{
+    return _storage;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives the simulator threads to split the update across.  The pool is not owned.  Pass 0 to 
+    go back to updating on the calling thread.
+Parameters:
+    threadPool  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetThreadPool(ThreadPool *threadPool)
+{
+    _threadPool = threadPool;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Caps the instruction set that the update kernels may use.  The CPU's own limit still 
+    applies.  Must be called before Init(...).
+Parameters:
+    maxSimdLevel    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetSimdLevel(SimdLevel maxSimdLevel)
+{
+    _maxSimdLevel = maxSimdLevel;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the instruction set that was picked during Init(...).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+SimdLevel ParticleSimulatorCpu::GetSimdLevel() const
+{
+    return _simdLevel;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for the particles to be sorted into a grid after every update (see NeighborGrid.h).  
+    The cells are square, and their size is relative to the emitters' radius (the smallest one 
+    if there is more than one) so that the grid is just as fine no matter how big the emitters 
+    are.  Must be called before Init(...).
+Parameters:
+    cellSizeInRadii     A cell's width as a fraction of the radius.  0 means no grid.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetNeighborGrid(float cellSizeInRadii)
+{
+    _gridCellSizeInRadii = (cellSizeInRadii > 0.0f) ? cellSizeInRadii : 0.0f;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the grid that the last update built.  It is empty (see 
+    NeighborGrid::IsInitialized()) unless SetNeighborGrid(...) was called before Init(...).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const NeighborGrid &ParticleSimulatorCpu::GetNeighborGrid() const
+{
+    return _neighborGrid;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for every particle to pull on every other particle (see GravityTree.h).  Must be 
+    called before Init(...).
+Parameters:
+    strength        What the acceleration would be at a distance of 1 from all of the active 
+                    particles together, in window coords per second per second.  Negative 
+                    pushes apart.  0 means no gravity.
+    openingAngle    How far away a group of particles has to be before it pulls as one (see 
+                    GravityTree::ComputeAccelerations(...)).  Bigger is faster and rougher.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetGravity(float strength, float openingAngle)
+{
+    _gravityStrength = strength;
+    _gravityOpeningAngle = (openingAngle > 0.0f) ? openingAngle : 0.0f;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the tree that the last update built.  It is empty (see 
+    GravityTree::IsInitialized()) unless SetGravity(...) was called before Init(...).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const GravityTree &ParticleSimulatorCpu::GetGravityTree() const
+{
+    return _gravityTree;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out gravity on a particle-mesh (see ParticleMeshGravity.h) instead of with the tree.  
+    The opening angle is then not used.  Must be called before Init(...).
+Parameters:
+    meshSize    How many mesh points across (a power of 2).  0 goes back to the tree.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetGravityMesh(unsigned int meshSize)
+{
+    _gravityMeshSize = meshSize;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the mesh that the last update used.  It is empty (see 
+    ParticleMeshGravity::IsInitialized()) unless SetGravity(...) and SetGravityMesh(...) were 
+    called before Init(...).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const ParticleMeshGravity &ParticleSimulatorCpu::GetGravityMesh() const
+{
+    return _gravityMesh;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for the particles to bounce off of each other (see ParticleCollider.h).  Must be 
+    called before Init(...).
+Parameters:
+    particleRadius  Every particle's radius, in window coords.  0 means no collisions.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetCollisions(float particleRadius)
+{
+    _collisionRadius = (particleRadius > 0.0f) ? particleRadius : 0.0f;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the collider that the last update used.  It is empty (see 
+    ParticleCollider::IsInitialized()) unless SetCollisions(...) was called before Init(...).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const ParticleCollider &ParticleSimulatorCpu::GetCollider() const
+{
+    return _collider;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for each particle's exit from its emitter's circle to be worked out when it is 
+    emitted instead of being found by a bounds test on every step (see SchedulesExits()).  
+    Must be called before Init(...).
+
+    Note: The exit step comes from where the particle would be after so many whole steps, 
+    not from adding up the steps one at a time, so once in a while a particle that only just 
+    leaves is sent back out a step sooner or later than the bounds test would have done it.  
+    The exit steps also assume that the step size doesn't change, which is true of the fixed 
+    steps that main.cpp takes (see FrameClock.h).
+Parameters:
+    scheduleExits   Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::SetExitScheduling(bool scheduleExits)
+{
+    _scheduleExits = scheduleExits;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the fluid that the last update used.  It is empty (see 
+    ParticleFluid::IsInitialized()) unless SetFluid(...) was called before Init(...).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const ParticleFluid &ParticleSimulatorCpu::GetFluid() const
+{
+    return _fluid;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the turbulence field.  It is empty (see 
+    TurbulenceField::IsInitialized()) unless SetTurbulence(...) was called.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const TurbulenceField &ParticleSimulatorCpu::GetTurbulence() const
+{
+    return _turbulence;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the sort, which also has the handle tables (see 
+    ParticleReorder::GetParticleIndex(...)).  It is empty (see 
+    ParticleReorder::IsInitialized()) unless SetReorder(...) was called before Init(...), 
+    and then a handle is always the same as its particle's index.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const ParticleReorder &ParticleSimulatorCpu::GetReorder() const
+{
+    return _reorder;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Finds the emitter that a particle belongs to.  The emitters are in order of their first 
+    particle, so it is the last one that starts at or before the particle.
+
+    Note: Thousands of emitters is still only a dozen or so steps.
+Parameters:
+    particleIndex   Self-explanatory.
+Returns:
+    An index into the emitter table.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleSimulatorCpu::GetEmitterIndex(unsigned int particleIndex) const
+{
+    std::vector<ParticleEmitter>::const_iterator emitterItr = std::upper_bound(
+        _emitters->begin(), _emitters->end(), particleIndex,
+        [](unsigned int particleIndex, const ParticleEmitter &emitter)
+    {
+        return particleIndex < emitter._firstParticle;
+    });
+    return (unsigned int)(emitterItr - _emitters->begin()) - 1;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Updates the particles in [beginIndex, endIndex).  The range may cross from one emitter's 
+    particles into the next, so it is cut at the emitter boundaries and each piece is updated 
+    with its own emitter's values.  If there is more than one substep, then the whole range 
+    takes each one before it takes the next (see StepBlocked(...)).
+
+    With the "structure of arrays" storage, the positions and flags are then copied back into the 
+    Particle collection if something is going to draw them.
+Parameters:
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    The length of each substep.
+    numSubsteps     Self-explanatory.  1 unless the steps are blocked.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::UpdateRange(unsigned int beginIndex, unsigned int endIndex, 
+    float deltaTimeSec, unsigned int numSubsteps)
+{
+    unsigned int firstEmitterIndex = this->GetEmitterIndex(beginIndex);
+    for (unsigned int substepIndex = 0; substepIndex < numSubsteps; substepIndex++)
+    {
+        unsigned int emitterIndex = firstEmitterIndex;
+        unsigned int pieceBeginIndex = beginIndex;
+        while (pieceBeginIndex < endIndex)
+        {
+            const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+            unsigned int pieceEndIndex = emitter._firstParticle + emitter._numParticles;
+            if (pieceEndIndex > endIndex)
+            {
+                pieceEndIndex = endIndex;
+            }
+
+            if (pieceEndIndex > pieceBeginIndex)
+            {
+                this->UpdateEmitterRange(emitterIndex, substepIndex, pieceBeginIndex, 
+                    pieceEndIndex, deltaTimeSec);
+                pieceBeginIndex = pieceEndIndex;
+            }
+            emitterIndex++;
+        }
+    }
+
+    if (_allPackedParticles == 0 && _storage == STORAGE_SOA && _particleBufferId != 0)
+    {
+        _particlesSoa.CopyBackTo(_allParticles, beginIndex, endIndex, 
+            this->ChangesVelocities());
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Updates some of one emitter's particles with the kernel for the current storage, after 
+    the turbulence pass if there is turbulence, the gravity pass if there is gravity, and the 
+    force field pass if there are any fields, and before the obstacle pass if there are 
+    obstacles.  Compact particles are always updated where they are.
+
+    With any integrator but semi-implicit Euler, the gravity and force field passes are 
+    replaced by the integrate pass, which moves the particles itself, so the update kernel is 
+    given a step of 0.
+
+    If the exits are scheduled (see SchedulesExits()), then the update kernels are the ones 
+    without the bounds test (see PickUpdateKernels()), which move every particle, and the 
+    emissions are sorted out around them (see PickScheduledEmissions(...)).
+Parameters:
+    emitterIndex    Self-explanatory.
+    substepIndex    Which substep's emission quotas to use (see StepBlocked(...)).  0 unless 
+                    the steps are blocked.
+    beginIndex      The first particle to update.  Must belong to the emitter and be in the 
+                    same chunk as the rest of the range.
+    endIndex        One past the last particle to update.  Must belong to the emitter.
+    deltaTimeSec    Self-explanatory
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::UpdateEmitterRange(unsigned int emitterIndex, 
+    unsigned int substepIndex, unsigned int beginIndex, unsigned int endIndex, 
+    float deltaTimeSec)
+{
+    const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+    EmissionQuota *quota = this->GetEmissionQuota(substepIndex, emitterIndex, beginIndex);
+    const glm::vec2 *accelerations = 0;
+    if (_gravityMesh.IsInitialized())
+    {
+        accelerations = _gravityMesh.GetAccelerations();
+    }
+    else if (_gravityTree.IsInitialized())
+    {
+        accelerations = _gravityTree.GetAccelerations();
+    }
+    const ForceField *forceFields = _forceFields.data();
+    unsigned int numForceFields = _forceFields.size();
+
+    if (_turbulence.IsInitialized())
+    {
+        const TurbulenceFieldHeader &header = _turbulence.GetHeader();
+        const glm::vec2 *samples = _turbulence.GetSamples();
+        if (_allPackedParticles != 0)
+        {
+            ApplyTurbulencePacked(_allPackedParticles->data(), beginIndex, endIndex, 
+                deltaTimeSec, emitter._center, emitter._radius, header, samples);
+        }
+        else if (_storage == STORAGE_SOA)
+        {
+            ApplyTurbulenceSoa(&_particlesSoa, beginIndex, endIndex, deltaTimeSec, header, 
+                samples);
+        }
+        else
+        {
+            ApplyTurbulenceAos(_allParticles->data(), beginIndex, endIndex, deltaTimeSec, 
+                header, samples);
+        }
+    }
+
+    float moveDeltaTimeSec = deltaTimeSec;
+    if (_integrator != INTEGRATOR_SEMI_IMPLICIT_EULER && 
+        (accelerations != 0 || numForceFields > 0))
+    {
+        if (_allPackedParticles != 0)
+        {
+            _packedIntegrateKernel(_allPackedParticles->data(), beginIndex, endIndex, 
+                deltaTimeSec, emitter._center, emitter._radius, accelerations, forceFields, 
+                numForceFields);
+        }
+        else if (_storage == STORAGE_SOA)
+        {
+            _soaIntegrateKernel(&_particlesSoa, beginIndex, endIndex, deltaTimeSec, 
+                accelerations, forceFields, numForceFields);
+        }
+        else
+        {
+            _aosIntegrateKernel(_allParticles->data(), beginIndex, endIndex, deltaTimeSec, 
+                accelerations, forceFields, numForceFields);
+        }
+
+        // already moved
+        moveDeltaTimeSec = 0.0f;
+    }
+    else
+    {
+        if (accelerations != 0)
+        {
+            if (_allPackedParticles != 0)
+            {
+                ApplyAccelerationsPacked(_allPackedParticles->data(), beginIndex, endIndex, 
+                    deltaTimeSec, accelerations);
+            }
+            else if (_storage == STORAGE_SOA)
+            {
+                ApplyAccelerationsSoa(&_particlesSoa, beginIndex, endIndex, deltaTimeSec, 
+                    accelerations);
+            }
+            else
+            {
+                ApplyAccelerationsAos(_allParticles->data(), beginIndex, endIndex, 
+                    deltaTimeSec, accelerations);
+            }
+        }
+
+        if (numForceFields > 0)
+        {
+            if (_allPackedParticles != 0)
+            {
+                ApplyForceFieldsPacked(_allPackedParticles->data(), beginIndex, endIndex, 
+                    deltaTimeSec, emitter._center, emitter._radius, forceFields, 
+                    numForceFields);
+            }
+            else if (_storage == STORAGE_SOA)
+            {
+                _soaForceFieldKernel(&_particlesSoa, beginIndex, endIndex, deltaTimeSec, 
+                    forceFields, numForceFields);
+            }
+            else
+            {
+                ApplyForceFieldsAos(_allParticles->data(), beginIndex, endIndex, 
+                    deltaTimeSec, forceFields, numForceFields);
+            }
+        }
+    }
+
+    if (_allPackedParticles != 0)
+    {
+        _packedKernel(_allPackedParticles->data(), beginIndex, endIndex, moveDeltaTimeSec, 
+            emitter._radius, quota);
+    }
+    else if (_storage == STORAGE_SOA)
+    {
+        _soaKernel(&_particlesSoa, beginIndex, endIndex, moveDeltaTimeSec, emitter._center, 
+            emitter._radiusSqr, quota);
+    }
+    else
+    {
+        _aosKernel(_allParticles->data(), beginIndex, endIndex, moveDeltaTimeSec, 
+            emitter._center, emitter._radiusSqr, quota);
+    }
+
+    if (_obstacles.IsBaked())
+    {
+        const ObstacleFieldHeader &header = _obstacles.GetHeader();
+        const float *samples = _obstacles.GetSamples();
+        if (_allPackedParticles != 0)
+        {
+            ApplyObstaclesPacked(_allPackedParticles->data(), beginIndex, endIndex, 
+                emitter._center, emitter._radius, header, samples);
+        }
+        else if (_storage == STORAGE_SOA)
+        {
+            ApplyObstaclesSoa(&_particlesSoa, beginIndex, endIndex, header, samples);
+        }
+        else
+        {
+            ApplyObstaclesAos(_allParticles->data(), beginIndex, endIndex, header, samples);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Turns off the particles whose lives end on this step, whether their lifetimes ran out or 
+    they were due to go out of bounds.  The first time through, this also makes the expiry 
+    buckets.
+
+    If the exits are scheduled, then the kernels won't look at the flags, so the particles are 
+    left on for PickScheduledEmissions(...), which only turns off the ones that can't be sent 
+    right back out.
+
+    Note: The particles are turned off in whichever storage the kernels use.  The "structure 
+    of arrays" flags are copied back into the Particle collection along with the positions.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ExpireParticles(unsigned int numParticles)
+{
+    if (!_expiryBuckets.IsInitialized())
+    {
+        _expiryBuckets.Init(numParticles);
+    }
+
+    _expiryBuckets.TakeExpired(_stepIndex, &_expiredParticles);
+    if (this->SchedulesExits())
+    {
+        return;
+    }
+
+    for (size_t expiredIndex = 0; expiredIndex < _expiredParticles.size(); expiredIndex++)
+    {
+        unsigned int particleIndex = _expiredParticles[expiredIndex];
+        if (_allPackedParticles != 0)
+        {
+            (*_allPackedParticles)[particleIndex]._lowBitsAndFlags &= ~PACKED_IS_ACTIVE_FLAG;
+        }
+        else if (_storage == STORAGE_SOA)
+        {
+            _particlesSoa._isActive[particleIndex] = 0;
+        }
+        else
+        {
+            (*_allParticles)[particleIndex]._isActive = 0;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Hands out each emitter's quota before a step with scheduled exits.  Nothing but the expiry 
+    buckets turns a particle off then, so the particles that want the quota are the ones in 
+    the emitter's waiting queue plus the ones whose lives just ended, and the kernels don't 
+    need to find them.  They get it in particle order, just like in EmitParticles(), so only 
+    the front of the queue is merged with the ones that just expired, and the ones that get it 
+    are turned on and listed for ScheduleExpiry(...) and EmitScheduledParticles().  The ones 
+    that just expired and didn't get it join the queue (see StartWaiting(...)).  The rest of 
+    the queue isn't touched.
+
+    The first time through, and after anything that could have turned the bounds test back on 
+    (see PickUpdateKernels()), every particle's flag is looked at to fill the queues (see 
+    FindWaitingParticles(...)).
+
+    Note: The particles that just expired only need sorting if there is a queue or if there 
+    are more of them than the quota, which is rare once the particles are all out.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::PickScheduledEmissions(unsigned int numParticles)
+{
+    if (!_knowsWaitingParticles)
+    {
+        this->FindWaitingParticles(numParticles);
+        _knowsWaitingParticles = true;
+    }
+
+    for (size_t emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        _emittedParticles[emitterIndex].clear();
+    }
+    for (size_t expiredIndex = 0; expiredIndex < _expiredParticles.size(); expiredIndex++)
+    {
+        unsigned int particleIndex = _expiredParticles[expiredIndex];
+        _emittedParticles[this->GetEmitterIndex(particleIndex)].push_back(particleIndex);
+    }
+
+    for (unsigned int emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        std::vector<unsigned int> &emittedParticles = _emittedParticles[emitterIndex];
+        const std::vector<WaitingParticle> &waitingParticles = _waitingParticles[emitterIndex];
+        size_t maxEmitted = (*_emitters)[emitterIndex]._maxParticlesEmittedPerFrame;
+        if (waitingParticles.empty() && emittedParticles.size() <= maxEmitted)
+        {
+            continue;
+        }
+
+        // the ones that are taken from the queue go on the end of the list, after the ones 
+        // that just expired
+        std::sort(emittedParticles.begin(), emittedParticles.end());
+        size_t numExpired = emittedParticles.size();
+        size_t expiredIndex = 0;
+        while ((emittedParticles.size() - numExpired) + expiredIndex < maxEmitted)
+        {
+            bool hasExpired = expiredIndex < numExpired;
+            if (!waitingParticles.empty() && (!hasExpired || 
+                waitingParticles.front()._particleIndex < emittedParticles[expiredIndex]))
+            {
+                emittedParticles.push_back(this->StopWaiting(emitterIndex));
+            }
+            else if (hasExpired)
+            {
+                expiredIndex++;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        for (size_t waitingIndex = expiredIndex; waitingIndex < numExpired; waitingIndex++)
+        {
+            this->StartWaiting(emitterIndex, emittedParticles[waitingIndex]);
+        }
+        emittedParticles.erase(emittedParticles.begin() + expiredIndex, 
+            emittedParticles.begin() + numExpired);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Puts every particle that is off into its emitter's waiting queue.  They are found in 
+    particle order, so each one goes on the bottom of the queue and the heap never has to be 
+    rearranged.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::FindWaitingParticles(unsigned int numParticles)
+{
+    for (unsigned int emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+        unsigned int endIndex = emitter._firstParticle + emitter._numParticles;
+        for (unsigned int particleIndex = emitter._firstParticle; 
+            particleIndex < endIndex && particleIndex < numParticles; particleIndex++)
+        {
+            int isActive = (_storage == STORAGE_SOA) ? 
+                _particlesSoa._isActive[particleIndex] : 
+                (*_allParticles)[particleIndex]._isActive;
+            if (isActive == 0)
+            {
+                this->StartWaiting(emitterIndex, particleIndex);
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Orders the waiting queues (see std::push_heap(...)) so that the particle with the lowest 
+    index is at the front, because that is the order that EmitParticles() hands out the quota 
+    in.
+Parameters:
+    left    Self-explanatory.
+    right   Self-explanatory.
+Returns:
+    True if left gets the quota after right, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleSimulatorCpu::IsServedAfter(const WaitingParticle &left, 
+    const WaitingParticle &right)
+{
+    return left._particleIndex > right._particleIndex;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Turns a particle off and puts it in its emitter's waiting queue.  Its velocity is kept in 
+    the queue and set to 0 in whichever storage the kernels use, so the kernels, which move 
+    every particle (see PickUpdateKernels()), leave it right where it is for as long as it 
+    waits, just like the bounds test does.
+
+    Note: With the "structure of arrays" storage, the Particle collection's velocity is left 
+    alone, because the SoA velocities aren't copied back unless something changes them (see 
+    ChangesVelocities()), and nothing does while the exits are scheduled.
+Parameters:
+    emitterIndex    Self-explanatory.
+    particleIndex   Must belong to the emitter.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::StartWaiting(unsigned int emitterIndex, unsigned int particleIndex)
+{
+    WaitingParticle waiting;
+    waiting._particleIndex = particleIndex;
+    if (_storage == STORAGE_SOA)
+    {
+        waiting._velocity = glm::vec2(_particlesSoa._velocityX[particleIndex], 
+            _particlesSoa._velocityY[particleIndex]);
+        _particlesSoa._velocityX[particleIndex] = 0.0f;
+        _particlesSoa._velocityY[particleIndex] = 0.0f;
+        _particlesSoa._isActive[particleIndex] = 0;
+    }
+    else
+    {
+        Particle &p = (*_allParticles)[particleIndex];
+        waiting._velocity = glm::vec2(p._velocity);
+        p._velocity.x = 0.0f;
+        p._velocity.y = 0.0f;
+        p._isActive = 0;
+    }
+
+    std::vector<WaitingParticle> &waitingParticles = _waitingParticles[emitterIndex];
+    waitingParticles.push_back(waiting);
+    std::push_heap(waitingParticles.begin(), waitingParticles.end(), IsServedAfter);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Takes the particle at the front of an emitter's waiting queue, gives it back its velocity, 
+    and turns it on (see StartWaiting(...)).
+Parameters:
+    emitterIndex    Must have at least one particle waiting.
+Returns:
+    The particle's index.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleSimulatorCpu::StopWaiting(unsigned int emitterIndex)
+{
+    std::vector<WaitingParticle> &waitingParticles = _waitingParticles[emitterIndex];
+    std::pop_heap(waitingParticles.begin(), waitingParticles.end(), IsServedAfter);
+    WaitingParticle waiting = waitingParticles.back();
+    waitingParticles.pop_back();
+
+    unsigned int particleIndex = waiting._particleIndex;
+    if (_storage == STORAGE_SOA)
+    {
+        _particlesSoa._velocityX[particleIndex] = waiting._velocity.x;
+        _particlesSoa._velocityY[particleIndex] = waiting._velocity.y;
+        _particlesSoa._isActive[particleIndex] = 1;
+    }
+    else
+    {
+        Particle &p = (*_allParticles)[particleIndex];
+        p._velocity.x = waiting._velocity.x;
+        p._velocity.y = waiting._velocity.y;
+        p._isActive = 1;
+    }
+    return particleIndex;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives every waiting particle back its velocity and empties the queues, so that the 
+    particles are just off, as the bounds test expects them to be (see StartWaiting(...)).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ReleaseWaitingParticles()
+{
+    for (size_t emitterIndex = 0; emitterIndex < _waitingParticles.size(); emitterIndex++)
+    {
+        std::vector<WaitingParticle> &waitingParticles = _waitingParticles[emitterIndex];
+        for (size_t waitingIndex = 0; waitingIndex < waitingParticles.size(); waitingIndex++)
+        {
+            const WaitingParticle &waiting = waitingParticles[waitingIndex];
+            if (_storage == STORAGE_SOA)
+            {
+                _particlesSoa._velocityX[waiting._particleIndex] = waiting._velocity.x;
+                _particlesSoa._velocityY[waiting._particleIndex] = waiting._velocity.y;
+            }
+            else
+            {
+                (*_allParticles)[waiting._particleIndex]._velocity.x = waiting._velocity.x;
+                (*_allParticles)[waiting._particleIndex]._velocity.y = waiting._velocity.y;
+            }
+        }
+        waitingParticles.clear();
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Files every particle that was emitted during this step under the step that its life ends 
+    on.  That is when its lifetime runs out, or if exits are scheduled, the first step that 
+    leaves it outside the circle, whichever is sooner.  The emitters that don't give their 
+    particles lifetimes are skipped, unless exits are scheduled, even if they kept a list for 
+    the force fields.
+
+    A particle that is sent out ends the step at its emitter's center, so after N more steps 
+    it has gone N times its velocity times the step size.  The first N that takes it past the 
+    exit time is the step that the bounds test would have caught it on.  If the exits are 
+    scheduled, then this is done before the kernels run, for the particles that 
+    PickScheduledEmissions(...) is about to send out, so the exits are worked out from the 
+    centers and not from where the particles are.
+Parameters:
+    deltaTimeSec    The step size.  Lifetimes are rounded to the nearest whole step.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ScheduleExpiry(float deltaTimeSec)
+{
+    // a particle that takes longer than this to leave is treated as if it never does
+    static const float MAX_EXIT_STEPS = 2147483648.0f;
+
+    bool schedulesExits = this->SchedulesExits();
+    for (size_t emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+        const std::vector<unsigned int> &emittedParticles = _emittedParticles[emitterIndex];
+        bool hasLifetime = emitter._maxLifetimeSec > 0.0f;
+        if (!hasLifetime && !schedulesExits)
+        {
+            continue;
+        }
+
+        for (size_t emittedIndex = 0; emittedIndex < emittedParticles.size(); emittedIndex++)
+        {
+            unsigned int particleIndex = emittedParticles[emittedIndex];
+            bool expires = false;
+            unsigned int stepsToLive = 0;
+            if (hasLifetime)
+            {
+                float lifetimeSec = GetParticleLifetimeSec(emitter, particleIndex);
+                stepsToLive = (unsigned int)((lifetimeSec / deltaTimeSec) + 0.5f);
+                expires = true;
+            }
+
+            if (schedulesExits)
+            {
+                glm::vec2 velocity;
+                if (_storage == STORAGE_SOA)
+                {
+                    velocity = glm::vec2(_particlesSoa._velocityX[particleIndex], 
+                        _particlesSoa._velocityY[particleIndex]);
+                }
+                else
+                {
+                    velocity = glm::vec2((*_allParticles)[particleIndex]._velocity);
+                }
+
+                float exitSteps = GetParticleExitTimeSec(emitter, emitter._center, velocity) / 
+                    deltaTimeSec;
+                if (exitSteps >= 0.0f && exitSteps < MAX_EXIT_STEPS)
+                {
+                    unsigned int stepsToExit = (unsigned int)exitSteps + 1;
+                    stepsToLive = (expires && stepsToLive < stepsToExit) ? 
+                        stepsToLive : stepsToExit;
+                    expires = true;
+                }
+            }
+
+            if (expires)
+            {
+                _expiryBuckets.Schedule(particleIndex, _stepIndex, stepsToLive);
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Hands out each emitter's quota after a plain step.  The particles that asked for it (see 
+    EmissionQuota.h) get it in particle order, one chunk's piece after the next, until it runs 
+    out.  Each one that gets it is put at its emitter's center and turned on, which is just 
+    what the kernel would have done.  The rest stay off and ask again next frame.
+
+    If the particles have lifetimes, or something changes the velocities, or the exits are 
+    scheduled, then the ones that were sent out are also listed for ScheduleExpiry(...) and 
+    ResetEmittedVelocities().
+
+    Note: This goes through nothing but the particles that asked, and it has to be done on 
+    one thread, but there are only ever as many of those as the quotas allow (plus what is 
+    left of the last piece to get any).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::EmitParticles()
+{
+    bool recordForAll = this->ChangesVelocities() || this->SchedulesExits();
+    for (unsigned int emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+        std::vector<unsigned int> &emittedParticles = _emittedParticles[emitterIndex];
+        bool record = recordForAll || (emitter._maxLifetimeSec > 0.0f);
+        emittedParticles.clear();
+
+        unsigned int numLeft = emitter._maxParticlesEmittedPerFrame;
+        unsigned int endIndex = emitter._firstParticle + emitter._numParticles;
+        unsigned int pieceBeginIndex = emitter._firstParticle;
+        while (pieceBeginIndex < endIndex && numLeft > 0)
+        {
+            const EmissionQuota *quota = this->GetEmissionQuota(0, emitterIndex, pieceBeginIndex);
+            const unsigned int *waitingParticles = quota->WaitingParticles();
+            unsigned int numEmitted = quota->NumWaiting();
+            if (numEmitted > numLeft)
+            {
+                numEmitted = numLeft;
+            }
+
+            for (unsigned int waitingIndex = 0; waitingIndex < numEmitted; waitingIndex++)
+            {
+                unsigned int particleIndex = waitingParticles[waitingIndex];
+                if (_allPackedParticles != 0)
+                {
+                    // packed positions are relative to the center
+                    ParticlePacked &p = (*_allPackedParticles)[particleIndex];
+                    SetPackedPosition(&p, 0, 0);
+                    p._lowBitsAndFlags |= PACKED_IS_ACTIVE_FLAG;
+                }
+                else if (_storage == STORAGE_SOA)
+                {
+                    _particlesSoa._positionX[particleIndex] = emitter._center.x;
+                    _particlesSoa._positionY[particleIndex] = emitter._center.y;
+                    _particlesSoa._isActive[particleIndex] = 1;
+
+                    // the chunk was already copied back
+                    if (_particleBufferId != 0)
+                    {
+                        Particle &p = (*_allParticles)[particleIndex];
+                        p._position.x = emitter._center.x;
+                        p._position.y = emitter._center.y;
+                        p._isActive = 1;
+                    }
+                }
+                else
+                {
+                    Particle &p = (*_allParticles)[particleIndex];
+                    p._position = glm::vec4(emitter._center, 0.0f, 0.0f);
+                    p._isActive = 1;
+                }
+
+                if (record)
+                {
+                    emittedParticles.push_back(particleIndex);
+                }
+            }
+            numLeft -= numEmitted;
+
+            pieceBeginIndex = ((pieceBeginIndex / _chunkSize) + 1) * _chunkSize;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Puts the particles that PickScheduledEmissions(...) gave the quota to at their emitters' 
+    centers.  The flags were already set before the kernels ran, and the ones that didn't get 
+    the quota had no velocity to move with (see StartWaiting(...)).
+
+    Note: With the "structure of arrays" storage, the chunks were already copied back, flags 
+    and all, so only the positions need to be copied too.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::EmitScheduledParticles()
+{
+    for (unsigned int emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+        const std::vector<unsigned int> &emittedParticles = _emittedParticles[emitterIndex];
+        for (size_t emittedIndex = 0; emittedIndex < emittedParticles.size(); emittedIndex++)
+        {
+            unsigned int particleIndex = emittedParticles[emittedIndex];
+            if (_storage == STORAGE_SOA)
+            {
+                _particlesSoa._positionX[particleIndex] = emitter._center.x;
+                _particlesSoa._positionY[particleIndex] = emitter._center.y;
+            }
+            if (_storage == STORAGE_AOS || _particleBufferId != 0)
+            {
+                (*_allParticles)[particleIndex]._position.x = emitter._center.x;
+                (*_allParticles)[particleIndex]._position.y = emitter._center.y;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives every particle that was emitted during this step a new velocity from its emitter's 
+    range.  Without this, a particle that drag had slowed to a stop would be sent back out 
+    just as stopped.
+
+    Note: An emitted particle was put at its emitter's center and not moved, so giving it a new 
+    velocity now is the same as if the kernel had done it.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ResetEmittedVelocities()
+{
+    for (size_t emitterIndex = 0; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+        const std::vector<unsigned int> &emittedParticles = _emittedParticles[emitterIndex];
+        for (size_t emittedIndex = 0; emittedIndex < emittedParticles.size(); emittedIndex++)
+        {
+            unsigned int particleIndex = emittedParticles[emittedIndex];
+            glm::vec2 velocity = GetParticleEmitVelocity(emitter, particleIndex, _stepIndex);
+            if (_allPackedParticles != 0)
+            {
+                (*_allPackedParticles)[particleIndex]._velocity = glm::packHalf2x16(velocity);
+            }
+            else if (_storage == STORAGE_SOA)
+            {
+                _particlesSoa._velocityX[particleIndex] = velocity.x;
+                _particlesSoa._velocityY[particleIndex] = velocity.y;
+
+                // the chunk was already copied back
+                if (_particleBufferId != 0)
+                {
+                    (*_allParticles)[particleIndex]._velocity.x = velocity.x;
+                    (*_allParticles)[particleIndex]._velocity.y = velocity.y;
+                }
+            }
+            else
+            {
+                (*_allParticles)[particleIndex]._velocity.x = velocity.x;
+                (*_allParticles)[particleIndex]._velocity.y = velocity.y;
+            }
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the "array of structures" and "structure of arrays" update kernels for the SIMD 
+    level.  If the exits are scheduled (see SchedulesExits()), then they are the versions 
+    without the bounds test, which only move the particles, because the expiry buckets catch 
+    the particles before they could fail it.
+
+    Init(...) calls this, and so does anything that can change SchedulesExits() after it.  The 
+    waiting particles aren't kept track of while the bounds test is on, so they are given back 
+    their velocities and forgotten here, and looked for again on the next step if the exits 
+    are still scheduled (see PickScheduledEmissions(...)).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::PickUpdateKernels()
+{
+    bool testBounds = !this->SchedulesExits();
+    _aosKernel = GetAosUpdateKernel(_simdLevel, testBounds);
+    _soaKernel = GetSoaUpdateKernel(_simdLevel, testBounds);
+    this->ReleaseWaitingParticles();
+    _knowsWaitingParticles = false;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Tells whether anything but the update kernel changes the particles' velocities, in which 
+    case the emitted particles need new velocities after the update and the SoA velocities 
+    need to be copied back.
+Parameters: None
+Returns:
+    True if there are force fields, gravity, collisions, obstacles, a fluid, or turbulence, 
+    otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleSimulatorCpu::ChangesVelocities() const
+{
+    return !_forceFields.empty() || _gravityStrength != 0.0f || _collisionRadius > 0.0f || 
+        _obstacles.IsBaked() || _fluidSettings._smoothingRadius > 0.0f || 
+        _turbulence.IsInitialized();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Tells whether the particles' exits are scheduled when they are emitted instead of being 
+    found by the kernels' bounds tests (see SetExitScheduling(...)).  That only works if 
+    nothing but the kernel moves them, so they stay on the straight line that the exit was 
+    worked out from, and not for the compact format, whose kernels find the exits from the 
+    packed positions themselves.
+
+    Note: Whatever would turn this off (ex: SetForceFields(...)) has to be set before the 
+    first update.  Otherwise the particles that are already out were never filed and would 
+    never be sent back.
+Parameters: None
+Returns:
+    True if asked to schedule exits, the particles aren't packed, and nothing changes the 
+    velocities (see ChangesVelocities()), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleSimulatorCpu::SchedulesExits() const
+{
+    return _scheduleExits && _allPackedParticles == 0 && !this->ChangesVelocities();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out the box around every emitter's circle.  The particles never leave their 
+    emitters' circles, so they can't leave the box either.
+Parameters:
+    minCorner   Gets the bottom left corner, in window coords.
+    maxCorner   Gets the top right corner.
+    minRadius   Gets the smallest emitter's radius.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::GetEmitterBounds(glm::vec2 *minCorner, glm::vec2 *maxCorner, 
+    float *minRadius) const
+{
+    const ParticleEmitter &firstEmitter = (*_emitters)[0];
+    *minCorner = firstEmitter._center - firstEmitter._radius;
+    *maxCorner = firstEmitter._center + firstEmitter._radius;
+    *minRadius = firstEmitter._radius;
+    for (size_t emitterIndex = 1; emitterIndex < _emitters->size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = (*_emitters)[emitterIndex];
+        *minCorner = glm::min(*minCorner, emitter._center - emitter._radius);
+        *maxCorner = glm::max(*maxCorner, emitter._center + emitter._radius);
+        *minRadius = (emitter._radius < *minRadius) ? emitter._radius : *minRadius;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the neighbor grid over every emitter's circle.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::InitNeighborGrid(unsigned int numParticles)
+{
+    if (_emitters->empty())
+    {
+        return;
+    }
+
+    glm::vec2 minCorner;
+    glm::vec2 maxCorner;
+    float minRadius = 0.0f;
+    this->GetEmitterBounds(&minCorner, &maxCorner, &minRadius);
+    _neighborGrid.Init(minCorner, maxCorner, minRadius * _gridCellSizeInRadii, numParticles);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sorts the particles into the neighbor grid from wherever the kernels keep them.  Inactive 
+    particles are left out.
+
+    Note: The packed positions are relative to each particle's emitter, so each one has to be 
+    turned back into window coords, the same way as UnpackParticle(...).
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::BuildNeighborGrid(unsigned int numParticles)
+{
+    const NeighborGrid &grid = _neighborGrid;
+    if (_allPackedParticles != 0)
+    {
+        const ParticlePacked *particles = _allPackedParticles->data();
+        const ParticleEmitter *emitters = _emitters->data();
+        _neighborGrid.Build(numParticles, 
+            [&grid, particles, emitters](unsigned int beginIndex, unsigned int endIndex, 
+                unsigned int *cellIndices)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const ParticlePacked &p = particles[particleIndex];
+                unsigned int cellIndex = NeighborGrid::NO_CELL;
+                if ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) != 0)
+                {
+                    const ParticleEmitter &emitter = emitters[GetPackedEmitterIndex(p)];
+                    int fixedX = 0;
+                    int fixedY = 0;
+                    GetPackedPosition(p, &fixedX, &fixedY);
+                    glm::vec2 fromCenter = glm::vec2((float)fixedX, (float)fixedY) / 
+                        (float)PACKED_POSITION_MAX;
+                    cellIndex = grid.GetCellIndex(emitter._center + (fromCenter * emitter._radius));
+                }
+                *cellIndices++ = cellIndex;
+            }
+        }, _threadPool);
+    }
+    else if (_storage == STORAGE_SOA)
+    {
+        const ParticleStorageSoa &particles = _particlesSoa;
+        _neighborGrid.Build(numParticles, 
+            [&grid, &particles](unsigned int beginIndex, unsigned int endIndex, 
+                unsigned int *cellIndices)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                unsigned int cellIndex = NeighborGrid::NO_CELL;
+                if (particles._isActive[particleIndex] != 0)
+                {
+                    cellIndex = grid.GetCellIndex(glm::vec2(particles._positionX[particleIndex], 
+                        particles._positionY[particleIndex]));
+                }
+                *cellIndices++ = cellIndex;
+            }
+        }, _threadPool);
+    }
+    else
+    {
+        const Particle *particles = _allParticles->data();
+        _neighborGrid.Build(numParticles, 
+            [&grid, particles](unsigned int beginIndex, unsigned int endIndex, 
+                unsigned int *cellIndices)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const Particle &p = particles[particleIndex];
+                unsigned int cellIndex = NeighborGrid::NO_CELL;
+                if (p._isActive != 0)
+                {
+                    cellIndex = grid.GetCellIndex(glm::vec2(p._position.x, p._position.y));
+                }
+                *cellIndices++ = cellIndex;
+            }
+        }, _threadPool);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the gravity tree's (or mesh's) square over every emitter's circle.  It has to be 
+    square, so the box is stretched out to its longer side around its center.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::InitGravity(unsigned int numParticles)
+{
+    if (_emitters->empty())
+    {
+        return;
+    }
+
+    glm::vec2 minCorner;
+    glm::vec2 maxCorner;
+    float minRadius = 0.0f;
+    this->GetEmitterBounds(&minCorner, &maxCorner, &minRadius);
+    glm::vec2 boxSize = maxCorner - minCorner;
+    float size = (boxSize.x > boxSize.y) ? boxSize.x : boxSize.y;
+    glm::vec2 center = (minCorner + maxCorner) * 0.5f;
+    if (_gravityMeshSize > 0)
+    {
+        _gravityMesh.Init(center - (size * 0.5f), size, _gravityMeshSize, numParticles);
+    }
+    else
+    {
+        _gravityTree.Init(center - (size * 0.5f), size, numParticles);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Hands the particles to the gravity tree or mesh from wherever the kernels keep them and 
+    works out every particle's acceleration.  Inactive particles are left out.
+
+    Note: The packed positions are turned back into window coords the same way as in 
+    BuildNeighborGrid(...).
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::BuildGravity(unsigned int numParticles)
+{
+    GravityTree::PositionFunction getPositions;
+    if (_allPackedParticles != 0)
+    {
+        const ParticlePacked *particles = _allPackedParticles->data();
+        const ParticleEmitter *emitters = _emitters->data();
+        getPositions = [particles, emitters](unsigned int beginIndex, unsigned int endIndex, 
+            glm::vec2 *positions, unsigned char *isActive)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const ParticlePacked &p = particles[particleIndex];
+                const ParticleEmitter &emitter = emitters[GetPackedEmitterIndex(p)];
+                int fixedX = 0;
+                int fixedY = 0;
+                GetPackedPosition(p, &fixedX, &fixedY);
+                glm::vec2 fromCenter = glm::vec2((float)fixedX, (float)fixedY) / 
+                    (float)PACKED_POSITION_MAX;
+                *positions++ = emitter._center + (fromCenter * emitter._radius);
+                *isActive++ = ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) != 0) ? 1 : 0;
+            }
+        };
+    }
+    else if (_storage == STORAGE_SOA)
+    {
+        const ParticleStorageSoa *particles = &_particlesSoa;
+        getPositions = [particles](unsigned int beginIndex, unsigned int endIndex, 
+            glm::vec2 *positions, unsigned char *isActive)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                *positions++ = glm::vec2(particles->_positionX[particleIndex], 
+                    particles->_positionY[particleIndex]);
+                *isActive++ = (particles->_isActive[particleIndex] != 0) ? 1 : 0;
+            }
+        };
+    }
+    else
+    {
+        const Particle *particles = _allParticles->data();
+        getPositions = [particles](unsigned int beginIndex, unsigned int endIndex, 
+            glm::vec2 *positions, unsigned char *isActive)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const Particle &p = particles[particleIndex];
+                *positions++ = glm::vec2(p._position.x, p._position.y);
+                *isActive++ = (p._isActive != 0) ? 1 : 0;
+            }
+        };
+    }
+
+    if (_gravityMesh.IsInitialized())
+    {
+        _gravityMesh.Build(numParticles, getPositions, _threadPool);
+        _gravityMesh.ComputeAccelerations(_gravityStrength, _threadPool);
+    }
+    else
+    {
+        _gravityTree.Build(numParticles, getPositions, _threadPool);
+        _gravityTree.ComputeAccelerations(_gravityStrength, _gravityOpeningAngle, _threadPool);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the collider's grid over every emitter's circle.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::InitCollider(unsigned int numParticles)
+{
+    if (_emitters->empty())
+    {
+        return;
+    }
+
+    glm::vec2 minCorner;
+    glm::vec2 maxCorner;
+    float minRadius = 0.0f;
+    this->GetEmitterBounds(&minCorner, &maxCorner, &minRadius);
+    _collider.Init(minCorner, maxCorner, _collisionRadius, numParticles);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Hands the particles to the collider and stores the ones that it moved (see 
+    GetParticleAccess(...)).
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ResolveCollisions(unsigned int numParticles)
+{
+    ParticleCollider::GetFunction getParticles;
+    ParticleCollider::SetFunction setParticles;
+    this->GetParticleAccess(&getParticles, &setParticles);
+    _collider.Resolve(numParticles, getParticles, setParticles, _threadPool);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Lays the fluid's grid over every emitter's circle.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::InitFluid(unsigned int numParticles)
+{
+    if (_emitters->empty())
+    {
+        return;
+    }
+
+    glm::vec2 minCorner;
+    glm::vec2 maxCorner;
+    float minRadius = 0.0f;
+    this->GetEmitterBounds(&minCorner, &maxCorner, &minRadius);
+    _fluid.Init(minCorner, maxCorner, _fluidSettings, numParticles);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Hands the particles to the fluid and stores their new velocities (see 
+    GetParticleAccess(...)).
+Parameters:
+    numParticles    Self-explanatory.
+    deltaTimeSec    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::StepFluid(unsigned int numParticles, float deltaTimeSec)
+{
+    ParticleFluid::GetFunction getParticles;
+    ParticleFluid::SetFunction setParticles;
+    this->GetParticleAccess(&getParticles, &setParticles);
+    _fluid.Step(numParticles, deltaTimeSec, getParticles, setParticles, _threadPool);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Makes the functions that the collider and the fluid use to get the particles' positions 
+    and velocities from wherever the kernels keep them and to store the ones that they 
+    changed.  Inactive particles are left out.
+
+    Note: The packed positions are turned back into window coords the same way as in 
+    BuildNeighborGrid(...), and the ones that changed are turned back into fixed point with the 
+    same rounding as the update kernel.  A particle that was pushed out of its emitter's circle 
+    is clamped to the square around it so that the 16 bit part doesn't wrap, and the next 
+    update sends it back out.
+
+    Note: The SoA chunks were already copied back into the Particle collection, so the ones 
+    that changed are copied again, like in ResetEmittedVelocities().
+Parameters:
+    getParticles    Gets the function that fills in the positions and velocities.
+    setParticles    Gets the function that stores them.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::GetParticleAccess(ParticleCollider::GetFunction *getParticles, 
+    ParticleCollider::SetFunction *setParticles)
+{
+    if (_allPackedParticles != 0)
+    {
+        ParticlePacked *particles = _allPackedParticles->data();
+        const ParticleEmitter *emitters = _emitters->data();
+        *getParticles = [particles, emitters](unsigned int beginIndex, unsigned int endIndex, 
+            glm::vec2 *positions, glm::vec2 *velocities, unsigned char *isActive)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const ParticlePacked &p = particles[particleIndex];
+                const ParticleEmitter &emitter = emitters[GetPackedEmitterIndex(p)];
+                int fixedX = 0;
+                int fixedY = 0;
+                GetPackedPosition(p, &fixedX, &fixedY);
+                glm::vec2 fromCenter = glm::vec2((float)fixedX, (float)fixedY) / 
+                    (float)PACKED_POSITION_MAX;
+                *positions++ = emitter._center + (fromCenter * emitter._radius);
+                *velocities++ = glm::unpackHalf2x16(p._velocity);
+                *isActive++ = ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) != 0) ? 1 : 0;
+            }
+        };
+        *setParticles = [particles, emitters](unsigned int beginIndex, unsigned int endIndex, 
+            const glm::vec2 *positions, const glm::vec2 *velocities, 
+            const unsigned char *isTouched)
+        {
+            float maxFixed = (float)PACKED_POSITION_MAX;
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; 
+                particleIndex++, positions++, velocities++, isTouched++)
+            {
+                if (*isTouched == 0)
+                {
+                    continue;
+                }
+
+                ParticlePacked &p = particles[particleIndex];
+                const ParticleEmitter &emitter = emitters[GetPackedEmitterIndex(p)];
+                glm::vec2 fixed = ((*positions - emitter._center) / emitter._radius) * maxFixed;
+                fixed = glm::clamp(fixed, glm::vec2(-maxFixed), glm::vec2(maxFixed));
+                int roundedX = (int)((fixed.x < 0.0f) ? (fixed.x - 0.5f) : (fixed.x + 0.5f));
+                int roundedY = (int)((fixed.y < 0.0f) ? (fixed.y - 0.5f) : (fixed.y + 0.5f));
+                SetPackedPosition(&p, roundedX, roundedY);
+                p._velocity = glm::packHalf2x16(*velocities);
+            }
+        };
+    }
+    else if (_storage == STORAGE_SOA)
+    {
+        ParticleStorageSoa *particles = &_particlesSoa;
+        Particle *copies = (_particleBufferId != 0) ? _allParticles->data() : 0;
+        *getParticles = [particles](unsigned int beginIndex, unsigned int endIndex, 
+            glm::vec2 *positions, glm::vec2 *velocities, unsigned char *isActive)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                *positions++ = glm::vec2(particles->_positionX[particleIndex], 
+                    particles->_positionY[particleIndex]);
+                *velocities++ = glm::vec2(particles->_velocityX[particleIndex], 
+                    particles->_velocityY[particleIndex]);
+                *isActive++ = (particles->_isActive[particleIndex] != 0) ? 1 : 0;
+            }
+        };
+        *setParticles = [particles, copies](unsigned int beginIndex, unsigned int endIndex, 
+            const glm::vec2 *positions, const glm::vec2 *velocities, 
+            const unsigned char *isTouched)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; 
+                particleIndex++, positions++, velocities++, isTouched++)
+            {
+                if (*isTouched == 0)
+                {
+                    continue;
+                }
+
+                particles->_positionX[particleIndex] = positions->x;
+                particles->_positionY[particleIndex] = positions->y;
+                particles->_velocityX[particleIndex] = velocities->x;
+                particles->_velocityY[particleIndex] = velocities->y;
+                if (copies != 0)
+                {
+                    copies[particleIndex]._position.x = positions->x;
+                    copies[particleIndex]._position.y = positions->y;
+                    copies[particleIndex]._velocity.x = velocities->x;
+                    copies[particleIndex]._velocity.y = velocities->y;
+                }
+            }
+        };
+    }
+    else
+    {
+        Particle *particles = _allParticles->data();
+        *getParticles = [particles](unsigned int beginIndex, unsigned int endIndex, 
+            glm::vec2 *positions, glm::vec2 *velocities, unsigned char *isActive)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const Particle &p = particles[particleIndex];
+                *positions++ = glm::vec2(p._position.x, p._position.y);
+                *velocities++ = glm::vec2(p._velocity.x, p._velocity.y);
+                *isActive++ = (p._isActive != 0) ? 1 : 0;
+            }
+        };
+        *setParticles = [particles](unsigned int beginIndex, unsigned int endIndex, 
+            const glm::vec2 *positions, const glm::vec2 *velocities, 
+            const unsigned char *isTouched)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; 
+                particleIndex++, positions++, velocities++, isTouched++)
+            {
+                if (*isTouched == 0)
+                {
+                    continue;
+                }
+
+                Particle &p = particles[particleIndex];
+                p._position.x = positions->x;
+                p._position.y = positions->y;
+                p._velocity.x = velocities->x;
+                p._velocity.y = velocities->y;
+            }
+        };
+    }
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out how the sort keys fit the emitters (see GetReorderKeyLayout(...)) and makes 
+    room for the sort and for the spare collection that the particles are copied into.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::InitReorder(unsigned int numParticles)
+{
+    if (_emitters->empty())
+    {
+        return;
+    }
+
+    _reorderKeyLayout = GetReorderKeyLayout(_emitters->size());
+    _reorder.Init(numParticles, _reorderKeyLayout._numKeyBits);
+    _reorderParticles.clear();
+    _reorderPackedParticles.clear();
+    _reorderParticlesSoa.Clear();
+    if (_allPackedParticles != 0)
+    {
+        _reorderPackedParticles.resize(numParticles);
+    }
+    else
+    {
+        _reorderParticles.resize(numParticles);
+        if (_storage == STORAGE_SOA)
+        {
+            _reorderParticlesSoa.Resize(numParticles);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sorts the particles from wherever the kernels keep them (see ParticleReorder.h), copies 
+    them into the spare collection in their new order, and swaps the collections.  The 
+    expiry buckets and the queues of particles waiting for the quota are then told where the 
+    particles went.  The particles stay in their emitters' ranges, so each queue only needs 
+    its heap rebuilt.
+
+    With the "structure of arrays" storage, the Particle collection is put in the new order 
+    too, even if it isn't being drawn, so that whatever of it isn't copied back (the 
+    velocities, the emitter indices) still lines up with the arrays.
+
+    Note: The manager's collection is swapped rather than copied back into, so its memory 
+    changes, but the manager only ever looks at it through the vector.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::ReorderParticles(unsigned int numParticles)
+{
+    if (numParticles != _reorder.NumParticles())
+    {
+        return;
+    }
+
+    const ReorderKeyLayout &layout = _reorderKeyLayout;
+    const ParticleEmitter *emitters = _emitters->data();
+    if (_allPackedParticles != 0)
+    {
+        // the packed positions are already relative to the emitter, in units of its radius
+        const ParticlePacked *particles = _allPackedParticles->data();
+        _reorder.Sort([&layout, particles](unsigned int beginIndex, unsigned int endIndex, 
+            unsigned int *keys)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const ParticlePacked &p = particles[particleIndex];
+                int fixedX = 0;
+                int fixedY = 0;
+                GetPackedPosition(p, &fixedX, &fixedY);
+                glm::vec2 fromCenter = glm::vec2((float)fixedX, (float)fixedY) / 
+                    (float)PACKED_POSITION_MAX;
+                *keys++ = GetReorderKey(layout, GetPackedEmitterIndex(p), 
+                    (p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) != 0, fromCenter);
+            }
+        }, _threadPool);
+    }
+    else if (_storage == STORAGE_SOA)
+    {
+        // Note: The arrays don't have the emitter indices, but the collection does.
+        const ParticleStorageSoa &particles = _particlesSoa;
+        const Particle *copies = _allParticles->data();
+        _reorder.Sort([&layout, &particles, copies, emitters](unsigned int beginIndex, 
+            unsigned int endIndex, unsigned int *keys)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                unsigned int emitterIndex = (unsigned int)copies[particleIndex]._emitterIndex;
+                const ParticleEmitter &emitter = emitters[emitterIndex];
+                glm::vec2 position(particles._positionX[particleIndex], 
+                    particles._positionY[particleIndex]);
+                *keys++ = GetReorderKey(layout, emitterIndex, 
+                    particles._isActive[particleIndex] != 0, 
+                    (position - emitter._center) / emitter._radius);
+            }
+        }, _threadPool);
+    }
+    else
+    {
+        const Particle *particles = _allParticles->data();
+        _reorder.Sort([&layout, particles, emitters](unsigned int beginIndex, 
+            unsigned int endIndex, unsigned int *keys)
+        {
+            for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+            {
+                const Particle &p = particles[particleIndex];
+                unsigned int emitterIndex = (unsigned int)p._emitterIndex;
+                const ParticleEmitter &emitter = emitters[emitterIndex];
+                glm::vec2 position(p._position.x, p._position.y);
+                *keys++ = GetReorderKey(layout, emitterIndex, p._isActive != 0, 
+                    (position - emitter._center) / emitter._radius);
+            }
+        }, _threadPool);
+    }
+
+    if (_threadPool != 0)
+    {
+        _threadPool->ParallelFor(numParticles, _chunkSize,
+            [this](unsigned int beginIndex, unsigned int endIndex)
+        {
+            this->GatherRange(beginIndex, endIndex);
+        });
+    }
+    else
+    {
+        this->GatherRange(0, numParticles);
+    }
+
+    if (_allPackedParticles != 0)
+    {
+        _allPackedParticles->swap(_reorderPackedParticles);
+    }
+    else
+    {
+        _allParticles->swap(_reorderParticles);
+        if (_storage == STORAGE_SOA)
+        {
+            _particlesSoa.Swap(&_reorderParticlesSoa);
+        }
+    }
+
+    if (_expiryBuckets.IsInitialized())
+    {
+        _expiryBuckets.Remap(_reorder.GetNewIndices());
+    }
+    const unsigned int *newIndices = _reorder.GetNewIndices();
+    for (size_t emitterIndex = 0; emitterIndex < _waitingParticles.size(); emitterIndex++)
+    {
+        std::vector<WaitingParticle> &waitingParticles = _waitingParticles[emitterIndex];
+        for (size_t waitingIndex = 0; waitingIndex < waitingParticles.size(); waitingIndex++)
+        {
+            WaitingParticle &waiting = waitingParticles[waitingIndex];
+            waiting._particleIndex = newIndices[waiting._particleIndex];
+        }
+        std::make_heap(waitingParticles.begin(), waitingParticles.end(), IsServedAfter);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Copies the particles in [beginIndex, endIndex) of the new order into the spare collection 
+    for the storage (see ReorderParticles(...)).
+Parameters:
+    beginIndex      The first particle in the new order.
+    endIndex        One past the last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorCpu::GatherRange(unsigned int beginIndex, unsigned int endIndex)
+{
+    const unsigned int *oldIndices = _reorder.GetOldIndices();
+    if (_allPackedParticles != 0)
+    {
+        const ParticlePacked *particles = _allPackedParticles->data();
+        ParticlePacked *sorted = _reorderPackedParticles.data();
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            sorted[particleIndex] = particles[oldIndices[particleIndex]];
+        }
+        return;
+    }
+
+    const Particle *particles = _allParticles->data();
+    Particle *sorted = _reorderParticles.data();
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        sorted[particleIndex] = particles[oldIndices[particleIndex]];
+    }
+    if (_storage == STORAGE_SOA)
+    {
+        _reorderParticlesSoa.GatherFrom(_particlesSoa, oldIndices, beginIndex, endIndex);
+    }
+}
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "EmissionQuota.h"
+#include "ExpiryBuckets.h"
+#include "GravityTree.h"
+#include "NeighborGrid.h"
+#include "ParticleCollider.h"
+#include "ParticleFluid.h"
+#include "ParticleMeshGravity.h"
+#include "ParticleReorder.h"
+#include "ParticleSimulator.h"
+#include "ParticleStorageSoa.h"
+#include "ParticleUpdateKernels.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Does the same thing as shaderParticle.comp, but on the CPU and over the particle collection
+    instead of the shader storage buffer.  This makes it possible to run the same scenario on a
+    machine that doesn't have an OpenGL 4.3 context (or any context at all) and to have a
+    baseline for timing the compute shader.
+
+    The particles can be updated as they are (an array of 48 byte Particle structures) or
+    copied into a "structure of arrays" that only has what the update needs.  The storage is
+    chosen with SetStorage(...) before Init(...).  If the manager keeps its particles in the
+    compact ParticlePacked format, then those are updated in place instead and the storage 
+    setting doesn't matter.
+
+    Emission is regulated the same way as in the compute shader: every frame, only so many 
+    inactive or out of bounds particles may be sent out.  Each emitter has its own quota.  
+    Unlike the shader's, it goes to the same particles no matter how many threads there are 
+    (see EmissionQuota.h).
+
+    Each emitter owns a contiguous range of the particles, so a chunk is updated one emitter 
+    range at a time with that emitter's center and radius.  The kernels don't know that there 
+    is more than one emitter.
+
+    If any emitter gives its particles a lifetime, then a list is kept of the particles that 
+    each emitter let out, and after the update those are filed by the step that they 
+    expire on (see ExpiryBuckets.h).  Before the next update, the particles that expire on that 
+    step are turned off so that they can be emitted again.  Neither of these looks at any 
+    particles except the ones that were just emitted or are just expiring, and the kernels only 
+    had to learn to tell the quota which particle is asking.
+
+    If there are force fields, then each emitter range gets the force field pass just before 
+    its update kernel, while the range is still in the cache.  Force fields change the 
+    velocities, so the lists of emitted particles are kept for this too, and after the 
+    update, each one that was sent out is given a new velocity (see 
+    GetParticleEmitVelocity(...)).
+
+    If there are obstacles, then each emitter range gets the obstacle pass just after its 
+    update kernel, so the particles that went into an obstacle are bounced back out before 
+    anything else sees them (see ObstacleField.h).  Bounces change the velocities too.
+
+    If asked to with SetTurbulence(...), then each emitter range gets the turbulence pass 
+    first, before any of the others (see TurbulenceField.h).  If the field changes over time, 
+    then it is moved along at the start of every update, before any particle is pushed, and 
+    its background thread bakes the next key while the particles are updated.
+
+    If given an integrator other than semi-implicit Euler with SetIntegrator(...), then when 
+    there are force fields or gravity, the acceleration and force field passes are replaced by 
+    the integrate pass, which moves the particles by itself, and the update kernel is only 
+    asked to check the bounds and emit (see GetAosIntegrateKernel(...)).  The kernel for the 
+    integrator is picked in Init(...).
+
+    If asked to with SetNeighborGrid(...), the particles are sorted into a uniform grid at the 
+    end of every update (see NeighborGrid.h) so that anything that needs a particle's 
+    neighbors can find them without looking at every particle.
+
+    If asked to with SetGravity(...), every particle pulls on every other one.  At the start of 
+    every update, a Barnes-Hut tree is built over the particles and each one's acceleration is 
+    worked out from it (see GravityTree.h), and then each emitter range gets the acceleration 
+    pass just before the force field pass.  Emitted particles are given new velocities 
+    afterwards, just like with the force fields.  SetGravityMesh(...) swaps the tree for a 
+    particle-mesh solver (see ParticleMeshGravity.h), which is faster and smoother for lots of 
+    evenly spread particles.
+
+    If asked to with SetCollisions(...), the particles bounce off of each other (see 
+    ParticleCollider.h).  This is done after the update, from where the particles ended up, and 
+    before the neighbor grid is built so that the grid sees where the collisions left them.
+
+    If asked to with SetFluid(...), the particles behave as a fluid (see ParticleFluid.h).  
+    Like the collisions, the fluid step runs after the update, from where the particles ended 
+    up, and changes their velocities for the next update to move them along.  It runs before 
+    the collisions so that those have the last word on where the particles are.
+
+    If asked to with SetReorder(...), then every so many steps, the particles are sorted by 
+    where they are along a Morton ("Z") curve (see ParticleReorder.h).  Otherwise particles 
+    that are next to each other in the window drift apart in memory as they are sent out 
+    again and again, and everything that looks at a particle's neighbors (the neighbor grid, 
+    the collisions, the fluid) jumps all over the collection.  Each emitter's particles stay 
+    in its range, with the inactive ones at the end of it.  The sort runs after the 
+    collisions and before the neighbor grid is built, so the grid indexes the sorted 
+    particles.  The lifetimes' expiry buckets are told where the particles went, and anything 
+    else that needs to follow a particle can look it up by its handle (see GetReorder()).
+
+    If asked to with SetSubsteps(...), then every update takes that many steps.  When the 
+    particles are only moving in straight lines and being sent back out, each chunk takes all 
+    of them before the next chunk is touched, so the particles only go to and from memory 
+    once per update instead of once per step (see StepBlocked(...)).  This is for running a 
+    scenario forward quickly, or offline.  Anything else takes the steps one at a time.
+
+    If asked to with SetExitScheduling(...), and the particles are only moving in straight 
+    lines, then the step that each one will go out of bounds on is worked out when it is 
+    emitted (see GetParticleExitTimeSec(...)) and it is filed in the expiry buckets along with 
+    the lifetimes.  The kernels then skip the bounds test, and only the particles that are due 
+    on a step are sent back out.  The simulator already knows every particle that is off or 
+    due, so it hands out the quota before the kernels run, and the kernels don't even look at 
+    the active flags (see PickScheduledEmissions(...)).  The particles that are waiting for 
+    the quota are kept in a queue for each emitter, and their velocities are set aside so that 
+    the kernels leave them where they are.
+
+    If given a thread pool, the update is split into chunks that fit in a core's L2 cache and
+    spread across the pool's threads.
+
+    The update kernel is picked in Init(...) from the fastest instruction set that the CPU 
+    supports, though it can be capped lower with SetSimdLevel(...) for comparison.
+-----------------------------------------------------------------------------------------------*/
+class ParticleSimulatorCpu : public ParticleSimulator
+{
+public:
+    enum StorageType
+    {
+        STORAGE_AOS = 0,    // update the manager's Particle collection directly
+        STORAGE_SOA,        // update separate X/Y position and velocity arrays
+    };
+
+    ParticleSimulatorCpu();
+    virtual ~ParticleSimulatorCpu();
+    virtual void Init(std::vector<Particle> *allParticles,
+        std::vector<ParticlePacked> *allPackedParticles,
+        unsigned int particleBufferId,
+        const std::vector<ParticleEmitter> *emitters,
+        unsigned int emitterBufferId);
+    virtual void Cleanup();
+    virtual void Update(float deltaTimeSec);
+    virtual void SetIntegrator(IntegratorType integrator);
+    virtual void SetFluid(const FluidSettings &settings);
+    virtual FluidPassTimes GetFluidPassTimes();
+    virtual void SetForceFields(const std::vector<ForceField> &forceFields);
+    virtual void SetObstacles(const ObstacleField &obstacles);
+    virtual void SetTurbulence(const TurbulenceSettings &settings);
+    virtual void SetReorder(unsigned int numStepsBetweenSorts);
+    virtual void SetSubsteps(unsigned int numSubsteps);
+    virtual bool UpdatesOnCpu() const;
+    virtual unsigned int GetLiveListBufferId() const;
+    virtual void ReadBackParticles();
+
+    void SetStorage(StorageType storage);
+    StorageType GetStorage() const;
+    void SetThreadPool(ThreadPool *threadPool);
+    void SetSimdLevel(SimdLevel maxSimdLevel);
+    SimdLevel GetSimdLevel() const;
+    void SetNeighborGrid(float cellSizeInRadii);
+    const NeighborGrid &GetNeighborGrid() const;
+    void SetGravity(float strength, float openingAngle);
+    const GravityTree &GetGravityTree() const;
+    void SetGravityMesh(unsigned int meshSize);
+    const ParticleMeshGravity &GetGravityMesh() const;
+    void SetCollisions(float particleRadius);
+    const ParticleCollider &GetCollider() const;
+    void SetExitScheduling(bool scheduleExits);
+    const ParticleFluid &GetFluid() const;
+    const TurbulenceField &GetTurbulence() const;
+    const ParticleReorder &GetReorder() const;
+
+private:
+    // a particle that is off and waiting for its emitter's quota while the exits are scheduled
+    struct WaitingParticle
+    {
+        unsigned int _particleIndex;
+        glm::vec2 _velocity;
+    };
+
+    static bool IsServedAfter(const WaitingParticle &left, const WaitingParticle &right);
+
+    void Step(unsigned int numParticles, float deltaTimeSec);
+    void StepBlocked(unsigned int numParticles, float deltaTimeSec);
+    bool CanBlockSubsteps() const;
+    void UpdateChunks(unsigned int numParticles, float deltaTimeSec, unsigned int numSubsteps);
+    void ResetEmissionQuotas(unsigned int numSubsteps);
+    EmissionQuota *GetEmissionQuota(unsigned int substepIndex, unsigned int emitterIndex, 
+        unsigned int particleIndex);
+    unsigned int GetEmitterIndex(unsigned int particleIndex) const;
+    void UpdateRange(unsigned int beginIndex, unsigned int endIndex, float deltaTimeSec, 
+        unsigned int numSubsteps);
+    void UpdateEmitterRange(unsigned int emitterIndex, unsigned int substepIndex, 
+        unsigned int beginIndex, unsigned int endIndex, float deltaTimeSec);
+    void ExpireParticles(unsigned int numParticles);
+    void ScheduleExpiry(float deltaTimeSec);
+    void PickScheduledEmissions(unsigned int numParticles);
+    void FindWaitingParticles(unsigned int numParticles);
+    void StartWaiting(unsigned int emitterIndex, unsigned int particleIndex);
+    unsigned int StopWaiting(unsigned int emitterIndex);
+    void ReleaseWaitingParticles();
+    void EmitParticles();
+    void EmitScheduledParticles();
+    void ResetEmittedVelocities();
+    void PickUpdateKernels();
+    bool ChangesVelocities() const;
+    bool SchedulesExits() const;
+    void GetEmitterBounds(glm::vec2 *minCorner, glm::vec2 *maxCorner, float *minRadius) const;
+    void InitNeighborGrid(unsigned int numParticles);
+    void BuildNeighborGrid(unsigned int numParticles);
+    void InitGravity(unsigned int numParticles);
+    void BuildGravity(unsigned int numParticles);
+    void InitCollider(unsigned int numParticles);
+    void ResolveCollisions(unsigned int numParticles);
+    void InitFluid(unsigned int numParticles);
+    void StepFluid(unsigned int numParticles, float deltaTimeSec);
+    void GetParticleAccess(ParticleCollider::GetFunction *getParticles, 
+        ParticleCollider::SetFunction *setParticles);
+    void InitReorder(unsigned int numParticles);
+    void ReorderParticles(unsigned int numParticles);
+    void GatherRange(unsigned int beginIndex, unsigned int endIndex);
+
+    StorageType _storage;
+    SimdLevel _maxSimdLevel;
+    SimdLevel _simdLevel;
+    AosUpdateKernel _aosKernel;
+    SoaUpdateKernel _soaKernel;
+    PackedUpdateKernel _packedKernel;
+    SoaForceFieldKernel _soaForceFieldKernel;
+    IntegratorType _integrator;
+    AosIntegrateKernel _aosIntegrateKernel;
+    SoaIntegrateKernel _soaIntegrateKernel;
+    PackedIntegrateKernel _packedIntegrateKernel;
+    ThreadPool *_threadPool;
+    unsigned int _chunkSize;
+    std::vector<Particle> *_allParticles;
+    std::vector<ParticlePacked> *_allPackedParticles;
+    ParticleStorageSoa _particlesSoa;
+
+    // if there is no buffer, then nothing is drawn and the SoA positions don't need to be 
+    // copied back into the Particle collection every frame
+    unsigned int _particleBufferId;
+
+    // the manager's emitter table, one quota for each piece of an emitter's particles in 
+    // each chunk (see GetEmissionQuota(...)), and the particles that each emitter sent out on 
+    // the last step if anything needs them (see EmitParticles())
+    const std::vector<ParticleEmitter> *_emitters;
+    std::vector<EmissionQuota> _emissionQuotas;
+    unsigned int _numQuotasPerSubstep;
+    std::vector<std::vector<unsigned int>> _emittedParticles;
+
+    // only used if at least one emitter's particles have a lifetime
+    bool _useLifetimes;
+    unsigned int _stepIndex;
+    ExpiryBuckets _expiryBuckets;
+    std::vector<unsigned int> _expiredParticles;
+
+    // only used if the exits are scheduled: a queue for each emitter of the particles that 
+    // are off and didn't get the quota, lowest index first (see PickScheduledEmissions(...))
+    bool _knowsWaitingParticles;
+    std::vector<std::vector<WaitingParticle>> _waitingParticles;
+
+    // empty unless set with SetForceFields(...)
+    std::vector<ForceField> _forceFields;
+
+    // not baked unless set with SetObstacles(...)
+    ObstacleField _obstacles;
+
+    // not initialized unless set with SetTurbulence(...)
+    TurbulenceField _turbulence;
+
+    // 0 (no grid) unless set with SetNeighborGrid(...)
+    float _gridCellSizeInRadii;
+    NeighborGrid _neighborGrid;
+
+    // 0 (no gravity) unless set with SetGravity(...)
+    float _gravityStrength;
+    float _gravityOpeningAngle;
+    GravityTree _gravityTree;
+
+    // 0 (use the tree) unless set with SetGravityMesh(...)
+    unsigned int _gravityMeshSize;
+    ParticleMeshGravity _gravityMesh;
+
+    // 0 (no collisions) unless set with SetCollisions(...)
+    float _collisionRadius;
+    ParticleCollider _collider;
+
+    // a smoothing radius of 0 (no fluid) unless set with SetFluid(...)
+    FluidSettings _fluidSettings;
+    ParticleFluid _fluid;
+
+    // 0 (never sort) unless set with SetReorder(...); the particles are copied in their new 
+    // order into the spare collection (or collections) for the storage, which is then swapped 
+    // with the one that the kernels use
+    unsigned int _reorderStepsBetween;
+    ReorderKeyLayout _reorderKeyLayout;
+    ParticleReorder _reorder;
+    std::vector<Particle> _reorderParticles;
+    std::vector<ParticlePacked> _reorderPackedParticles;
+    ParticleStorageSoa _reorderParticlesSoa;
+
+    // 1 unless set with SetSubsteps(...)
+    unsigned int _numSubsteps;
+
+    // false unless set with SetExitScheduling(...)
+    bool _scheduleExits;
+};
@@ -0,0 +1,1445 @@
+#include "ParticleSimulatorGpu.h"
+
+#include "GenerateShader.h"
+#include "NeighborGrid.h"
+#include "glload/include/glload/gl_4_4.h"
+#include "glm/common.hpp"   // glm::min, glm::max
+
+#include <stdio.h>
+#include <stddef.h> // offsetof(...)
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The start of each live particle list buffer.  The first 5 values are a
+    DrawElementsIndirectCommand and the last 3 are a DispatchIndirectCommand, so the same buffer
+    can be given to glDrawElementsIndirect(...) (with the indices that follow the header as the
+    element array) and to glDispatchComputeIndirect(...).
+
+    Note: Must match LiveListHeader in the compute shaders.
+-----------------------------------------------------------------------------------------------*/
+struct LiveListHeader
+{
+    unsigned int _count;            // how many particles are live
+    unsigned int _instanceCount;    // always 1
+    unsigned int _firstIndex;       // always the header size in indices
+    unsigned int _baseVertex;       // always 0
+    unsigned int _baseInstance;     // always 0
+    unsigned int _numGroupsX;       // written by shaderParticleListPrepare.comp
+    unsigned int _numGroupsY;       // always 1
+    unsigned int _numGroupsZ;       // always 1
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The part of each emitter that changes while the shaders run.  There is one of these for 
+    each emitter in the manager's table, in the same order.
+
+    Note: Must match EmitterState in the compute shaders.
+-----------------------------------------------------------------------------------------------*/
+struct EmitterState
+{
+    unsigned int _numEmitted;       // this frame; zeroed by shaderParticleListPrepare.comp
+    unsigned int _deadCount;        // how many of the emitter's particles are in the dead list
+    unsigned int _deadNumPopped;    // how many the emit shader took off the dead list
+    unsigned int _padding;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The start of the fluid's grid buffer, which is followed by where each cell starts in grid 
+    order (see shaderFluid.comp).  It is written once in InitFluid(...).  The kernels' scales 
+    come from GetFluidKernelScales(...).
+
+    Note: Must match FluidGridHeader in shaderFluid.comp, which uses the std430 layout.  The 
+    vec2 comes first so that it is on an 8 byte boundary, and the size (64 bytes) is a 
+    multiple of 8.
+-----------------------------------------------------------------------------------------------*/
+struct FluidGridHeader
+{
+    glm::vec2 _minCorner;
+    float _cellSize;
+    float _inverseCellSize;
+    unsigned int _numCellsX;
+    unsigned int _numCellsY;
+    unsigned int _numParticles;
+    unsigned int _numScanBlocks;
+    float _smoothingRadius;
+    float _restDensity;
+    float _stiffness;
+    float _viscosity;
+    float _densityScale;
+    float _pressureScale;
+    float _viscosityScale;
+    unsigned int _padding;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    One particle in the fluid's grid order, along with what the density pass works out for it.  
+    Only the compute shaders touch these.
+
+    Note: Must match FluidBody in shaderFluid.comp.
+-----------------------------------------------------------------------------------------------*/
+struct FluidBody
+{
+    glm::vec2 _position;
+    glm::vec2 _velocity;
+    float _density;
+    float _pressure;
+    unsigned int _particleIndex;
+    unsigned int _padding;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The start of the reorder's count buffer, which is followed by each tile's count of each 
+    digit and then by the scan blocks' totals (see shaderParticleReorder.comp).  It is written 
+    once in InitReorder(...).  The key layout comes from GetReorderKeyLayout(...).
+
+    Note: Must match ReorderHeader in shaderParticleReorder.comp, which uses the std430 layout.
+-----------------------------------------------------------------------------------------------*/
+struct ReorderHeader
+{
+    unsigned int _numParticles;
+    unsigned int _numTiles;
+    unsigned int _numCounts;
+    unsigned int _numScanBlocks;
+    unsigned int _bitsPerAxis;
+    unsigned int _inactiveShift;
+    unsigned int _emitterShift;
+    unsigned int _sortedSet;
+    unsigned int _useExpiry;
+    unsigned int _padding[3];
+};
+
+// the shader storage bindings that the compute shaders use (the emitter table's is in 
+// ParticleEmitter.h)
+static const unsigned int PARTICLE_BUFFER_BINDING = 0;
+static const unsigned int LIVE_LIST_IN_BINDING = 1;
+static const unsigned int LIVE_LIST_OUT_BINDING = 2;
+static const unsigned int DEAD_LIST_BINDING = 3;
+static const unsigned int EMITTER_STATE_BINDING = 5;
+static const unsigned int EXPIRY_BINDING = 6;
+
+// Note: The force field table's binding (7) is in ForceField.h, the obstacle field's (8) is 
+// in ObstacleField.h, and the turbulence field's (13) is in TurbulenceField.h.
+
+// Note: Must match "local_size_x" in shaderParticleListPrepare.comp.
+static const unsigned int PREPARE_WORK_GROUP_SIZE = 256;
+
+// only used by shaderFluid.comp
+static const unsigned int FLUID_GRID_BINDING = 9;
+static const unsigned int FLUID_SCAN_BINDING = 10;
+static const unsigned int FLUID_PLACE_BINDING = 11;
+static const unsigned int FLUID_BODY_BINDING = 12;
+
+// Note: Must match "local_size_x" and SCAN_BLOCK_SIZE in shaderFluid.comp.
+static const unsigned int FLUID_WORK_GROUP_SIZE = 256;
+static const unsigned int FLUID_SCAN_BLOCK_SIZE = 512;
+
+// only used by shaderParticleReorder.comp
+static const unsigned int REORDER_PAIR_BINDING = 14;
+static const unsigned int REORDER_COUNT_BINDING = 15;
+static const unsigned int REORDER_HANDLE_BINDING = 16;
+static const unsigned int REORDER_PARTICLE_BINDING = 17;
+static const unsigned int REORDER_EXPIRY_BINDING = 18;
+
+// Note: Must match "local_size_x", RADIX_SIZE, and SCAN_BLOCK_SIZE in 
+// shaderParticleReorder.comp.  A tile of keys is one work group, and each tile has one count 
+// for each 8 bit digit.
+static const unsigned int REORDER_WORK_GROUP_SIZE = 256;
+static const unsigned int REORDER_RADIX_BITS = 8;
+static const unsigned int REORDER_RADIX_SIZE = 256;
+static const unsigned int REORDER_SCAN_BLOCK_SIZE = 512;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  The compute shader isn't loaded until Init(...) because
+    there might not be an OpenGL context yet.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleSimulatorGpu::ParticleSimulatorGpu() :
+    _computeProgramId(0),
+    _emitProgramId(0),
+    _prepareProgramId(0),
+    _numParticles(0),
+    _numEmitters(0),
+    _stepIndex(0),
+    _particleBufferId(0),
+    _allParticles(0),
+    _allPackedParticles(0),
+    _emitterStateBufferId(0),
+    _expiryBufferId(0),
+    _forceFieldBufferId(0),
+    _numForceFields(0),
+    _integrator(INTEGRATOR_SEMI_IMPLICIT_EULER),
+    _obstacleBufferId(0),
+    _obstacleBufferBytes(0),
+    _useObstacles(false),
+    _turbulenceBufferId(0),
+    _fluidGridBufferId(0),
+    _fluidScanBufferId(0),
+    _fluidPlaceBufferId(0),
+    _fluidBodyBufferId(0),
+    _fluidNumCells(0),
+    _fluidNumScanBlocks(0),
+    _unifLocFluidDeltaTimeSec(0),
+    _currentFluidQuerySet(0),
+    _reorderStepsBetween(0),
+    _reorderPairBufferId(0),
+    _reorderCountBufferId(0),
+    _reorderHandleBufferId(0),
+    _reorderParticleBufferId(0),
+    _reorderExpiryBufferId(0),
+    _reorderParticleBytes(0),
+    _reorderNumTiles(0),
+    _reorderNumScanBlocks(0),
+    _reorderNumPasses(0),
+    _reorderHandleSet(0),
+    _unifLocReorderCountDigitShift(0),
+    _unifLocReorderScatterDigitShift(0),
+    _unifLocReorderHandleSet(0),
+    _numSubsteps(1),
+    _currentLiveList(0),
+    _deadListBufferId(0),
+    _unifLocDeltaTimeSec(0),
+    _unifLocStepIndex(0),
+    _unifLocNumForceFields(0),
+    _unifLocUseObstacles(0),
+    _unifLocUseTurbulence(0),
+    _unifLocResetVelocities(0),
+    _unifLocEmitDeltaTimeSec(0),
+    _unifLocEmitStepIndex(0),
+    _unifLocEmitResetVelocities(0),
+    _unifLocNumSubsteps(0),
+    _unifLocEmitNumSubsteps(0)
+{
+    _liveListBufferIds[0] = 0;
+    _liveListBufferIds[1] = 0;
+    _fluidSettings._smoothingRadius = 0.0f;
+    _fluidSettings._restDensity = 0.0f;
+    _fluidSettings._stiffness = 0.0f;
+    _fluidSettings._viscosity = 0.0f;
+    for (unsigned int passIndex = 0; passIndex < NUM_FLUID_SHADER_PASSES; passIndex++)
+    {
+        _fluidProgramIds[passIndex] = 0;
+    }
+    for (unsigned int passIndex = 0; passIndex < NUM_REORDER_SHADER_PASSES; passIndex++)
+    {
+        _reorderProgramIds[passIndex] = 0;
+    }
+    for (unsigned int setIndex = 0; setIndex < 2; setIndex++)
+    {
+        for (unsigned int queryIndex = 0; queryIndex < NUM_FLUID_TIMESTAMPS; queryIndex++)
+        {
+            _fluidQueryIds[setIndex][queryIndex] = 0;
+        }
+        _isFluidQuerySetPending[setIndex] = false;
+    }
+    _fluidPassTimes._numSteps = 0;
+    for (int passIndex = 0; passIndex < FLUID_PASS_COUNT; passIndex++)
+    {
+        _fluidPassTimes._totalMs[passIndex] = 0.0;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Calls Cleanup() in the event that the user forgot to call it themselves.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleSimulatorGpu::~ParticleSimulatorGpu()
+{
+    this->Cleanup();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Loads the compute shaders for the manager's particle format, with the update shader 
+    compiled for the integrator, and looks up the time step uniforms.  Then binds the particle 
+    buffer and the emitter table to the compute shaders' buffer bindings and sorts the 
+    particles into the live list and the emitters' dead lists.  
+    If any emitter uses lifetimes, then this also creates the buffer of expiry steps.  If the 
+    particles are a fluid, then this also loads the fluid passes and creates their buffers, 
+    and the same for the reorder passes if the particles are sorted.
+Parameters:
+    allParticles    Used for the particle count and for which particles start out active.  The
+                    particle data was already uploaded into the buffer.  0 if the manager uses
+                    the packed format.
+    allPackedParticles  Same, but for the packed format.
+    particleBufferId    The shader storage buffer that the manager created.
+    emitters        The manager's emitter table.  Only used here.
+    emitterBufferId     The shader storage buffer with the manager's copy of the table.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::Init(std::vector<Particle> *allParticles,
+    std::vector<ParticlePacked> *allPackedParticles,
+    unsigned int particleBufferId,
+    const std::vector<ParticleEmitter> *emitters,
+    unsigned int emitterBufferId)
+{
+    // Note: Must match the INTEGRATOR_* #defines in the update shaders.
+    char integratorDefine[64];
+    snprintf(integratorDefine, sizeof(integratorDefine), "#define INTEGRATOR %d\n", 
+        (int)_integrator);
+
+    std::vector<bool> isActive;
+    if (allPackedParticles != 0)
+    {
+        _computeProgramId = GenerateComputeShaderProgram("shaderParticlePacked.comp", 
+            integratorDefine);
+        _emitProgramId = GenerateComputeShaderProgram("shaderParticlePackedEmit.comp");
+        _numParticles = allPackedParticles->size();
+        isActive.resize(_numParticles);
+        for (unsigned int particleIndex = 0; particleIndex < _numParticles; particleIndex++)
+        {
+            isActive[particleIndex] =
+                ((*allPackedParticles)[particleIndex]._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) != 0;
+        }
+    }
+    else
+    {
+        _computeProgramId = GenerateComputeShaderProgram("shaderParticle.comp", 
+            integratorDefine);
+        _emitProgramId = GenerateComputeShaderProgram("shaderParticleEmit.comp");
+        _numParticles = allParticles->size();
+        isActive.resize(_numParticles);
+        for (unsigned int particleIndex = 0; particleIndex < _numParticles; particleIndex++)
+        {
+            isActive[particleIndex] = (*allParticles)[particleIndex]._isActive != 0;
+        }
+    }
+    _prepareProgramId = GenerateComputeShaderProgram("shaderParticleListPrepare.comp");
+    _particleBufferId = particleBufferId;
+    _allParticles = allParticles;
+    _allPackedParticles = allPackedParticles;
+    _numEmitters = emitters->size();
+
+    _unifLocDeltaTimeSec = glGetUniformLocation(_computeProgramId, "uDeltaTimeSec");
+    _unifLocStepIndex = glGetUniformLocation(_computeProgramId, "uStepIndex");
+    _unifLocNumForceFields = glGetUniformLocation(_computeProgramId, "uNumForceFields");
+    _unifLocUseObstacles = glGetUniformLocation(_computeProgramId, "uUseObstacles");
+    _unifLocUseTurbulence = glGetUniformLocation(_computeProgramId, "uUseTurbulence");
+    _unifLocResetVelocities = glGetUniformLocation(_computeProgramId, "uResetVelocities");
+    _unifLocEmitDeltaTimeSec = glGetUniformLocation(_emitProgramId, "uDeltaTimeSec");
+    _unifLocEmitStepIndex = glGetUniformLocation(_emitProgramId, "uStepIndex");
+    _unifLocEmitResetVelocities = glGetUniformLocation(_emitProgramId, "uResetVelocities");
+    _unifLocNumSubsteps = glGetUniformLocation(_computeProgramId, "uNumSubsteps");
+    _unifLocEmitNumSubsteps = glGetUniformLocation(_emitProgramId, "uNumSubsteps");
+    _stepIndex = 0;
+    _numForceFields = 0;
+    _useObstacles = false;
+    _turbulence.Cleanup();
+
+    //??why are these work group counts all undefined??
+    int workGroupCount[3];
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &workGroupCount[0]);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 1, &workGroupCount[1]);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 2, &workGroupCount[2]);
+    printf("max global (total) work group counts: x = %d, y = %d, z = %d\n", workGroupCount[0],
+        workGroupCount[1], workGroupCount[2]);
+
+    int workGroupSize[3];
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &workGroupSize[0]);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 1, &workGroupSize[1]);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 2, &workGroupSize[2]);
+    printf("max global (total) work group sizes: x = %d, y = %d, z = %d\n", workGroupSize[0],
+        workGroupSize[1], workGroupSize[2]);
+
+    int workGroupInvocations = 0;
+    // ??why is GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, which is in the lists at https://www.opengl.org/wiki/GLAPI/glGet, bute  undefined, but GL_MAX_COMPUTE_LOCAL_INVOCATIONS, which is not in the lists on that website, is defined? are they the same thing??
+    glGetIntegerv(GL_MAX_COMPUTE_LOCAL_INVOCATIONS, &workGroupInvocations);
+    printf("max local invocations = %d\n", workGroupInvocations);
+
+    glUseProgram(0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLE_BUFFER_BINDING, particleBufferId);  // ??the hey does this do??
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_BUFFER_BINDING, emitterBufferId);
+
+    this->InitParticleLists(isActive, *emitters);
+
+    // Note: The particles start their lives when they are emitted, so there is nothing to put 
+    // in here yet.
+    bool useLifetimes = false;
+    for (size_t emitterIndex = 0; emitterIndex < emitters->size(); emitterIndex++)
+    {
+        useLifetimes = useLifetimes || ((*emitters)[emitterIndex]._maxLifetimeSec > 0.0f);
+    }
+    if (useLifetimes)
+    {
+        std::vector<GLuint> expirySteps(_numParticles, 0);
+        glGenBuffers(1, &_expiryBufferId);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _expiryBufferId);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * _numParticles, 
+            expirySteps.data(), GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    if (_fluidSettings._smoothingRadius > 0.0f)
+    {
+        if (allPackedParticles != 0)
+        {
+            printf("the GPU fluid needs the full particle format (no -packed); ignoring it\n");
+        }
+        else
+        {
+            this->InitFluid(*emitters);
+        }
+    }
+
+    if (_reorderStepsBetween > 0)
+    {
+        this->InitReorder(*emitters, allPackedParticles != 0);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Deletes the compute shader programs, the emitter state, expiry, and force field buffers, 
+    the particle lists, the fluid's programs, buffers, and queries, and the reorder's programs 
+    and buffers.
+    The particle buffer and the emitter table belong to the manager.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::Cleanup()
+{
+    if (_computeProgramId != 0)
+    {
+        glDeleteProgram(_computeProgramId);
+        _computeProgramId = 0;
+    }
+
+    if (_emitProgramId != 0)
+    {
+        glDeleteProgram(_emitProgramId);
+        _emitProgramId = 0;
+    }
+
+    if (_prepareProgramId != 0)
+    {
+        glDeleteProgram(_prepareProgramId);
+        _prepareProgramId = 0;
+    }
+
+    if (_emitterStateBufferId != 0)
+    {
+        glDeleteBuffers(1, &_emitterStateBufferId);
+        _emitterStateBufferId = 0;
+    }
+
+    if (_expiryBufferId != 0)
+    {
+        glDeleteBuffers(1, &_expiryBufferId);
+        _expiryBufferId = 0;
+    }
+
+    if (_forceFieldBufferId != 0)
+    {
+        glDeleteBuffers(1, &_forceFieldBufferId);
+        _forceFieldBufferId = 0;
+    }
+    _numForceFields = 0;
+
+    if (_obstacleBufferId != 0)
+    {
+        glDeleteBuffers(1, &_obstacleBufferId);
+        _obstacleBufferId = 0;
+    }
+    _obstacleBufferBytes = 0;
+    _useObstacles = false;
+
+    if (_turbulenceBufferId != 0)
+    {
+        glDeleteBuffers(1, &_turbulenceBufferId);
+        _turbulenceBufferId = 0;
+    }
+    _turbulence.Cleanup();
+
+    if (_liveListBufferIds[0] != 0)
+    {
+        glDeleteBuffers(2, _liveListBufferIds);
+        _liveListBufferIds[0] = 0;
+        _liveListBufferIds[1] = 0;
+    }
+
+    if (_deadListBufferId != 0)
+    {
+        glDeleteBuffers(1, &_deadListBufferId);
+        _deadListBufferId = 0;
+    }
+
+    for (unsigned int passIndex = 0; passIndex < NUM_FLUID_SHADER_PASSES; passIndex++)
+    {
+        if (_fluidProgramIds[passIndex] != 0)
+        {
+            glDeleteProgram(_fluidProgramIds[passIndex]);
+            _fluidProgramIds[passIndex] = 0;
+        }
+    }
+
+    if (_fluidGridBufferId != 0)
+    {
+        GLuint fluidBufferIds[4] = { _fluidGridBufferId, _fluidScanBufferId, 
+            _fluidPlaceBufferId, _fluidBodyBufferId };
+        glDeleteBuffers(4, fluidBufferIds);
+        _fluidGridBufferId = 0;
+        _fluidScanBufferId = 0;
+        _fluidPlaceBufferId = 0;
+        _fluidBodyBufferId = 0;
+    }
+    _fluidNumCells = 0;
+    _fluidNumScanBlocks = 0;
+
+    for (unsigned int passIndex = 0; passIndex < NUM_REORDER_SHADER_PASSES; passIndex++)
+    {
+        if (_reorderProgramIds[passIndex] != 0)
+        {
+            glDeleteProgram(_reorderProgramIds[passIndex]);
+            _reorderProgramIds[passIndex] = 0;
+        }
+    }
+
+    if (_reorderPairBufferId != 0)
+    {
+        GLuint reorderBufferIds[4] = { _reorderPairBufferId, _reorderCountBufferId, 
+            _reorderHandleBufferId, _reorderParticleBufferId };
+        glDeleteBuffers(4, reorderBufferIds);
+        _reorderPairBufferId = 0;
+        _reorderCountBufferId = 0;
+        _reorderHandleBufferId = 0;
+        _reorderParticleBufferId = 0;
+    }
+
+    if (_reorderExpiryBufferId != 0)
+    {
+        glDeleteBuffers(1, &_reorderExpiryBufferId);
+        _reorderExpiryBufferId = 0;
+    }
+    _reorderParticleBytes = 0;
+    _reorderNumTiles = 0;
+    _reorderNumScanBlocks = 0;
+    _reorderNumPasses = 0;
+
+    // Note: Whatever the pending queries had to say is lost.
+    if (_fluidQueryIds[0][0] != 0)
+    {
+        glDeleteQueries(NUM_FLUID_TIMESTAMPS * 2, &_fluidQueryIds[0][0]);
+        for (unsigned int setIndex = 0; setIndex < 2; setIndex++)
+        {
+            for (unsigned int queryIndex = 0; queryIndex < NUM_FLUID_TIMESTAMPS; queryIndex++)
+            {
+                _fluidQueryIds[setIndex][queryIndex] = 0;
+            }
+            _isFluidQuerySetPending[setIndex] = false;
+        }
+    }
+
+    _particleBufferId = 0;
+    _allParticles = 0;
+    _allPackedParticles = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Takes as many steps of deltaTimeSec as it was asked to with SetSubsteps(...), which is 
+    one unless asked otherwise.  If the update shader can take them all by itself (see 
+    CanBlockSubsteps()), then they are taken with one set of passes.  Otherwise each one gets 
+    its own.
+Parameters:
+    deltaTimeSec    The length of each step.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::Update(float deltaTimeSec)
+{
+    if (_numSubsteps > 1 && this->CanBlockSubsteps())
+    {
+        this->Step(deltaTimeSec, _numSubsteps);
+        return;
+    }
+
+    for (unsigned int substepIndex = 0; substepIndex < _numSubsteps; substepIndex++)
+    {
+        this->Step(deltaTimeSec, 1);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Runs the three passes (see the class description), the fluid passes if there are any, 
+    and the reorder passes if this is a step to sort on, then waits for the writes to be 
+    visible to the vertex shader and the indirect draw.  If the turbulence changes over time, 
+    then its samples for this step are uploaded first.
+
+    If there is more than one substep, then the update shader takes all of them for each live 
+    particle before writing it back, and the emit shader sends out whatever is left of the 
+    quota for all of them at the end (see SetSubsteps(...)).
+Parameters:
+    deltaTimeSec    The length of each substep.
+    numSubsteps     Self-explanatory.  1 unless the steps are blocked.
+Returns:    None
+Exception:  Safe
+Creator:    John Cox (7-4-2016)
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::Step(float deltaTimeSec, unsigned int numSubsteps)
+{
+    // last frame's output is this frame's input
+    GLuint liveListInId = _liveListBufferIds[_currentLiveList];
+    GLuint liveListOutId = _liveListBufferIds[1 - _currentLiveList];
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIVE_LIST_IN_BINDING, liveListInId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIVE_LIST_OUT_BINDING, liveListOutId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DEAD_LIST_BINDING, _deadListBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EMITTER_STATE_BINDING, _emitterStateBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EXPIRY_BINDING, _expiryBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FORCE_FIELD_BUFFER_BINDING, _forceFieldBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBSTACLE_FIELD_BUFFER_BINDING, _obstacleBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TURBULENCE_FIELD_BUFFER_BINDING, 
+        _turbulenceBufferId);
+    if (_turbulence.Advance(deltaTimeSec))
+    {
+        // Note: The update shader is the first thing to read the samples, and the upload is in 
+        // order with the dispatches, so it doesn't need a barrier.
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _turbulenceBufferId);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(TurbulenceFieldHeader), 
+            sizeof(glm::vec2) * _turbulence.NumSamples(), _turbulence.GetSamples());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    bool resetVelocities = _numForceFields > 0 || _useObstacles || 
+        _turbulence.IsInitialized() || _fluidGridBufferId != 0;
+
+    // (1) one thread per emitter starts the emitter's frame over, and the first one also 
+    // figures out how many work groups the update needs
+    // Note: The indirect dispatch reads the work group count as a command, not as shader
+    // storage, so it needs the command barrier.
+    glUseProgram(_prepareProgramId);
+    glDispatchCompute((_numEmitters + PREPARE_WORK_GROUP_SIZE - 1) / PREPARE_WORK_GROUP_SIZE, 
+        1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+    // (2) update only the live particles
+    // bind before attempting to send any uniforms or starting to compute stuff
+    glUseProgram(_computeProgramId);
+    glUniform1f(_unifLocDeltaTimeSec, deltaTimeSec);
+    glUniform1ui(_unifLocStepIndex, _stepIndex);
+    glUniform1ui(_unifLocNumForceFields, _numForceFields);
+    glUniform1ui(_unifLocUseObstacles, _useObstacles ? 1 : 0);
+    glUniform1ui(_unifLocUseTurbulence, _turbulence.IsInitialized() ? 1 : 0);
+    glUniform1ui(_unifLocResetVelocities, resetVelocities ? 1 : 0);
+    glUniform1ui(_unifLocNumSubsteps, numSubsteps);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, liveListInId);
+    glDispatchComputeIndirect(offsetof(LiveListHeader, _numGroupsX));
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // (3) emit with whatever is left of each emitter's quota
+    // Note: One work group per emitter, and its threads take turns with the emitter's quota, 
+    // so this doesn't need to know how big any of the quotas are.
+    // Also Note: The particles are sent out at the end of the last substep, so their lives 
+    // and velocities start from that one.
+    glUseProgram(_emitProgramId);
+    glUniform1f(_unifLocEmitDeltaTimeSec, deltaTimeSec);
+    glUniform1ui(_unifLocEmitStepIndex, _stepIndex + numSubsteps - 1);
+    glUniform1ui(_unifLocEmitResetVelocities, resetVelocities ? 1 : 0);
+    glUniform1ui(_unifLocEmitNumSubsteps, numSubsteps);
+    GLuint numWorkGroupsX = _numEmitters;
+    GLuint numWorkGroupsY = 1;
+    GLuint numWorkGroupsZ = 1;
+    glDispatchCompute(numWorkGroupsX, numWorkGroupsY, numWorkGroupsZ);
+
+    // (4) - (8) if the particles are a fluid
+    if (_fluidGridBufferId != 0)
+    {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        this->UpdateFluid(deltaTimeSec);
+    }
+
+    // (9) - (11) every so many steps if the particles are sorted
+    // Note: The step count starts from 1 here, the same as the CPU simulator's.
+    if (_reorderPairBufferId != 0 && ((_stepIndex + 1) % _reorderStepsBetween) == 0)
+    {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        this->ReorderParticles();
+    }
+
+    // tell the GPU:
+    // (1) Accesses to the shader buffer after this call will reflect writes prior to the
+    // barrier.  This is only available in OpenGL 4.3 or higher.
+    // (2) Vertex data sourced from buffer objects after the barrier will reflect data written
+    // by shaders prior to the barrier.  The affected buffer(s) is determined by the buffers
+    // that were bound for the vertex attributes.  In this case, that means GL_ARRAY_BUFFER.
+    // (3) The live list will be used as both the element array and the draw command.
+    //glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT |
+    //    GL_ELEMENT_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+    glUseProgram(0);
+
+    _currentLiveList = 1 - _currentLiveList;
+    _stepIndex += numSubsteps;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Tells whether the update shader can take all of an update's substeps by itself (see 
+    Step(...)).  Everything that it does to a particle depends only on that particle, but 
+    the fluid passes and the sort have to run between the steps, and so does the upload of 
+    turbulence that changes over time.
+Parameters: None
+Returns:
+    True if there is no fluid, no sort, and no turbulence that changes over time, otherwise 
+    false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleSimulatorGpu::CanBlockSubsteps() const
+{
+    return _fluidGridBufferId == 0 && _reorderPairBufferId == 0 && !_turbulence.IsAnimated();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Chooses the integrator that the update shader is compiled for (see ParticleIntegrator.h).  
+    Must be called before Init(...).
+Parameters:
+    integrator  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::SetIntegrator(IntegratorType integrator)
+{
+    _integrator = integrator;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for the particles to behave as a fluid (see ParticleFluid.h).  Must be called before 
+    Init(...), which loads the fluid passes.
+Parameters:
+    settings    See FluidSettings.  A smoothing radius of 0 means no fluid.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::SetFluid(const FluidSettings &settings)
+{
+    _fluidSettings = settings;
+    if (_fluidSettings._smoothingRadius < 0.0f)
+    {
+        _fluidSettings._smoothingRadius = 0.0f;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Reads whatever timestamps are still pending and then gives back how long each fluid pass 
+    has taken, added up over every step since Init(...).  Waits for the GPU to finish the 
+    last step, so this is for reporting, not for every frame.
+Parameters: None
+Returns:
+    See FluidPassTimes.  The store pass is always 0 (see ParticleFluid.h).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+FluidPassTimes ParticleSimulatorGpu::GetFluidPassTimes()
+{
+    // the older set first
+    this->ReadFluidTimestamps(_currentFluidQuerySet);
+    this->ReadFluidTimestamps(1 - _currentFluidQuerySet);
+    return _fluidPassTimes;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Uploads the force field table.  The buffer is made the first time that there are any 
+    fields and is grown if the table outgrows it.
+Parameters:
+    forceFields     See ForceField.h.  May be empty.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::SetForceFields(const std::vector<ForceField> &forceFields)
+{
+    if (!forceFields.empty())
+    {
+        if (_forceFieldBufferId == 0)
+        {
+            glGenBuffers(1, &_forceFieldBufferId);
+        }
+
+        GLsizeiptr sizeBytes = sizeof(ForceField) * forceFields.size();
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _forceFieldBufferId);
+        if (forceFields.size() > _numForceFields)
+        {
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeBytes, forceFields.data(), 
+                GL_DYNAMIC_DRAW);
+        }
+        else
+        {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeBytes, forceFields.data());
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    _numForceFields = forceFields.size();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Uploads the baked obstacle field, header first and then the samples, the way that 
+    "ObstacleBuffer" in the update shaders expects.  Like SetForceFields(...), the buffer is 
+    made the first time that there are obstacles and is grown if a field outgrows it.
+Parameters:
+    obstacles   See ObstacleField.h.  If it isn't baked, then there are no obstacles.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::SetObstacles(const ObstacleField &obstacles)
+{
+    _useObstacles = obstacles.IsBaked();
+    if (!_useObstacles)
+    {
+        return;
+    }
+
+    if (_obstacleBufferId == 0)
+    {
+        glGenBuffers(1, &_obstacleBufferId);
+    }
+
+    GLsizeiptr headerBytes = sizeof(ObstacleFieldHeader);
+    GLsizeiptr samplesBytes = sizeof(float) * obstacles.NumSamples();
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _obstacleBufferId);
+    if ((unsigned int)(headerBytes + samplesBytes) > _obstacleBufferBytes)
+    {
+        _obstacleBufferBytes = (unsigned int)(headerBytes + samplesBytes);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _obstacleBufferBytes, 0, GL_STATIC_DRAW);
+    }
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, headerBytes, &obstacles.GetHeader());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, headerBytes, samplesBytes, obstacles.GetSamples());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Bakes the turbulence field (see TurbulenceField::Init(...)) and uploads it, header first 
+    and then the samples, the way that "TurbulenceBuffer" in the update shaders expects.  The 
+    tile is always the same size, so the buffer is made once.  If the field changes over 
+    time, then Update(...) uploads new samples every step.
+Parameters:
+    settings    See TurbulenceSettings.  A strength of 0 means no turbulence.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::SetTurbulence(const TurbulenceSettings &settings)
+{
+    _turbulence.Init(settings);
+    if (!_turbulence.IsInitialized())
+    {
+        return;
+    }
+
+    GLsizeiptr headerBytes = sizeof(TurbulenceFieldHeader);
+    GLsizeiptr samplesBytes = sizeof(glm::vec2) * _turbulence.NumSamples();
+    if (_turbulenceBufferId == 0)
+    {
+        glGenBuffers(1, &_turbulenceBufferId);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _turbulenceBufferId);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, headerBytes + samplesBytes, 0, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _turbulenceBufferId);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, headerBytes, &_turbulence.GetHeader());
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, headerBytes, samplesBytes, 
+        _turbulence.GetSamples());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for the particles to be sorted by where they are every so many steps (see the class 
+    description).  Must be called before Init(...), which loads the reorder passes.
+Parameters:
+    numStepsBetweenSorts    The particles are sorted at the end of every step whose count 
+                            (starting from 1) is a multiple of this.  0 means never.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::SetReorder(unsigned int numStepsBetweenSorts)
+{
+    _reorderStepsBetween = numStepsBetweenSorts;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks for every update to take this many steps (see Update(...)).  Unlike the CPU 
+    simulator, the substeps share one emission quota (big enough for all of them) instead of 
+    each having its own, since the GPU's quota is a single count per emitter.  The dead 
+    particles are only sent back out once per update, at the end.
+Parameters:
+    numSubsteps     0 is the same as 1.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::SetSubsteps(unsigned int numSubsteps)
+{
+    _numSubsteps = (numSubsteps > 0) ? numSubsteps : 1;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Tells the manager that the particle data lives in the shader storage buffer and that the
+    particle collection is stale.
+Parameters: None
+Returns:
+    False.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ParticleSimulatorGpu::UpdatesOnCpu() const
+{
+    return false;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives the manager the live list that the last update wrote so that it can draw only the
+    live particles.  The buffer starts with a DrawElementsIndirectCommand, and the indices
+    after it are the element array.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleSimulatorGpu::GetLiveListBufferId() const
+{
+    return _liveListBufferIds[_currentLiveList];
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Copies the particle buffer back into the manager's particle collection.  This waits for the 
+    GPU to finish everything that it was given, so it is only for inspecting the particles (ex: 
+    replay fingerprints), not for every frame.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::ReadBackParticles()
+{
+    void *particleData = 0;
+    unsigned int sizeBytes = 0;
+    if (_allPackedParticles != 0)
+    {
+        particleData = _allPackedParticles->data();
+        sizeBytes = sizeof(ParticlePacked) * _allPackedParticles->size();
+    }
+    else if (_allParticles != 0)
+    {
+        particleData = _allParticles->data();
+        sizeBytes = sizeof(Particle) * _allParticles->size();
+    }
+
+    if (particleData == 0 || _particleBufferId == 0)
+    {
+        return;
+    }
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _particleBufferId);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeBytes, particleData);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives whatever needs to follow a particle from step to step on the GPU the buffer that 
+    says where each particle went.  The first value for each particle is the particle index 
+    that goes with each handle, where a particle's handle is its index before the first sort 
+    (see ParticleReorder.h).  The rest of the buffer is the reorder's own.
+Parameters: None
+Returns:
+    See description.  0 unless SetReorder(...) was called before Init(...).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleSimulatorGpu::GetReorderHandleBufferId() const
+{
+    return _reorderHandleBufferId;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Creates the two live lists, the dead list, and the emitter state and fills them from the 
+    particles' starting "is active" flags.  Each list has room for every particle.
+
+    Each emitter's dead particles go in the part of the dead list that lines up with the 
+    emitter's particles, so the emitters' stacks never run into each other.  Each stack is 
+    filled backwards so that the particles are emitted in order.
+Parameters:
+    isActive    Self-explanatory.
+    emitters    Used for their particle ranges.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::InitParticleLists(const std::vector<bool> &isActive, 
+    const std::vector<ParticleEmitter> &emitters)
+{
+    std::vector<GLuint> liveIndices;
+    for (unsigned int particleIndex = 0; particleIndex < _numParticles; particleIndex++)
+    {
+        if (isActive[particleIndex])
+        {
+            liveIndices.push_back(particleIndex);
+        }
+    }
+
+    // every slot of the dead list belongs to some emitter, so the list is exactly as long as 
+    // the particle buffer
+    std::vector<GLuint> deadIndices(_numParticles, 0);
+    std::vector<EmitterState> emitterStates(emitters.size());
+    for (size_t emitterIndex = 0; emitterIndex < emitters.size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = emitters[emitterIndex];
+        EmitterState &state = emitterStates[emitterIndex];
+        state._numEmitted = 0;
+        state._deadCount = 0;
+        state._deadNumPopped = 0;
+        state._padding = 0;
+
+        unsigned int end = emitter._firstParticle + emitter._numParticles;
+        for (unsigned int particleIndex = end; particleIndex > emitter._firstParticle; particleIndex--)
+        {
+            if (!isActive[particleIndex - 1])
+            {
+                deadIndices[emitter._firstParticle + state._deadCount] = particleIndex - 1;
+                state._deadCount++;
+            }
+        }
+    }
+
+    LiveListHeader header;
+    header._count = 0;
+    header._instanceCount = 1;
+    header._firstIndex = sizeof(LiveListHeader) / sizeof(GLuint);
+    header._baseVertex = 0;
+    header._baseInstance = 0;
+    header._numGroupsX = 0;
+    header._numGroupsY = 1;
+    header._numGroupsZ = 1;
+
+    // both live lists get the same header, but only the current one starts with any particles
+    // Note: Allocate with null data and then fill it because the header and the indices are
+    // separate.
+    unsigned int listSizeBytes = sizeof(LiveListHeader) + (sizeof(GLuint) * _numParticles);
+    glGenBuffers(2, _liveListBufferIds);
+    _currentLiveList = 0;
+    for (unsigned int listIndex = 0; listIndex < 2; listIndex++)
+    {
+        header._count = (listIndex == _currentLiveList) ? liveIndices.size() : 0;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _liveListBufferIds[listIndex]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, listSizeBytes, 0, GL_DYNAMIC_COPY);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), &header);
+        if (header._count > 0)
+        {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(header),
+                sizeof(GLuint) * liveIndices.size(), liveIndices.data());
+        }
+    }
+
+    glGenBuffers(1, &_deadListBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _deadListBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * _numParticles, 
+        deadIndices.data(), GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &_emitterStateBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _emitterStateBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(EmitterState) * emitterStates.size(), 
+        emitterStates.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Loads shaderFluid.comp once for each of its passes and creates the fluid's buffers and 
+    timestamp queries.  The grid covers every emitter's circle and is laid out the same way as 
+    the CPU simulator's (see NeighborGrid::Init(...)), and its header is written here once.
+Parameters:
+    emitters    Used for the area that the grid covers.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::InitFluid(const std::vector<ParticleEmitter> &emitters)
+{
+    if (emitters.empty())
+    {
+        return;
+    }
+
+    glm::vec2 minCorner = emitters[0]._center - emitters[0]._radius;
+    glm::vec2 maxCorner = emitters[0]._center + emitters[0]._radius;
+    for (size_t emitterIndex = 1; emitterIndex < emitters.size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = emitters[emitterIndex];
+        minCorner = glm::min(minCorner, emitter._center - emitter._radius);
+        maxCorner = glm::max(maxCorner, emitter._center + emitter._radius);
+    }
+
+    // Note: No particles, so this only works out the cells.
+    NeighborGrid cellLayout;
+    cellLayout.Init(minCorner, maxCorner, _fluidSettings._smoothingRadius, 0);
+    _fluidNumCells = cellLayout.NumCellsX() * cellLayout.NumCellsY();
+
+    // the scan covers one more than the number of cells (see shaderFluid.comp)
+    unsigned int numScanEntries = _fluidNumCells + 1;
+    _fluidNumScanBlocks = (numScanEntries + FLUID_SCAN_BLOCK_SIZE - 1) / FLUID_SCAN_BLOCK_SIZE;
+
+    FluidGridHeader header;
+    header._minCorner = minCorner;
+    header._cellSize = cellLayout.CellSize();
+    header._inverseCellSize = 1.0f / cellLayout.CellSize();
+    header._numCellsX = cellLayout.NumCellsX();
+    header._numCellsY = cellLayout.NumCellsY();
+    header._numParticles = _numParticles;
+    header._numScanBlocks = _fluidNumScanBlocks;
+    header._smoothingRadius = _fluidSettings._smoothingRadius;
+    header._restDensity = _fluidSettings._restDensity;
+    header._stiffness = _fluidSettings._stiffness;
+    header._viscosity = _fluidSettings._viscosity;
+    GetFluidKernelScales(_fluidSettings._smoothingRadius, &header._densityScale, 
+        &header._pressureScale, &header._viscosityScale);
+    header._padding = 0;
+
+    // Note: Must match the FLUID_SHADER_PASS_* #defines in shaderFluid.comp.
+    for (unsigned int passIndex = 0; passIndex < NUM_FLUID_SHADER_PASSES; passIndex++)
+    {
+        char passDefine[64];
+        snprintf(passDefine, sizeof(passDefine), "#define FLUID_SHADER_PASS %u\n", passIndex);
+        _fluidProgramIds[passIndex] = GenerateComputeShaderProgram("shaderFluid.comp", 
+            passDefine);
+    }
+    _unifLocFluidDeltaTimeSec = glGetUniformLocation(
+        _fluidProgramIds[FLUID_SHADER_PASS_FORCES], "uDeltaTimeSec");
+
+    // the cells' counts are cleared every step, so only the header needs to be uploaded
+    GLsizeiptr cellStartsBytes = sizeof(GLuint) * (_fluidNumCells + 1);
+    glGenBuffers(1, &_fluidGridBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _fluidGridBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(header) + cellStartsBytes, 0, GL_DYNAMIC_COPY);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), &header);
+
+    glGenBuffers(1, &_fluidScanBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _fluidScanBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * _fluidNumScanBlocks, 0, 
+        GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &_fluidPlaceBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _fluidPlaceBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 2 * _numParticles, 0, 
+        GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &_fluidBodyBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _fluidBodyBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(FluidBody) * _numParticles, 0, 
+        GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glGenQueries(NUM_FLUID_TIMESTAMPS * 2, &_fluidQueryIds[0][0]);
+    _currentFluidQuerySet = 0;
+    _isFluidQuerySetPending[0] = false;
+    _isFluidQuerySetPending[1] = false;
+    _fluidPassTimes._numSteps = 0;
+    for (int passIndex = 0; passIndex < FLUID_PASS_COUNT; passIndex++)
+    {
+        _fluidPassTimes._totalMs[passIndex] = 0.0;
+    }
+
+    printf("fluid: %u x %u cells, %u scan blocks\n", cellLayout.NumCellsX(), 
+        cellLayout.NumCellsY(), _fluidNumScanBlocks);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Runs the fluid passes (see the class description), with a timestamp at the start and 
+    after the grid, density, and forces passes.  The emit shader must be done with the 
+    particle buffer first.
+Parameters:
+    deltaTimeSec    Self-explanatory
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::UpdateFluid(float deltaTimeSec)
+{
+    // this set was last used two steps ago, so its results should be in by now
+    unsigned int querySet = _currentFluidQuerySet;
+    this->ReadFluidTimestamps(querySet);
+    const GLuint *queryIds = _fluidQueryIds[querySet];
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FLUID_GRID_BINDING, _fluidGridBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FLUID_SCAN_BINDING, _fluidScanBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FLUID_PLACE_BINDING, _fluidPlaceBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FLUID_BODY_BINDING, _fluidBodyBufferId);
+    GLuint numParticleGroups = 
+        (_numParticles + FLUID_WORK_GROUP_SIZE - 1) / FLUID_WORK_GROUP_SIZE;
+    GLuint numCellGroups = 
+        (_fluidNumCells + 1 + FLUID_WORK_GROUP_SIZE - 1) / FLUID_WORK_GROUP_SIZE;
+    glQueryCounter(queryIds[0], GL_TIMESTAMP);
+
+    // (4) count the particles in each cell, starting from 0
+    // Note: A null clear value means 0.
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _fluidGridBufferId);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, sizeof(FluidGridHeader), 
+        sizeof(GLuint) * (_fluidNumCells + 1), GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glUseProgram(_fluidProgramIds[FLUID_SHADER_PASS_COUNT_CELLS]);
+    glDispatchCompute(numParticleGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // (5) turn the counts into where each cell starts
+    glUseProgram(_fluidProgramIds[FLUID_SHADER_PASS_SCAN_BLOCKS]);
+    glDispatchCompute(_fluidNumScanBlocks, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(_fluidProgramIds[FLUID_SHADER_PASS_SCAN_TOTALS]);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(_fluidProgramIds[FLUID_SHADER_PASS_SCAN_ADD]);
+    glDispatchCompute(numCellGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // (6) copy the particles into grid order
+    glUseProgram(_fluidProgramIds[FLUID_SHADER_PASS_SORT]);
+    glDispatchCompute(numParticleGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glQueryCounter(queryIds[1], GL_TIMESTAMP);
+
+    // (7) and (8)
+    // Note: There can't be more particles in the grid than there are particles, so this is 
+    // the same number of work groups, and the threads past the end of the grid quit.
+    glUseProgram(_fluidProgramIds[FLUID_SHADER_PASS_DENSITY]);
+    glDispatchCompute(numParticleGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glQueryCounter(queryIds[2], GL_TIMESTAMP);
+    glUseProgram(_fluidProgramIds[FLUID_SHADER_PASS_FORCES]);
+    glUniform1f(_unifLocFluidDeltaTimeSec, deltaTimeSec);
+    glDispatchCompute(numParticleGroups, 1, 1);
+    glQueryCounter(queryIds[3], GL_TIMESTAMP);
+
+    _isFluidQuerySetPending[querySet] = true;
+    _currentFluidQuerySet = 1 - _currentFluidQuerySet;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    If the set of timestamps is waiting to be read, then this reads it (waiting for the GPU 
+    if it has to) and adds the time between them to the pass times.
+Parameters:
+    querySet    0 or 1.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::ReadFluidTimestamps(unsigned int querySet)
+{
+    if (!_isFluidQuerySetPending[querySet])
+    {
+        return;
+    }
+
+    GLuint64 timestampsNs[NUM_FLUID_TIMESTAMPS];
+    for (unsigned int queryIndex = 0; queryIndex < NUM_FLUID_TIMESTAMPS; queryIndex++)
+    {
+        glGetQueryObjectui64v(_fluidQueryIds[querySet][queryIndex], GL_QUERY_RESULT, 
+            &timestampsNs[queryIndex]);
+    }
+    _isFluidQuerySetPending[querySet] = false;
+
+    // Note: Each pass is the time from the timestamp before it to the one after it.
+    _fluidPassTimes._numSteps++;
+    _fluidPassTimes._totalMs[FLUID_PASS_GRID] += (timestampsNs[1] - timestampsNs[0]) / 1000000.0;
+    _fluidPassTimes._totalMs[FLUID_PASS_DENSITY] += 
+        (timestampsNs[2] - timestampsNs[1]) / 1000000.0;
+    _fluidPassTimes._totalMs[FLUID_PASS_FORCES] += 
+        (timestampsNs[3] - timestampsNs[2]) / 1000000.0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Loads shaderParticleReorder.comp once for each of its passes and creates the reorder's 
+    buffers.  The sort keys are laid out the same way as the CPU simulator's (see 
+    GetReorderKeyLayout(...)), and the count buffer's header is written here once.  Each handle 
+    starts out as its particle's index.
+Parameters:
+    emitters    Used for how many there are.
+    isPacked    True if the manager uses the compact particle format.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::InitReorder(const std::vector<ParticleEmitter> &emitters, 
+    bool isPacked)
+{
+    if (emitters.empty() || _numParticles == 0)
+    {
+        return;
+    }
+
+    // Note: Unlike the CPU's sort, every pass is run even if every key has the same digit, 
+    // since finding that out would need a read back.
+    ReorderKeyLayout layout = GetReorderKeyLayout(emitters.size());
+    _reorderNumPasses = (layout._numKeyBits + REORDER_RADIX_BITS - 1) / REORDER_RADIX_BITS;
+    _reorderNumTiles = (_numParticles + REORDER_WORK_GROUP_SIZE - 1) / REORDER_WORK_GROUP_SIZE;
+    unsigned int numCounts = _reorderNumTiles * REORDER_RADIX_SIZE;
+    _reorderNumScanBlocks = (numCounts + REORDER_SCAN_BLOCK_SIZE - 1) / REORDER_SCAN_BLOCK_SIZE;
+
+    ReorderHeader header;
+    header._numParticles = _numParticles;
+    header._numTiles = _reorderNumTiles;
+    header._numCounts = numCounts;
+    header._numScanBlocks = _reorderNumScanBlocks;
+    header._bitsPerAxis = layout._bitsPerAxis;
+    header._inactiveShift = layout._inactiveShift;
+    header._emitterShift = layout._emitterShift;
+    header._sortedSet = _reorderNumPasses & 1;
+    header._useExpiry = (_expiryBufferId != 0) ? 1 : 0;
+    header._padding[0] = 0;
+    header._padding[1] = 0;
+    header._padding[2] = 0;
+
+    // Note: Must match the REORDER_SHADER_PASS_* #defines in shaderParticleReorder.comp.
+    for (unsigned int passIndex = 0; passIndex < NUM_REORDER_SHADER_PASSES; passIndex++)
+    {
+        char passDefines[96];
+        snprintf(passDefines, sizeof(passDefines), "#define REORDER_SHADER_PASS %u\n%s", 
+            passIndex, isPacked ? "#define PACKED_PARTICLES 1\n" : "");
+        _reorderProgramIds[passIndex] = GenerateComputeShaderProgram(
+            "shaderParticleReorder.comp", passDefines);
+    }
+    _unifLocReorderCountDigitShift = glGetUniformLocation(
+        _reorderProgramIds[REORDER_SHADER_PASS_COUNT], "uDigitShift");
+    _unifLocReorderScatterDigitShift = glGetUniformLocation(
+        _reorderProgramIds[REORDER_SHADER_PASS_SCATTER], "uDigitShift");
+    _unifLocReorderHandleSet = glGetUniformLocation(
+        _reorderProgramIds[REORDER_SHADER_PASS_GATHER], "uHandleSet");
+
+    // two sets of (key, particle index) pairs
+    glGenBuffers(1, &_reorderPairBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _reorderPairBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 2 * 2 * _numParticles, 0, 
+        GL_DYNAMIC_COPY);
+
+    // the counts and the scan blocks' totals are worked out every pass, so only the header 
+    // needs to be uploaded
+    // Note: The emitters pass also needs one value for every emitter.
+    unsigned int numCountValues = glm::max(numCounts + _reorderNumScanBlocks, 
+        (unsigned int)emitters.size());
+    glGenBuffers(1, &_reorderCountBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _reorderCountBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(header) + (sizeof(GLuint) * numCountValues), 
+        0, GL_DYNAMIC_COPY);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), &header);
+
+    // each handle's particle, and then two sets of each particle's handle
+    std::vector<GLuint> handles(3 * _numParticles);
+    for (unsigned int valueIndex = 0; valueIndex < handles.size(); valueIndex++)
+    {
+        handles[valueIndex] = valueIndex % _numParticles;
+    }
+    glGenBuffers(1, &_reorderHandleBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _reorderHandleBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * handles.size(), handles.data(), 
+        GL_DYNAMIC_COPY);
+    _reorderHandleSet = 0;
+
+    _reorderParticleBytes = (isPacked ? sizeof(ParticlePacked) : sizeof(Particle)) * 
+        _numParticles;
+    glGenBuffers(1, &_reorderParticleBufferId);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _reorderParticleBufferId);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _reorderParticleBytes, 0, GL_DYNAMIC_COPY);
+
+    // Note: The expiry steps are swapped with this buffer rather than copied back.
+    if (_expiryBufferId != 0)
+    {
+        glGenBuffers(1, &_reorderExpiryBufferId);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _reorderExpiryBufferId);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * _numParticles, 0, 
+            GL_DYNAMIC_COPY);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    printf("reorder: %u key bits, %u passes, %u tiles\n", layout._numKeyBits, 
+        _reorderNumPasses, _reorderNumTiles);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Runs the reorder passes (see the class description), then copies the particles in their 
+    new order over the manager's particle buffer.  Whatever came before must be done with the 
+    particle buffer first, and the live list that this step wrote must still be bound.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleSimulatorGpu::ReorderParticles()
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REORDER_PAIR_BINDING, _reorderPairBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REORDER_COUNT_BINDING, _reorderCountBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REORDER_HANDLE_BINDING, _reorderHandleBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REORDER_PARTICLE_BINDING, 
+        _reorderParticleBufferId);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, REORDER_EXPIRY_BINDING, _reorderExpiryBufferId);
+
+    // (9) the keys, and then one counting sort for each 8 bits of them
+    // Note: There are as many counts as there are threads in the tiles, so the pass that adds 
+    // where each scan block starts needs as many work groups as there are tiles.
+    glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_KEYS]);
+    glDispatchCompute(_reorderNumTiles, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    for (unsigned int passIndex = 0; passIndex < _reorderNumPasses; passIndex++)
+    {
+        GLuint digitShift = passIndex * REORDER_RADIX_BITS;
+        glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_COUNT]);
+        glUniform1ui(_unifLocReorderCountDigitShift, digitShift);
+        glDispatchCompute(_reorderNumTiles, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_SCAN_BLOCKS]);
+        glDispatchCompute(_reorderNumScanBlocks, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_SCAN_TOTALS]);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_SCAN_ADD]);
+        glDispatchCompute(_reorderNumTiles, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_SCATTER]);
+        glUniform1ui(_unifLocReorderScatterDigitShift, digitShift);
+        glDispatchCompute(_reorderNumTiles, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // (10) where each emitter's live particles go in the live list
+    glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_EMITTERS]);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // (11) copy the particles into the spare buffer in their new order and rebuild the lists
+    glUseProgram(_reorderProgramIds[REORDER_SHADER_PASS_GATHER]);
+    glUniform1ui(_unifLocReorderHandleSet, _reorderHandleSet);
+    glDispatchCompute(_reorderNumTiles, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    _reorderHandleSet = 1 - _reorderHandleSet;
+
+    // the manager owns the particle buffer (and the vertex array that draws it), so the 
+    // particles are copied back rather than swapped, but nothing else has to know about the 
+    // expiry steps
+    glBindBuffer(GL_COPY_READ_BUFFER, _reorderParticleBufferId);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, _particleBufferId);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, _reorderParticleBytes);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (_expiryBufferId != 0)
+    {
+        GLuint sortedExpiryBufferId = _reorderExpiryBufferId;
+        _reorderExpiryBufferId = _expiryBufferId;
+        _expiryBufferId = sortedExpiryBufferId;
+    }
+}
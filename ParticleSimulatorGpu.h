@@ -0,0 +1,244 @@
+#pragma once
+
+#include "ParticleSimulator.h"
+#include "ParticleReorder.h"
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Runs shaderParticle.comp over the particle shader storage buffer.  This was originally part
+    of the particle manager, but it was pulled out so that the manager could be given a CPU
+    simulator instead.  It requires an OpenGL 4.3 context.
+
+    If the manager uses the compact particle format, then shaderParticlePacked.comp is run 
+    instead.
+
+    The particles can belong to any number of emitters (see ParticleEmitter.h).  The shaders 
+    read each particle's emitter out of the manager's emitter table, and this simulator keeps 
+    a second table of each emitter's changing state: how many particles it has emitted this 
+    frame and how many of its particles are in the dead list.  That way every pass is still a 
+    single dispatch no matter how many emitters there are.
+
+    Most of the particles are usually inactive, so rather than run a thread for every particle
+    and draw every particle, the simulator keeps the indices of the live particles in a list
+    and the inactive ones in a "dead" list.  Each emitter's dead particles are kept in its own 
+    part of the dead list (the same range that its particles have in the particle buffer).  
+    Every frame takes three dispatches:
+    (1) shaderParticleListPrepare.comp, one thread per emitter, finishes last frame's 
+    bookkeeping, and its first thread writes the work group count for...
+    (2) the update shader, dispatched indirectly, which runs one thread per live particle and
+    appends each particle to a new live list or to its emitter's dead list.
+    (3) the emit shader (shaderParticleEmit.comp or shaderParticlePackedEmit.comp), one work 
+    group per emitter, which takes what is left of the emitter's quota from its dead list and 
+    appends them to the new live list.
+    The live lists are swapped every frame, and the new one doubles as the indirect draw
+    command (see GetLiveListBufferId()).  Nothing is read back to the CPU.
+
+    If any emitter gives its particles a lifetime, then the shaders write the step that each 
+    particle's life ends on into one more buffer when they emit it, and the update compares 
+    against it.  That is the GPU's version of the CPU simulator's expiry buckets: the update 
+    only runs over the live list anyway, so an expired particle is found without looking at 
+    the rest, and the buffer is only touched for particles whose emitters use lifetimes.
+
+    Force fields (see ForceField.h) are uploaded to their own buffer, and the update shader 
+    adds them all up for each live particle just before moving it.  With force fields, both the 
+    update and the emit shaders give each particle that they send out a new velocity.
+
+    The update shader is compiled for the integrator that was picked with SetIntegrator(...) 
+    (see ParticleIntegrator.h) by putting a #define for it at the top, so each integrator is 
+    its own program and no particle has to ask which one to use.
+
+    The baked obstacle field (see ObstacleField.h) is uploaded to a buffer too, header first 
+    and then the samples, and the update shader bounces each live particle off of it just 
+    after moving it.  Bounces change the velocities, so the emit shaders give new ones to the 
+    particles that they send out when there are obstacles too.
+
+    The turbulence field (see TurbulenceField.h) is baked on the CPU and uploaded to one more 
+    buffer, header first and then the samples, and the update shader gives each live particle 
+    a kick from it before moving it.  If the field changes over time, then the samples are 
+    blended on the CPU and uploaded again at the start of every update (a tile is only 128 KB), 
+    while the field's background thread bakes the next key.
+
+    If asked to with SetFluid(...), the particles behave as a fluid (see ParticleFluid.h) after 
+    the emit shader.  shaderFluid.comp is compiled once for each of its passes:
+    (4) one thread per particle counts the particles in each cell of a neighbor grid, 
+    (5) three dispatches turn the counts into where each cell starts (a scan of blocks of 
+    cells, a scan of the blocks' totals, and adding each block's start back in), 
+    (6) one thread per particle copies it into grid order, 
+    (7) one thread per particle in the grid adds up its density, and 
+    (8) one thread per particle in the grid adds up its pressure and viscosity and writes its 
+    new velocity straight into the particle buffer.
+    Each step is timed with timestamp queries.  The results are read back a couple of steps 
+    later so that the CPU doesn't wait on them (see GetFluidPassTimes()).  The fluid only works 
+    with the full particle format.
+
+    If asked to with SetReorder(...), then every so many steps, the particles are sorted by 
+    where they are (see ParticleReorder.h) at the very end of the step.  
+    shaderParticleReorder.comp is compiled once for each of its passes:
+    (9) one thread per particle works out its sort key, and then for every 8 bits of the key, 
+    one work group per tile of 256 keys counts the tile's digits, the counts are scanned the 
+    same way as the fluid's cells, and each tile copies its keys to where they go, 
+    (10) a single work group works out where each emitter's live particles start in the live 
+    list, and 
+    (11) one thread per particle copies the particle that goes in its place (and its expiry 
+    step) into a spare buffer and puts the place in the live list or its emitter's dead list.
+    The spare buffer is then copied over the manager's particle buffer.  The particles that 
+    the update wrote to the live list are the ones in it afterwards, so the lists stay in step 
+    with the "is active" flags.  The handle buffer (see GetReorderHandleBufferId()) says where 
+    each particle went.
+
+    If asked to with SetSubsteps(...), then every update takes that many steps.  Unless there 
+    is a fluid, a sort, or turbulence that changes over time, the update shader loops over 
+    all of them for each live particle, so the particle is only read and written once per 
+    update instead of once per step.
+-----------------------------------------------------------------------------------------------*/
+class ParticleSimulatorGpu : public ParticleSimulator
+{
+public:
+    ParticleSimulatorGpu();
+    virtual ~ParticleSimulatorGpu();
+    virtual void Init(std::vector<Particle> *allParticles,
+        std::vector<ParticlePacked> *allPackedParticles,
+        unsigned int particleBufferId,
+        const std::vector<ParticleEmitter> *emitters,
+        unsigned int emitterBufferId);
+    virtual void Cleanup();
+    virtual void Update(float deltaTimeSec);
+    virtual void SetIntegrator(IntegratorType integrator);
+    virtual void SetFluid(const FluidSettings &settings);
+    virtual FluidPassTimes GetFluidPassTimes();
+    virtual void SetForceFields(const std::vector<ForceField> &forceFields);
+    virtual void SetObstacles(const ObstacleField &obstacles);
+    virtual void SetTurbulence(const TurbulenceSettings &settings);
+    virtual void SetReorder(unsigned int numStepsBetweenSorts);
+    virtual void SetSubsteps(unsigned int numSubsteps);
+    virtual bool UpdatesOnCpu() const;
+    virtual unsigned int GetLiveListBufferId() const;
+    virtual void ReadBackParticles();
+
+    unsigned int GetReorderHandleBufferId() const;
+
+private:
+    // Note: Must match the FLUID_SHADER_PASS_* #defines in shaderFluid.comp.
+    enum FluidShaderPass
+    {
+        FLUID_SHADER_PASS_COUNT_CELLS = 0,
+        FLUID_SHADER_PASS_SCAN_BLOCKS,
+        FLUID_SHADER_PASS_SCAN_TOTALS,
+        FLUID_SHADER_PASS_SCAN_ADD,
+        FLUID_SHADER_PASS_SORT,
+        FLUID_SHADER_PASS_DENSITY,
+        FLUID_SHADER_PASS_FORCES,
+        NUM_FLUID_SHADER_PASSES,
+    };
+
+    // Note: Must match the REORDER_SHADER_PASS_* #defines in shaderParticleReorder.comp.
+    enum ReorderShaderPass
+    {
+        REORDER_SHADER_PASS_KEYS = 0,
+        REORDER_SHADER_PASS_COUNT,
+        REORDER_SHADER_PASS_SCAN_BLOCKS,
+        REORDER_SHADER_PASS_SCAN_TOTALS,
+        REORDER_SHADER_PASS_SCAN_ADD,
+        REORDER_SHADER_PASS_SCATTER,
+        REORDER_SHADER_PASS_EMITTERS,
+        REORDER_SHADER_PASS_GATHER,
+        NUM_REORDER_SHADER_PASSES,
+    };
+
+    // the start of the step and the end of the grid, density, and forces passes
+    static const unsigned int NUM_FLUID_TIMESTAMPS = 4;
+
+    void Step(float deltaTimeSec, unsigned int numSubsteps);
+    bool CanBlockSubsteps() const;
+    void InitParticleLists(const std::vector<bool> &isActive, 
+        const std::vector<ParticleEmitter> &emitters);
+    void InitFluid(const std::vector<ParticleEmitter> &emitters);
+    void UpdateFluid(float deltaTimeSec);
+    void ReadFluidTimestamps(unsigned int querySet);
+    void InitReorder(const std::vector<ParticleEmitter> &emitters, bool isPacked);
+    void ReorderParticles();
+
+    unsigned int _computeProgramId;
+    unsigned int _emitProgramId;
+    unsigned int _prepareProgramId;
+    unsigned int _numParticles;
+    unsigned int _numEmitters;
+    unsigned int _stepIndex;
+
+    // only for ReadBackParticles()
+    unsigned int _particleBufferId;
+    std::vector<Particle> *_allParticles;
+    std::vector<ParticlePacked> *_allPackedParticles;
+
+    unsigned int _emitterStateBufferId;
+    unsigned int _expiryBufferId;   // 0 unless some emitter uses lifetimes
+    unsigned int _forceFieldBufferId;   // 0 until there are force fields
+    unsigned int _numForceFields;
+    IntegratorType _integrator;
+    unsigned int _obstacleBufferId; // 0 until there are obstacles
+    unsigned int _obstacleBufferBytes;
+    bool _useObstacles;
+    TurbulenceField _turbulence;
+    unsigned int _turbulenceBufferId;   // 0 until there is turbulence
+
+    // a smoothing radius of 0 (no fluid) unless set with SetFluid(...); the programs and 
+    // buffers are 0 unless there is a fluid
+    FluidSettings _fluidSettings;
+    unsigned int _fluidProgramIds[NUM_FLUID_SHADER_PASSES];
+    unsigned int _fluidGridBufferId;
+    unsigned int _fluidScanBufferId;
+    unsigned int _fluidPlaceBufferId;
+    unsigned int _fluidBodyBufferId;
+    unsigned int _fluidNumCells;
+    unsigned int _fluidNumScanBlocks;
+    unsigned int _unifLocFluidDeltaTimeSec;
+
+    // two sets of timestamps, used every other step, so that a set's results are only read 
+    // after the GPU has had a whole step to finish with it
+    unsigned int _fluidQueryIds[2][NUM_FLUID_TIMESTAMPS];
+    bool _isFluidQuerySetPending[2];
+    unsigned int _currentFluidQuerySet;
+    FluidPassTimes _fluidPassTimes;
+
+    // 0 (never sort) unless set with SetReorder(...); the programs and buffers are 0 unless 
+    // the particles are sorted
+    unsigned int _reorderStepsBetween;
+    unsigned int _reorderProgramIds[NUM_REORDER_SHADER_PASSES];
+    unsigned int _reorderPairBufferId;
+    unsigned int _reorderCountBufferId;
+    unsigned int _reorderHandleBufferId;
+    unsigned int _reorderParticleBufferId;
+    unsigned int _reorderExpiryBufferId;   // 0 unless some emitter uses lifetimes
+    unsigned int _reorderParticleBytes;
+    unsigned int _reorderNumTiles;
+    unsigned int _reorderNumScanBlocks;
+    unsigned int _reorderNumPasses;
+    unsigned int _reorderHandleSet;
+    unsigned int _unifLocReorderCountDigitShift;
+    unsigned int _unifLocReorderScatterDigitShift;
+    unsigned int _unifLocReorderHandleSet;
+
+    // 1 unless set with SetSubsteps(...)
+    unsigned int _numSubsteps;
+
+    // the live list that the last update wrote is _liveListBufferIds[_currentLiveList]
+    unsigned int _liveListBufferIds[2];
+    unsigned int _currentLiveList;
+    unsigned int _deadListBufferId;
+
+    // associated with the compute shaders
+    // Note: The emitters' centers, radii, and quotas used to be uniforms too, but they are in 
+    // the emitter table now, so only the time step is left.  The emit shader needs it too for 
+    // the lifetimes.
+    unsigned int _unifLocDeltaTimeSec;
+    unsigned int _unifLocStepIndex;
+    unsigned int _unifLocNumForceFields;
+    unsigned int _unifLocUseObstacles;
+    unsigned int _unifLocUseTurbulence;
+    unsigned int _unifLocResetVelocities;
+    unsigned int _unifLocEmitDeltaTimeSec;
+    unsigned int _unifLocEmitStepIndex;
+    unsigned int _unifLocEmitResetVelocities;
+    unsigned int _unifLocNumSubsteps;
+    unsigned int _unifLocEmitNumSubsteps;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Particle.h"
+#include "ParticleEmitter.h"
+#include "glm/vec2.hpp"
+
+#include <math.h>
+
+// the clock is wrapped to this before it goes down to a float (see SplitStatelessTime(...)), 
+// and every particle's life is cut down so that a whole number of them fit in it
+// Note: Must match PERIOD_SEC in shaderParticleStateless.vert.
+static const float STATELESS_PERIOD_SEC = 1024.0f;
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A float only has 24 bits, so the time since the particles were created can't go into one 
+    as it is.  After a day, the nearest floats are 1/128th of a second apart, which is most of 
+    a frame, and the particles visibly step.  Instead, the time is split in double precision 
+    into how many whole periods (STATELESS_PERIOD_SEC) have gone by and how far into the 
+    current one it is.  The time within the period never goes past 1024, so it stays good to 
+    a fraction of a millisecond no matter how long the program runs.
+Parameters:
+    timeSec         How long it has been since the particles were created.
+    periodIndex     Gets how many whole periods have gone by.
+    periodTimeSec   Gets how far into the current period it is.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline void SplitStatelessTime(double timeSec, unsigned int *periodIndex, float *periodTimeSec)
+{
+    double periods = floor(timeSec / STATELESS_PERIOD_SEC);
+    *periodIndex = (unsigned int)periods;
+    *periodTimeSec = (float)(timeSec - (periods * STATELESS_PERIOD_SEC));
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out where a "stateless" particle is at any time without keeping anything for it (see
+    ParticleManager::SetStateless(...)).  Without force fields or anything else to push them
+    around, the particles only move in straight lines from the emitter center until they leave
+    the circle, so where one is only depends on when it was last sent out and which way.  Both
+    of those come from hashes of the particle's index (see HashParticleIndex(...)), so nothing
+    needs to be stored and no update needs to run.
+
+    Each particle has its own speed on the emitter's range, which never changes.  From the
+    center, that speed takes it to the edge of the circle in (radius / speed) seconds, so that
+    is how long each of its lives (its "generations") lasts.  If the emitter gives its
+    particles a lifetime, and it is shorter, then that is how long they last instead.  Either
+    way, the particle is sent right back out when one life ends, just like a reset in
+    shaderParticle.comp, so nothing needs to check whether it went out of bounds.
+
+    Generation G starts at (G + phase) lives, where the phase is on [0,1) and also comes from
+    a hash of the index.  The particles therefore come out of the emitter spread out over
+    their first lives instead of all at once, which is what the emission quota does for the
+    simulated particles.  Before its first life starts, a particle is inactive.  The direction
+    of each life comes from a hash of the index and the generation, mixed the same way that
+    GetParticleEmitVelocity(...) mixes in the step.
+
+    The time comes in as a period and the time within it (see SplitStatelessTime(...)), and 
+    each life is shortened a little so that a whole number of them fit in a period.  Then the 
+    particle is at the same point in its life at the same time in every period, and only the 
+    time within the period needs to be a float.  The lives start over at the phase in each 
+    period, so until then, a particle is still on the last life of the period before.  The 
+    shortened life is never longer than the real one, so the particle still doesn't leave its 
+    emitter's circle.
+
+    Note: Must match shaderParticleStateless.vert, which does the same thing for drawing.
+    Also Note: Everything is in floats like the shader.  The time within the period and the 
+    lives in it are both good to about a millisecond, however long the program runs, as long 
+    as a life is longer than that.
+Parameters:
+    emitter         The particle's emitter.
+    emitterIndex    Self-explanatory.
+    particleIndex   Across all emitters, not within this one, so that each emitter's particles 
+                    hash differently.
+    periodIndex     See SplitStatelessTime(...).
+    periodTimeSec   See SplitStatelessTime(...).
+Returns:
+    The particle at that time.  Inactive ones are at the emitter center with no velocity.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline Particle GetStatelessParticle(const ParticleEmitter &emitter, unsigned int emitterIndex,
+    unsigned int particleIndex, unsigned int periodIndex, float periodTimeSec)
+{
+    // Note: The lifetime uses the plain hash of the index (see GetParticleLifetimeSec(...)),
+    // so the speed and the phase hash that again so that they aren't tied to it.
+    unsigned int speedHash = HashParticleIndex(HashParticleIndex(particleIndex));
+    unsigned int phaseHash = HashParticleIndex(speedHash);
+    float speed = emitter._minVelocity + ((float)(speedHash >> 8) * (1.0f / 16777216.0f) *
+        (emitter._maxVelocity - emitter._minVelocity));
+    float phase = (float)(phaseHash >> 8) * (1.0f / 16777216.0f);
+
+    // a particle that never moves never leaves, so keep its life long but finite
+    float lifeSec = emitter._radius / ((speed > 1e-6f) ? speed : 1e-6f);
+    if (emitter._maxLifetimeSec > 0.0f)
+    {
+        float lifetimeSec = GetParticleLifetimeSec(emitter, particleIndex);
+        lifeSec = (lifetimeSec > 0.0f && lifetimeSec < lifeSec) ? lifetimeSec : lifeSec;
+    }
+    float livesPerPeriod = ceilf(STATELESS_PERIOD_SEC / lifeSec);
+    lifeSec = STATELESS_PERIOD_SEC / livesPerPeriod;
+
+    Particle p = Particle();
+    p._position = glm::vec4(emitter._center, 0.0f, 0.0f);
+    p._emitterIndex = (int)emitterIndex;
+    float lives = (periodTimeSec / lifeSec) - phase;
+    if (lives < 0.0f)
+    {
+        if (periodIndex == 0)
+        {
+            return p;
+        }
+
+        // still on the last life of the period before
+        lives += livesPerPeriod;
+        periodIndex--;
+    }
+
+    // the generation counts up across periods so that each life still gets its own direction
+    float generation = floorf(lives);
+    float ageSec = (lives - generation) * lifeSec;
+    unsigned int generationIndex = (periodIndex * (unsigned int)livesPerPeriod) + 
+        (unsigned int)generation;
+    unsigned int angleHash = HashParticleIndex(particleIndex ^ (generationIndex * 0x9e3779b9));
+    float angle = (float)(angleHash >> 8) * (6.2831853f / 16777216.0f);
+    glm::vec2 velocity = glm::vec2(cosf(angle), sinf(angle)) * speed;
+    p._position = glm::vec4(emitter._center + (velocity * ageSec), 0.0f, 0.0f);
+    p._velocity = glm::vec4(velocity, 0.0f, 0.0f);
+    p._isActive = 1;
+    return p;
+}
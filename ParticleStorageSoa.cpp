@@ -0,0 +1,223 @@
+#include "ParticleStorageSoa.h"
+
+#include <xmmintrin.h>  // _mm_malloc(...) and _mm_free(...)
+#include <utility>      // std::swap(...)
+
+// AVX registers are 32 bytes, and loads are fastest when they don't straddle cache lines
+static const size_t SOA_ALIGNMENT_BYTES = 32;
+
+// pad each array to a whole number of AVX registers (8 floats)
+static const unsigned int SOA_PADDING_ITEMS = 8;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing is allocated until Resize(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleStorageSoa::ParticleStorageSoa() :
+    _positionX(0),
+    _positionY(0),
+    _velocityX(0),
+    _velocityY(0),
+    _isActive(0),
+    _numParticles(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Frees the arrays.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ParticleStorageSoa::~ParticleStorageSoa()
+{
+    this->Clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Frees any existing arrays and allocates new, zeroed, aligned ones that can hold the
+    requested number of particles.  The array length is rounded up to a multiple of 8 so that
+    the padding at the end never belongs to another allocation.
+Parameters:
+    numParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleStorageSoa::Resize(unsigned int numParticles)
+{
+    this->Clear();
+
+    size_t numItems = ((numParticles + SOA_PADDING_ITEMS - 1) / SOA_PADDING_ITEMS) *
+        SOA_PADDING_ITEMS;
+    size_t floatBytes = numItems * sizeof(float);
+    size_t intBytes = numItems * sizeof(int);
+    _positionX = (float *)_mm_malloc(floatBytes, SOA_ALIGNMENT_BYTES);
+    _positionY = (float *)_mm_malloc(floatBytes, SOA_ALIGNMENT_BYTES);
+    _velocityX = (float *)_mm_malloc(floatBytes, SOA_ALIGNMENT_BYTES);
+    _velocityY = (float *)_mm_malloc(floatBytes, SOA_ALIGNMENT_BYTES);
+    _isActive = (int *)_mm_malloc(intBytes, SOA_ALIGNMENT_BYTES);
+
+    for (size_t itemIndex = 0; itemIndex < numItems; itemIndex++)
+    {
+        _positionX[itemIndex] = 0.0f;
+        _positionY[itemIndex] = 0.0f;
+        _velocityX[itemIndex] = 0.0f;
+        _velocityY[itemIndex] = 0.0f;
+        _isActive[itemIndex] = 0;
+    }
+
+    _numParticles = numParticles;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Frees the arrays.  Safe to call more than once.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleStorageSoa::Clear()
+{
+    // _mm_free(...) ignores null like free(...) does
+    _mm_free(_positionX);
+    _mm_free(_positionY);
+    _mm_free(_velocityX);
+    _mm_free(_velocityY);
+    _mm_free(_isActive);
+    _positionX = 0;
+    _positionY = 0;
+    _velocityX = 0;
+    _velocityY = 0;
+    _isActive = 0;
+    _numParticles = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Re-sizes to match the provided collection and splits each particle's X and Y position and
+    velocity and its "is active" flag into the separate arrays.  The Z and W components are
+    always 0 in this 2D demo, so they are dropped.
+Parameters:
+    allParticles    Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleStorageSoa::CopyFrom(const std::vector<Particle> &allParticles)
+{
+    this->Resize(allParticles.size());
+    for (unsigned int particleIndex = 0; particleIndex < _numParticles; particleIndex++)
+    {
+        const Particle &p = allParticles[particleIndex];
+        _positionX[particleIndex] = p._position.x;
+        _positionY[particleIndex] = p._position.y;
+        _velocityX[particleIndex] = p._velocity.x;
+        _velocityY[particleIndex] = p._velocity.y;
+        _isActive[particleIndex] = p._isActive;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Writes the X and Y positions and the "is active" flags in the range [beginIndex, endIndex) 
+    back into the provided collection, which must be at least as large as this one.  Only these
+    are written because the update doesn't change anything else, and this is called every 
+    frame when the particles are drawn.  It takes a range so that it can be done right after 
+    updating a chunk, while the positions are still in the cache.
+
+    The velocities are only written if asked for because they only change when something 
+    pushes the particles around (force fields, gravity, collisions, obstacles, the fluid, or 
+    turbulence), and then the emitted particles get new ones too (see 
+    ParticleSimulatorCpu::ChangesVelocities()).
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to copy.
+    endIndex        One past the last particle to copy.
+    includeVelocities   If true, the X and Y velocities are written too.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleStorageSoa::CopyBackTo(std::vector<Particle> *allParticles,
+    unsigned int beginIndex, unsigned int endIndex, bool includeVelocities) const
+{
+    Particle *particles = allParticles->data();
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        particles[particleIndex]._position.x = _positionX[particleIndex];
+        particles[particleIndex]._position.y = _positionY[particleIndex];
+        particles[particleIndex]._isActive = _isActive[particleIndex];
+    }
+
+    if (includeVelocities)
+    {
+        for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+        {
+            particles[particleIndex]._velocity.x = _velocityX[particleIndex];
+            particles[particleIndex]._velocity.y = _velocityY[particleIndex];
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Copies particles from another SoA storage into the range [beginIndex, endIndex) of this 
+    one, in whatever order they are asked for.  This is how the particles are put in a new 
+    order (see ParticleReorder.h), a range at a time so that it can be split across threads.
+Parameters:
+    source          Must not be this one.
+    sourceIndices   Particle I here is copied from particle sourceIndices[I] in the source.
+    beginIndex      The first particle to copy into.
+    endIndex        One past the last.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleStorageSoa::GatherFrom(const ParticleStorageSoa &source, 
+    const unsigned int *sourceIndices, unsigned int beginIndex, unsigned int endIndex)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        unsigned int sourceIndex = sourceIndices[particleIndex];
+        _positionX[particleIndex] = source._positionX[sourceIndex];
+        _positionY[particleIndex] = source._positionY[sourceIndex];
+        _velocityX[particleIndex] = source._velocityX[sourceIndex];
+        _velocityY[particleIndex] = source._velocityY[sourceIndex];
+        _isActive[particleIndex] = source._isActive[sourceIndex];
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Trades arrays with another SoA storage.  Nothing is copied.
+Parameters:
+    other       Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ParticleStorageSoa::Swap(ParticleStorageSoa *other)
+{
+    std::swap(_positionX, other->_positionX);
+    std::swap(_positionY, other->_positionY);
+    std::swap(_velocityX, other->_velocityX);
+    std::swap(_velocityY, other->_velocityY);
+    std::swap(_isActive, other->_isActive);
+    std::swap(_numParticles, other->_numParticles);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the number of particles (not including the padding).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ParticleStorageSoa::Size() const
+{
+    return _numParticles;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Particle.h"
+
+#include <vector>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A "structure of arrays" version of the particle collection.  The Particle structure is 48
+    bytes because it has to match the compute shader's std430 layout, but the CPU update only
+    needs 2D position, 2D velocity, and the "is active" flag, which is 20 bytes.  Splitting
+    them into separate arrays also means that the SSE/AVX update kernels can load 4 or 8 X
+    values at once without shuffling.
+
+    The arrays are public so that the update kernels can get at them directly, in the same
+    spirit as the Particle structure.  Each array is aligned on a 32 byte boundary (AVX) and
+    is padded to a multiple of 8 items.
+-----------------------------------------------------------------------------------------------*/
+class ParticleStorageSoa
+{
+public:
+    ParticleStorageSoa();
+    ~ParticleStorageSoa();
+    void Resize(unsigned int numParticles);
+    void Clear();
+    void CopyFrom(const std::vector<Particle> &allParticles);
+    void CopyBackTo(std::vector<Particle> *allParticles, unsigned int beginIndex,
+        unsigned int endIndex, bool includeVelocities) const;
+    void GatherFrom(const ParticleStorageSoa &source, const unsigned int *sourceIndices, 
+        unsigned int beginIndex, unsigned int endIndex);
+    void Swap(ParticleStorageSoa *other);
+    unsigned int Size() const;
+
+    float *_positionX;
+    float *_positionY;
+    float *_velocityX;
+    float *_velocityY;
+    int *_isActive;
+
+private:
+    // each array is a separate aligned allocation, so copying would be a double delete
+    ParticleStorageSoa(const ParticleStorageSoa &) = delete;
+    ParticleStorageSoa &operator=(const ParticleStorageSoa &) = delete;
+
+    unsigned int _numParticles;
+};
@@ -0,0 +1,2087 @@
+#include "ParticleUpdateKernels.h"
+
+#include "glm/detail/func_geometric.hpp"    // glm::dot
+#include "glm/packing.hpp"                  // glm::packHalf2x16, glm::unpackHalf2x16
+
+#include <emmintrin.h>  // SSE2
+#include <immintrin.h>  // AVX2
+#include <ctype.h>      // tolower(...)
+
+#ifdef _MSC_VER
+#include <intrin.h>     // __cpuid(...) and _xgetbv(...)
+
+// Visual Studio will emit AVX2 intrinsics in any function
+#define TARGET_AVX2
+#else
+#include <cpuid.h>      // __cpuid_count(...)
+
+// gcc and clang refuse to emit AVX2 intrinsics unless the function (or the whole file) is 
+// allowed to use them
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Runs the CPUID instruction.  The two compilers spell it differently.
+Parameters:
+    leaf        The "function" to ask about (EAX).
+    subLeaf     Some functions have more than one page of results (ECX).
+    registers   EAX, EBX, ECX, and EDX, in that order, come back in here.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static void CpuId(unsigned int leaf, unsigned int subLeaf, unsigned int registers[4])
+{
+#ifdef _MSC_VER
+    int cpuInfo[4];
+    __cpuidex(cpuInfo, (int)leaf, (int)subLeaf);
+    for (int registerIndex = 0; registerIndex < 4; registerIndex++)
+    {
+        registers[registerIndex] = (unsigned int)cpuInfo[registerIndex];
+    }
+#else
+    __cpuid_count(leaf, subLeaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Reads the XCR0 register, which says which register sets the operating system saves during 
+    a context switch.  A CPU can have AVX, but if the OS doesn't save the upper halves of the 
+    YMM registers, then using them would corrupt other threads.
+Parameters: None
+Returns:
+    The lower 32 bits of XCR0.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static unsigned int ReadXcr0()
+{
+#ifdef _MSC_VER
+    return (unsigned int)_xgetbv(0);
+#else
+    unsigned int eax = 0;
+    unsigned int edx = 0;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return eax;
+#endif
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Asks the CPU (and the OS) which of the kernels' instruction sets can be used.
+Parameters: None
+Returns:
+    The fastest SimdLevel that is safe to use on this machine.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+SimdLevel DetectSimdLevel()
+{
+    unsigned int registers[4] = { 0, 0, 0, 0 };
+    CpuId(0, 0, registers);
+    unsigned int maxLeaf = registers[0];
+
+    CpuId(1, 0, registers);
+    bool hasSse2 = (registers[3] & (1 << 26)) != 0;
+    bool hasOsXsave = (registers[2] & (1 << 27)) != 0;
+    bool hasAvx = (registers[2] & (1 << 28)) != 0;
+    if (!hasSse2)
+    {
+        return SIMD_LEVEL_SCALAR;
+    }
+
+    // XCR0 bit 1 is SSE state and bit 2 is AVX state
+    bool osSavesAvx = hasOsXsave && ((ReadXcr0() & 0x6) == 0x6);
+    bool hasAvx2 = false;
+    if (maxLeaf >= 7)
+    {
+        CpuId(7, 0, registers);
+        hasAvx2 = (registers[1] & (1 << 5)) != 0;
+    }
+
+    if (hasAvx && hasAvx2 && osSavesAvx)
+    {
+        return SIMD_LEVEL_AVX2;
+    }
+    return SIMD_LEVEL_SSE2;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    For printouts.
+Parameters:
+    simdLevel   Self-explanatory.
+Returns:
+    A string literal.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const char *SimdLevelName(SimdLevel simdLevel)
+{
+    switch (simdLevel)
+    {
+    case SIMD_LEVEL_SSE2: return "SSE2";
+    case SIMD_LEVEL_AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The reverse of SimdLevelName(...).  Upper and lower case are the same, so the command line 
+    can take "sse2" for "SSE2".
+Parameters:
+    name        Self-explanatory.
+    simdLevel   Gets the matching level.  Left alone if the name doesn't match any of them.
+Returns:
+    True if the name matched, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool GetSimdLevelByName(const char *name, SimdLevel *simdLevel)
+{
+    for (int level = SIMD_LEVEL_SCALAR; level <= SIMD_LEVEL_AVX2; level++)
+    {
+        const char *levelName = SimdLevelName((SimdLevel)level);
+        unsigned int charIndex = 0;
+        while (name[charIndex] != 0 && 
+            tolower(name[charIndex]) == tolower(levelName[charIndex]))
+        {
+            charIndex++;
+        }
+        if (name[charIndex] == 0 && levelName[charIndex] == 0)
+        {
+            *simdLevel = (SimdLevel)level;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the compact ParticlePacked kernel for the given instruction set.  There is no AVX2
+    version because the particles have to be gathered out of their 12 byte structures one 
+    field at a time, and that, not the math, is what takes the time.
+Parameters:
+    simdLevel   Should be no higher than DetectSimdLevel().
+Returns:
+    A function pointer.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+PackedUpdateKernel GetPackedUpdateKernel(SimdLevel simdLevel)
+{
+    if (simdLevel >= SIMD_LEVEL_SSE2)
+    {
+        return UpdateParticlesPackedSse;
+    }
+    return UpdateParticlesPacked;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the "structure of arrays" force field kernel for the given instruction set.  There is 
+    no SSE2 version because it would need the same 8-wide mask handling for half the width.
+Parameters:
+    simdLevel   Should be no higher than DetectSimdLevel().
+Returns:
+    A function pointer.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+SoaForceFieldKernel GetSoaForceFieldKernel(SimdLevel simdLevel)
+{
+    if (simdLevel >= SIMD_LEVEL_AVX2)
+    {
+        return ApplyForceFieldsSoaAvx2;
+    }
+    return ApplyForceFieldsSoa;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Moves a single particle from the "array of structures" storage.  This is the original CPU 
+    update, and the SIMD kernel uses it for the leftover particles at the end of a range and 
+    for any particles that need the emission quota.
+
+    Like the compute shader, an inactive particle doesn't move.  It waits at the center until 
+    the quota lets it go.  A particle that goes out of bounds goes back to the center and is 
+    sent right back out if the quota allows it, or else it is turned off.  Without TestBounds, 
+    the particle is only moved, whether it is on or off, and the quota isn't used.
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    p               Self-explanatory.
+    index           Which particle p is, for the quota.
+    deltaTimeSec    Self-explanatory.
+    emitterCenter   The center as a vec4 (Z and W are 0) like the compute shader uses.
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static inline void UpdateOneParticleAos(Particle &p, unsigned int index, 
+    float deltaTimeSec, const glm::vec4 &emitterCenter, float radiusSqr, EmissionQuota *quota)
+{
+    if (TestBounds && p._isActive == 0)
+    {
+        if (quota->TryEmit(index))
+        {
+            p._position = emitterCenter;
+            p._isActive = 1;
+        }
+        return;
+    }
+
+    // update position
+    p._position = p._position + (p._velocity * deltaTimeSec);
+    if (!TestBounds)
+    {
+        return;
+    }
+
+    // if it went out of bounds, restart it
+    glm::vec4 distToCenter = p._position - emitterCenter;
+    float distSqr = glm::dot(distToCenter, distToCenter);
+    if (distSqr > radiusSqr)
+    {
+        // just a simple reset for now
+        p._position = emitterCenter;
+        if (!quota->TryEmit(index))
+        {
+            p._isActive = 0;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Moves a single particle from the "structure of arrays" storage.  The SIMD kernels use this
+    for the leftover particles at the beginning and end of a range that don't fill a whole
+    register and for any particles that need the emission quota.  Emission and TestBounds work 
+    the same as in UpdateOneParticleAos(...).
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    allParticles    Self-explanatory.
+    index           Which particle.
+    deltaTimeSec    Self-explanatory.
+    center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static inline void UpdateOneParticleSoa(ParticleStorageSoa *allParticles, unsigned int index,
+    float deltaTimeSec, const glm::vec2 &center, float radiusSqr, EmissionQuota *quota)
+{
+    if (TestBounds && allParticles->_isActive[index] == 0)
+    {
+        if (quota->TryEmit(index))
+        {
+            allParticles->_positionX[index] = center.x;
+            allParticles->_positionY[index] = center.y;
+            allParticles->_isActive[index] = 1;
+        }
+        return;
+    }
+
+    float x = allParticles->_positionX[index] + (allParticles->_velocityX[index] * deltaTimeSec);
+    float y = allParticles->_positionY[index] + (allParticles->_velocityY[index] * deltaTimeSec);
+    float distX = x - center.x;
+    float distY = y - center.y;
+    if (TestBounds && ((distX * distX) + (distY * distY)) > radiusSqr)
+    {
+        x = center.x;
+        y = center.y;
+        if (!quota->TryEmit(index))
+        {
+            allParticles->_isActive[index] = 0;
+        }
+    }
+    allParticles->_positionX[index] = x;
+    allParticles->_positionY[index] = y;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Moves a single compact particle.  The math is done in the 24 bit fixed point units of the
+    packed position (see ParticlePacked.h), which floats hold exactly, so the center drops out: 
+    a particle is out of bounds when it is more than PACKED_POSITION_MAX from 0, and a reset 
+    particle goes back to 0.
+
+    Rounding is half away from zero (like glm::round(...)) so that the SSE kernel, which does
+    its own rounding, gets the same answer.
+
+    Emission works the same as in UpdateOneParticleAos(...).
+Parameters:
+    p               Self-explanatory.
+    index           Which particle p is, for the quota.
+    velocityToSteps Multiply the window coords velocity by this to get how many fixed point 
+                    steps the particle moves this update.
+    maxDistSqr      PACKED_POSITION_MAX squared, as a float.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline void UpdateOneParticlePacked(ParticlePacked &p, unsigned int index, 
+    float velocityToSteps, float maxDistSqr, EmissionQuota *quota)
+{
+    if ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) == 0)
+    {
+        if (quota->TryEmit(index))
+        {
+            SetPackedPosition(&p, 0, 0);
+            p._lowBitsAndFlags |= PACKED_IS_ACTIVE_FLAG;
+        }
+        return;
+    }
+
+    int fixedX = 0;
+    int fixedY = 0;
+    GetPackedPosition(p, &fixedX, &fixedY);
+    glm::vec2 velocity = glm::unpackHalf2x16(p._velocity);
+    float x = (float)fixedX + (velocity.x * velocityToSteps);
+    float y = (float)fixedY + (velocity.y * velocityToSteps);
+    if (((x * x) + (y * y)) > maxDistSqr)
+    {
+        x = 0.0f;
+        y = 0.0f;
+        if (!quota->TryEmit(index))
+        {
+            p._lowBitsAndFlags &= ~PACKED_IS_ACTIVE_FLAG;
+        }
+    }
+
+    int roundedX = (int)((x < 0.0f) ? (x - 0.5f) : (x + 0.5f));
+    int roundedY = (int)((y < 0.0f) ? (y - 0.5f) : (y + 0.5f));
+    SetPackedPosition(&p, roundedX, roundedY);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Converts 4 16 bit floats, one in the bottom of each 32 bit lane, into 4 32 bit floats.  SSE2
+    doesn't have an instruction for this (that came with F16C), so shift the exponent and 
+    mantissa into place and multiply by 2^(127 - 15) to fix the exponent bias.  The multiply 
+    also turns 16 bit denormals into normal 32 bit floats.  Infinity and NaN don't come out 
+    right, but the velocity is never either one.
+Parameters:
+    halves      Self-explanatory.  The upper 16 bits of each lane must be 0.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline __m128 HalfToFloatSse(__m128i halves)
+{
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x8000)), 16);
+    __m128i magnitude = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x7fff)), 13);
+    __m128 biasFix = _mm_castsi128_ps(_mm_set1_epi32(0x77800000));     // 2^112
+    __m128 value = _mm_mul_ps(_mm_castsi128_ps(magnitude), biasFix);
+    return _mm_or_ps(value, _mm_castsi128_ps(sign));
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Loads 4 compact particles (48 bytes, or 3 registers) and sorts their fields out so that 
+    each register holds one field from all 4.  Going through _mm_set_epi32(...) instead makes 
+    some compilers build the registers on the stack, which costs more than the whole update.
+
+    The loads look like this (P = position, V = velocity, L = low bits):
+        a = P0 V0 L0 P1
+        b = V1 L1 P2 V2
+        c = L2 P3 V3 L3
+Parameters:
+    p           A pointer to the first of the 4 particles.
+    position    Self-explanatory.
+    velocity    Self-explanatory.
+    lowBits     Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline void GatherPackedSse(const ParticlePacked *p, __m128i *position, 
+    __m128i *velocity, __m128i *lowBits)
+{
+    __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)p));
+    __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)p + 1));
+    __m128 c = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)p + 2));
+
+    // Note: _mm_shuffle_ps(x, y, ...) takes its lower 2 lanes from x and its upper 2 from y.
+    __m128 p2p3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+    *position = _mm_castps_si128(_mm_shuffle_ps(a, p2p3, _MM_SHUFFLE(2, 0, 3, 0)));
+
+    __m128 v0v1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+    __m128 v2v3 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+    *velocity = _mm_castps_si128(_mm_shuffle_ps(v0v1, v2v3, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    __m128 l0l1 = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+    __m128 l2l3 = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0));
+    *lowBits = _mm_castps_si128(_mm_shuffle_ps(l0l1, l2l3, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The reverse of GatherPackedSse(...).  Each output register is put together from two 
+    shuffles that each have the needed values in lanes 0 and 2.
+Parameters:
+    p           A pointer to the first of the 4 particles.
+    position    Self-explanatory.
+    velocity    Self-explanatory.
+    lowBits     Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline void ScatterPackedSse(ParticlePacked *p, __m128i position, __m128i velocity, 
+    __m128i lowBits)
+{
+    __m128 pos = _mm_castsi128_ps(position);
+    __m128 vel = _mm_castsi128_ps(velocity);
+    __m128 low = _mm_castsi128_ps(lowBits);
+
+    // a = P0 V0 L0 P1
+    __m128 p0v0 = _mm_shuffle_ps(pos, vel, _MM_SHUFFLE(0, 0, 0, 0));
+    __m128 l0p1 = _mm_shuffle_ps(low, pos, _MM_SHUFFLE(1, 1, 0, 0));
+    __m128 a = _mm_shuffle_ps(p0v0, l0p1, _MM_SHUFFLE(2, 0, 2, 0));
+
+    // b = V1 L1 P2 V2
+    __m128 v1l1 = _mm_shuffle_ps(vel, low, _MM_SHUFFLE(1, 1, 1, 1));
+    __m128 p2v2 = _mm_shuffle_ps(pos, vel, _MM_SHUFFLE(2, 2, 2, 2));
+    __m128 b = _mm_shuffle_ps(v1l1, p2v2, _MM_SHUFFLE(2, 0, 2, 0));
+
+    // c = L2 P3 V3 L3
+    __m128 l2p3 = _mm_shuffle_ps(low, pos, _MM_SHUFFLE(3, 3, 2, 2));
+    __m128 v3l3 = _mm_shuffle_ps(vel, low, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 c = _mm_shuffle_ps(l2p3, v3l3, _MM_SHUFFLE(2, 0, 2, 0));
+
+    _mm_storeu_si128((__m128i *)p, _mm_castps_si128(a));
+    _mm_storeu_si128((__m128i *)p + 1, _mm_castps_si128(b));
+    _mm_storeu_si128((__m128i *)p + 2, _mm_castps_si128(c));
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The original CPU update over the Particle structure, with no SIMD.  Works on the full 
+    glm::vec4 just like the compute shader so that the results are the same.
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    allParticles    A pointer to the first particle of the collection.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static void UpdateParticlesAos(Particle *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radiusSqr, 
+    EmissionQuota *quota)
+{
+    // the shader works with a vec4 center, so do the same to get the same results
+    glm::vec4 emitterCenter(center, 0.0f, 0.0f);
+
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticleAos<TestBounds>(allParticles[particleIndex], particleIndex, 
+            deltaTimeSec, emitterCenter, radiusSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The "array of structures" update with SSE2, 4 particles at a time.  Each particle's 
+    position and velocity are loaded whole and then transposed so that one register holds the 
+    4 Xs and another the 4 Ys, and from there it is the same as the "structure of arrays" 
+    kernel: one multiply and one add for each coordinate and 4 bounds tests at once.  The new 
+    positions are interleaved again and only their X and Y are stored.
+
+    Note: Z and W are left alone.  They are 0 in every particle's position and velocity (see 
+    ParticleManager), so the scalar kernel's full glm::vec4 math leaves them at 0 too, and its 
+    dot product comes out the same as X*X + Y*Y.
+
+    Emission is handled like it is in UpdateParticlesSoaSse(...): a group with an inactive or 
+    out of bounds particle is done one at a time if the quota isn't used up yet, and otherwise
+    the out of bounds particles go back to the center and are turned off and the inactive ones 
+    are left where they were.  Without TestBounds, every group is just moved and stored, and 
+    the active flags aren't even looked at.
+
+    Note: Loads are unaligned because the particle collection's allocator only guarantees 8 
+    byte alignment in 32bit builds.
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    allParticles    A pointer to the first particle of the collection.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static void UpdateParticlesAosSse(Particle *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radiusSqr, 
+    EmissionQuota *quota)
+{
+    glm::vec4 emitterCenter(center, 0.0f, 0.0f);
+    __m128 dt = _mm_set1_ps(deltaTimeSec);
+    __m128 centerX = _mm_set1_ps(center.x);
+    __m128 centerY = _mm_set1_ps(center.y);
+    __m128 radSqr = _mm_set1_ps(radiusSqr);
+    __m128i zero = _mm_setzero_si128();
+
+    unsigned int particleIndex = beginIndex;
+    for (; (particleIndex + 4) <= endIndex; particleIndex += 4)
+    {
+        Particle *p = allParticles + particleIndex;
+
+        // [x0 x1 y0 y1] and [x2 x3 y2 y3], then the low and high halves of both
+        __m128 pos01 = _mm_unpacklo_ps(_mm_loadu_ps(&p[0]._position.x), 
+            _mm_loadu_ps(&p[1]._position.x));
+        __m128 pos23 = _mm_unpacklo_ps(_mm_loadu_ps(&p[2]._position.x), 
+            _mm_loadu_ps(&p[3]._position.x));
+        __m128 vel01 = _mm_unpacklo_ps(_mm_loadu_ps(&p[0]._velocity.x), 
+            _mm_loadu_ps(&p[1]._velocity.x));
+        __m128 vel23 = _mm_unpacklo_ps(_mm_loadu_ps(&p[2]._velocity.x), 
+            _mm_loadu_ps(&p[3]._velocity.x));
+        __m128 oldX = _mm_movelh_ps(pos01, pos23);
+        __m128 oldY = _mm_movehl_ps(pos23, pos01);
+        __m128 x = _mm_add_ps(oldX, _mm_mul_ps(_mm_movelh_ps(vel01, vel23), dt));
+        __m128 y = _mm_add_ps(oldY, _mm_mul_ps(_mm_movehl_ps(vel23, vel01), dt));
+        if (TestBounds)
+        {
+            __m128 distX = _mm_sub_ps(x, centerX);
+            __m128 distY = _mm_sub_ps(y, centerY);
+            __m128 distSqr = _mm_add_ps(_mm_mul_ps(distX, distX), _mm_mul_ps(distY, distY));
+
+            // all 1s in the lanes that went out of bounds or are waiting to be emitted
+            __m128 outOfBounds = _mm_cmpgt_ps(distSqr, radSqr);
+            __m128i active = _mm_set_epi32(p[3]._isActive, p[2]._isActive, p[1]._isActive, 
+                p[0]._isActive);
+            __m128 inactive = _mm_castsi128_ps(_mm_cmpeq_epi32(active, zero));
+            if (_mm_movemask_ps(_mm_or_ps(outOfBounds, inactive)) != 0)
+            {
+                if (!quota->IsUsedUp())
+                {
+                    // nothing has been stored yet, so start over from the particles as they were
+                    for (int groupIndex = 0; groupIndex < 4; groupIndex++)
+                    {
+                        UpdateOneParticleAos<TestBounds>(p[groupIndex], 
+                            particleIndex + groupIndex, deltaTimeSec, emitterCenter, radiusSqr, 
+                            quota);
+                    }
+                    continue;
+                }
+
+                // Note: SSE2 doesn't have a blend instruction, so use (mask & a) | (~mask & b).
+                x = _mm_or_ps(_mm_and_ps(outOfBounds, centerX), _mm_andnot_ps(outOfBounds, x));
+                y = _mm_or_ps(_mm_and_ps(outOfBounds, centerY), _mm_andnot_ps(outOfBounds, y));
+                x = _mm_or_ps(_mm_and_ps(inactive, oldX), _mm_andnot_ps(inactive, x));
+                y = _mm_or_ps(_mm_and_ps(inactive, oldY), _mm_andnot_ps(inactive, y));
+                int outOfBoundsBits = _mm_movemask_ps(outOfBounds);
+                for (int groupIndex = 0; groupIndex < 4; groupIndex++)
+                {
+                    if ((outOfBoundsBits >> groupIndex) & 1)
+                    {
+                        p[groupIndex]._isActive = 0;
+                    }
+                }
+            }
+        }
+
+        // [x0 y0 x1 y1] and [x2 y2 x3 y3], stored 2 floats at a time
+        __m128 xy01 = _mm_unpacklo_ps(x, y);
+        __m128 xy23 = _mm_unpackhi_ps(x, y);
+        _mm_storel_pi((__m64 *)&p[0]._position.x, xy01);
+        _mm_storeh_pi((__m64 *)&p[1]._position.x, xy01);
+        _mm_storel_pi((__m64 *)&p[2]._position.x, xy23);
+        _mm_storeh_pi((__m64 *)&p[3]._position.x, xy23);
+    }
+
+    for (; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticleAos<TestBounds>(allParticles[particleIndex], particleIndex, 
+            deltaTimeSec, emitterCenter, radiusSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Same as the SSE version, but 8 particles at a time.  Particles 0-3 go in the low half of 
+    each register and 4-7 in the high half, because AVX's unpacks and shuffles stay within 
+    each half.  TestBounds and emission work the same way too, except that AVX has a blend 
+    instruction.
+
+    Note: The emission mask needs the AVX2 integer compare, but everything else is plain AVX.  
+    FMA is deliberately not used so that the results match the other kernels exactly.
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    allParticles    A pointer to the first particle of the collection.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static TARGET_AVX2 void UpdateParticlesAosAvx2(Particle *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radiusSqr, 
+    EmissionQuota *quota)
+{
+    glm::vec4 emitterCenter(center, 0.0f, 0.0f);
+    __m256 dt = _mm256_set1_ps(deltaTimeSec);
+    __m256 centerX = _mm256_set1_ps(center.x);
+    __m256 centerY = _mm256_set1_ps(center.y);
+    __m256 radSqr = _mm256_set1_ps(radiusSqr);
+    __m256i zero = _mm256_setzero_si256();
+
+    unsigned int particleIndex = beginIndex;
+    for (; (particleIndex + 8) <= endIndex; particleIndex += 8)
+    {
+        Particle *p = allParticles + particleIndex;
+
+        // rows[n] is particle n's vector in the low half and particle n+4's in the high half
+        __m256 posRows[4];
+        __m256 velRows[4];
+        for (int row = 0; row < 4; row++)
+        {
+            posRows[row] = _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(&p[row]._position.x)), 
+                _mm_loadu_ps(&p[row + 4]._position.x), 1);
+            velRows[row] = _mm256_insertf128_ps(
+                _mm256_castps128_ps256(_mm_loadu_ps(&p[row]._velocity.x)), 
+                _mm_loadu_ps(&p[row + 4]._velocity.x), 1);
+        }
+
+        // [x0 x1 y0 y1 | x4 x5 y4 y5] and [x2 x3 y2 y3 | x6 x7 y6 y7], then pick the Xs and Ys
+        __m256 pos01 = _mm256_unpacklo_ps(posRows[0], posRows[1]);
+        __m256 pos23 = _mm256_unpacklo_ps(posRows[2], posRows[3]);
+        __m256 vel01 = _mm256_unpacklo_ps(velRows[0], velRows[1]);
+        __m256 vel23 = _mm256_unpacklo_ps(velRows[2], velRows[3]);
+        __m256 oldX = _mm256_shuffle_ps(pos01, pos23, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 oldY = _mm256_shuffle_ps(pos01, pos23, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 velX = _mm256_shuffle_ps(vel01, vel23, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 velY = _mm256_shuffle_ps(vel01, vel23, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 x = _mm256_add_ps(oldX, _mm256_mul_ps(velX, dt));
+        __m256 y = _mm256_add_ps(oldY, _mm256_mul_ps(velY, dt));
+        if (TestBounds)
+        {
+            __m256 distX = _mm256_sub_ps(x, centerX);
+            __m256 distY = _mm256_sub_ps(y, centerY);
+            __m256 distSqr = _mm256_add_ps(_mm256_mul_ps(distX, distX), 
+                _mm256_mul_ps(distY, distY));
+
+            // the lanes are in the same order as the particles that went into them
+            __m256 outOfBounds = _mm256_cmp_ps(distSqr, radSqr, _CMP_GT_OQ);
+            __m256i active = _mm256_set_epi32(p[7]._isActive, p[6]._isActive, 
+                p[5]._isActive, p[4]._isActive, p[3]._isActive, p[2]._isActive, 
+                p[1]._isActive, p[0]._isActive);
+            __m256 inactive = _mm256_castsi256_ps(_mm256_cmpeq_epi32(active, zero));
+            if (_mm256_movemask_ps(_mm256_or_ps(outOfBounds, inactive)) != 0)
+            {
+                if (!quota->IsUsedUp())
+                {
+                    for (int groupIndex = 0; groupIndex < 8; groupIndex++)
+                    {
+                        UpdateOneParticleAos<TestBounds>(p[groupIndex], 
+                            particleIndex + groupIndex, deltaTimeSec, emitterCenter, radiusSqr, 
+                            quota);
+                    }
+                    continue;
+                }
+
+                // blendv takes the second argument in the lanes where the mask's sign bit is set
+                x = _mm256_blendv_ps(x, centerX, outOfBounds);
+                y = _mm256_blendv_ps(y, centerY, outOfBounds);
+                x = _mm256_blendv_ps(x, oldX, inactive);
+                y = _mm256_blendv_ps(y, oldY, inactive);
+                int outOfBoundsBits = _mm256_movemask_ps(outOfBounds);
+                for (int groupIndex = 0; groupIndex < 8; groupIndex++)
+                {
+                    if ((outOfBoundsBits >> groupIndex) & 1)
+                    {
+                        p[groupIndex]._isActive = 0;
+                    }
+                }
+            }
+        }
+
+        // [x0 y0 x1 y1 | x4 y4 x5 y5] and [x2 y2 x3 y3 | x6 y6 x7 y7]
+        __m256 xy01 = _mm256_unpacklo_ps(x, y);
+        __m256 xy23 = _mm256_unpackhi_ps(x, y);
+        __m128 xy01Low = _mm256_castps256_ps128(xy01);
+        __m128 xy23Low = _mm256_castps256_ps128(xy23);
+        __m128 xy01High = _mm256_extractf128_ps(xy01, 1);
+        __m128 xy23High = _mm256_extractf128_ps(xy23, 1);
+        _mm_storel_pi((__m64 *)&p[0]._position.x, xy01Low);
+        _mm_storeh_pi((__m64 *)&p[1]._position.x, xy01Low);
+        _mm_storel_pi((__m64 *)&p[2]._position.x, xy23Low);
+        _mm_storeh_pi((__m64 *)&p[3]._position.x, xy23Low);
+        _mm_storel_pi((__m64 *)&p[4]._position.x, xy01High);
+        _mm_storeh_pi((__m64 *)&p[5]._position.x, xy01High);
+        _mm_storel_pi((__m64 *)&p[6]._position.x, xy23High);
+        _mm_storeh_pi((__m64 *)&p[7]._position.x, xy23High);
+    }
+
+    for (; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticleAos<TestBounds>(allParticles[particleIndex], particleIndex, 
+            deltaTimeSec, emitterCenter, radiusSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The plain C++ version of the "structure of arrays" update.  Mostly useful for checking the
+    SIMD versions, though the compiler may vectorize it on its own.
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static void UpdateParticlesSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radiusSqr, 
+    EmissionQuota *quota)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticleSoa<TestBounds>(allParticles, particleIndex, deltaTimeSec, center, 
+            radiusSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Updates 4 particles at a time with SSE2.  The "is it out of bounds?" branch is replaced by
+    a comparison mask that selects between the new position and the emitter center.
+
+    Particles before the first 16 byte boundary and after the last one are done one at a time
+    so that the loads in the middle can be aligned.
+
+    Emission is handled like it is in UpdateParticlesAosSse(...): a group with an inactive or 
+    out of bounds particle is done one at a time if the quota isn't used up yet, and otherwise
+    the out of bounds particles are turned off and the inactive ones are masked out.  Without 
+    TestBounds, every group is just moved and stored, and the active flags aren't even loaded.
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static void UpdateParticlesSoaSse(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radiusSqr, 
+    EmissionQuota *quota)
+{
+    unsigned int particleIndex = beginIndex;
+    while (particleIndex < endIndex && (particleIndex % 4) != 0)
+    {
+        UpdateOneParticleSoa<TestBounds>(allParticles, particleIndex, deltaTimeSec, center, 
+            radiusSqr, quota);
+        particleIndex++;
+    }
+
+    float *posX = allParticles->_positionX;
+    float *posY = allParticles->_positionY;
+    const float *velX = allParticles->_velocityX;
+    const float *velY = allParticles->_velocityY;
+    __m128 dt = _mm_set1_ps(deltaTimeSec);
+    __m128 centerX = _mm_set1_ps(center.x);
+    __m128 centerY = _mm_set1_ps(center.y);
+    int *isActive = allParticles->_isActive;
+    __m128 radSqr = _mm_set1_ps(radiusSqr);
+    __m128i zero = _mm_setzero_si128();
+    for (; (particleIndex + 4) <= endIndex; particleIndex += 4)
+    {
+        __m128 oldX = _mm_load_ps(posX + particleIndex);
+        __m128 oldY = _mm_load_ps(posY + particleIndex);
+        __m128 x = _mm_add_ps(oldX, _mm_mul_ps(_mm_load_ps(velX + particleIndex), dt));
+        __m128 y = _mm_add_ps(oldY, _mm_mul_ps(_mm_load_ps(velY + particleIndex), dt));
+        if (!TestBounds)
+        {
+            _mm_store_ps(posX + particleIndex, x);
+            _mm_store_ps(posY + particleIndex, y);
+            continue;
+        }
+        __m128 distX = _mm_sub_ps(x, centerX);
+        __m128 distY = _mm_sub_ps(y, centerY);
+        __m128 distSqr = _mm_add_ps(_mm_mul_ps(distX, distX), _mm_mul_ps(distY, distY));
+
+        // all 1s in the lanes that went out of bounds or are waiting to be emitted
+        __m128 outOfBounds = _mm_cmpgt_ps(distSqr, radSqr);
+        __m128i active = _mm_load_si128((const __m128i *)(isActive + particleIndex));
+        __m128 inactive = _mm_castsi128_ps(_mm_cmpeq_epi32(active, zero));
+        if (_mm_movemask_ps(_mm_or_ps(outOfBounds, inactive)) != 0)
+        {
+            if (!quota->IsUsedUp())
+            {
+                for (unsigned int groupIndex = 0; groupIndex < 4; groupIndex++)
+                {
+                    UpdateOneParticleSoa<TestBounds>(allParticles, particleIndex + groupIndex, 
+                        deltaTimeSec, center, radiusSqr, quota);
+                }
+                continue;
+            }
+
+            // Note: SSE2 doesn't have a blend instruction, so use (mask & a) | (~mask & b).
+            x = _mm_or_ps(_mm_and_ps(outOfBounds, centerX), _mm_andnot_ps(outOfBounds, x));
+            y = _mm_or_ps(_mm_and_ps(outOfBounds, centerY), _mm_andnot_ps(outOfBounds, y));
+            x = _mm_or_ps(_mm_and_ps(inactive, oldX), _mm_andnot_ps(inactive, x));
+            y = _mm_or_ps(_mm_and_ps(inactive, oldY), _mm_andnot_ps(inactive, y));
+            active = _mm_andnot_si128(_mm_castps_si128(outOfBounds), active);
+            _mm_store_si128((__m128i *)(isActive + particleIndex), active);
+        }
+        _mm_store_ps(posX + particleIndex, x);
+        _mm_store_ps(posY + particleIndex, y);
+    }
+
+    for (; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticleSoa<TestBounds>(allParticles, particleIndex, deltaTimeSec, center, 
+            radiusSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Same as the SSE version, but 8 particles at a time, and AVX has a blend instruction.  
+    TestBounds works the same way too.
+
+    Note: The emission mask needs the AVX2 integer compare, but everything else is plain AVX.
+    AVX2 CPUs are also the ones with the full-speed 256bit units.  FMA is deliberately not used so that the 
+    results match the other kernels (and the compute shader) exactly.
+Parameters:
+    TestBounds      See ParticleUpdateKernels.h.
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    center          A 2D vector in window coordinates (X and Y bounded by [-1,+1]).
+    radiusSqr       In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <bool TestBounds>
+static TARGET_AVX2 void UpdateParticlesSoaAvx2(ParticleStorageSoa *allParticles, 
+    unsigned int beginIndex, unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, 
+    float radiusSqr, EmissionQuota *quota)
+{
+    unsigned int particleIndex = beginIndex;
+    while (particleIndex < endIndex && (particleIndex % 8) != 0)
+    {
+        UpdateOneParticleSoa<TestBounds>(allParticles, particleIndex, deltaTimeSec, center, 
+            radiusSqr, quota);
+        particleIndex++;
+    }
+
+    float *posX = allParticles->_positionX;
+    float *posY = allParticles->_positionY;
+    const float *velX = allParticles->_velocityX;
+    const float *velY = allParticles->_velocityY;
+    __m256 dt = _mm256_set1_ps(deltaTimeSec);
+    __m256 centerX = _mm256_set1_ps(center.x);
+    __m256 centerY = _mm256_set1_ps(center.y);
+    int *isActive = allParticles->_isActive;
+    __m256 radSqr = _mm256_set1_ps(radiusSqr);
+    __m256i zero = _mm256_setzero_si256();
+    for (; (particleIndex + 8) <= endIndex; particleIndex += 8)
+    {
+        __m256 oldX = _mm256_load_ps(posX + particleIndex);
+        __m256 oldY = _mm256_load_ps(posY + particleIndex);
+        __m256 x = _mm256_add_ps(oldX, _mm256_mul_ps(_mm256_load_ps(velX + particleIndex), dt));
+        __m256 y = _mm256_add_ps(oldY, _mm256_mul_ps(_mm256_load_ps(velY + particleIndex), dt));
+        if (!TestBounds)
+        {
+            _mm256_store_ps(posX + particleIndex, x);
+            _mm256_store_ps(posY + particleIndex, y);
+            continue;
+        }
+        __m256 distX = _mm256_sub_ps(x, centerX);
+        __m256 distY = _mm256_sub_ps(y, centerY);
+        __m256 distSqr = _mm256_add_ps(_mm256_mul_ps(distX, distX), _mm256_mul_ps(distY, distY));
+
+        __m256 outOfBounds = _mm256_cmp_ps(distSqr, radSqr, _CMP_GT_OQ);
+        __m256i active = _mm256_load_si256((const __m256i *)(isActive + particleIndex));
+        __m256 inactive = _mm256_castsi256_ps(_mm256_cmpeq_epi32(active, zero));
+        if (_mm256_movemask_ps(_mm256_or_ps(outOfBounds, inactive)) != 0)
+        {
+            if (!quota->IsUsedUp())
+            {
+                for (unsigned int groupIndex = 0; groupIndex < 8; groupIndex++)
+                {
+                    UpdateOneParticleSoa<TestBounds>(allParticles, particleIndex + groupIndex, 
+                        deltaTimeSec, center, radiusSqr, quota);
+                }
+                continue;
+            }
+
+            // blendv takes the second argument in the lanes where the mask's sign bit is set
+            x = _mm256_blendv_ps(x, centerX, outOfBounds);
+            y = _mm256_blendv_ps(y, centerY, outOfBounds);
+            x = _mm256_blendv_ps(x, oldX, inactive);
+            y = _mm256_blendv_ps(y, oldY, inactive);
+            active = _mm256_andnot_si256(_mm256_castps_si256(outOfBounds), active);
+            _mm256_store_si256((__m256i *)(isActive + particleIndex), active);
+        }
+        _mm256_store_ps(posX + particleIndex, x);
+        _mm256_store_ps(posY + particleIndex, y);
+    }
+
+    for (; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticleSoa<TestBounds>(allParticles, particleIndex, deltaTimeSec, center, 
+            radiusSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the "array of structures" kernel for the given instruction set.
+Parameters:
+    simdLevel   Should be no higher than DetectSimdLevel().
+    testBounds  False if something else takes care of the particles that leave their circles 
+                (see ParticleUpdateKernels.h).
+Returns:
+    A function pointer.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+AosUpdateKernel GetAosUpdateKernel(SimdLevel simdLevel, bool testBounds)
+{
+    if (simdLevel >= SIMD_LEVEL_AVX2)
+    {
+        return testBounds ? UpdateParticlesAosAvx2<true> : UpdateParticlesAosAvx2<false>;
+    }
+    else if (simdLevel >= SIMD_LEVEL_SSE2)
+    {
+        return testBounds ? UpdateParticlesAosSse<true> : UpdateParticlesAosSse<false>;
+    }
+    return testBounds ? UpdateParticlesAos<true> : UpdateParticlesAos<false>;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the "structure of arrays" kernel for the given instruction set.
+Parameters:
+    simdLevel   Should be no higher than DetectSimdLevel().
+    testBounds  See GetAosUpdateKernel(...).
+Returns:
+    A function pointer.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+SoaUpdateKernel GetSoaUpdateKernel(SimdLevel simdLevel, bool testBounds)
+{
+    if (simdLevel >= SIMD_LEVEL_AVX2)
+    {
+        return testBounds ? UpdateParticlesSoaAvx2<true> : UpdateParticlesSoaAvx2<false>;
+    }
+    else if (simdLevel >= SIMD_LEVEL_SSE2)
+    {
+        return testBounds ? UpdateParticlesSoaSse<true> : UpdateParticlesSoaSse<false>;
+    }
+    return testBounds ? UpdateParticlesSoa<true> : UpdateParticlesSoa<false>;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The plain C++ version of the compact ParticlePacked update.  It unpacks each particle, 
+    moves it, and packs it back in, so only 12 bytes per particle go to and from memory.
+Parameters:
+    allParticles    A pointer to the first particle of the collection.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    radius          In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void UpdateParticlesPacked(ParticlePacked *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, float radius, EmissionQuota *quota)
+{
+    float velocityToSteps = deltaTimeSec * ((float)PACKED_POSITION_MAX / radius);
+    float maxDistSqr = (float)PACKED_POSITION_MAX * (float)PACKED_POSITION_MAX;
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticlePacked(allParticles[particleIndex], particleIndex, velocityToSteps, 
+            maxDistSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Updates 4 compact particles at a time with SSE2.  Each field is gathered from the 4 
+    structures into one register, the 16 bit halves and 8 bit corrections are sign-extended 
+    with shifts, and everything after that is the same as the "structure of arrays" kernel, 
+    only in fixed point steps.  Then the fields are split back up and scattered.
+
+    Emission is handled like it is in UpdateParticlesAosSse(...).
+Parameters:
+    allParticles    A pointer to the first particle of the collection.
+    beginIndex      The first particle to update.
+    endIndex        One past the last particle to update.
+    deltaTimeSec    Self-explanatory.
+    radius          In window coords.
+    quota           This frame's emission quota.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void UpdateParticlesPackedSse(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, float radius, EmissionQuota *quota)
+{
+    float velocityToSteps = deltaTimeSec * ((float)PACKED_POSITION_MAX / radius);
+    float maxDistSqr = (float)PACKED_POSITION_MAX * (float)PACKED_POSITION_MAX;
+    __m128 velToSteps = _mm_set1_ps(velocityToSteps);
+    __m128 maxDist = _mm_set1_ps(maxDistSqr);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 signBit = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+    __m128i lowHalf = _mm_set1_epi32(0x0000ffff);
+    __m128i lowByte = _mm_set1_epi32(0x000000ff);
+    __m128i roundingOffset = _mm_set1_epi32(128);
+    __m128i activeFlag = _mm_set1_epi32(PACKED_IS_ACTIVE_FLAG);
+
+    unsigned int particleIndex = beginIndex;
+    for (; (particleIndex + 4) <= endIndex; particleIndex += 4)
+    {
+        ParticlePacked *p = allParticles + particleIndex;
+        __m128i position;
+        __m128i velocity;
+        __m128i lowBits;
+        GatherPackedSse(p, &position, &velocity, &lowBits);
+
+        // shift each piece to the top of the lane and then arithmetic shift it back down to 
+        // sign-extend it
+        __m128i highX = _mm_srai_epi32(_mm_slli_epi32(position, 16), 16);
+        __m128i highY = _mm_srai_epi32(position, 16);
+        __m128i lowX = _mm_srai_epi32(_mm_slli_epi32(lowBits, 24), 24);
+        __m128i lowY = _mm_srai_epi32(_mm_slli_epi32(lowBits, 16), 24);
+        __m128 oldX = _mm_cvtepi32_ps(_mm_add_epi32(_mm_slli_epi32(highX, 8), lowX));
+        __m128 oldY = _mm_cvtepi32_ps(_mm_add_epi32(_mm_slli_epi32(highY, 8), lowY));
+
+        __m128 velX = HalfToFloatSse(_mm_and_si128(velocity, lowHalf));
+        __m128 velY = HalfToFloatSse(_mm_srli_epi32(velocity, 16));
+        __m128 x = _mm_add_ps(oldX, _mm_mul_ps(velX, velToSteps));
+        __m128 y = _mm_add_ps(oldY, _mm_mul_ps(velY, velToSteps));
+
+        __m128 distSqr = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+        __m128 outOfBounds = _mm_cmpgt_ps(distSqr, maxDist);
+        __m128 inactive = _mm_castsi128_ps(
+            _mm_cmpeq_epi32(_mm_and_si128(lowBits, activeFlag), _mm_setzero_si128()));
+        if (_mm_movemask_ps(_mm_or_ps(outOfBounds, inactive)) != 0)
+        {
+            if (!quota->IsUsedUp())
+            {
+                for (int groupIndex = 0; groupIndex < 4; groupIndex++)
+                {
+                    UpdateOneParticlePacked(p[groupIndex], particleIndex + groupIndex, 
+                        velocityToSteps, maxDistSqr, quota);
+                }
+                continue;
+            }
+
+            // the center is 0, so out of bounds particles just get zeroed, and inactive 
+            // particles go back to where they were (which are whole steps, so they round to 
+            // themselves)
+            x = _mm_andnot_ps(outOfBounds, x);
+            y = _mm_andnot_ps(outOfBounds, y);
+            x = _mm_or_ps(_mm_and_ps(inactive, oldX), _mm_andnot_ps(inactive, x));
+            y = _mm_or_ps(_mm_and_ps(inactive, oldY), _mm_andnot_ps(inactive, y));
+            lowBits = _mm_andnot_si128(
+                _mm_and_si128(_mm_castps_si128(outOfBounds), activeFlag), lowBits);
+        }
+
+        // round half away from zero: add 0.5 with the value's sign and truncate
+        __m128i fixedX = _mm_cvttps_epi32(_mm_add_ps(x, _mm_or_ps(half, _mm_and_ps(x, signBit))));
+        __m128i fixedY = _mm_cvttps_epi32(_mm_add_ps(y, _mm_or_ps(half, _mm_and_ps(y, signBit))));
+
+        // same split as SetPackedPosition(...)
+        highX = _mm_srai_epi32(_mm_add_epi32(fixedX, roundingOffset), 8);
+        highY = _mm_srai_epi32(_mm_add_epi32(fixedY, roundingOffset), 8);
+        lowX = _mm_sub_epi32(fixedX, _mm_slli_epi32(highX, 8));
+        lowY = _mm_sub_epi32(fixedY, _mm_slli_epi32(highY, 8));
+        position = _mm_or_si128(_mm_and_si128(highX, lowHalf), _mm_slli_epi32(highY, 16));
+        lowBits = _mm_or_si128(_mm_andnot_si128(lowHalf, lowBits), 
+            _mm_or_si128(_mm_and_si128(lowX, lowByte), 
+            _mm_slli_epi32(_mm_and_si128(lowY, lowByte), 8)));
+
+        ScatterPackedSse(p, position, velocity, lowBits);
+    }
+
+    for (; particleIndex < endIndex; particleIndex++)
+    {
+        UpdateOneParticlePacked(allParticles[particleIndex], particleIndex, velocityToSteps, 
+            maxDistSqr, quota);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Changes one "structure of arrays" particle's velocity by the force fields.  The SIMD 
+    kernel uses it for the leftover particles at the ends of a range.
+Parameters:
+    allParticles    Self-explanatory.
+    index           Which particle.
+    deltaTimeSec    Self-explanatory.
+    forceFields     The table.
+    numForceFields  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline void ApplyForceFieldsOneSoa(ParticleStorageSoa *allParticles, unsigned int index,
+    float deltaTimeSec, const ForceField *forceFields, unsigned int numForceFields)
+{
+    if (allParticles->_isActive[index] == 0)
+    {
+        return;
+    }
+
+    glm::vec2 position(allParticles->_positionX[index], allParticles->_positionY[index]);
+    glm::vec2 velocity(allParticles->_velocityX[index], allParticles->_velocityY[index]);
+    velocity += GetForceFieldAcceleration(forceFields, numForceFields, position, velocity) * 
+        deltaTimeSec;
+    allParticles->_velocityX[index] = velocity.x;
+    allParticles->_velocityY[index] = velocity.y;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The force field pass for the "array of structures" storage.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    forceFields     The table.
+    numForceFields  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyForceFieldsAos(Particle *allParticles, unsigned int beginIndex, unsigned int endIndex,
+    float deltaTimeSec, const ForceField *forceFields, unsigned int numForceFields)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        Particle &p = allParticles[particleIndex];
+        if (p._isActive == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 position(p._position.x, p._position.y);
+        glm::vec2 velocity(p._velocity.x, p._velocity.y);
+        velocity += GetForceFieldAcceleration(forceFields, numForceFields, position, velocity) * 
+            deltaTimeSec;
+        p._velocity.x = velocity.x;
+        p._velocity.y = velocity.y;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The force field pass for the "structure of arrays" storage, one particle at a time.  The 
+    compiler may vectorize it on its own if there is only one kind of field.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    forceFields     The table.
+    numForceFields  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyForceFieldsSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const ForceField *forceFields,
+    unsigned int numForceFields)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        ApplyForceFieldsOneSoa(allParticles, particleIndex, deltaTimeSec, forceFields, 
+            numForceFields);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Pushes 8 particles at a time with AVX.  The fields are the outer loop's body: every lane 
+    goes through every field, and the field's type is the same for all 8 lanes, so the only 
+    branch is on the type.  Inactive lanes are worked out anyway and then blended back to their 
+    old velocities.
+
+    Note: The math is done in the same order as GetForceFieldAcceleration(...), without FMA, so 
+    that the results match the scalar kernel exactly.  AVX's square root and division are 
+    correctly rounded, just like the scalar ones.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    forceFields     The table.
+    numForceFields  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+TARGET_AVX2 void ApplyForceFieldsSoaAvx2(ParticleStorageSoa *allParticles, 
+    unsigned int beginIndex, unsigned int endIndex, float deltaTimeSec, 
+    const ForceField *forceFields, unsigned int numForceFields)
+{
+    unsigned int particleIndex = beginIndex;
+    while (particleIndex < endIndex && (particleIndex % 8) != 0)
+    {
+        ApplyForceFieldsOneSoa(allParticles, particleIndex, deltaTimeSec, forceFields, 
+            numForceFields);
+        particleIndex++;
+    }
+
+    const float *posX = allParticles->_positionX;
+    const float *posY = allParticles->_positionY;
+    float *velX = allParticles->_velocityX;
+    float *velY = allParticles->_velocityY;
+    const int *isActive = allParticles->_isActive;
+    __m256 dt = _mm256_set1_ps(deltaTimeSec);
+    __m256i zero = _mm256_setzero_si256();
+    for (; (particleIndex + 8) <= endIndex; particleIndex += 8)
+    {
+        __m256i active = _mm256_load_si256((const __m256i *)(isActive + particleIndex));
+        __m256 inactive = _mm256_castsi256_ps(_mm256_cmpeq_epi32(active, zero));
+        if (_mm256_movemask_ps(inactive) == 0xff)
+        {
+            continue;
+        }
+
+        __m256 x = _mm256_load_ps(posX + particleIndex);
+        __m256 y = _mm256_load_ps(posY + particleIndex);
+        __m256 oldVelX = _mm256_load_ps(velX + particleIndex);
+        __m256 oldVelY = _mm256_load_ps(velY + particleIndex);
+        __m256 accelX = _mm256_setzero_ps();
+        __m256 accelY = _mm256_setzero_ps();
+        for (unsigned int fieldIndex = 0; fieldIndex < numForceFields; fieldIndex++)
+        {
+            const ForceField &field = forceFields[fieldIndex];
+            __m256 strength = _mm256_set1_ps(field._strength);
+            if (field._type == FORCE_FIELD_DRAG)
+            {
+                accelX = _mm256_sub_ps(accelX, _mm256_mul_ps(oldVelX, strength));
+                accelY = _mm256_sub_ps(accelY, _mm256_mul_ps(oldVelY, strength));
+            }
+            else if (field._type == FORCE_FIELD_WIND)
+            {
+                accelX = _mm256_add_ps(accelX, _mm256_set1_ps(field._direction.x * field._strength));
+                accelY = _mm256_add_ps(accelY, _mm256_set1_ps(field._direction.y * field._strength));
+            }
+            else
+            {
+                __m256 toFieldX = _mm256_sub_ps(_mm256_set1_ps(field._position.x), x);
+                __m256 toFieldY = _mm256_sub_ps(_mm256_set1_ps(field._position.y), y);
+                __m256 distSqr = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(toFieldX, toFieldX), _mm256_mul_ps(toFieldY, toFieldY)),
+                    _mm256_set1_ps(field._radius * field._radius));
+                if (field._type == FORCE_FIELD_ATTRACTOR)
+                {
+                    __m256 scale = _mm256_div_ps(strength, 
+                        _mm256_mul_ps(distSqr, _mm256_sqrt_ps(distSqr)));
+                    accelX = _mm256_add_ps(accelX, _mm256_mul_ps(toFieldX, scale));
+                    accelY = _mm256_add_ps(accelY, _mm256_mul_ps(toFieldY, scale));
+                }
+                else
+                {
+                    // (y, -x) * scale, and negating after the multiply is the same thing
+                    __m256 scale = _mm256_div_ps(strength, distSqr);
+                    accelX = _mm256_add_ps(accelX, _mm256_mul_ps(toFieldY, scale));
+                    accelY = _mm256_sub_ps(accelY, _mm256_mul_ps(toFieldX, scale));
+                }
+            }
+        }
+
+        __m256 newVelX = _mm256_add_ps(oldVelX, _mm256_mul_ps(accelX, dt));
+        __m256 newVelY = _mm256_add_ps(oldVelY, _mm256_mul_ps(accelY, dt));
+        _mm256_store_ps(velX + particleIndex, _mm256_blendv_ps(newVelX, oldVelX, inactive));
+        _mm256_store_ps(velY + particleIndex, _mm256_blendv_ps(newVelY, oldVelY, inactive));
+    }
+
+    for (; particleIndex < endIndex; particleIndex++)
+    {
+        ApplyForceFieldsOneSoa(allParticles, particleIndex, deltaTimeSec, forceFields, 
+            numForceFields);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The force field pass for the compact format.  The fields are in window coords, so each 
+    particle's position is turned back into window coords first, and its velocity is unpacked 
+    from and repacked into 16 bit floats.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    center          The particles' emitter's center, in window coords.
+    radius          The particles' emitter's radius, in window coords.
+    forceFields     The table.
+    numForceFields  Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyForceFieldsPacked(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radius,
+    const ForceField *forceFields, unsigned int numForceFields)
+{
+    float stepsToWindow = radius / (float)PACKED_POSITION_MAX;
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        ParticlePacked &p = allParticles[particleIndex];
+        if ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) == 0)
+        {
+            continue;
+        }
+
+        int fixedX = 0;
+        int fixedY = 0;
+        GetPackedPosition(p, &fixedX, &fixedY);
+        glm::vec2 position = center + (glm::vec2((float)fixedX, (float)fixedY) * stepsToWindow);
+        glm::vec2 velocity = glm::unpackHalf2x16(p._velocity);
+        velocity += GetForceFieldAcceleration(forceFields, numForceFields, position, velocity) * 
+            deltaTimeSec;
+        p._velocity = glm::packHalf2x16(velocity);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The acceleration pass for the "array of structures" storage.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    accelerations   One for every particle in the collection, not just the range.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyAccelerationsAos(Particle *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        Particle &p = allParticles[particleIndex];
+        if (p._isActive == 0)
+        {
+            continue;
+        }
+
+        p._velocity.x += accelerations[particleIndex].x * deltaTimeSec;
+        p._velocity.y += accelerations[particleIndex].y * deltaTimeSec;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The acceleration pass for the "structure of arrays" storage.  There is no SIMD version 
+    because it is only a multiply and an add, and the time goes to working out the 
+    accelerations.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    accelerations   One for every particle in the collection, not just the range.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyAccelerationsSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        if (allParticles->_isActive[particleIndex] == 0)
+        {
+            continue;
+        }
+
+        allParticles->_velocityX[particleIndex] += accelerations[particleIndex].x * deltaTimeSec;
+        allParticles->_velocityY[particleIndex] += accelerations[particleIndex].y * deltaTimeSec;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The acceleration pass for the compact format.  The velocity is unpacked from and repacked 
+    into 16 bit floats.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    accelerations   One for every particle in the collection, not just the range.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyAccelerationsPacked(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        ParticlePacked &p = allParticles[particleIndex];
+        if ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 velocity = glm::unpackHalf2x16(p._velocity);
+        velocity += accelerations[particleIndex] * deltaTimeSec;
+        p._velocity = glm::packHalf2x16(velocity);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The integrate pass for the "array of structures" storage, for one integrator.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to move.
+    endIndex        One past the last particle to move.
+    deltaTimeSec    Self-explanatory.
+    accelerations   One for every particle in the collection, not just the range.  May be 0.
+    forceFields     The table.
+    numForceFields  Self-explanatory.  May be 0.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <typename Integrator>
+static void IntegrateParticlesAos(Particle *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations, 
+    const ForceField *forceFields, unsigned int numForceFields)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        Particle &p = allParticles[particleIndex];
+        if (p._isActive == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 heldAcceleration = (accelerations != 0) ? 
+            accelerations[particleIndex] : glm::vec2(0.0f, 0.0f);
+        glm::vec2 position(p._position.x, p._position.y);
+        glm::vec2 velocity(p._velocity.x, p._velocity.y);
+        Integrator::Step(&position, &velocity, deltaTimeSec, 
+            [heldAcceleration, forceFields, numForceFields](const glm::vec2 &stagePosition, 
+            const glm::vec2 &stageVelocity)
+        {
+            return heldAcceleration + GetForceFieldAcceleration(forceFields, numForceFields, 
+                stagePosition, stageVelocity);
+        });
+        p._position.x = position.x;
+        p._position.y = position.y;
+        p._velocity.x = velocity.x;
+        p._velocity.y = velocity.y;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The integrate pass for the "structure of arrays" storage, for one integrator.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to move.
+    endIndex        One past the last particle to move.
+    deltaTimeSec    Self-explanatory.
+    accelerations   One for every particle in the collection, not just the range.  May be 0.
+    forceFields     The table.
+    numForceFields  Self-explanatory.  May be 0.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <typename Integrator>
+static void IntegrateParticlesSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations, 
+    const ForceField *forceFields, unsigned int numForceFields)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        if (allParticles->_isActive[particleIndex] == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 heldAcceleration = (accelerations != 0) ? 
+            accelerations[particleIndex] : glm::vec2(0.0f, 0.0f);
+        glm::vec2 position(allParticles->_positionX[particleIndex], 
+            allParticles->_positionY[particleIndex]);
+        glm::vec2 velocity(allParticles->_velocityX[particleIndex], 
+            allParticles->_velocityY[particleIndex]);
+        Integrator::Step(&position, &velocity, deltaTimeSec, 
+            [heldAcceleration, forceFields, numForceFields](const glm::vec2 &stagePosition, 
+            const glm::vec2 &stageVelocity)
+        {
+            return heldAcceleration + GetForceFieldAcceleration(forceFields, numForceFields, 
+                stagePosition, stageVelocity);
+        });
+        allParticles->_positionX[particleIndex] = position.x;
+        allParticles->_positionY[particleIndex] = position.y;
+        allParticles->_velocityX[particleIndex] = velocity.x;
+        allParticles->_velocityY[particleIndex] = velocity.y;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Four "structure of arrays" particles' positions (or velocities, or accelerations), one 
+    particle in each lane, so that the integrator policies can carry 4 particles forward with 
+    the same code that they use for one (see ParticleIntegrator.h).  Only the operators that 
+    the policies use are here.  Each is the same float math as glm's, lane by lane, so the 
+    results match the scalar kernel exactly.
+
+    Note: This is SSE2 instead of AVX2 because the policies are templates that aren't 
+    compiled for AVX2, and gcc and clang won't inline AVX2 code into them (see TARGET_AVX2), 
+    so every operator would be a function call.  Every x64 CPU has SSE2.
+-----------------------------------------------------------------------------------------------*/
+struct Vec2Sse
+{
+    __m128 _x;
+    __m128 _y;
+};
+
+static inline Vec2Sse operator+(const Vec2Sse &left, const Vec2Sse &right)
+{
+    Vec2Sse sum = { _mm_add_ps(left._x, right._x), _mm_add_ps(left._y, right._y) };
+    return sum;
+}
+
+static inline Vec2Sse &operator+=(Vec2Sse &left, const Vec2Sse &right)
+{
+    left = left + right;
+    return left;
+}
+
+static inline Vec2Sse operator*(const Vec2Sse &vec, float scale)
+{
+    __m128 scales = _mm_set1_ps(scale);
+    Vec2Sse product = { _mm_mul_ps(vec._x, scales), _mm_mul_ps(vec._y, scales) };
+    return product;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    GetForceFieldAcceleration(...) for 4 particles at once.  Like ApplyForceFieldsSoaAvx2(...), 
+    the fields are the outer loop, so the only branch is on each field's type, and the math 
+    is done in the same order as the scalar version so that the results match it exactly.
+Parameters:
+    forceFields     The table.
+    numForceFields  Self-explanatory.
+    position        The particles' positions in window coords.
+    velocity        The particles' velocities in window coords.
+Returns:
+    The accelerations in window coords per second per second.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static inline Vec2Sse GetForceFieldAccelerationSse(const ForceField *forceFields,
+    unsigned int numForceFields, const Vec2Sse &position, const Vec2Sse &velocity)
+{
+    __m128 accelX = _mm_setzero_ps();
+    __m128 accelY = _mm_setzero_ps();
+    for (unsigned int fieldIndex = 0; fieldIndex < numForceFields; fieldIndex++)
+    {
+        const ForceField &field = forceFields[fieldIndex];
+        __m128 strength = _mm_set1_ps(field._strength);
+        if (field._type == FORCE_FIELD_DRAG)
+        {
+            accelX = _mm_sub_ps(accelX, _mm_mul_ps(velocity._x, strength));
+            accelY = _mm_sub_ps(accelY, _mm_mul_ps(velocity._y, strength));
+        }
+        else if (field._type == FORCE_FIELD_WIND)
+        {
+            accelX = _mm_add_ps(accelX, _mm_set1_ps(field._direction.x * field._strength));
+            accelY = _mm_add_ps(accelY, _mm_set1_ps(field._direction.y * field._strength));
+        }
+        else
+        {
+            __m128 toFieldX = _mm_sub_ps(_mm_set1_ps(field._position.x), position._x);
+            __m128 toFieldY = _mm_sub_ps(_mm_set1_ps(field._position.y), position._y);
+            __m128 distSqr = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(toFieldX, toFieldX), _mm_mul_ps(toFieldY, toFieldY)),
+                _mm_set1_ps(field._radius * field._radius));
+            if (field._type == FORCE_FIELD_ATTRACTOR)
+            {
+                __m128 scale = _mm_div_ps(strength, _mm_mul_ps(distSqr, _mm_sqrt_ps(distSqr)));
+                accelX = _mm_add_ps(accelX, _mm_mul_ps(toFieldX, scale));
+                accelY = _mm_add_ps(accelY, _mm_mul_ps(toFieldY, scale));
+            }
+            else
+            {
+                // (y, -x) * scale, and negating after the multiply is the same thing
+                __m128 scale = _mm_div_ps(strength, distSqr);
+                accelX = _mm_add_ps(accelX, _mm_mul_ps(toFieldY, scale));
+                accelY = _mm_sub_ps(accelY, _mm_mul_ps(toFieldX, scale));
+            }
+        }
+    }
+
+    Vec2Sse acceleration = { accelX, accelY };
+    return acceleration;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The integrate pass for the "structure of arrays" storage, for one integrator, 4 particles 
+    at a time with SSE2.  Inactive lanes are carried forward anyway and then blended back to 
+    where they were, and a group with no active particles is skipped.  The particles before 
+    the first group and after the last one go through the scalar kernel.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to move.
+    endIndex        One past the last particle to move.
+    deltaTimeSec    Self-explanatory.
+    accelerations   One for every particle in the collection, not just the range.  May be 0.
+    forceFields     The table.
+    numForceFields  Self-explanatory.  May be 0.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <typename Integrator>
+static void IntegrateParticlesSoaSse(ParticleStorageSoa *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations, 
+    const ForceField *forceFields, unsigned int numForceFields)
+{
+    unsigned int particleIndex = beginIndex;
+    while (particleIndex < endIndex && (particleIndex % 4) != 0)
+    {
+        particleIndex++;
+    }
+    IntegrateParticlesSoa<Integrator>(allParticles, beginIndex, particleIndex, deltaTimeSec, 
+        accelerations, forceFields, numForceFields);
+
+    float *posX = allParticles->_positionX;
+    float *posY = allParticles->_positionY;
+    float *velX = allParticles->_velocityX;
+    float *velY = allParticles->_velocityY;
+    const int *isActive = allParticles->_isActive;
+    __m128i zero = _mm_setzero_si128();
+    for (; (particleIndex + 4) <= endIndex; particleIndex += 4)
+    {
+        __m128i active = _mm_load_si128((const __m128i *)(isActive + particleIndex));
+        __m128 inactive = _mm_castsi128_ps(_mm_cmpeq_epi32(active, zero));
+        if (_mm_movemask_ps(inactive) == 0xf)
+        {
+            continue;
+        }
+
+        Vec2Sse heldAcceleration = { _mm_setzero_ps(), _mm_setzero_ps() };
+        if (accelerations != 0)
+        {
+            // 4 vec2s in a row are X0 Y0 X1 Y1 and X2 Y2 X3 Y3, so take the evens and odds
+            const float *pairs = &accelerations[particleIndex].x;
+            __m128 first = _mm_loadu_ps(pairs);
+            __m128 second = _mm_loadu_ps(pairs + 4);
+            heldAcceleration._x = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+            heldAcceleration._y = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+        }
+
+        Vec2Sse oldPosition = { _mm_load_ps(posX + particleIndex), 
+            _mm_load_ps(posY + particleIndex) };
+        Vec2Sse oldVelocity = { _mm_load_ps(velX + particleIndex), 
+            _mm_load_ps(velY + particleIndex) };
+        Vec2Sse position = oldPosition;
+        Vec2Sse velocity = oldVelocity;
+        Integrator::Step(&position, &velocity, deltaTimeSec, 
+            [&heldAcceleration, forceFields, numForceFields](const Vec2Sse &stagePosition, 
+            const Vec2Sse &stageVelocity)
+        {
+            return heldAcceleration + GetForceFieldAccelerationSse(forceFields, numForceFields, 
+                stagePosition, stageVelocity);
+        });
+
+        // Note: SSE2 doesn't have a blend instruction, so use (mask & a) | (~mask & b).
+        _mm_store_ps(posX + particleIndex, _mm_or_ps(_mm_and_ps(inactive, oldPosition._x), 
+            _mm_andnot_ps(inactive, position._x)));
+        _mm_store_ps(posY + particleIndex, _mm_or_ps(_mm_and_ps(inactive, oldPosition._y), 
+            _mm_andnot_ps(inactive, position._y)));
+        _mm_store_ps(velX + particleIndex, _mm_or_ps(_mm_and_ps(inactive, oldVelocity._x), 
+            _mm_andnot_ps(inactive, velocity._x)));
+        _mm_store_ps(velY + particleIndex, _mm_or_ps(_mm_and_ps(inactive, oldVelocity._y), 
+            _mm_andnot_ps(inactive, velocity._y)));
+    }
+
+    IntegrateParticlesSoa<Integrator>(allParticles, particleIndex, endIndex, deltaTimeSec, 
+        accelerations, forceFields, numForceFields);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The integrate pass for the compact format, for one integrator.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to move.
+    endIndex        One past the last particle to move.
+    deltaTimeSec    Self-explanatory.
+    center          The emitter's center in window coords.
+    radius          The emitter's radius in window coords.
+    accelerations   One for every particle in the collection, not just the range.  May be 0.
+    forceFields     The table.
+    numForceFields  Self-explanatory.  May be 0.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+template <typename Integrator>
+static void IntegrateParticlesPacked(ParticlePacked *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radius, 
+    const glm::vec2 *accelerations, const ForceField *forceFields, unsigned int numForceFields)
+{
+    float maxFixed = (float)PACKED_POSITION_MAX;
+    float stepsToWindow = radius / maxFixed;
+    float windowToSteps = maxFixed / radius;
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        ParticlePacked &p = allParticles[particleIndex];
+        if ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 heldAcceleration = (accelerations != 0) ? 
+            accelerations[particleIndex] : glm::vec2(0.0f, 0.0f);
+        int fixedX = 0;
+        int fixedY = 0;
+        GetPackedPosition(p, &fixedX, &fixedY);
+        glm::vec2 position = center + (glm::vec2((float)fixedX, (float)fixedY) * stepsToWindow);
+        glm::vec2 velocity = glm::unpackHalf2x16(p._velocity);
+        Integrator::Step(&position, &velocity, deltaTimeSec, 
+            [heldAcceleration, forceFields, numForceFields](const glm::vec2 &stagePosition, 
+            const glm::vec2 &stageVelocity)
+        {
+            return heldAcceleration + GetForceFieldAcceleration(forceFields, numForceFields, 
+                stagePosition, stageVelocity);
+        });
+
+        glm::vec2 fixed = (position - center) * windowToSteps;
+        if (glm::dot(fixed, fixed) > (maxFixed * maxFixed))
+        {
+            fixed.x = (fixed.x < 0.0f) ? -maxFixed : maxFixed;
+            fixed.y = (fixed.y < 0.0f) ? -maxFixed : maxFixed;
+        }
+        int roundedX = (int)((fixed.x < 0.0f) ? (fixed.x - 0.5f) : (fixed.x + 0.5f));
+        int roundedY = (int)((fixed.y < 0.0f) ? (fixed.y - 0.5f) : (fixed.y + 0.5f));
+        SetPackedPosition(&p, roundedX, roundedY);
+        p._velocity = glm::packHalf2x16(velocity);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the "array of structures" integrate kernel for the given integrator.
+Parameters:
+    integrator  Self-explanatory.
+Returns:
+    A function pointer.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+AosIntegrateKernel GetAosIntegrateKernel(IntegratorType integrator)
+{
+    switch (integrator)
+    {
+    case INTEGRATOR_EULER: return IntegrateParticlesAos<IntegratorEuler>;
+    case INTEGRATOR_VERLET: return IntegrateParticlesAos<IntegratorVerlet>;
+    case INTEGRATOR_RK4: return IntegrateParticlesAos<IntegratorRk4>;
+    default: return IntegrateParticlesAos<IntegratorSemiImplicitEuler>;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the "structure of arrays" integrate kernel for the given integrator and instruction 
+    set.  There is no AVX2 version (see Vec2Sse), so AVX2 gets the SSE2 one.
+Parameters:
+    integrator  Self-explanatory.
+    simdLevel   Should be no higher than DetectSimdLevel().
+Returns:
+    A function pointer.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+SoaIntegrateKernel GetSoaIntegrateKernel(IntegratorType integrator, SimdLevel simdLevel)
+{
+    if (simdLevel >= SIMD_LEVEL_SSE2)
+    {
+        switch (integrator)
+        {
+        case INTEGRATOR_EULER: return IntegrateParticlesSoaSse<IntegratorEuler>;
+        case INTEGRATOR_VERLET: return IntegrateParticlesSoaSse<IntegratorVerlet>;
+        case INTEGRATOR_RK4: return IntegrateParticlesSoaSse<IntegratorRk4>;
+        default: return IntegrateParticlesSoaSse<IntegratorSemiImplicitEuler>;
+        }
+    }
+
+    switch (integrator)
+    {
+    case INTEGRATOR_EULER: return IntegrateParticlesSoa<IntegratorEuler>;
+    case INTEGRATOR_VERLET: return IntegrateParticlesSoa<IntegratorVerlet>;
+    case INTEGRATOR_RK4: return IntegrateParticlesSoa<IntegratorRk4>;
+    default: return IntegrateParticlesSoa<IntegratorSemiImplicitEuler>;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Picks the compact format's integrate kernel for the given integrator.
+Parameters:
+    integrator  Self-explanatory.
+Returns:
+    A function pointer.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+PackedIntegrateKernel GetPackedIntegrateKernel(IntegratorType integrator)
+{
+    switch (integrator)
+    {
+    case INTEGRATOR_EULER: return IntegrateParticlesPacked<IntegratorEuler>;
+    case INTEGRATOR_VERLET: return IntegrateParticlesPacked<IntegratorVerlet>;
+    case INTEGRATOR_RK4: return IntegrateParticlesPacked<IntegratorRk4>;
+    default: return IntegrateParticlesPacked<IntegratorSemiImplicitEuler>;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The obstacle pass for the "array of structures" storage.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to check.
+    endIndex        One past the last particle to check.
+    header          See ObstacleFieldHeader.
+    samples         Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyObstaclesAos(Particle *allParticles, unsigned int beginIndex, unsigned int endIndex, 
+    const ObstacleFieldHeader &header, const float *samples)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        Particle &p = allParticles[particleIndex];
+        if (p._isActive == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 position(p._position.x, p._position.y);
+        glm::vec2 velocity(p._velocity.x, p._velocity.y);
+        if (CollideWithObstacles(header, samples, &position, &velocity))
+        {
+            p._position.x = position.x;
+            p._position.y = position.y;
+            p._velocity.x = velocity.x;
+            p._velocity.y = velocity.y;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The obstacle pass for the "structure of arrays" storage.  There is no SIMD version because 
+    the 4 samples around each particle are somewhere different for every particle, and the 
+    lookups are most of the work.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to check.
+    endIndex        One past the last particle to check.
+    header          See ObstacleFieldHeader.
+    samples         Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyObstaclesSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, const ObstacleFieldHeader &header, const float *samples)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        if (allParticles->_isActive[particleIndex] == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 position(allParticles->_positionX[particleIndex], 
+            allParticles->_positionY[particleIndex]);
+        glm::vec2 velocity(allParticles->_velocityX[particleIndex], 
+            allParticles->_velocityY[particleIndex]);
+        if (CollideWithObstacles(header, samples, &position, &velocity))
+        {
+            allParticles->_positionX[particleIndex] = position.x;
+            allParticles->_positionY[particleIndex] = position.y;
+            allParticles->_velocityX[particleIndex] = velocity.x;
+            allParticles->_velocityY[particleIndex] = velocity.y;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The obstacle pass for the compact format.  The position is turned into window coords the 
+    same way as in the force field pass, and if the particle was pushed, it is turned back 
+    into fixed point with the same rounding as the update kernel.  A particle that was pushed 
+    out of its emitter's circle is clamped to the square around it so that the 16 bit part 
+    doesn't wrap, and the next update sends it back out.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to check.
+    endIndex        One past the last particle to check.
+    center          The emitter's center in window coords.
+    radius          The emitter's radius in window coords.
+    header          See ObstacleFieldHeader.
+    samples         Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyObstaclesPacked(ParticlePacked *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, const glm::vec2 &center, float radius, 
+    const ObstacleFieldHeader &header, const float *samples)
+{
+    float maxFixed = (float)PACKED_POSITION_MAX;
+    float stepsToWindow = radius / maxFixed;
+    float windowToSteps = maxFixed / radius;
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        ParticlePacked &p = allParticles[particleIndex];
+        if ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) == 0)
+        {
+            continue;
+        }
+
+        int fixedX = 0;
+        int fixedY = 0;
+        GetPackedPosition(p, &fixedX, &fixedY);
+        glm::vec2 position = center + (glm::vec2((float)fixedX, (float)fixedY) * stepsToWindow);
+        glm::vec2 velocity = glm::unpackHalf2x16(p._velocity);
+        if (!CollideWithObstacles(header, samples, &position, &velocity))
+        {
+            continue;
+        }
+
+        glm::vec2 fixed = (position - center) * windowToSteps;
+        fixed.x = (fixed.x > -maxFixed) ? ((fixed.x < maxFixed) ? fixed.x : maxFixed) : -maxFixed;
+        fixed.y = (fixed.y > -maxFixed) ? ((fixed.y < maxFixed) ? fixed.y : maxFixed) : -maxFixed;
+        int roundedX = (int)((fixed.x < 0.0f) ? (fixed.x - 0.5f) : (fixed.x + 0.5f));
+        int roundedY = (int)((fixed.y < 0.0f) ? (fixed.y - 0.5f) : (fixed.y + 0.5f));
+        SetPackedPosition(&p, roundedX, roundedY);
+        p._velocity = glm::packHalf2x16(velocity);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The turbulence pass for the "array of structures" storage.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    header          See TurbulenceFieldHeader.
+    samples         Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyTurbulenceAos(Particle *allParticles, unsigned int beginIndex, unsigned int endIndex, 
+    float deltaTimeSec, const TurbulenceFieldHeader &header, const glm::vec2 *samples)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        Particle &p = allParticles[particleIndex];
+        if (p._isActive == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 acceleration = SampleTurbulenceField(header, samples, 
+            glm::vec2(p._position.x, p._position.y));
+        p._velocity.x += acceleration.x * deltaTimeSec;
+        p._velocity.y += acceleration.y * deltaTimeSec;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The turbulence pass for the "structure of arrays" storage.  There is no SIMD version for 
+    the same reason as the obstacle pass.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    header          See TurbulenceFieldHeader.
+    samples         Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyTurbulenceSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const TurbulenceFieldHeader &header, 
+    const glm::vec2 *samples)
+{
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        if (allParticles->_isActive[particleIndex] == 0)
+        {
+            continue;
+        }
+
+        glm::vec2 acceleration = SampleTurbulenceField(header, samples, 
+            glm::vec2(allParticles->_positionX[particleIndex], 
+            allParticles->_positionY[particleIndex]));
+        allParticles->_velocityX[particleIndex] += acceleration.x * deltaTimeSec;
+        allParticles->_velocityY[particleIndex] += acceleration.y * deltaTimeSec;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The turbulence pass for the compact format.  The position is turned into window coords the 
+    same way as in the force field pass, and the velocity is unpacked from and repacked into 
+    16 bit floats.
+Parameters:
+    allParticles    Self-explanatory.
+    beginIndex      The first particle to push.
+    endIndex        One past the last particle to push.
+    deltaTimeSec    Self-explanatory.
+    center          The emitter's center in window coords.
+    radius          The emitter's radius in window coords.
+    header          See TurbulenceFieldHeader.
+    samples         Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ApplyTurbulencePacked(ParticlePacked *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radius, 
+    const TurbulenceFieldHeader &header, const glm::vec2 *samples)
+{
+    float stepsToWindow = radius / (float)PACKED_POSITION_MAX;
+    for (unsigned int particleIndex = beginIndex; particleIndex < endIndex; particleIndex++)
+    {
+        ParticlePacked &p = allParticles[particleIndex];
+        if ((p._lowBitsAndFlags & PACKED_IS_ACTIVE_FLAG) == 0)
+        {
+            continue;
+        }
+
+        int fixedX = 0;
+        int fixedY = 0;
+        GetPackedPosition(p, &fixedX, &fixedY);
+        glm::vec2 position = center + (glm::vec2((float)fixedX, (float)fixedY) * stepsToWindow);
+        glm::vec2 velocity = glm::unpackHalf2x16(p._velocity);
+        velocity += SampleTurbulenceField(header, samples, position) * deltaTimeSec;
+        p._velocity = glm::packHalf2x16(velocity);
+    }
+}
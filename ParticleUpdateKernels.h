@@ -0,0 +1,204 @@
+#pragma once
+
+#include "EmissionQuota.h"
+#include "ForceField.h"
+#include "ObstacleField.h"
+#include "TurbulenceField.h"
+#include "Particle.h"
+#include "ParticleIntegrator.h"
+#include "ParticlePacked.h"
+#include "ParticleStorageSoa.h"
+#include "glm/vec2.hpp"
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The CPU versions of shaderParticle.comp's main(), one for each way of storing particles
+    and each instruction set.  They all do the same thing: move each particle in the range
+    [beginIndex, endIndex) along its velocity and put it back at the emitter center if it went
+    outside the circle.  They work on a range rather than the whole collection so that the
+    work can be divided up.
+
+    Inactive particles don't move.  A particle is only (re)emitted if this frame's emission
+    quota allows it, so a particle that goes out of bounds after the quota is used up is turned
+    off until a later frame.  Each range is given its own part of the quota (see 
+    EmissionQuota.h), so no two threads ever share one.
+
+    Which instruction sets the CPU has isn't known until run time, so every kernel is always
+    compiled and the caller asks DetectSimdLevel() which ones are safe to use.  The AVX2 kernels
+    must not be called on a CPU without AVX2.
+
+    The compact ParticlePacked kernels take the radius instead of the center and radius squared
+    because a packed position is already relative to the center in units of the radius.
+
+    The "array of structures" and "structure of arrays" kernels also come without the bounds 
+    test (TestBounds false), for when something else turns off the particles that leave their 
+    circles (see ParticleSimulatorCpu::SetExitScheduling(...)).  Those move every particle, on 
+    or off, and never use the quota, so whatever calls them has to send out the inactive 
+    particles itself and take the velocities away from the ones that should stay put.  That 
+    leaves nothing for the kernel but loads, one multiply-add per coordinate, and stores.  Like 
+    the integrate kernels, the AoS and SoA kernels can only be had from GetAosUpdateKernel(...) 
+    and GetSoaUpdateKernel(...).
+-----------------------------------------------------------------------------------------------*/
+
+// from slowest to fastest
+enum SimdLevel
+{
+    SIMD_LEVEL_SCALAR = 0,
+    SIMD_LEVEL_SSE2,
+    SIMD_LEVEL_AVX2,
+};
+
+SimdLevel DetectSimdLevel();
+const char *SimdLevelName(SimdLevel simdLevel);
+bool GetSimdLevelByName(const char *name, SimdLevel *simdLevel);
+
+typedef void (*AosUpdateKernel)(Particle *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radiusSqr,
+    EmissionQuota *quota);
+typedef void (*SoaUpdateKernel)(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radiusSqr,
+    EmissionQuota *quota);
+typedef void (*PackedUpdateKernel)(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, float radius, EmissionQuota *quota);
+AosUpdateKernel GetAosUpdateKernel(SimdLevel simdLevel, bool testBounds);
+SoaUpdateKernel GetSoaUpdateKernel(SimdLevel simdLevel, bool testBounds);
+PackedUpdateKernel GetPackedUpdateKernel(SimdLevel simdLevel);
+
+void UpdateParticlesPacked(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, float radius, EmissionQuota *quota);
+void UpdateParticlesPackedSse(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, float radius, EmissionQuota *quota);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The force field pass, which runs on a range just before the update kernel does.  Each
+    active particle's velocity is changed by the sum of every field in the table (see
+    GetForceFieldAcceleration(...)), all in one pass, and then the update moves the particle
+    along the new velocity.  Inactive particles are left alone.
+
+    Only the "structure of arrays" storage has a SIMD version because it is the only one
+    whose velocities can be loaded 8 at a time without shuffling.  With the compact format,
+    the velocities are 16 bit floats, so a field that changes a particle's velocity by less
+    than about 1 part in 2048 per step (ex: very light drag) is rounded away.
+-----------------------------------------------------------------------------------------------*/
+
+typedef void (*SoaForceFieldKernel)(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const ForceField *forceFields,
+    unsigned int numForceFields);
+SoaForceFieldKernel GetSoaForceFieldKernel(SimdLevel simdLevel);
+
+void ApplyForceFieldsAos(Particle *allParticles, unsigned int beginIndex, unsigned int endIndex,
+    float deltaTimeSec, const ForceField *forceFields, unsigned int numForceFields);
+void ApplyForceFieldsSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const ForceField *forceFields,
+    unsigned int numForceFields);
+void ApplyForceFieldsSoaAvx2(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const ForceField *forceFields,
+    unsigned int numForceFields);
+void ApplyForceFieldsPacked(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radius,
+    const ForceField *forceFields, unsigned int numForceFields);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The pass for accelerations that were worked out ahead of time for each particle (ex: the 
+    gravity from GravityTree).  It runs on a range just before the force field pass.  Each 
+    active particle's velocity is changed by accelerations[its index], and inactive particles 
+    are left alone.
+
+    As with the force fields, the compact format's 16 bit velocities round away changes that 
+    are too small.
+-----------------------------------------------------------------------------------------------*/
+
+void ApplyAccelerationsAos(Particle *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations);
+void ApplyAccelerationsSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations);
+void ApplyAccelerationsPacked(ParticlePacked *allParticles, unsigned int beginIndex,
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The integrate pass, which takes the place of the acceleration and force field passes when 
+    the simulator uses any integrator but semi-implicit Euler (see ParticleIntegrator.h).  Each 
+    active particle is carried forward by a whole step, position and velocity, and then the 
+    update kernel is run with a step of 0 so that all it does is the bounds check and emission.  
+    Inactive particles are left alone.
+
+    The acceleration is the particle's entry in accelerations (if there are any) plus the sum 
+    of the force fields.  The accelerations (gravity) were worked out from where every 
+    particle was at the start of the step, so they are held constant over the step, and only 
+    the fields are looked up again at each of the integrator's stages.
+
+    There is one kernel for each integrator and storage, all made from the same template, and 
+    Get*IntegrateKernel(...) hands out the one for the integrator.  The simulator asks once in 
+    Init(...), so the integrator costs nothing per particle.  The "structure of arrays" 
+    storage also has an SSE2 version of each, which runs the same policy on 4 particles at 
+    once.  The other storages have no SIMD versions, so the integrators other than 
+    semi-implicit Euler look up the fields one particle at a time there.  Semi-implicit Euler 
+    has kernels too, so that it can be timed against the others, but the simulator uses the 
+    separate passes for it because the force field pass has an AVX2 version.
+
+    With the compact format, the position is turned into window coords and back the same way 
+    as in the obstacle pass.  A particle that left its emitter's circle is put on the corner of 
+    the square around it, which keeps the 16 bit part from wrapping and is still out of bounds 
+    for the update kernel.
+-----------------------------------------------------------------------------------------------*/
+
+typedef void (*AosIntegrateKernel)(Particle *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations, 
+    const ForceField *forceFields, unsigned int numForceFields);
+typedef void (*SoaIntegrateKernel)(ParticleStorageSoa *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 *accelerations, 
+    const ForceField *forceFields, unsigned int numForceFields);
+typedef void (*PackedIntegrateKernel)(ParticlePacked *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radius, 
+    const glm::vec2 *accelerations, const ForceField *forceFields, unsigned int numForceFields);
+AosIntegrateKernel GetAosIntegrateKernel(IntegratorType integrator);
+SoaIntegrateKernel GetSoaIntegrateKernel(IntegratorType integrator, SimdLevel simdLevel);
+PackedIntegrateKernel GetPackedIntegrateKernel(IntegratorType integrator);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The obstacle pass, which runs on a range just after the update kernel, so it sees where 
+    the particles ended up.  Each active particle that went into an obstacle is pushed back 
+    out and bounced off of it (see CollideWithObstacles(...)).  Inactive particles are left 
+    alone.  Every particle only looks at the 4 baked samples around it, so this costs the same 
+    no matter how many obstacles there are.
+
+    As with the force fields, the compact format's 16 bit velocities are rounded after the 
+    bounce.
+-----------------------------------------------------------------------------------------------*/
+
+void ApplyObstaclesAos(Particle *allParticles, unsigned int beginIndex, unsigned int endIndex, 
+    const ObstacleFieldHeader &header, const float *samples);
+void ApplyObstaclesSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, const ObstacleFieldHeader &header, const float *samples);
+void ApplyObstaclesPacked(ParticlePacked *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, const glm::vec2 &center, float radius, 
+    const ObstacleFieldHeader &header, const float *samples);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The turbulence pass, which runs on a range first, before the acceleration and force field 
+    passes (or the integrate pass).  Each active particle's velocity is changed by the push of 
+    the baked turbulence field where the particle is (see SampleTurbulenceField(...)), and 
+    inactive particles are left alone.  Like the obstacle pass, every particle only looks at 
+    the 4 samples around it.
+
+    Note: The push is a kick to the velocity ahead of the rest of the step, so with any 
+    integrator but semi-implicit Euler it is still only as accurate as semi-implicit Euler.  
+    The field is smooth and slow enough that this doesn't show.
+
+    As with the force fields, the compact format's 16 bit velocities round away changes that 
+    are too small.
+-----------------------------------------------------------------------------------------------*/
+
+void ApplyTurbulenceAos(Particle *allParticles, unsigned int beginIndex, unsigned int endIndex, 
+    float deltaTimeSec, const TurbulenceFieldHeader &header, const glm::vec2 *samples);
+void ApplyTurbulenceSoa(ParticleStorageSoa *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const TurbulenceFieldHeader &header, 
+    const glm::vec2 *samples);
+void ApplyTurbulencePacked(ParticlePacked *allParticles, unsigned int beginIndex, 
+    unsigned int endIndex, float deltaTimeSec, const glm::vec2 &center, float radius, 
+    const TurbulenceFieldHeader &header, const glm::vec2 *samples);
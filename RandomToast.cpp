@@ -1,8 +1,112 @@
 #include "RandomToast.h"
-#include <climits>
+
+#include <atomic>
 
 // initial values for xorshf96()
-static unsigned long x = 123456789, y = 362436069, z = 521288629;
+static const unsigned int XORSHF96_INITIAL_X = 123456789;
+static const unsigned int XORSHF96_INITIAL_Y = 362436069;
+static const unsigned int XORSHF96_INITIAL_Z = 521288629;
+
+// used for fast (faster than dividing, at least) reduction to the range [0,+1]
+static const float INVERSE_UNSIGNED_INT = 1.0f / 4294967295.0f;
+
+// the polynomial for jumping xorshf96 ahead by 2^64 (see RandomContext::Jump()), lowest bit 
+// first
+static const unsigned int XORSHF96_JUMP_2_TO_64[3] = { 0xf467cce3, 0x05fa0bf1, 0x0e380e6d };
+
+// for the free functions that don't care about repeatability; each thread that uses them gets 
+// the next stream (see GetThreadContext())
+static std::atomic<unsigned int> nextThreadStream(0);
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Starts the generator at Marsaglia's initial values, which is the same sequence that the 
+    free functions always gave.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+RandomContext::RandomContext() :
+    _x(XORSHF96_INITIAL_X),
+    _y(XORSHF96_INITIAL_Y),
+    _z(XORSHF96_INITIAL_Z)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Restarts the generator from a state that depends only on the seed.  
+
+    Note: Nearby seeds (1, 2, 3...) differ in only a bit or two, and xorshf96 takes a while to 
+    spread a small difference around, so the seed is scrambled (splitmix32's finalizer) before 
+    it is mixed into the initial values.  The initial values are never all 0, which is the one 
+    state that xorshf96 can't get out of.
+Parameters:
+    seed    Any value.  The same seed always gives the same sequence.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RandomContext::Seed(unsigned int seed)
+{
+    unsigned int words[3] = { XORSHF96_INITIAL_X, XORSHF96_INITIAL_Y, XORSHF96_INITIAL_Z };
+    for (int wordIndex = 0; wordIndex < 3; wordIndex++)
+    {
+        seed += 0x9e3779b9;
+        unsigned int mixed = seed;
+        mixed = (mixed ^ (mixed >> 16)) * 0x85ebca6b;
+        mixed = (mixed ^ (mixed >> 13)) * 0xc2b2ae35;
+        mixed ^= mixed >> 16;
+        words[wordIndex] ^= mixed;
+    }
+
+    _x = words[0];
+    _y = words[1];
+    _z = words[2];
+    if ((_x | _y | _z) == 0)
+    {
+        _x = XORSHF96_INITIAL_X;
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Moves the generator ahead by 2^64 numbers without making them.  Contexts that were copied 
+    from the same one and jumped a different number of times make sequences that won't 
+    overlap for 2^64 numbers each.
+
+    Every step of xorshf96 is a linear map on the 96 bits of state (only shifts and XORs), so 
+    the state N steps ahead is a sum (XOR) of the next 96 states.  Which ones to add up are 
+    the coefficients of x^N modulo the generator's characteristic polynomial, which were 
+    worked out ahead of time for N = 2^64.  This is the same way that Vigna's xorshift 
+    generators jump.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RandomContext::Jump()
+{
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int z = 0;
+    for (int wordIndex = 0; wordIndex < 3; wordIndex++)
+    {
+        for (int bitIndex = 0; bitIndex < 32; bitIndex++)
+        {
+            if ((XORSHF96_JUMP_2_TO_64[wordIndex] & (1u << bitIndex)) != 0)
+            {
+                x ^= _x;
+                y ^= _y;
+                z ^= _z;
+            }
+            this->Next();
+        }
+    }
+
+    _x = x;
+    _y = y;
+    _z = z;
+}
 
 /*-----------------------------------------------------------------------------------------------
 Description:
@@ -16,32 +120,80 @@ Description:
     old, I might as well get a newer and faster generator.
     http://stackoverflow.com/questions/22600100/why-are-stdshuffle-methods-being-deprecated-in-c14
 
-    The algorithm operates on all of the 64bits in the long integer.  It is positive if stuck 
-    into an unsigned long but can be negative if stuck into a signed long because the most 
-    significant bit (the signed bit) might be 1.
+    The shifts are meant for 32 bit words, which is what the period of 2^96-1 assumes.
 Parameters: None
 Returns:    
-    A decently chaotic unsigned long (64bit) number.
+    A decently chaotic 32 bit number.
 Exception:  Safe
 Creator:    Some online dude named Marsaglia (unknown date).
 -----------------------------------------------------------------------------------------------*/
-static unsigned long xorshf96(void) {          //period 2^96-1
-    unsigned long t;
-    x ^= x << 16;
-    x ^= x >> 5;
-    x ^= x << 1;
-
-    t = x;
-    x = y;
-    y = z;
-    z = t ^ x ^ y;
-
-    return z;
+unsigned int RandomContext::Next()
+{
+    unsigned int t;
+    _x ^= _x << 16;
+    _x ^= _x >> 5;
+    _x ^= _x << 1;
+
+    t = _x;
+    _x = _y;
+    _y = _z;
+    _z = t ^ _x ^ _y;
+
+    return _z;
 }
 
-// used for fast (faster than dividing, at least) reduction to the range [0,+1]
-static const float INVERSE_UNSIGNED_LONG = 1.0f / ULONG_MAX;
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Generates a random positve float on the range [0,+1].
+Parameters: None
+Returns:    
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+float RandomContext::OnRange0to1()
+{
+    return ((float)this->Next() * INVERSE_UNSIGNED_INT);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Generates a random integer that may be positive or negative.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+int RandomContext::PosAndNeg()
+{
+    return (int)this->Next();
+}
 
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives the calling thread its own context for the free functions so that threads don't 
+    race each other for one shared state.  The first thread to ask gets the unjumped sequence 
+    that the free functions have always made, and each one after that is jumped one more time 
+    (see RandomContext::Jump()).
+Parameters: None
+Returns:
+    A reference to the calling thread's context.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static RandomContext &GetThreadContext()
+{
+    thread_local bool isMade = false;
+    thread_local RandomContext context;
+    if (!isMade)
+    {
+        unsigned int streamIndex = nextThreadStream++;
+        for (unsigned int jumpCount = 0; jumpCount < streamIndex; jumpCount++)
+        {
+            context.Jump();
+        }
+        isMade = true;
+    }
+    return context;
+}
 
 /*-----------------------------------------------------------------------------------------------
 Description:
@@ -54,7 +206,7 @@ Creator:    John Cox (7-2-2016)
 -----------------------------------------------------------------------------------------------*/
 float RandomOnRange0to1()
 {
-    return ((float)xorshf96() * INVERSE_UNSIGNED_LONG);
+    return GetThreadContext().OnRange0to1();
 }
 
 /*-----------------------------------------------------------------------------------------------
@@ -69,7 +221,7 @@ Creator:    John Cox (7-2-2016)
 -----------------------------------------------------------------------------------------------*/
 unsigned long Random()
 {
-    return xorshf96();
+    return GetThreadContext().Next();
 }
 
 /*-----------------------------------------------------------------------------------------------
@@ -84,7 +236,7 @@ Creator:    John Cox (7-2-2016)
 -----------------------------------------------------------------------------------------------*/
 long RandomPosAndNeg()
 {
-    return (long)(xorshf96());
+    return GetThreadContext().PosAndNeg();
 }
 
 /*-----------------------------------------------------------------------------------------------
@@ -19,6 +19,43 @@ Description:
 Creator:    John Cox (6-25-2016)
 -----------------------------------------------------------------------------------------------*/
 
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Well, it turned out that a generator without initialization wasn't good enough either.  
+    Every caller shared the same hidden state, so asking for one more random number anywhere 
+    changed every particle after it, and there was no way to run the same scenario twice.  This 
+    keeps the same generator's state in an object so that the particle manager can have its 
+    own, seeded from the command line or a replay log (see ReplayLog.h).
+
+    The state is three 32 bit words on every compiler.  It used to be "unsigned long", which is 
+    32 bits in Visual Studio but 64 bits in gcc, so the same seed gave different particles.
+
+    The free functions below use a context for each thread that is never re-seeded, which is 
+    fine for anything that doesn't need to be repeatable (ex: colors).
+
+    A context is only safe to use from one thread at a time.  To make random numbers on 
+    several threads, give each thread (or better, each fixed piece of the work) its own 
+    context, all copied from one seeded context and moved apart with Jump().  Each Jump() skips 
+    2^64 numbers ahead, so the pieces' sequences never run into each other, and because they 
+    depend on the piece and not on the thread, the results are the same no matter how many 
+    threads there are.
+-----------------------------------------------------------------------------------------------*/
+class RandomContext
+{
+public:
+    RandomContext();
+    void Seed(unsigned int seed);
+    void Jump();
+    unsigned int Next();
+    float OnRange0to1();
+    int PosAndNeg();
+
+private:
+    unsigned int _x;
+    unsigned int _y;
+    unsigned int _z;
+};
+
 float RandomOnRange0to1();
 unsigned long Random();
 long RandomPosAndNeg();
@@ -0,0 +1,386 @@
+#include "ReplayLog.h"
+
+#include <string.h>
+#include <math.h>
+
+// the first line of every log; bump the version if the format changes
+static const char *REPLAY_LOG_HEADER = "particle replay log, version 17";
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing is recorded or played back until StartRecording(...) 
+    or StartReplay(...) is called.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ReplayLog::ReplayLog() :
+    _recordFile(0),
+    _numFramesRecorded(0),
+    _scenario(),
+    _isReplaying(false),
+    _currentReplayFrame(0),
+    _firstHashMismatchFrame(0),
+    _numHashMismatches(0),
+    _maxActiveCountDifference(0),
+    _maxMeanPositionDifference(0.0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Calls Cleanup() in the event that the user forgot to call it themselves.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ReplayLog::~ReplayLog()
+{
+    this->Cleanup();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Creates the log file and writes the scenario to it.  Every EndFrame(...) after this adds a 
+    frame.
+Parameters:
+    filePath        Self-explanatory.  Overwritten if it exists.
+    scenario        What the particle manager was (or is about to be) initialized with.
+    simulatorName   One word that says what did the simulating (ex: "gpu").  Only for the 
+                    report.
+Returns:
+    False if the file couldn't be created, otherwise true.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ReplayLog::StartRecording(const char *filePath, const ReplayScenario &scenario, 
+    const char *simulatorName)
+{
+    this->Cleanup();
+
+    _recordFile = fopen(filePath, "w");
+    if (_recordFile == 0)
+    {
+        printf("replay log: could not create '%s'\n", filePath);
+        return false;
+    }
+
+    _scenario = scenario;
+    _recordedSimulatorName = simulatorName;
+    fprintf(_recordFile, "%s\n", REPLAY_LOG_HEADER);
+    fprintf(_recordFile, "simulator %s\n", simulatorName);
+    fprintf(_recordFile, "seed %u\n", scenario._randomSeed);
+    fprintf(_recordFile, "particles %u\n", scenario._numParticles);
+    fprintf(_recordFile, "emitted_per_frame %u\n", scenario._maxParticlesEmittedPerFrame);
+    fprintf(_recordFile, "center %.9g %.9g\n", scenario._center.x, scenario._center.y);
+    fprintf(_recordFile, "radius %.9g\n", scenario._radius);
+    fprintf(_recordFile, "velocity %.9g %.9g\n", scenario._minVelocity, scenario._maxVelocity);
+    fprintf(_recordFile, "lifetime %.9g %.9g\n", scenario._minLifetimeSec, scenario._maxLifetimeSec);
+    fprintf(_recordFile, "emitters %u\n", scenario._numEmitters);
+    fprintf(_recordFile, "force_fields %d\n", scenario._useForceFields ? 1 : 0);
+    fprintf(_recordFile, "packed %d\n", scenario._usePackedFormat ? 1 : 0);
+    fprintf(_recordFile, "gravity %.9g %.9g %u\n", scenario._gravityStrength, 
+        scenario._gravityOpeningAngle, scenario._gravityMeshSize);
+    fprintf(_recordFile, "collisions %.9g\n", scenario._collisionRadius);
+    fprintf(_recordFile, "obstacles %s\n", 
+        scenario._obstacleFilePath.empty() ? "-" : scenario._obstacleFilePath.c_str());
+    fprintf(_recordFile, "integrator %s\n", IntegratorName(scenario._integrator));
+    fprintf(_recordFile, "fluid %.9g %.9g %.9g %.9g\n", scenario._fluid._smoothingRadius, 
+        scenario._fluid._restDensity, scenario._fluid._stiffness, scenario._fluid._viscosity);
+    fprintf(_recordFile, "turbulence %.9g %.9g %.9g\n", scenario._turbulence._strength, 
+        scenario._turbulence._featureSize, scenario._turbulence._changesPerSec);
+    fprintf(_recordFile, "reorder %u\n", scenario._reorderSteps);
+    fprintf(_recordFile, "substeps %u\n", scenario._numSubsteps);
+    fprintf(_recordFile, "stateless %d\n", scenario._isStateless ? 1 : 0);
+    fprintf(_recordFile, "schedule_exits %d\n", scenario._scheduleExits ? 1 : 0);
+    fprintf(_recordFile, "threads %u\n", scenario._numThreads);
+    fprintf(_recordFile, "storage %s\n", scenario._useSoaStorage ? "soa" : "aos");
+    fprintf(_recordFile, "simd %s\n", SimdLevelName(scenario._simdLevel));
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Reads a whole log that StartRecording(...) made.  Afterwards, GetScenario() says how to set 
+    up the particle manager and GetReplayFrame(...) says how to run each frame.
+Parameters:
+    filePath    Self-explanatory.
+Returns:
+    False if the file couldn't be opened or wasn't a replay log, otherwise true.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ReplayLog::StartReplay(const char *filePath)
+{
+    this->Cleanup();
+
+    FILE *logFile = fopen(filePath, "r");
+    if (logFile == 0)
+    {
+        printf("replay log: could not open '%s'\n", filePath);
+        return false;
+    }
+
+    char line[128] = { 0 };
+    char simulatorName[64] = { 0 };
+    char obstacleFilePath[256] = { 0 };
+    char integratorName[64] = { 0 };
+    char storageName[64] = { 0 };
+    char simdLevelName[64] = { 0 };
+    int useForceFields = 0;
+    int usePackedFormat = 0;
+    int isStateless = 0;
+    int scheduleExits = 0;
+    bool isGood = (fgets(line, sizeof(line), logFile) != 0) && 
+        (strncmp(line, REPLAY_LOG_HEADER, strlen(REPLAY_LOG_HEADER)) == 0);
+    isGood = isGood && (fscanf(logFile, " simulator %63s", simulatorName) == 1);
+    isGood = isGood && (fscanf(logFile, " seed %u", &_scenario._randomSeed) == 1);
+    isGood = isGood && (fscanf(logFile, " particles %u", &_scenario._numParticles) == 1);
+    isGood = isGood && 
+        (fscanf(logFile, " emitted_per_frame %u", &_scenario._maxParticlesEmittedPerFrame) == 1);
+    isGood = isGood && 
+        (fscanf(logFile, " center %f %f", &_scenario._center.x, &_scenario._center.y) == 2);
+    isGood = isGood && (fscanf(logFile, " radius %f", &_scenario._radius) == 1);
+    isGood = isGood && 
+        (fscanf(logFile, " velocity %f %f", &_scenario._minVelocity, &_scenario._maxVelocity) == 2);
+    isGood = isGood && 
+        (fscanf(logFile, " lifetime %f %f", &_scenario._minLifetimeSec, &_scenario._maxLifetimeSec) == 2);
+    isGood = isGood && (fscanf(logFile, " emitters %u", &_scenario._numEmitters) == 1);
+    isGood = isGood && (fscanf(logFile, " force_fields %d", &useForceFields) == 1);
+    isGood = isGood && (fscanf(logFile, " packed %d", &usePackedFormat) == 1);
+    isGood = isGood && (fscanf(logFile, " gravity %f %f %u", &_scenario._gravityStrength, 
+        &_scenario._gravityOpeningAngle, &_scenario._gravityMeshSize) == 3);
+    isGood = isGood && (fscanf(logFile, " collisions %f", &_scenario._collisionRadius) == 1);
+    isGood = isGood && (fscanf(logFile, " obstacles %255s", obstacleFilePath) == 1);
+    isGood = isGood && (fscanf(logFile, " integrator %63s", integratorName) == 1);
+    isGood = isGood && GetIntegratorByName(integratorName, &_scenario._integrator);
+    isGood = isGood && (fscanf(logFile, " fluid %f %f %f %f", &_scenario._fluid._smoothingRadius, 
+        &_scenario._fluid._restDensity, &_scenario._fluid._stiffness, 
+        &_scenario._fluid._viscosity) == 4);
+    isGood = isGood && (fscanf(logFile, " turbulence %f %f %f", 
+        &_scenario._turbulence._strength, &_scenario._turbulence._featureSize, 
+        &_scenario._turbulence._changesPerSec) == 3);
+    isGood = isGood && (fscanf(logFile, " reorder %u", &_scenario._reorderSteps) == 1);
+    isGood = isGood && (fscanf(logFile, " substeps %u", &_scenario._numSubsteps) == 1);
+    isGood = isGood && (fscanf(logFile, " stateless %d", &isStateless) == 1);
+    isGood = isGood && (fscanf(logFile, " schedule_exits %d", &scheduleExits) == 1);
+    isGood = isGood && (fscanf(logFile, " threads %u", &_scenario._numThreads) == 1);
+    isGood = isGood && (fscanf(logFile, " storage %63s", storageName) == 1);
+    isGood = isGood && 
+        ((strcmp(storageName, "aos") == 0) || (strcmp(storageName, "soa") == 0));
+    isGood = isGood && (fscanf(logFile, " simd %63s", simdLevelName) == 1);
+    isGood = isGood && GetSimdLevelByName(simdLevelName, &_scenario._simdLevel);
+    if (!isGood)
+    {
+        printf("replay log: '%s' is not a replay log or is damaged\n", filePath);
+        fclose(logFile);
+        return false;
+    }
+    _scenario._useForceFields = (useForceFields != 0);
+    _scenario._usePackedFormat = (usePackedFormat != 0);
+    _scenario._isStateless = (isStateless != 0);
+    _scenario._scheduleExits = (scheduleExits != 0);
+    _scenario._useSoaStorage = (strcmp(storageName, "soa") == 0);
+    _scenario._obstacleFilePath = (strcmp(obstacleFilePath, "-") == 0) ? "" : obstacleFilePath;
+    _recordedSimulatorName = simulatorName;
+
+    // frames until the end of the file
+    // Note: A recording that was cut off mid-line just loses its last frame.
+    unsigned int frameIndex = 0;
+    ReplayFrame frame;
+    while (fscanf(logFile, " frame %u steps %u step_sec %f active %u sum %lf %lf hash %llx", 
+        &frameIndex, &frame._numSteps, &frame._stepSec, &frame._fingerprint._numActive, 
+        &frame._fingerprint._sumX, &frame._fingerprint._sumY, &frame._fingerprint._hash) == 7)
+    {
+        _replayFrames.push_back(frame);
+    }
+    fclose(logFile);
+
+    _isReplaying = true;
+    _currentReplayFrame = 0;
+    printf("replay log: %u frames recorded with the '%s' simulator\n", 
+        (unsigned int)_replayFrames.size(), simulatorName);
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Closes the recording, if there is one, and forgets the replay, if there is one.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ReplayLog::Cleanup()
+{
+    if (_recordFile != 0)
+    {
+        fclose(_recordFile);
+        _recordFile = 0;
+    }
+    _numFramesRecorded = 0;
+
+    _replayFrames.clear();
+    _isReplaying = false;
+    _currentReplayFrame = 0;
+    _firstHashMismatchFrame = 0;
+    _numHashMismatches = 0;
+    _maxActiveCountDifference = 0;
+    _maxMeanPositionDifference = 0.0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ReplayLog::IsRecording() const
+{
+    return _recordFile != 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.  Stays true after the last frame so that the caller can tell that it 
+    should stop (see GetReplayFrame(...)).
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ReplayLog::IsReplaying() const
+{
+    return _isReplaying;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The scenario that is being recorded or that was loaded for playback.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const ReplayScenario &ReplayLog::GetScenario() const
+{
+    return _scenario;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Says how to run the next frame of the playback.
+Parameters:
+    numSteps    How many times to update the particle manager this frame.
+    stepSec     The delta time for each of those updates.
+Returns:
+    False if every recorded frame has been played back, otherwise true.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ReplayLog::GetReplayFrame(unsigned int *numSteps, float *stepSec) const
+{
+    if (_currentReplayFrame >= _replayFrames.size())
+    {
+        return false;
+    }
+
+    *numSteps = _replayFrames[_currentReplayFrame]._numSteps;
+    *stepSec = _replayFrames[_currentReplayFrame]._stepSec;
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Call this after every frame's updates.  While recording, it writes the frame to the log.  
+    While playing back, it compares the fingerprint against the recorded one and moves on to 
+    the next frame.  Otherwise it does nothing.
+Parameters:
+    numSteps        How many updates were run this frame.
+    stepSec         The delta time for each of them.
+    fingerprint     From ParticleManager::TakeFingerprint() after the updates.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ReplayLog::EndFrame(unsigned int numSteps, float stepSec, 
+    const ParticleFingerprint &fingerprint)
+{
+    if (_recordFile != 0)
+    {
+        fprintf(_recordFile, "frame %u steps %u step_sec %.9g active %u sum %.17g %.17g hash %016llx\n", 
+            _numFramesRecorded, numSteps, stepSec, fingerprint._numActive, fingerprint._sumX, 
+            fingerprint._sumY, fingerprint._hash);
+        _numFramesRecorded++;
+    }
+
+    if (!_isReplaying || _currentReplayFrame >= _replayFrames.size())
+    {
+        return;
+    }
+
+    const ParticleFingerprint &recorded = _replayFrames[_currentReplayFrame]._fingerprint;
+    if (fingerprint._hash != recorded._hash)
+    {
+        if (_numHashMismatches == 0)
+        {
+            _firstHashMismatchFrame = _currentReplayFrame;
+        }
+        _numHashMismatches++;
+    }
+
+    unsigned int activeCountDifference = (fingerprint._numActive > recorded._numActive) ? 
+        (fingerprint._numActive - recorded._numActive) : 
+        (recorded._numActive - fingerprint._numActive);
+    if (activeCountDifference > _maxActiveCountDifference)
+    {
+        _maxActiveCountDifference = activeCountDifference;
+    }
+
+    // compare the average positions rather than the sums so that the difference is in window 
+    // coords no matter how many particles there are
+    if (fingerprint._numActive > 0 && recorded._numActive > 0)
+    {
+        double diffX = (fingerprint._sumX / fingerprint._numActive) - 
+            (recorded._sumX / recorded._numActive);
+        double diffY = (fingerprint._sumY / fingerprint._numActive) - 
+            (recorded._sumY / recorded._numActive);
+        double meanPositionDifference = sqrt((diffX * diffX) + (diffY * diffY));
+        if (meanPositionDifference > _maxMeanPositionDifference)
+        {
+            _maxMeanPositionDifference = meanPositionDifference;
+        }
+    }
+
+    _currentReplayFrame++;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Prints how the playback compared to the recording.  Does nothing if not playing back.
+Parameters:
+    simulatorName   What did the simulating during playback (ex: "cpu").
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ReplayLog::PrintReplayReport(const char *simulatorName) const
+{
+    if (!_isReplaying)
+    {
+        return;
+    }
+
+    printf("replay: %u of %u frames played back with the '%s' simulator (recorded with '%s')\n", 
+        _currentReplayFrame, (unsigned int)_replayFrames.size(), simulatorName, 
+        _recordedSimulatorName.c_str());
+    if (_numHashMismatches == 0)
+    {
+        printf("    every frame matched bit-for-bit\n");
+    }
+    else
+    {
+        printf("    %u frames differed, starting with frame %u\n", _numHashMismatches, 
+            _firstHashMismatchFrame);
+    }
+    printf("    max active count difference: %u\n", _maxActiveCountDifference);
+    printf("    max average position difference: %.3g (window coords)\n", 
+        _maxMeanPositionDifference);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "ParticleFingerprint.h"
+#include "ParticleFluid.h"
+#include "ParticleIntegrator.h"
+#include "ParticleUpdateKernels.h"
+#include "TurbulenceField.h"
+#include "glm/vec2.hpp"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Everything that the particle manager needs to make the same particles twice.
+
+    Note: If there is more than one emitter, then the particles and the quota are split evenly 
+    between them and the emitters are spread out over the window (see main.cpp).  The center 
+    and radius are only used as-is when there is one.
+
+    Note: The force fields are main.cpp's demo set, so only whether they were on is recorded.
+
+    Note: The obstacles are recorded as the file that they came from, not as the shapes, so 
+    the file has to still be there (and the same) to replay the run.  The path can't have 
+    spaces in it.
+
+    Note: The thread count, storage, and instruction set are how the CPU simulator ran.  The 
+    thread count doesn't change its particles, but the storage and instruction set can change 
+    the last bits of their positions (ex: with substeps), so a replay uses all three of the 
+    recorded ones (see main.cpp).
+-----------------------------------------------------------------------------------------------*/
+struct ReplayScenario
+{
+    unsigned int _randomSeed;
+    unsigned int _numParticles;
+    unsigned int _maxParticlesEmittedPerFrame;
+    glm::vec2 _center;
+    float _radius;
+    float _minVelocity;
+    float _maxVelocity;
+    float _minLifetimeSec;
+    float _maxLifetimeSec;
+    unsigned int _numEmitters;
+    bool _useForceFields;
+    bool _usePackedFormat;
+    float _gravityStrength;         // 0 for none
+    float _gravityOpeningAngle;
+    unsigned int _gravityMeshSize;  // 0 for the tree
+    float _collisionRadius;         // 0 for none
+    std::string _obstacleFilePath;  // empty for none
+    IntegratorType _integrator;
+    FluidSettings _fluid;           // a smoothing radius of 0 for none
+    TurbulenceSettings _turbulence; // a strength of 0 for none
+    unsigned int _reorderSteps;     // 0 for never
+    unsigned int _numSubsteps;      // steps per update; 1 for the usual one
+    bool _isStateless;              // true if nothing is simulated (see ParticleStateless.h)
+    bool _scheduleExits;            // CPU only (see ParticleSimulatorCpu::SetExitScheduling(...))
+    unsigned int _numThreads;       // CPU only; how many the pool had, or 0 for the GPU
+    bool _useSoaStorage;            // CPU only (see ParticleSimulatorCpu::SetStorage(...))
+    SimdLevel _simdLevel;           // CPU only; the one that was used, not the cap
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    What happened during one frame: how many simulation steps were taken, how long each one 
+    was, and what the particles looked like afterwards.
+-----------------------------------------------------------------------------------------------*/
+struct ReplayFrame
+{
+    unsigned int _numSteps;
+    float _stepSec;
+    ParticleFingerprint _fingerprint;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Records a run's scenario and every frame's time steps to a text file, and plays them back 
+    later so that a different build or a different simulator (CPU or compute shader) does 
+    exactly the same work.  During playback, each frame's fingerprint is compared against the 
+    recorded one, and PrintReplayReport() says where the runs started to differ and by how much.
+
+    The file is plain text so that two recordings can be diffed.  Floats are written with 
+    enough digits (9) to come back exactly the same.
+
+    Note: Which particles get emitted in the compute shader depends on which ones claim the 
+    frame's quota first, which isn't in a fixed order, so once particles start going out of 
+    bounds and getting sent back out, its fingerprint hashes differ even when nothing is 
+    wrong.  The active count and position sums still show whether the runs are doing the same 
+    thing.  The CPU simulator hands out the quota in particle order (see EmissionQuota.h), so 
+    it is repeatable bit-for-bit with any number of threads as long as the storage and 
+    instruction set are the same (see ReplayScenario).
+-----------------------------------------------------------------------------------------------*/
+class ReplayLog
+{
+public:
+    ReplayLog();
+    ~ReplayLog();
+    bool StartRecording(const char *filePath, const ReplayScenario &scenario, 
+        const char *simulatorName);
+    bool StartReplay(const char *filePath);
+    void Cleanup();
+
+    bool IsRecording() const;
+    bool IsReplaying() const;
+    const ReplayScenario &GetScenario() const;
+    bool GetReplayFrame(unsigned int *numSteps, float *stepSec) const;
+    void EndFrame(unsigned int numSteps, float stepSec, const ParticleFingerprint &fingerprint);
+    void PrintReplayReport(const char *simulatorName) const;
+
+private:
+    FILE *_recordFile;
+    unsigned int _numFramesRecorded;
+
+    ReplayScenario _scenario;
+    std::string _recordedSimulatorName;
+    std::vector<ReplayFrame> _replayFrames;
+    bool _isReplaying;
+    unsigned int _currentReplayFrame;
+
+    // how playback compared to the recording
+    unsigned int _firstHashMismatchFrame;
+    unsigned int _numHashMismatches;
+    unsigned int _maxActiveCountDifference;
+    double _maxMeanPositionDifference;
+};
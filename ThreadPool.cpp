@@ -0,0 +1,379 @@
+#include "ThreadPool.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>    // SetThreadGroupAffinity(...)
+#else
+#include <pthread.h>    // pthread_setaffinity_np(...)
+#include <sched.h>
+#endif
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Restricts the given thread to a single logical processor so that the OS doesn't move it
+    (and its warm cache) around between frames.
+
+    Windows puts more than 64 logical processors into separate "processor groups", and the
+    plain SetThreadAffinityMask(...) can only see the thread's current group, so the group
+    has to be worked out from the processor index.
+Parameters:
+    thread          Self-explanatory.
+    processorIndex  Counting across all processor groups.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static void PinThread(std::thread &thread, unsigned int processorIndex)
+{
+#ifdef _WIN32
+    WORD groupCount = GetActiveProcessorGroupCount();
+    for (WORD group = 0; group < groupCount; group++)
+    {
+        DWORD processorsInGroup = GetActiveProcessorCount(group);
+        if (processorIndex < processorsInGroup)
+        {
+            GROUP_AFFINITY affinity = {};
+            affinity.Group = group;
+            affinity.Mask = ((KAFFINITY)1) << processorIndex;
+            SetThreadGroupAffinity((HANDLE)thread.native_handle(), &affinity, 0);
+            return;
+        }
+        processorIndex -= processorsInGroup;
+    }
+#else
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(processorIndex, &cpuSet);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+#endif
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  No threads are created until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ThreadPool::ThreadPool() :
+    _generation(0),
+    _quit(false),
+    _remainingTasks(0)
+{
+
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Calls Cleanup() in the event that the user forgot to call it themselves.  The worker
+    threads MUST be joined before they are destroyed or else std::thread calls terminate().
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ThreadPool::~ThreadPool()
+{
+    this->Cleanup();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Creates the task queues and starts the worker threads, which immediately go to sleep until
+    there is work.
+Parameters:
+    numThreads  How many threads, including the calling thread, will work on each
+                ParallelFor(...).  0 means one for each logical processor.
+    pinThreads  If true, worker N is kept on logical processor N (the calling thread is left
+                alone, and it can be assumed to be on processor 0).
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ThreadPool::Init(unsigned int numThreads, bool pinThreads)
+{
+    this->Cleanup();
+
+    unsigned int numProcessors = std::thread::hardware_concurrency();
+    if (numProcessors == 0)
+    {
+        // the standard says that this can happen if the number can't be determined
+        numProcessors = 1;
+    }
+
+    if (numThreads == 0)
+    {
+        numThreads = numProcessors;
+    }
+
+    for (unsigned int queueCount = 0; queueCount < numThreads; queueCount++)
+    {
+        _queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+    }
+
+    _quit = false;
+    for (unsigned int workerIndex = 0; workerIndex < (numThreads - 1); workerIndex++)
+    {
+        _workers.push_back(std::thread(&ThreadPool::WorkerLoop, this, workerIndex));
+        if (pinThreads)
+        {
+            PinThread(_workers.back(), (workerIndex + 1) % numProcessors);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Wakes up the workers, tells them to quit, and waits for them.  Safe to call more than once.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ThreadPool::Cleanup()
+{
+    {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        _quit = true;
+    }
+    _wakeCondition.notify_all();
+
+    for (size_t workerIndex = 0; workerIndex < _workers.size(); workerIndex++)
+    {
+        _workers[workerIndex].join();
+    }
+    _workers.clear();
+    _queues.clear();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The same as the other ParallelFor(...), but for code that may or may not have been given a 
+    pool.
+Parameters:
+    threadPool  May be 0 to run the chunks in order on the calling thread.
+    numItems    Self-explanatory.
+    chunkSize   How many items each call of the function handles (the last may be smaller).
+    func        Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ThreadPool::ParallelFor(ThreadPool *threadPool, unsigned int numItems, 
+    unsigned int chunkSize, const RangeFunction &func)
+{
+    if (threadPool != 0)
+    {
+        threadPool->ParallelFor(numItems, chunkSize, func);
+        return;
+    }
+
+    if (numItems == 0)
+    {
+        return;
+    }
+
+    if (chunkSize == 0)
+    {
+        chunkSize = numItems;
+    }
+    RunInOrder(numItems, chunkSize, func);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Calls the provided function on every chunk of the range [0, numItems) and returns when all
+    of them are done.  Chunks may run in any order and on any thread, so the function must not
+    write anything outside its own range without its own synchronization.
+
+    If Init(...) was never called, then the chunks are run in order on the calling thread.
+Parameters:
+    numItems    Self-explanatory.
+    chunkSize   How many items each call of the function handles (the last may be smaller).
+    func        Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ThreadPool::ParallelFor(unsigned int numItems, unsigned int chunkSize,
+    const RangeFunction &func)
+{
+    if (numItems == 0)
+    {
+        return;
+    }
+
+    if (chunkSize == 0)
+    {
+        chunkSize = numItems;
+    }
+
+    unsigned int numTasks = ((numItems - 1) / chunkSize) + 1;
+    if (_queues.empty())
+    {
+        RunInOrder(numItems, chunkSize, func);
+        return;
+    }
+
+    // set the count before any worker can possibly finish a task
+    _remainingTasks = numTasks;
+
+    // deal out contiguous blocks of chunks
+    unsigned int numQueues = _queues.size();
+    for (unsigned int queueIndex = 0; queueIndex < numQueues; queueIndex++)
+    {
+        unsigned int firstTask = (unsigned int)(((unsigned long long)numTasks * queueIndex) / numQueues);
+        unsigned int lastTask = (unsigned int)(((unsigned long long)numTasks * (queueIndex + 1)) / numQueues);
+
+        TaskQueue &queue = *_queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue._mutex);
+        for (unsigned int taskIndex = firstTask; taskIndex < lastTask; taskIndex++)
+        {
+            Task task;
+            task._beginIndex = taskIndex * chunkSize;
+            task._endIndex = (numItems - task._beginIndex > chunkSize) ?
+                (task._beginIndex + chunkSize) : numItems;
+            task._func = &func;
+            queue._tasks.push_back(task);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_wakeMutex);
+        _generation++;
+    }
+    _wakeCondition.notify_all();
+
+    // the calling thread has the last queue
+    unsigned int callerQueueIndex = numQueues - 1;
+    while (this->RunOneTask(callerQueueIndex))
+    {
+    }
+
+    // nothing left to steal, but the workers might still be finishing their last chunks
+    std::unique_lock<std::mutex> lock(_doneMutex);
+    _doneCondition.wait(lock, [this]() { return _remainingTasks == 0; });
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Calls the function on every chunk of the range [0, numItems), one after another on the 
+    calling thread.
+Parameters:
+    numItems    At least 1.
+    chunkSize   At least 1.
+    func        Self-explanatory.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ThreadPool::RunInOrder(unsigned int numItems, unsigned int chunkSize, 
+    const RangeFunction &func)
+{
+    for (unsigned int beginIndex = 0; beginIndex < numItems; beginIndex += chunkSize)
+    {
+        unsigned int endIndex = (numItems - beginIndex > chunkSize) ?
+            (beginIndex + chunkSize) : numItems;
+        func(beginIndex, endIndex);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A simple getter for the number of threads (including the calling thread) that work on each
+    ParallelFor(...).  0 if the pool wasn't initialized.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int ThreadPool::NumThreads() const
+{
+    return _queues.size();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    What each worker thread does for its whole life: sleep until a job is posted, then run
+    tasks until there aren't any left anywhere, then go back to sleep.
+Parameters:
+    queueIndex  This worker's own queue.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void ThreadPool::WorkerLoop(unsigned int queueIndex)
+{
+    unsigned int seenGeneration = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_wakeMutex);
+            _wakeCondition.wait(lock,
+                [this, seenGeneration]() { return _quit || (_generation != seenGeneration); });
+            if (_quit)
+            {
+                return;
+            }
+            seenGeneration = _generation;
+        }
+
+        while (this->RunOneTask(queueIndex))
+        {
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Takes the next task from the front of this thread's own queue or, if that is empty, steals
+    one from the back of another queue, and runs it.  The owner takes from the front so that
+    it moves forward through memory, and thieves take from the back so that they stay out of
+    the owner's way.
+Parameters:
+    queueIndex  The calling thread's own queue.
+Returns:
+    True if a task was run, false if every queue was empty.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool ThreadPool::RunOneTask(unsigned int queueIndex)
+{
+    Task task;
+    bool haveTask = false;
+
+    {
+        TaskQueue &ownQueue = *_queues[queueIndex];
+        std::lock_guard<std::mutex> lock(ownQueue._mutex);
+        if (!ownQueue._tasks.empty())
+        {
+            task = ownQueue._tasks.front();
+            ownQueue._tasks.pop_front();
+            haveTask = true;
+        }
+    }
+
+    unsigned int numQueues = _queues.size();
+    for (unsigned int offset = 1; !haveTask && offset < numQueues; offset++)
+    {
+        TaskQueue &victimQueue = *_queues[(queueIndex + offset) % numQueues];
+        std::lock_guard<std::mutex> lock(victimQueue._mutex);
+        if (!victimQueue._tasks.empty())
+        {
+            task = victimQueue._tasks.back();
+            victimQueue._tasks.pop_back();
+            haveTask = true;
+        }
+    }
+
+    if (!haveTask)
+    {
+        return false;
+    }
+
+    (*task._func)(task._beginIndex, task._endIndex);
+
+    // the last one out wakes up the thread that's waiting in ParallelFor(...)
+    // Note: Lock before notifying or else the waiting thread could check the count, then this
+    // thread decrements and notifies, and then the waiting thread goes to sleep forever.
+    if (--_remainingTasks == 0)
+    {
+        std::lock_guard<std::mutex> lock(_doneMutex);
+        _doneCondition.notify_all();
+    }
+
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A persistent set of worker threads for splitting up "do this to every particle" loops.
+    Creating threads every frame costs more than updating a few hundred thousand particles, so
+    the threads are created once in Init(...) and sleep between jobs.
+
+    ParallelFor(...) cuts the range into chunks and deals a contiguous block of chunks to each
+    thread's queue so that each thread walks through memory in order.  When a thread runs out,
+    it steals chunks from the back of the other queues, so a thread that got held up (or a
+    core that is slower or busier) doesn't hold up the whole frame.
+
+    The calling thread works on chunks too, so a pool of N threads has N-1 workers.
+
+    Note: ParallelFor(...) must not be called from inside a chunk.
+-----------------------------------------------------------------------------------------------*/
+class ThreadPool
+{
+public:
+    // called with the range [beginIndex, endIndex) of a single chunk
+    typedef std::function<void(unsigned int beginIndex, unsigned int endIndex)> RangeFunction;
+
+    ThreadPool();
+    ~ThreadPool();
+    void Init(unsigned int numThreads, bool pinThreads);
+    void Cleanup();
+    void ParallelFor(unsigned int numItems, unsigned int chunkSize, const RangeFunction &func);
+    static void ParallelFor(ThreadPool *threadPool, unsigned int numItems, 
+        unsigned int chunkSize, const RangeFunction &func);
+    unsigned int NumThreads() const;
+
+private:
+    // the pool owns threads and mutexes, neither of which can be copied
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    struct Task
+    {
+        unsigned int _beginIndex;
+        unsigned int _endIndex;
+        const RangeFunction *_func;
+    };
+
+    struct TaskQueue
+    {
+        std::mutex _mutex;
+        std::deque<Task> _tasks;
+    };
+
+    static void RunInOrder(unsigned int numItems, unsigned int chunkSize, 
+        const RangeFunction &func);
+    void WorkerLoop(unsigned int queueIndex);
+    bool RunOneTask(unsigned int queueIndex);
+
+    std::vector<std::thread> _workers;
+
+    // one for each worker, plus one for the calling thread (the last one)
+    std::vector<std::unique_ptr<TaskQueue>> _queues;
+
+    // workers sleep on this until a new job is posted (the generation changes) or they are told
+    // to quit
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeCondition;
+    unsigned int _generation;
+    bool _quit;
+
+    // the calling thread sleeps on this until every chunk of the job is done
+    std::atomic<unsigned int> _remainingTasks;
+    std::mutex _doneMutex;
+    std::condition_variable _doneCondition;
+};
@@ -0,0 +1,455 @@
+#include "TurbulenceField.h"
+
+#include "glm/vec3.hpp"
+#include "glm/gtc/noise.hpp"    // glm::perlin
+
+// the tile is this many samples across for every swirl, which is plenty for the blend between
+// samples to look smooth
+static const unsigned int SAMPLES_PER_FEATURE = 16;
+
+// each octave of noise has twice as many (half as big) swirls as the one before it and half
+// the height
+static const unsigned int NUM_OCTAVES = 2;
+
+// how many keys are baked for every "whole new field" (see TurbulenceField)
+static const unsigned int KEYS_PER_CHANGE = 4;
+
+// the noise repeats in time after this many whole new fields, which keeps the time that goes
+// into glm::perlin(...) small enough for a float to be precise
+static const unsigned int CHANGES_PER_TIME_PERIOD = 64;
+
+// how far either side of a position GetExactAcceleration(...) looks for the slope, in swirls
+static const float EXACT_SLOPE_STEP = 1.0f / 256.0f;
+
+// scales the swirls of the noise so that a typical spot pushes with about the strength in the
+// settings (worked out by measuring the average push of a lot of keys)
+static const float CURL_SCALE = 0.75f;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters:
+    keyIndex    Self-explanatory.
+Returns:
+    Where the key is along the noise's time, which repeats (see CHANGES_PER_TIME_PERIOD).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static float GetKeyNoiseTime(unsigned int keyIndex)
+{
+    return (float)(keyIndex % (CHANGES_PER_TIME_PERIOD * KEYS_PER_CHANGE)) / 
+        (float)KEYS_PER_CHANGE;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The height field that the swirls come from: a couple of octaves of glm's periodic Perlin 
+    noise, which repeats every featuresAcross swirls in X and Y and every 
+    CHANGES_PER_TIME_PERIOD in time.
+Parameters:
+    position        In swirls (one swirl is one unit of noise).
+    noiseTime       See GetKeyNoiseTime(...).
+    featuresAcross  How many swirls go across the tile.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+static float GetNoiseHeight(const glm::vec2 &position, float noiseTime, float featuresAcross)
+{
+    glm::vec3 octavePosition(position.x, position.y, noiseTime);
+    glm::vec3 period(featuresAcross, featuresAcross, (float)CHANGES_PER_TIME_PERIOD);
+    float height = 0.0f;
+    float octaveHeight = 1.0f;
+    for (unsigned int octave = 0; octave < NUM_OCTAVES; octave++)
+    {
+        height += glm::perlin(octavePosition, period) * octaveHeight;
+        octavePosition *= 2.0f;
+        period *= 2.0f;
+        octaveHeight *= 0.5f;
+    }
+    return height;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Gives members default values.  Nothing is baked and no thread is started until Init(...).
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+TurbulenceField::TurbulenceField() :
+    _header(),
+    _firstKeyIndex(0),
+    _keyIntervalSec(0.0f),
+    _timeSec(0.0f),
+    _numStalls(0),
+    _bakeKeyIndex(0),
+    _isBakeRequested(false),
+    _isBakeDone(false),
+    _quitBaking(false)
+{
+    _settings._strength = 0.0f;
+    _settings._featureSize = 0.0f;
+    _settings._changesPerSec = 0.0f;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Stops the background thread if there is one.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+TurbulenceField::~TurbulenceField()
+{
+    this->Cleanup();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Bakes the field at time 0.  If the field changes over time, then this also bakes the key
+    after that one and starts the background thread on the one after that.  A strength of 0
+    or a feature size that isn't above 0 leaves the field empty.
+Parameters:
+    settings    See TurbulenceSettings.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void TurbulenceField::Init(const TurbulenceSettings &settings)
+{
+    this->Cleanup();
+    if (settings._strength == 0.0f || settings._featureSize <= 0.0f)
+    {
+        return;
+    }
+
+    _settings = settings;
+    _header._inverseCellSize = (float)SAMPLES_PER_FEATURE / settings._featureSize;
+    _header._numSamples = TURBULENCE_TILE_SAMPLES;
+    _header._sampleMask = TURBULENCE_TILE_SAMPLES - 1;
+    _header._padding = 0;
+
+    unsigned int numSamples = TURBULENCE_TILE_SAMPLES * TURBULENCE_TILE_SAMPLES;
+    _samples.resize(numSamples);
+    _bakeHeights.resize(numSamples);
+    this->BakeKey(0, _samples.data(), _bakeHeights.data());
+    if (!this->IsAnimated())
+    {
+        _bakeHeights.clear();
+        return;
+    }
+
+    _keys[0] = _samples;
+    _keys[1].resize(numSamples);
+    _nextKey.resize(numSamples);
+    this->BakeKey(1, _keys[1].data(), _bakeHeights.data());
+    _firstKeyIndex = 0;
+    _keyIntervalSec = 1.0f / (settings._changesPerSec * KEYS_PER_CHANGE);
+    _timeSec = 0.0f;
+
+    // the thread is asked for key 2 before it starts, so it gets right to it
+    _bakeKeyIndex = 2;
+    _isBakeRequested = true;
+    _isBakeDone = false;
+    _quitBaking = false;
+    _bakeThread = std::thread(&TurbulenceField::BakeLoop, this);
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Stops the background thread if there is one and throws out the samples.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void TurbulenceField::Cleanup()
+{
+    if (_bakeThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_bakeMutex);
+            _quitBaking = true;
+        }
+        _bakeCondition.notify_all();
+        _bakeThread.join();
+    }
+    _isBakeRequested = false;
+    _isBakeDone = false;
+    _quitBaking = false;
+
+    _header = TurbulenceFieldHeader();
+    _samples.clear();
+    _keys[0].clear();
+    _keys[1].clear();
+    _nextKey.clear();
+    _bakeHeights.clear();
+    _keyIntervalSec = 0.0f;
+    _timeSec = 0.0f;
+    _numStalls = 0;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if Init(...) baked a field, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool TurbulenceField::IsInitialized() const
+{
+    return !_samples.empty();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    True if the field changes over time, otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool TurbulenceField::IsAnimated() const
+{
+    return this->IsInitialized() && _settings._changesPerSec > 0.0f;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Moves the field's time forward and blends the samples between the two keys on either side
+    of it.  If the time went past the second key, then the keys move along by one (or more),
+    which might have to wait for the background thread to finish baking.
+Parameters:
+    deltaTimeSec    Self-explanatory.
+Returns:
+    True if the samples changed (the field is animated), otherwise false.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+bool TurbulenceField::Advance(float deltaTimeSec)
+{
+    if (!this->IsAnimated())
+    {
+        return false;
+    }
+
+    // Note: The time is kept from the first key rather than from the start so that it stays
+    // small and doesn't lose precision over a long run.
+    _timeSec += deltaTimeSec;
+    while (_timeSec >= _keyIntervalSec)
+    {
+        this->TakeNextKey();
+        _timeSec -= _keyIntervalSec;
+    }
+
+    float fraction = _timeSec / _keyIntervalSec;
+    const glm::vec2 *firstKey = _keys[0].data();
+    const glm::vec2 *secondKey = _keys[1].data();
+    glm::vec2 *samples = _samples.data();
+    unsigned int numSamples = _samples.size();
+    for (unsigned int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+    {
+        samples[sampleIndex] = firstKey[sampleIndex] +
+            ((secondKey[sampleIndex] - firstKey[sampleIndex]) * fraction);
+    }
+    return true;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    See TurbulenceFieldHeader.  All 0 if nothing is baked.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const TurbulenceFieldHeader &TurbulenceField::GetHeader() const
+{
+    return _header;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The samples for the current time, for SampleTurbulenceField(...) and for uploading.
+Parameters: None
+Returns:
+    See description.  0 if nothing is baked.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const glm::vec2 *TurbulenceField::GetSamples() const
+{
+    return _samples.empty() ? 0 : _samples.data();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Self-explanatory.
+Parameters: None
+Returns:
+    How many samples the tile has in all.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int TurbulenceField::NumSamples() const
+{
+    return _samples.size();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    For reporting.
+Parameters: None
+Returns:
+    How many times Advance(...) had to wait for the background thread since Init(...).
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+unsigned int TurbulenceField::NumStalls() const
+{
+    return _numStalls;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out one key: a height field of periodic Perlin noise at the key's time, and then its
+    swirls (the "curl" of the heights: along Y, and minus along X) from the neighboring
+    samples on either side.  Both wrap around the tile.  Only reads the header and the
+    settings, so it is safe to call from any thread once Init(...) has set them.
+
+    This is public so that the benchmark can time it.
+Parameters:
+    keyIndex    Which key.  Key K is at K / KEYS_PER_CHANGE whole new fields.
+    samples     Gets the key.  Must have room for NumSamples().
+    heights     For the height field.  Must have room for NumSamples().
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void TurbulenceField::BakeKey(unsigned int keyIndex, glm::vec2 *samples, float *heights) const
+{
+    unsigned int numSamples = _header._numSamples;
+    unsigned int sampleMask = _header._sampleMask;
+    float featuresAcross = (float)(numSamples / SAMPLES_PER_FEATURE);
+    float noiseTime = GetKeyNoiseTime(keyIndex);
+    for (unsigned int row = 0; row < numSamples; row++)
+    {
+        for (unsigned int column = 0; column < numSamples; column++)
+        {
+            glm::vec2 position((float)column, (float)row);
+            heights[(row * numSamples) + column] = 
+                GetNoiseHeight(position / (float)SAMPLES_PER_FEATURE, noiseTime, featuresAcross);
+        }
+    }
+
+    // Note: The neighbors are one sample (1 / SAMPLES_PER_FEATURE of a swirl) away on either
+    // side, so the slope in "swirls" is the difference times half of SAMPLES_PER_FEATURE.
+    float scale = _settings._strength * CURL_SCALE * (0.5f * SAMPLES_PER_FEATURE);
+    for (unsigned int row = 0; row < numSamples; row++)
+    {
+        const float *rowHeights = heights + (row * numSamples);
+        const float *belowHeights = heights + (((row - 1) & sampleMask) * numSamples);
+        const float *aboveHeights = heights + (((row + 1) & sampleMask) * numSamples);
+        glm::vec2 *rowSamples = samples + (row * numSamples);
+        for (unsigned int column = 0; column < numSamples; column++)
+        {
+            float slopeX = rowHeights[(column + 1) & sampleMask] -
+                rowHeights[(column - 1) & sampleMask];
+            float slopeY = aboveHeights[column] - belowHeights[column];
+            rowSamples[column] = glm::vec2(slopeY, -slopeX) * scale;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Works out one key's push at a position the slow way, straight from the noise, with the 
+    slopes taken much closer in than the samples are.  This is what the baked samples stand 
+    for, and it is handy for checking how far off the blend between them is and for timing 
+    what the bake saves.
+Parameters:
+    position    In window coords.
+    keyIndex    Self-explanatory.  Key 0 is the field at time 0 (and always, if it doesn't 
+                change).
+Returns:
+    The acceleration in window coords per second per second.  0 if nothing is baked.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+glm::vec2 TurbulenceField::GetExactAcceleration(const glm::vec2 &position, 
+    unsigned int keyIndex) const
+{
+    if (!this->IsInitialized())
+    {
+        return glm::vec2(0.0f, 0.0f);
+    }
+
+    float featuresAcross = (float)(_header._numSamples / SAMPLES_PER_FEATURE);
+    float noiseTime = GetKeyNoiseTime(keyIndex);
+    glm::vec2 featurePosition = position * (_header._inverseCellSize / SAMPLES_PER_FEATURE);
+    glm::vec2 stepX(EXACT_SLOPE_STEP, 0.0f);
+    glm::vec2 stepY(0.0f, EXACT_SLOPE_STEP);
+    float slopeX = GetNoiseHeight(featurePosition + stepX, noiseTime, featuresAcross) - 
+        GetNoiseHeight(featurePosition - stepX, noiseTime, featuresAcross);
+    float slopeY = GetNoiseHeight(featurePosition + stepY, noiseTime, featuresAcross) - 
+        GetNoiseHeight(featurePosition - stepY, noiseTime, featuresAcross);
+    float scale = _settings._strength * CURL_SCALE * (0.5f / EXACT_SLOPE_STEP);
+    return glm::vec2(slopeY, -slopeX) * scale;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The background thread.  Sleeps until it is asked for a key, bakes it into _nextKey, says
+    that it is done, and goes back to sleep, until Cleanup() tells it to quit.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void TurbulenceField::BakeLoop()
+{
+    while (true)
+    {
+        unsigned int keyIndex = 0;
+        {
+            std::unique_lock<std::mutex> lock(_bakeMutex);
+            _bakeCondition.wait(lock, [this]() { return _quitBaking || _isBakeRequested; });
+            if (_quitBaking)
+            {
+                return;
+            }
+            keyIndex = _bakeKeyIndex;
+            _isBakeRequested = false;
+        }
+
+        this->BakeKey(keyIndex, _nextKey.data(), _bakeHeights.data());
+
+        {
+            std::lock_guard<std::mutex> lock(_bakeMutex);
+            _isBakeDone = true;
+        }
+        _bakeCondition.notify_all();
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Moves the keys along by one: the second key becomes the first and the key that the
+    background thread baked becomes the second.  Then the thread is asked for the key after
+    that.  Waits for the thread if it isn't done yet.
+Parameters: None
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void TurbulenceField::TakeNextKey()
+{
+    {
+        std::unique_lock<std::mutex> lock(_bakeMutex);
+        if (!_isBakeDone)
+        {
+            _numStalls++;
+            _bakeCondition.wait(lock, [this]() { return _isBakeDone; });
+        }
+
+        _keys[0].swap(_keys[1]);
+        _keys[1].swap(_nextKey);
+        _firstKeyIndex++;
+        _bakeKeyIndex = _firstKeyIndex + 2;
+        _isBakeDone = false;
+        _isBakeRequested = true;
+    }
+    _bakeCondition.notify_all();
+}
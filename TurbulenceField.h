@@ -0,0 +1,176 @@
+#pragma once
+
+#include "glm/vec2.hpp"
+
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    How the turbulence pushes the particles around (see TurbulenceField).
+
+    _strength       Window coords per second per second.  About how hard a typical spot in the
+                    field pushes.  0 means no turbulence.
+    _featureSize    Window coords.  About how far apart the swirls are.
+    _changesPerSec  How quickly the swirls change, in "whole new field"s per second.  0 means
+                    that the field never changes.
+
+    Note: The settings go into the replay log, so the field is the same every time for the
+    same settings.
+-----------------------------------------------------------------------------------------------*/
+struct TurbulenceSettings
+{
+    float _strength;
+    float _featureSize;
+    float _changesPerSec;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The part of the turbulence field that the update needs to find a sample, followed in
+    memory (and in the shader storage buffer) by the samples themselves.
+
+    _inverseCellSize    Samples per window coord.
+    _numSamples         Across the tile in each direction.  A power of 2, so that a sample's
+                        place wraps around the tile with a mask.  Sample (X, Y) is number
+                        (Y * _numSamples) + X.
+    _sampleMask         _numSamples - 1.
+
+    Note: The header goes into a shader storage buffer just ahead of the samples, so the
+    structure has to match "struct TurbulenceFieldHeader" in the update shaders, which use the
+    std430 layout.  The size (16 bytes) is a multiple of 8 so that the vec2 samples after it
+    are on 8 byte boundaries.
+-----------------------------------------------------------------------------------------------*/
+struct TurbulenceFieldHeader
+{
+    float _inverseCellSize;
+    unsigned int _numSamples;
+    unsigned int _sampleMask;
+    unsigned int _padding;
+};
+
+// the shader storage binding of the turbulence field (see ParticleSimulatorGpu for the others)
+static const unsigned int TURBULENCE_FIELD_BUFFER_BINDING = 13;
+
+// how many samples go across the tile each way
+// Note: Must be a power of 2 (see TurbulenceFieldHeader).
+static const unsigned int TURBULENCE_TILE_SAMPLES = 128;
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A swirling push that gives the particles "rich" motion without working out any noise
+    while they are updated.
+
+    The push is "curl noise": the swirls of a smooth random height field (periodic Perlin
+    noise from glm), which are all loops, so the push never bunches the particles up or
+    spreads them out.  Working that out takes a couple of Perlin lookups and a few dozen
+    multiplies per particle, so instead it is baked ahead of time into a square tile of
+    samples that repeats forever across the window, and the update only blends the 4 samples
+    around a particle (see SampleTurbulenceField(...)).  The noise repeats at the edges of the
+    tile, so there are no seams.
+
+    If the field changes over time, then "keys" are baked at even steps in time and the
+    samples that the update sees are blended between the two keys on either side of the
+    current time (see Advance(...)).  While the simulation goes between those two, a
+    background thread bakes the key after them, so by the time that one is needed it is
+    (nearly always) ready, and the simulation thread only ever blends.  If it isn't ready,
+    then Advance(...) waits for it (see NumStalls()), so the field is the same no matter how
+    fast the background thread is.
+
+    Note: The blend between keys is a straight line, so a swirl fades out and the next one fades
+    in rather than drifting across.  There are 4 keys for every "whole new field", which is
+    enough that it isn't noticeable.
+-----------------------------------------------------------------------------------------------*/
+class TurbulenceField
+{
+public:
+    TurbulenceField();
+    ~TurbulenceField();
+    void Init(const TurbulenceSettings &settings);
+    void Cleanup();
+    bool IsInitialized() const;
+    bool IsAnimated() const;
+    bool Advance(float deltaTimeSec);
+    const TurbulenceFieldHeader &GetHeader() const;
+    const glm::vec2 *GetSamples() const;
+    unsigned int NumSamples() const;
+    unsigned int NumStalls() const;
+    void BakeKey(unsigned int keyIndex, glm::vec2 *samples, float *heights) const;
+    glm::vec2 GetExactAcceleration(const glm::vec2 &position, unsigned int keyIndex) const;
+
+private:
+    // the field owns a thread and a mutex, neither of which can be copied
+    TurbulenceField(const TurbulenceField &) = delete;
+    TurbulenceField &operator=(const TurbulenceField &) = delete;
+
+    void BakeLoop();
+    void TakeNextKey();
+
+    TurbulenceSettings _settings;
+
+    // empty until Init(...)
+    TurbulenceFieldHeader _header;
+    std::vector<glm::vec2> _samples;
+
+    // only used if the field is animated; _keys[1] is one key interval after _keys[0], and
+    // _timeSec is how far the field is past _keys[0]
+    std::vector<glm::vec2> _keys[2];
+    unsigned int _firstKeyIndex;
+    float _keyIntervalSec;
+    float _timeSec;
+    unsigned int _numStalls;
+
+    // the background bake
+    // Note: The background thread only touches _nextKey and _bakeHeights, and only between
+    // being asked for a key and saying that it is done, so they don't need the mutex.
+    std::thread _bakeThread;
+    std::mutex _bakeMutex;
+    std::condition_variable _bakeCondition;
+    unsigned int _bakeKeyIndex;
+    bool _isBakeRequested;
+    bool _isBakeDone;
+    bool _quitBaking;
+    std::vector<glm::vec2> _nextKey;
+    std::vector<float> _bakeHeights;
+};
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Looks up the turbulence's push at a position by blending the 4 samples around it.  The
+    tile repeats forever, so a position anywhere is fine.  This is in the header so that the
+    CPU kernels can inline it.
+
+    Note: Must match TurbulenceAcceleration(...) in the update shaders.
+Parameters:
+    header      See TurbulenceFieldHeader.
+    samples     Self-explanatory.
+    position    In window coords.
+Returns:
+    The acceleration in window coords per second per second.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+inline glm::vec2 SampleTurbulenceField(const TurbulenceFieldHeader &header,
+    const glm::vec2 *samples, const glm::vec2 &position)
+{
+    // Note: floor(...) first so that negative positions wrap the same way as positive ones.
+    // The cast to unsigned keeps the low bits of a negative cell, which is what the mask wants.
+    float x = position.x * header._inverseCellSize;
+    float y = position.y * header._inverseCellSize;
+    float floorX = floorf(x);
+    float floorY = floorf(y);
+    float fractionX = x - floorX;
+    float fractionY = y - floorY;
+    unsigned int left = (unsigned int)(int)floorX & header._sampleMask;
+    unsigned int bottom = (unsigned int)(int)floorY & header._sampleMask;
+    unsigned int right = (left + 1) & header._sampleMask;
+    unsigned int top = (bottom + 1) & header._sampleMask;
+
+    const glm::vec2 *bottomRow = samples + (bottom * header._numSamples);
+    const glm::vec2 *topRow = samples + (top * header._numSamples);
+    glm::vec2 bottomBlend = bottomRow[left] + ((bottomRow[right] - bottomRow[left]) * fractionX);
+    glm::vec2 topBlend = topRow[left] + ((topRow[right] - topRow[left]) * fractionX);
+    return bottomBlend + ((topBlend - bottomBlend) * fractionY);
+}
@@ -33,14 +33,373 @@
 // for printf(...)
 #include <stdio.h>
 
+// for parsing the command line
+#include <string.h>
+#include <stdlib.h>
+
+// for timing headless runs
+#include <chrono>
+
+// for laying out the emitters
+#include <math.h>
+#include <vector>
+#include "glm/common.hpp"   // glm::min and glm::max
+
 // for basic OpenGL stuff
 #include "OpenGlErrorHandling.h"
 #include "GenerateShader.h"
 #include "ParticleManager.h"
+#include "ParticleSimulatorCpu.h"
+#include "ParticleSimulatorGpu.h"
+#include "ParticleBenchmark.h"
+#include "ThreadPool.h"
+#include "FrameClock.h"
+#include "ReplayLog.h"
 
 
+// Note: The simulators are declared before the manager so that they are destroyed after it, and 
+// the thread pool is declared before the simulators for the same reason.
+ThreadPool gThreadPool;
+ParticleSimulatorCpu gCpuSimulator;
+ParticleSimulatorGpu gGpuSimulator;
 ParticleManager gParticleManager;
 
+// set from the command line
+bool gUseCpuSimulator = false;
+bool gUsePackedFormat = false;
+unsigned int gNumThreads = 0;   // 0 means one for each logical processor
+bool gPinThreads = false;
+float gSimRateHz = 60.0f;
+unsigned int gRandomSeed = 0;
+const char *gRecordFilePath = 0;    // 0 means don't record
+unsigned int gNumEmitters = 1;
+float gMinLifetimeSec = 0.0f;   // 0 and 0 means that particles live until they go out of bounds
+float gMaxLifetimeSec = 0.0f;
+bool gUseForceFields = false;
+float gGravityStrength = 0.0f;  // 0 means no gravity
+float gGravityOpeningAngle = 0.0f;
+unsigned int gGravityMeshSize = 0;  // 0 means use the tree
+float gCollisionRadius = 0.0f;  // 0 means no collisions
+const char *gObstacleFilePath = 0;  // 0 means no obstacles
+IntegratorType gIntegrator = INTEGRATOR_SEMI_IMPLICIT_EULER;
+FluidSettings gFluid = { 0.0f, 0.0f, 0.0f, 0.0f };  // a smoothing radius of 0 means no fluid
+TurbulenceSettings gTurbulence = { 0.0f, 0.0f, 0.0f };  // a strength of 0 means no turbulence
+unsigned int gReorderSteps = 0;     // 0 means never sort the particles
+unsigned int gNumSubsteps = 1;      // how many steps each update takes
+bool gUseStateless = false;
+bool gScheduleExits = false;
+unsigned int gNumStatelessParticles = 0;
+
+// how far apart the obstacle field's samples are, in window coords (main.cpp's window is 500 
+// pixels across the [-1,+1] window space, so this is about a pixel)
+static const float OBSTACLE_CELL_SIZE = 2.0f / 512.0f;
+
+// drives the simulation in fixed steps, independent of how fast frames are drawn
+// Note: If a frame owes more steps than this, then the simulation slows down instead of 
+// trying to catch up (see FrameClock.h).
+FrameClock gFrameClock;
+static const unsigned int MAX_SIM_STEPS_PER_FRAME = 4;
+
+// records this run or plays back an earlier one (see ReplayLog.h)
+ReplayLog gReplayLog;
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    A one-word name for the simulator that is in use, for the replay log.
+Parameters: None
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+const char *SimulatorName()
+{
+    return gUseCpuSimulator ? "cpu" : "gpu";
+}
+
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Turns the scenario into the emitter table.  One emitter is just the scenario's circle.  
+    More than that are laid out in a grid over the window, each with a circle that fits in its 
+    grid cell, and the particles and the quota are split between them as evenly as they go.
+Parameters:
+    scenario    Self-explanatory.
+Returns:
+    See description.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+std::vector<ParticleEmitter> BuildEmitters(const ReplayScenario &scenario)
+{
+    unsigned int numEmitters = (scenario._numEmitters > 0) ? scenario._numEmitters : 1;
+    unsigned int numPerRow = (unsigned int)ceil(sqrt((double)numEmitters));
+    float cellSize = 2.0f / numPerRow;
+
+    std::vector<ParticleEmitter> emitters(numEmitters, ParticleEmitter());
+    for (unsigned int emitterIndex = 0; emitterIndex < numEmitters; emitterIndex++)
+    {
+        ParticleEmitter &emitter = emitters[emitterIndex];
+        if (numEmitters == 1)
+        {
+            emitter._center = scenario._center;
+            emitter._radius = scenario._radius;
+        }
+        else
+        {
+            unsigned int column = emitterIndex % numPerRow;
+            unsigned int row = emitterIndex / numPerRow;
+            emitter._center = glm::vec2(-1.0f + ((column + 0.5f) * cellSize), 
+                -1.0f + ((row + 0.5f) * cellSize));
+            emitter._radius = cellSize * 0.5f;
+        }
+        emitter._minVelocity = scenario._minVelocity;
+        emitter._maxVelocity = scenario._maxVelocity;
+        emitter._minLifetimeSec = scenario._minLifetimeSec;
+        emitter._maxLifetimeSec = scenario._maxLifetimeSec;
+
+        // the first few get any that are left over
+        emitter._numParticles = (scenario._numParticles / numEmitters) + 
+            ((emitterIndex < (scenario._numParticles % numEmitters)) ? 1 : 0);
+        emitter._maxParticlesEmittedPerFrame = (scenario._maxParticlesEmittedPerFrame / numEmitters) +
+            ((emitterIndex < (scenario._maxParticlesEmittedPerFrame % numEmitters)) ? 1 : 0);
+    }
+
+    return emitters;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    The demo's force fields: a gravity well off to one side, a whirlpool on the other, a 
+    little drag so that the swirling particles don't speed up forever, and a light wind that 
+    blows down like gravity.  The scenario only says whether to use them.
+Parameters:
+    scenario    Self-explanatory.
+Returns:
+    The table for ParticleSimulator::SetForceFields(...).  Empty if they aren't used.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+std::vector<ForceField> BuildForceFields(const ReplayScenario &scenario)
+{
+    std::vector<ForceField> forceFields;
+    if (!scenario._useForceFields)
+    {
+        return forceFields;
+    }
+
+    ForceField field = ForceField();
+    field._type = FORCE_FIELD_ATTRACTOR;
+    field._position = glm::vec2(-0.4f, -0.2f);
+    field._strength = 0.05f;
+    field._radius = 0.1f;
+    forceFields.push_back(field);
+
+    field = ForceField();
+    field._type = FORCE_FIELD_VORTEX;
+    field._position = glm::vec2(+0.5f, +0.4f);
+    field._strength = 0.1f;
+    field._radius = 0.1f;
+    forceFields.push_back(field);
+
+    field = ForceField();
+    field._type = FORCE_FIELD_DRAG;
+    field._strength = 0.2f;
+    forceFields.push_back(field);
+
+    field = ForceField();
+    field._type = FORCE_FIELD_WIND;
+    field._direction = glm::vec2(0.0f, -1.0f);
+    field._strength = 0.1f;
+    forceFields.push_back(field);
+
+    return forceFields;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Loads the scenario's obstacle file, if it has one, and bakes it over the box around every 
+    emitter's circle, which is everywhere that the particles can be.
+Parameters:
+    scenario    Self-explanatory.
+    emitters    From BuildEmitters(...).
+Returns:
+    The field for ParticleSimulator::SetObstacles(...).  Not baked if there are no obstacles 
+    or the file couldn't be read.
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+ObstacleField BuildObstacles(const ReplayScenario &scenario, 
+    const std::vector<ParticleEmitter> &emitters)
+{
+    ObstacleField obstacles;
+    if (scenario._obstacleFilePath.empty() || !obstacles.Load(scenario._obstacleFilePath.c_str()))
+    {
+        return obstacles;
+    }
+
+    glm::vec2 minCorner = emitters[0]._center - glm::vec2(emitters[0]._radius);
+    glm::vec2 maxCorner = emitters[0]._center + glm::vec2(emitters[0]._radius);
+    for (size_t emitterIndex = 1; emitterIndex < emitters.size(); emitterIndex++)
+    {
+        const ParticleEmitter &emitter = emitters[emitterIndex];
+        minCorner = glm::min(minCorner, emitter._center - glm::vec2(emitter._radius));
+        maxCorner = glm::max(maxCorner, emitter._center + glm::vec2(emitter._radius));
+    }
+
+    // Note: The thread pool is only running for the CPU simulator.
+    std::chrono::high_resolution_clock::time_point start =
+        std::chrono::high_resolution_clock::now();
+    obstacles.Bake(minCorner, maxCorner, OBSTACLE_CELL_SIZE, 
+        gUseCpuSimulator ? &gThreadPool : 0);
+    std::chrono::high_resolution_clock::time_point end =
+        std::chrono::high_resolution_clock::now();
+    const ObstacleFieldHeader &header = obstacles.GetHeader();
+    printf("obstacles: %u shapes baked into %u x %u samples in %.1f ms\n", 
+        obstacles.NumShapes(), header._numSamplesX, header._numSamplesY,
+        std::chrono::duration<double, std::milli>(end - start).count());
+    return obstacles;
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Sets up the particle manager with the demo's particle count, emitter, and velocities.  This 
+    is separate from Init() so that a headless run can use the same scenario without creating 
+    any OpenGL objects.
+Parameters:
+    particleProgramId   The drawing program.  0 if there is no OpenGL context.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void InitParticles(unsigned int particleProgramId)
+{
+    ParticleSimulator *simulator = &gGpuSimulator;
+    if (gUseCpuSimulator)
+    {
+        gThreadPool.Init(gNumThreads, gPinThreads);
+        gCpuSimulator.SetThreadPool(&gThreadPool);
+        simulator = &gCpuSimulator;
+    }
+
+    // all values are in windows space (X and Y limited to [-1,+1])
+    // Note: Toy with the values as you will.
+    // Also Note: A replay has to use the recorded values instead.
+    ReplayScenario scenario;
+    if (gReplayLog.IsReplaying())
+    {
+        scenario = gReplayLog.GetScenario();
+    }
+    else
+    {
+        //scenario._numParticles = 20000;
+        scenario._randomSeed = gRandomSeed;
+        scenario._numParticles = gUseStateless ? gNumStatelessParticles : 600000;
+        scenario._maxParticlesEmittedPerFrame = 200;
+        scenario._center = glm::vec2(+0.3f, +0.3f);
+        scenario._radius = 1.1f;
+        scenario._minVelocity = 0.05f;
+        scenario._maxVelocity = 0.6f;
+        scenario._minLifetimeSec = gMinLifetimeSec;
+        scenario._maxLifetimeSec = gMaxLifetimeSec;
+        scenario._numEmitters = gNumEmitters;
+        scenario._useForceFields = gUseForceFields;
+        scenario._usePackedFormat = gUsePackedFormat;
+        scenario._gravityStrength = gGravityStrength;
+        scenario._gravityOpeningAngle = gGravityOpeningAngle;
+        scenario._gravityMeshSize = gGravityMeshSize;
+        scenario._collisionRadius = gCollisionRadius;
+        scenario._obstacleFilePath = (gObstacleFilePath != 0) ? gObstacleFilePath : "";
+        scenario._integrator = gIntegrator;
+        scenario._fluid = gFluid;
+        scenario._turbulence = gTurbulence;
+        scenario._reorderSteps = gReorderSteps;
+        scenario._numSubsteps = gNumSubsteps;
+        scenario._isStateless = gUseStateless;
+        scenario._scheduleExits = gScheduleExits;
+    }
+    gParticleManager.SetPackedFormat(scenario._usePackedFormat);
+    gParticleManager.SetStateless(scenario._isStateless);
+
+    // Note: The integrator, fluid, reorder, substeps, gravity, and collisions are set up during 
+    // the simulator's Init(...), which the manager calls.
+    simulator->SetIntegrator(scenario._integrator);
+    simulator->SetFluid(scenario._fluid);
+    simulator->SetReorder(scenario._reorderSteps);
+    simulator->SetSubsteps(scenario._numSubsteps);
+    gCpuSimulator.SetGravity(scenario._gravityStrength, scenario._gravityOpeningAngle);
+    gCpuSimulator.SetGravityMesh(scenario._gravityMeshSize);
+    gCpuSimulator.SetCollisions(scenario._collisionRadius);
+    gCpuSimulator.SetExitScheduling(scenario._scheduleExits);
+    if (!gUseCpuSimulator && scenario._gravityStrength != 0.0f)
+    {
+        printf("gravity only runs on the CPU simulator (-cpu); ignoring it\n");
+    }
+    if (!gUseCpuSimulator && scenario._collisionRadius > 0.0f)
+    {
+        printf("collisions only run on the CPU simulator (-cpu); ignoring them\n");
+    }
+    if (!gUseCpuSimulator && scenario._scheduleExits)
+    {
+        printf("scheduled exits only run on the CPU simulator (-cpu); ignoring them\n");
+    }
+
+    // Note: The particles are the same whether or not they are made on the threads (see 
+    // ParticleManager::SetThreadPool(...)), so a replay doesn't care which simulator made them.
+    gParticleManager.SetRandomSeed(scenario._randomSeed);
+    gParticleManager.SetThreadPool(gUseCpuSimulator ? &gThreadPool : 0);
+    std::vector<ParticleEmitter> emitters = BuildEmitters(scenario);
+    gParticleManager.Init(particleProgramId, simulator, emitters);
+    if (scenario._isStateless)
+    {
+        // Note: The simulator was never initialized, so don't hand it anything.
+        bool usesSimulator = scenario._useForceFields || 
+            !scenario._obstacleFilePath.empty() || (scenario._turbulence._strength != 0.0f) || 
+            (scenario._fluid._smoothingRadius > 0.0f) || (scenario._gravityStrength != 0.0f) || 
+            (scenario._collisionRadius > 0.0f) || (scenario._reorderSteps > 0) || 
+            (scenario._numSubsteps > 1) || scenario._usePackedFormat || scenario._scheduleExits;
+        if (usesSimulator)
+        {
+            printf("stateless particles aren't simulated; ignoring the simulator's options\n");
+        }
+    }
+    else
+    {
+        simulator->SetForceFields(BuildForceFields(scenario));
+        simulator->SetObstacles(BuildObstacles(scenario, emitters));
+        simulator->SetTurbulence(scenario._turbulence);
+    }
+
+    if (gRecordFilePath != 0)
+    {
+        // Note: The instruction set isn't known until the simulator has been initialized.
+        scenario._numThreads = gUseCpuSimulator ? gThreadPool.NumThreads() : 0;
+        scenario._useSoaStorage = 
+            (gCpuSimulator.GetStorage() == ParticleSimulatorCpu::STORAGE_SOA);
+        scenario._simdLevel = gCpuSimulator.GetSimdLevel();
+        gReplayLog.StartRecording(gRecordFilePath, scenario, SimulatorName());
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Advances the particles by the given number of fixed steps.  If a replay log is recording or 
+    playing back, then the frame is handed to it afterwards.
+Parameters:
+    numSteps    Self-explanatory.  May be 0.
+    stepSec     The delta time of each step.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void SimulateFrame(unsigned int numSteps, float stepSec)
+{
+    for (unsigned int stepCount = 0; stepCount < numSteps; stepCount++)
+    {
+        gParticleManager.Update(stepSec);
+    }
+
+    if (gReplayLog.IsRecording() || gReplayLog.IsReplaying())
+    {
+        gReplayLog.EndFrame(numSteps, stepSec, gParticleManager.TakeFingerprint());
+    }
+}
+
 
 /*-----------------------------------------------------------------------------------------------
 Description:
@@ -66,26 +425,15 @@ void Init()
     glDepthFunc(GL_LEQUAL);
     glDepthRange(0.0f, 1.0f);
 
-    GLuint particleProgramId = GenerateVertexShaderProgram();
-    GLuint computeProgramId = GenerateComputeShaderProgram();
-
-    // all values are in windows space (X and Y limited to [-1,+1])
-    // Note: Toy with the values as you will.
-    //unsigned int totalParticles = 20000;
-    unsigned int totalParticles = 600000;
-    unsigned int maxParticlesEmittedPerFrame = 200;
-    glm::vec2 center = glm::vec2(+0.3f, +0.3f);
-    float radius = 1.1f;
-    float minVelocity = 0.05f;
-    float maxVelocity = 0.6f;
-    gParticleManager.Init(particleProgramId,
-        computeProgramId,
-        totalParticles,
-        maxParticlesEmittedPerFrame,
-        center,
-        radius, 
-        minVelocity, 
-        maxVelocity);
+    // Note: The compute shader, if needed, is loaded by the GPU simulator.
+    const char *vertFileName = gUsePackedFormat ? "shaderParticlePacked.vert" : 
+        "shaderParticle.vert";
+    if (gUseStateless)
+    {
+        vertFileName = "shaderParticleStateless.vert";
+    }
+    GLuint particleProgramId = GenerateVertexShaderProgram(vertFileName);
+    InitParticles(particleProgramId);
 }
 
 /*-----------------------------------------------------------------------------------------------
@@ -106,11 +454,28 @@ void Display()
     glClearDepth(1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // in the absence of an actual timer, use a hard-coded delta time
-    gParticleManager.Update(0.01f);
+    // simulate however many fixed steps of real time have gone by since the last frame (maybe 
+    // none if the display rate is faster than the simulation rate)
+    unsigned int numSteps = gFrameClock.Tick();
+    float stepSec = gFrameClock.GetFixedStepSec();
+    float interpolation = gFrameClock.GetInterpolation();
+    if (gReplayLog.IsReplaying())
+    {
+        // a replay takes the recorded steps instead, one recorded frame per drawn frame
+        interpolation = 1.0f;
+        if (!gReplayLog.GetReplayFrame(&numSteps, &stepSec))
+        {
+            gReplayLog.PrintReplayReport(SimulatorName());
+            glutLeaveMainLoop();
+            return;
+        }
+    }
+    SimulateFrame(numSteps, stepSec);
 
     // this handles its own bindings and cleans up when it is done
-    gParticleManager.Render();
+    // Note: The leftover time that wasn't enough for a whole step says how far to draw the 
+    // particles between the last two steps.
+    gParticleManager.Render(interpolation);
 
     // tell the GPU to swap out the displayed buffer with the one that was just rendered
     glutSwapBuffers();
@@ -220,12 +585,173 @@ Creator:    John Cox (2-13-2016)
 -----------------------------------------------------------------------------------------------*/
 void CleanupAll()
 {
+    // the fluid's pass timings, if there was a fluid
+    ParticleSimulator *simulator = &gGpuSimulator;
+    if (gUseCpuSimulator)
+    {
+        simulator = &gCpuSimulator;
+    }
+    FluidPassTimes fluidPassTimes = simulator->GetFluidPassTimes();
+    if (fluidPassTimes._numSteps > 0)
+    {
+        printf("fluid: %u steps,", fluidPassTimes._numSteps);
+        for (int passIndex = 0; passIndex < FLUID_PASS_COUNT; passIndex++)
+        {
+            printf(" %s %.3f ms/step", FluidPassName((FluidPass)passIndex), 
+                fluidPassTimes._totalMs[passIndex] / fluidPassTimes._numSteps);
+        }
+        printf("\n");
+    }
+
     gParticleManager.Cleanup();
+    gThreadPool.Cleanup();
+    gReplayLog.Cleanup();
+}
+
+/*-----------------------------------------------------------------------------------------------
+Description:
+    Runs the CPU simulator for the requested number of frames without creating a window or an 
+    OpenGL context, then reports how long it took.  This is for machines that don't have a GPU 
+    and for comparing the CPU simulator against the compute shader.
+
+    If a replay log is playing back, then its frames are run instead, and the timing includes 
+    taking every frame's fingerprint.
+Parameters:
+    numFrames   Self-explanatory.  Ignored during playback.
+Returns:    None
+Exception:  Safe
+-----------------------------------------------------------------------------------------------*/
+void RunHeadless(unsigned int numFrames)
+{
+    // no context, so no compute shader
+    gUseCpuSimulator = true;
+    InitParticles(0);
+
+    std::chrono::high_resolution_clock::time_point start = 
+        std::chrono::high_resolution_clock::now();
+    unsigned int frameCount = 0;
+    for (; gReplayLog.IsReplaying() || frameCount < numFrames; frameCount++)
+    {
+        // same fixed step as Display(), but as fast as it will go
+        unsigned int numSteps = 1;
+        float stepSec = 1.0f / gSimRateHz;
+        if (gReplayLog.IsReplaying() && !gReplayLog.GetReplayFrame(&numSteps, &stepSec))
+        {
+            break;
+        }
+        SimulateFrame(numSteps, stepSec);
+    }
+    numFrames = frameCount;
+    std::chrono::high_resolution_clock::time_point end = 
+        std::chrono::high_resolution_clock::now();
+
+    double elapsedMs = std::chrono::duration<double, std::milli>(end - start).count();
+    double msPerFrame = (numFrames > 0) ? (elapsedMs / numFrames) : 0.0;
+    double nsPerParticle = (msPerFrame * 1000000.0) / gParticleManager.NumParticles();
+    printf("headless: %u frames of %u particles on %u threads (%s) in %.3f ms (%.4f ms/frame, %.3f ns/particle)\n", 
+        numFrames, gParticleManager.NumParticles(), gThreadPool.NumThreads(), 
+        SimdLevelName(gCpuSimulator.GetSimdLevel()), elapsedMs, msPerFrame, nsPerParticle);
+    gReplayLog.PrintReplayReport(SimulatorName());
+
+    CleanupAll();
 }
 
 /*-----------------------------------------------------------------------------------------------
 Description:
     Program start and end.
+
+    Command line options:
+    -cpu                Simulate on the CPU instead of in the compute shader.
+    -soa                Have the CPU simulator use "structure of arrays" storage.
+    -packed             Keep the particles in the compact 12 byte format (see ParticlePacked.h).
+                        Works with either simulator.
+    -threads <count>    How many threads the CPU simulator uses (default: all of them).
+    -pin                Keep each CPU simulator thread on its own logical processor.
+    -simd <level>       The fastest instruction set that the CPU simulator may use ("scalar", 
+                        "sse2", or "avx2"; default: the fastest that the CPU has).
+    -simrate <hz>       How many fixed steps per second the simulation takes (default: 60), 
+                        no matter how fast frames are drawn.
+    -emitters <count>   Split the particles between this many emitters, spread out over the 
+                        window (default: 1).  They are all updated and drawn together.
+    -lifetime <min> <max>
+                        Give each particle a lifetime between min and max seconds, after 
+                        which it is recycled even if it is still in bounds (default: none).  
+                        Slow particles then don't hold on to their slots for so long.
+    -forces             Push the particles around with a few force fields (see 
+                        BuildForceFields(...)).
+    -grid <size>        Have the CPU simulator sort the particles into a neighbor grid after 
+                        every update, with cells this fraction of the emitter radius across 
+                        (see NeighborGrid.h).  Nothing in the demo uses it yet, but the cost 
+                        shows up in -headless timings.
+    -gravity <strength> <angle>
+                        Have every particle pull on every other one with the CPU simulator, 
+                        using a Barnes-Hut tree with the given opening angle (ex: 0.1 0.7; see 
+                        GravityTree.h).  Strength is the pull at a distance of 1 from all of 
+                        the particles together.
+    -gravitymesh <size> With -gravity, work out the pull on a size x size particle-mesh with 
+                        FFTs instead of with the tree (ex: 512; see ParticleMeshGravity.h).
+    -collide <radius>   Have the particles bounce off of each other with the CPU simulator, as 
+                        if each were a circle of this radius in window coords (ex: 0.002; see 
+                        ParticleCollider.h).
+    -obstacles <file>   Bounce the particles off of the shapes in this file, which are baked 
+                        into a signed distance field first (see ObstacleField.h for the 
+                        format).  Works with either simulator.
+    -integrator <name>  How the particles are moved when force fields or gravity push on them 
+                        ("euler", "semi-implicit", "verlet", or "rk4"; default: 
+                        "semi-implicit"; see ParticleIntegrator.h).  Works with either 
+                        simulator.
+    -fluid <radius> <density> <stiffness> <viscosity>
+                        Make the particles behave like a fluid with this smoothing radius, 
+                        rest density, stiffness, and viscosity (ex: 0.01 60000 0.05 0.0002; 
+                        see ParticleFluid.h).  Works with either simulator, but the compute 
+                        shader needs the full particle format.  The time that each pass took 
+                        is printed at the end.
+    -turbulence <strength> <size> <speed>
+                        Push the particles around with swirling turbulence this strong, with 
+                        swirls about this far apart, that change this many times a second 
+                        (ex: 0.5 0.2 0.5; a speed of 0 never changes; see TurbulenceField.h).  
+                        Works with either simulator.
+    -reorder <steps>    Sort the particles by where they are every this many steps so that 
+                        particles that are close together are close together in memory (ex: 
+                        20; see ParticleReorder.h).  Works with either simulator.
+    -substeps <count>   Take this many steps every update, so the simulation runs that many 
+                        times faster (default: 1).  If the particles are only moving in 
+                        straight lines, then each one is only loaded and stored once per 
+                        update (see ParticleSimulatorCpu::StepBlocked(...)).  Works with 
+                        either simulator.
+    -exits              Have the CPU simulator work out when each particle will leave its 
+                        emitter's circle as soon as it is sent out, instead of testing every 
+                        particle on every step (see 
+                        ParticleSimulatorCpu::SetExitScheduling(...)).  Only used when the 
+                        particles move in straight lines and aren't packed.
+    -stateless <count>  Don't simulate or even store the particles, but work out where each of 
+                        this many particles is from its index and the time, in the vertex 
+                        shader (ex: 100000000; see ParticleStateless.h).  They only move in 
+                        straight lines, so the simulator's options are ignored.
+    -seed <number>      Seeds the particles' random starting positions and velocities 
+                        (default: 0).  The same seed always makes the same particles.
+    -record <file>      Write the scenario and every frame's time steps and particle 
+                        fingerprint to a replay log (see ReplayLog.h).
+    -replay <file>      Run the scenario and time steps from a replay log instead of the 
+                        defaults and the clock, compare every frame's particles against it, 
+                        print how they compared, and quit.  Works with either simulator and 
+                        with -headless.  If the CPU simulator made the log, then its thread 
+                        count, storage, and instruction set are used instead of -threads, 
+                        -soa, and -simd.
+    -headless <frames>  Simulate on the CPU for the given number of frames without a window, 
+                        print the timing, and quit.
+    -benchmark          Time the CPU simulator's storage options at 600 thousand and 50 million 
+                        particles and its scaling across threads, report the packed format's 
+                        drift, time the force fields at 1 million particles, time the 
+                        neighbor grid at 10 million particles, time the gravity tree and mesh at 1 
+                        million particles, time the collisions and the obstacles at 1 
+                        million particles, compare the integrators' accuracy and time them 
+                        at 1 million particles, time the fluid at 250 thousand particles, 
+                        time the turbulence at 1 million particles, time the reorder at 2 
+                        million particles, time the substeps at 10 million particles, 
+                        compare stateless particles against simulated ones at 10 million 
+                        particles, time the scheduled exits at 2 million particles, all 
+                        without a window, and quit.
 Parameters:
     argc    The number of strings in argv.
     argv    A pointer to an array of null-terminated, C-style strings.
@@ -236,6 +762,225 @@ Creator:    John Cox (2-13-2016)
 -----------------------------------------------------------------------------------------------*/
 int main(int argc, char *argv[])
 {
+    unsigned int numHeadlessFrames = 0;
+    bool runHeadless = false;
+    for (int argIndex = 1; argIndex < argc; argIndex++)
+    {
+        if (strcmp(argv[argIndex], "-cpu") == 0)
+        {
+            gUseCpuSimulator = true;
+        }
+        else if (strcmp(argv[argIndex], "-soa") == 0)
+        {
+            gCpuSimulator.SetStorage(ParticleSimulatorCpu::STORAGE_SOA);
+        }
+        else if (strcmp(argv[argIndex], "-packed") == 0)
+        {
+            gUsePackedFormat = true;
+        }
+        else if (strcmp(argv[argIndex], "-threads") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gNumThreads = (unsigned int)atoi(argv[argIndex]);
+        }
+        else if (strcmp(argv[argIndex], "-pin") == 0)
+        {
+            gPinThreads = true;
+        }
+        else if (strcmp(argv[argIndex], "-simd") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            SimdLevel maxSimdLevel = SIMD_LEVEL_AVX2;
+            if (GetSimdLevelByName(argv[argIndex], &maxSimdLevel))
+            {
+                gCpuSimulator.SetSimdLevel(maxSimdLevel);
+            }
+            else
+            {
+                printf("unknown instruction set '%s' (use scalar, sse2, or avx2); ignoring it\n", 
+                    argv[argIndex]);
+            }
+        }
+        else if (strcmp(argv[argIndex], "-simrate") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            float simRateHz = (float)atof(argv[argIndex]);
+            if (simRateHz > 0.0f)
+            {
+                gSimRateHz = simRateHz;
+            }
+        }
+        else if (strcmp(argv[argIndex], "-benchmark") == 0)
+        {
+            RunStorageBenchmark(600000, 100);
+            RunStorageBenchmark(50000000, 10);
+            RunThreadingBenchmark(10000000, 20, gNumThreads, gPinThreads);
+            RunPackedErrorReport(600000, 2000);
+            RunForceFieldBenchmark(1000000, 50);
+            RunNeighborGridBenchmark(10000000, 20, gNumThreads, gPinThreads);
+            RunGravityBenchmark(1000000, 5, gNumThreads, gPinThreads);
+            RunCollisionBenchmark(1000000, 10, gNumThreads, gPinThreads);
+            RunObstacleBenchmark(1000000, 50);
+            RunIntegratorBenchmark(1000000, 50);
+            RunFluidBenchmark(250000, 20, gNumThreads, gPinThreads);
+            RunTurbulenceBenchmark(1000000, 50);
+            RunReorderBenchmark(2000000, 5, gNumThreads, gPinThreads);
+            RunSubstepBenchmark(10000000, 16, gNumThreads, gPinThreads);
+            RunStatelessBenchmark(10000000, 10);
+            RunExitScheduleBenchmark(2000000, 400);
+            return 0;
+        }
+        else if (strcmp(argv[argIndex], "-emitters") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            unsigned int numEmitters = (unsigned int)atoi(argv[argIndex]);
+            if (numEmitters > 0 && numEmitters <= MAX_EMITTERS)
+            {
+                gNumEmitters = numEmitters;
+            }
+        }
+        else if (strcmp(argv[argIndex], "-lifetime") == 0 && (argIndex + 2) < argc)
+        {
+            float minLifetimeSec = (float)atof(argv[argIndex + 1]);
+            float maxLifetimeSec = (float)atof(argv[argIndex + 2]);
+            argIndex += 2;
+            if (minLifetimeSec > 0.0f && maxLifetimeSec >= minLifetimeSec)
+            {
+                gMinLifetimeSec = minLifetimeSec;
+                gMaxLifetimeSec = maxLifetimeSec;
+            }
+        }
+        else if (strcmp(argv[argIndex], "-forces") == 0)
+        {
+            gUseForceFields = true;
+        }
+        else if (strcmp(argv[argIndex], "-grid") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gCpuSimulator.SetNeighborGrid((float)atof(argv[argIndex]));
+        }
+        else if (strcmp(argv[argIndex], "-gravity") == 0 && (argIndex + 2) < argc)
+        {
+            gGravityStrength = (float)atof(argv[argIndex + 1]);
+            gGravityOpeningAngle = (float)atof(argv[argIndex + 2]);
+            argIndex += 2;
+        }
+        else if (strcmp(argv[argIndex], "-gravitymesh") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gGravityMeshSize = (unsigned int)atoi(argv[argIndex]);
+        }
+        else if (strcmp(argv[argIndex], "-collide") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gCollisionRadius = (float)atof(argv[argIndex]);
+        }
+        else if (strcmp(argv[argIndex], "-obstacles") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gObstacleFilePath = argv[argIndex];
+        }
+        else if (strcmp(argv[argIndex], "-integrator") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            GetIntegratorByName(argv[argIndex], &gIntegrator);
+        }
+        else if (strcmp(argv[argIndex], "-fluid") == 0 && (argIndex + 4) < argc)
+        {
+            gFluid._smoothingRadius = (float)atof(argv[argIndex + 1]);
+            gFluid._restDensity = (float)atof(argv[argIndex + 2]);
+            gFluid._stiffness = (float)atof(argv[argIndex + 3]);
+            gFluid._viscosity = (float)atof(argv[argIndex + 4]);
+            argIndex += 4;
+        }
+        else if (strcmp(argv[argIndex], "-turbulence") == 0 && (argIndex + 3) < argc)
+        {
+            gTurbulence._strength = (float)atof(argv[argIndex + 1]);
+            gTurbulence._featureSize = (float)atof(argv[argIndex + 2]);
+            gTurbulence._changesPerSec = (float)atof(argv[argIndex + 3]);
+            argIndex += 3;
+        }
+        else if (strcmp(argv[argIndex], "-reorder") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gReorderSteps = (unsigned int)atoi(argv[argIndex]);
+        }
+        else if (strcmp(argv[argIndex], "-substeps") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            unsigned int numSubsteps = (unsigned int)atoi(argv[argIndex]);
+            if (numSubsteps > 0)
+            {
+                gNumSubsteps = numSubsteps;
+            }
+        }
+        else if (strcmp(argv[argIndex], "-exits") == 0)
+        {
+            gScheduleExits = true;
+        }
+        else if (strcmp(argv[argIndex], "-stateless") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gNumStatelessParticles = (unsigned int)strtoul(argv[argIndex], 0, 10);
+            gUseStateless = (gNumStatelessParticles > 0);
+        }
+        else if (strcmp(argv[argIndex], "-seed") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gRandomSeed = (unsigned int)strtoul(argv[argIndex], 0, 10);
+        }
+        else if (strcmp(argv[argIndex], "-record") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            gRecordFilePath = argv[argIndex];
+        }
+        else if (strcmp(argv[argIndex], "-replay") == 0 && (argIndex + 1) < argc)
+        {
+            argIndex++;
+            if (!gReplayLog.StartReplay(argv[argIndex]))
+            {
+                return 0;
+            }
+        }
+        else if (strcmp(argv[argIndex], "-headless") == 0 && (argIndex + 1) < argc)
+        {
+            // run after the rest of the options have been read
+            argIndex++;
+            numHeadlessFrames = (unsigned int)atoi(argv[argIndex]);
+            runHeadless = true;
+        }
+    }
+
+    // the drawing program has to match the recorded particle format, and the CPU simulator has 
+    // to run the way that it did when it was recorded (see ReplayScenario)
+    if (gReplayLog.IsReplaying())
+    {
+        const ReplayScenario &scenario = gReplayLog.GetScenario();
+        gUsePackedFormat = scenario._usePackedFormat;
+        gUseStateless = scenario._isStateless;
+        if (scenario._numThreads > 0)
+        {
+            gNumThreads = scenario._numThreads;
+            gCpuSimulator.SetStorage(scenario._useSoaStorage ? 
+                ParticleSimulatorCpu::STORAGE_SOA : ParticleSimulatorCpu::STORAGE_AOS);
+            gCpuSimulator.SetSimdLevel(scenario._simdLevel);
+            printf("replay log: the CPU simulator uses %u threads, %s storage, and %s\n", 
+                scenario._numThreads, scenario._useSoaStorage ? "SoA" : "AoS", 
+                SimdLevelName(scenario._simdLevel));
+            if (DetectSimdLevel() < scenario._simdLevel)
+            {
+                printf("replay log: this CPU doesn't have %s, so the particles may differ\n", 
+                    SimdLevelName(scenario._simdLevel));
+            }
+        }
+    }
+
+    if (runHeadless)
+    {
+        RunHeadless(numHeadlessFrames);
+        return 0;
+    }
+
     glutInit(&argc, argv);
 
     int width = 500;
@@ -278,6 +1023,9 @@ int main(int argc, char *argv[])
 
     Init();
 
+    // start the clock last so that the first frame doesn't owe steps for the setup time
+    gFrameClock.Init(1.0f / gSimRateHz, MAX_SIM_STEPS_PER_FRAME);
+
     glutDisplayFunc(Display);
     glutReshapeFunc(Reshape);
     glutKeyboardFunc(Keyboard);
@@ -7,6 +7,13 @@ layout (location = 0) in vec2 pos;
 // seconds)
 layout (location = 1) in vec2 vel;  
 
+// the "is active" flag, converted from an int to a float by glVertexAttribPointer(...)
+layout (location = 2) in float isActive;
+
+// how far back in time from the last update to draw the particle (see 
+// ParticleManager::Render(...)); 0 or negative
+uniform float uRenderOffsetSec;
+
 // must have the same name as its corresponding "in" item in the frag shader
 smooth out vec3 particleColor;
 
@@ -14,6 +21,18 @@ void main()
 {
     // hard code a white particle color
     particleColor = vec3(1.0f, 1.0f, 1.0f);
-	gl_Position = vec4(pos, -1.0f, 1.0f);
+
+    // the simulation runs in fixed steps that don't line up with frames, so draw the particle
+    // partway between the last two steps instead of where the last one left it
+    // Note: This is the same as blending the last two positions, but it doesn't need a second 
+    // copy of them.  Particles move in a straight line during each step, and that line is 
+    // along the velocity that the step ended with, even when force fields change it.
+    gl_Position = vec4(pos + (vel * uRenderOffsetSec), -1.0f, 1.0f);
+
+    // a vertex shader can't skip a point, so put inactive ones outside of the clip volume
+    if (isActive == 0.0f)
+    {
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+    }
 }
 
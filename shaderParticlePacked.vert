@@ -0,0 +1,58 @@
+#version 440
+
+// the compact particle's position relative to the emitter center in units of the radius, as 
+// two 16 bit signed normalized values (see ParticlePacked.h)
+// Note: The 8 bits of extra precision in the particle's third field only matter to the update.
+// 1/32767th of the radius is already much smaller than a pixel.
+layout (location = 0) in uint packedPos;  
+
+// velocity as two 16 bit floats (see shaderParticle.vert for what it is used for)
+layout (location = 1) in uint packedVel;  
+
+// the low position bits, the "is active" flag (bit 16), and the emitter index (bits 17-31)
+layout (location = 2) in uint packedLowBitsAndFlags;
+
+// the emitter table, for the center and radius that the position is relative to
+// Note: Must match ParticleEmitter in ParticleEmitter.h.
+struct Emitter
+{
+    vec2 _center;
+    float _radius;
+    float _radiusSqr;
+    float _minVelocity;
+    float _maxVelocity;
+    float _minLifetimeSec;
+    float _maxLifetimeSec;
+    uint _firstParticle;
+    uint _numParticles;
+    uint _maxParticlesEmittedPerFrame;
+    uint _padding;
+};
+
+layout (std430, binding = 4) buffer EmitterBuffer {
+    Emitter AllEmitters[];
+};
+
+// same as in shaderParticle.vert
+uniform float uRenderOffsetSec;
+
+// must have the same name as its corresponding "in" item in the frag shader
+smooth out vec3 particleColor;
+
+void main()
+{
+    Emitter e = AllEmitters[packedLowBitsAndFlags >> 17];
+    vec2 pos = e._center + (unpackSnorm2x16(packedPos) * e._radius);
+    pos += unpackHalf2x16(packedVel) * uRenderOffsetSec;
+
+    // hard code a white particle color
+    particleColor = vec3(1.0f, 1.0f, 1.0f);
+    gl_Position = vec4(pos, -1.0f, 1.0f);
+
+    // a vertex shader can't skip a point, so put inactive ones outside of the clip volume
+    if ((packedLowBitsAndFlags & 0x00010000u) == 0u)
+    {
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+    }
+}
+
@@ -0,0 +1,108 @@
+#version 440
+
+// there are no vertex attributes; each vertex is one particle, and gl_VertexID is its index 
+// within its emitter (see ParticleManager::SetStateless(...))
+
+// the emitter table, for the center, radius, speeds, and lifetimes
+// Note: Must match ParticleEmitter in ParticleEmitter.h.
+struct Emitter
+{
+    vec2 _center;
+    float _radius;
+    float _radiusSqr;
+    float _minVelocity;
+    float _maxVelocity;
+    float _minLifetimeSec;
+    float _maxLifetimeSec;
+    uint _firstParticle;
+    uint _numParticles;
+    uint _maxParticlesEmittedPerFrame;
+    uint _padding;
+};
+
+layout (std430, binding = 4) buffer EmitterBuffer {
+    Emitter AllEmitters[];
+};
+
+// each emitter's particles are drawn separately, so this is the same for every vertex
+uniform uint uEmitterIndex;
+
+// how long it has been since the particles were created, including the part of a step that
+// the frame is drawn between (see ParticleManager::Render(...)), split into whole periods and 
+// the time within the current one so that it fits in a float (see SplitStatelessTime(...) in 
+// ParticleStateless.h)
+uniform uint uPeriodIndex;
+uniform float uPeriodTimeSec;
+
+// Note: Must match STATELESS_PERIOD_SEC in ParticleStateless.h.
+const float PERIOD_SEC = 1024.0f;
+
+// must have the same name as its corresponding "in" item in the frag shader
+smooth out vec3 particleColor;
+
+// the "lowbias32" integer hash
+// Note: Must match HashParticleIndex(...) in ParticleEmitter.h.
+uint Hash(uint value)
+{
+    uint hash = value;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352du;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68bu;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+// Note: Must match GetStatelessParticle(...) in ParticleStateless.h.
+void main()
+{
+    // hash the index across all emitters so that each emitter's particles are different
+    Emitter e = AllEmitters[uEmitterIndex];
+    uint index = e._firstParticle + uint(gl_VertexID);
+
+    uint speedHash = Hash(Hash(index));
+    uint phaseHash = Hash(speedHash);
+    float speed = e._minVelocity + (float(speedHash >> 8) * (1.0f / 16777216.0f) *
+        (e._maxVelocity - e._minVelocity));
+    float phase = float(phaseHash >> 8) * (1.0f / 16777216.0f);
+
+    // a particle that never moves never leaves, so keep its life long but finite
+    float lifeSec = e._radius / max(speed, 1e-6f);
+    if (e._maxLifetimeSec > 0.0f)
+    {
+        float fraction = float(Hash(index) >> 8) * (1.0f / 16777216.0f);
+        float lifetimeSec = e._minLifetimeSec +
+            (fraction * (e._maxLifetimeSec - e._minLifetimeSec));
+        lifeSec = (lifetimeSec > 0.0f && lifetimeSec < lifeSec) ? lifetimeSec : lifeSec;
+    }
+    float livesPerPeriod = ceil(PERIOD_SEC / lifeSec);
+    lifeSec = PERIOD_SEC / livesPerPeriod;
+
+    // hard code a white particle color
+    particleColor = vec3(1.0f, 1.0f, 1.0f);
+
+    // a vertex shader can't skip a point, so put ones that haven't come out yet outside of
+    // the clip volume
+    float lives = (uPeriodTimeSec / lifeSec) - phase;
+    uint periodIndex = uPeriodIndex;
+    if (lives < 0.0f)
+    {
+        if (periodIndex == 0u)
+        {
+            gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+            return;
+        }
+
+        // still on the last life of the period before
+        lives += livesPerPeriod;
+        periodIndex--;
+    }
+
+    float generation = floor(lives);
+    float ageSec = (lives - generation) * lifeSec;
+    uint generationIndex = (periodIndex * uint(livesPerPeriod)) + uint(generation);
+    uint angleHash = Hash(index ^ (generationIndex * 0x9e3779b9u));
+    float angle = float(angleHash >> 8) * (6.2831853f / 16777216.0f);
+    vec2 velocity = vec2(cos(angle), sin(angle)) * speed;
+    gl_Position = vec4(e._center + (velocity * ageSec), -1.0f, 1.0f);
+}